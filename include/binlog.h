@@ -0,0 +1,31 @@
+#ifndef FINAL_BINLOG_H
+#define FINAL_BINLOG_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BINLOG_MAGIC 0x474c4246                 // "FBLG", id of SESSION record
+#define BINLOG_RECORD_LEN sizeof( BinlogRecord )
+
+// Flags of MESSAGE records
+#define BINLOG_TRANSMITTED 1
+#define BINLOG_TRANSMITTED_TO_RECIPIENT 2
+
+/// \brief Writes $record to $fp, followed by its payload ( $record->data.payload.length bytes of $payload, zero-padded
+/// to whole records ) if $payload is not NULL.
+/// \param fp
+/// \param record
+/// \param payload
+/// \return bytes written
+size_t binlog_write(FILE *fp, const BinlogRecord *record, const void *payload);
+
+/// \brief Exports session.json document $jsonFileName from binary session log $binlogFileName ( same layout as the one
+/// "json" & "ndjson" logs produce, times in local time zone of the export ). A log cut short ( session killed ) yields
+/// the events stopped so far.
+/// \param binlogFileName
+/// \param jsonFileName
+/// \return no. of events exported, -1 on error ( files, or not a binary session log )
+int32_t binlog_export(const char *binlogFileName, const char *jsonFileName);
+
+#endif //FINAL_BINLOG_H
@@ -10,13 +10,22 @@
 #include <netinet/in.h>
 #include <net/if.h>
 #include <arpa/inet.h>
+#include "types.h"
 
 /// \brief Fetches AEM of running device from $interface network interface
 /// \param interface usually this is "wlan0"
 /// \return uint32_t ( 4-digits )
 uint32_t getClientAem(const char *interface);
 
-/// \brief Polling thread. Starts polling to find active servers. Creates a new thread for each server found.
+/// \brief Runs a single polling round: dials all $targets keeping up to $POLLING_CONNECTS_IN_FLIGHT_MAX non-blocking
+/// connects open at once. Each connect is given $POLLING_CONNECT_TIMEOUT msecs before being dropped ( time spent
+/// dispatching other connected devices excluded ).
+/// \param epoll_fd epoll instance used to wait for connect() completions
+/// \param targets devices to dial
+/// \param targets_n size of $targets
+void polling_round(int epoll_fd, const Device *targets, uint16_t targets_n);
+
+/// \brief Polling thread. Starts polling to find active servers. Offloads each server found to the communication worker.
 void *polling_worker(void);
 
 /// \brief Message producer thread. Produces a random message at the end of the pre-defined interval.
@@ -15,14 +15,39 @@ bool communication_datetime_receiver();
 /// \param thread_args pointer to communicate_args_t type
 void communication_worker(void *args);
 
-/// \brief Receiver sub-worker of communication worker ( POSIX thread compatible function ).
-/// \param connectedSocket socket file descriptor with connected device
-/// \param connectedDevice connected device that will send messages
-void communication_receiver_worker(int32_t connectedSocket, Device connectedDevice);
-
-/// \brief Transmitter sub-worker of communication worker ( POSIX thread compatible function ).
-/// \param connectedSocket socket file descriptor with connected device
-/// \param connectedDevice connected device that will receive messages
-void communication_transmitter_worker(int32_t connectedSocket, Device connectedDevice);
+/// \brief Stores $message received from $connectedDevice, unless it is a duplicate.
+/// \param message received message ( its metadata are updated )
+/// \param connectedDevice device that sent the message
+/// \return FALSE if message was a duplicate, TRUE else
+bool communication_store_message(Message *message, Device connectedDevice);
+
+/// \brief Stores receipts received from a device & purges the delivered messages they name.
+/// \param packed received receipts ( receipts_length() bytes )
+/// \return no. of receipts that were new
+uint32_t communication_store_receipts(const uint8_t *packed);
+
+/// \brief Find next message of $messages ( starting from $message_i ) that has to be transmitted to $connectedDevice.
+/// \param message_i first slot to examine
+/// \param connectedDevice
+/// \param message copy of the pending message ( passed as pointer )
+/// \return slot index, -1 if no more messages are pending for device
+int32_t communication_next_pending(uint16_t message_i, Device connectedDevice, Message *message);
+
+/// \brief Find next message of $messages that $connectedDevice is missing, as far as its $versions tell.
+/// \param cursor position in $messages ( advanced past the returned slot )
+/// \param versions version vector of $connectedDevice, by origin
+/// \param connectedDevice
+/// \param message copy of the missing message ( passed as pointer )
+/// \return slot index, -1 if no more messages are missing from device
+int32_t communication_next_missing(MessagesCursor *cursor, const uint32_t *versions, Device connectedDevice, Message *message);
+
+/// \brief Marks $messages[$message_i] as transmitted to $connectedDevice & updates stats, if the slot still holds the
+/// message of $key ( it may have been purged & reused since the message was serialized ).
+/// \param message_i
+/// \param key key of the message transmitted
+/// \param connectedDevice
+/// \param message copy of the message, refreshed with its updated metadata ( passed as pointer )
+/// \return FALSE if slot no longer holds the message, TRUE else
+bool communication_mark_transmitted(uint16_t message_i, const MessageKey *key, Device connectedDevice, Message *message);
 
 #endif //FINAL_COMMUNICATION_H
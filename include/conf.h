@@ -16,6 +16,73 @@
     #define SETUP_DATETIME_AEM 0001               // Device with AEM = 0001 will setup datetime with all connected devices
     #define SETUP_DATETIME_TIMEOUT 10             // secs
 #endif
+
+#ifndef COMMUNICATION_SESSION_MODE
+    #define COMMUNICATION_SESSION_MODE "full-duplex"  // "full-duplex": transmit & receive at once, "half-duplex": server transmits first
+#endif
+
+#ifndef COMMUNICATION_PROTOCOL
+    // "summary": peers swap Bloom filters of the messages they hold before any message, if both run it ( settled by the
+    // negotiation; devices that do not negotiate are served as "text" ones ), "text": messages only, as devices without
+    // summaries
+    #define COMMUNICATION_PROTOCOL "text"
+#endif
+
+#ifndef COMMUNICATION_FRAMING
+    // "binary": messages travel as length-prefixed frames with bodies of their real length, if device supports them too
+    // ( settled by the negotiation, in either protocol ), "text": fixed-size text records ( as devices without binary
+    // frames )
+    #define COMMUNICATION_FRAMING "text"
+#endif
+
+#ifndef COMMUNICATION_STREAM_MODE
+    // "batched": messages go out in batches, one gather write per batch ( TCP_CORK held while transmitting ), & come in
+    // with reads as large as the receive buffer, "per-message": one send() & one read() ( or two ) per message
+    #define COMMUNICATION_STREAM_MODE "batched"
+#endif
+
+#ifndef STREAM_TX_LEN
+    #define STREAM_TX_LEN 16384                     // bytes of a session's transmit batch, > $MESSAGE_SEQUENCED_LEN
+    #define STREAM_BATCH_MAX 64                     // messages of a session's transmit batch
+#endif
+
+#ifndef STREAM_RX_LEN
+    #define STREAM_RX_LEN 16384                     // bytes of a session's receive buffer, > $MESSAGE_SEQUENCED_LEN
+#endif
+
+#ifndef SUMMARY_BLOOM_BITS
+    #define SUMMARY_BLOOM_BITS 32768                // power of 2; ~0.5% false positives at $MESSAGES_SIZE + $INBOX_SIZE messages
+    #define SUMMARY_BLOOM_HASHES 7
+#endif
+
+// Negotiation: a listening device that runs any feature opens with magic & features, the dialing device answers with
+// its own. Shorter than a text record: devices without negotiation read it as a short record & stop receiving
+#define NEGOTIATION_MAGIC 0x464e4547                // "FNEG"
+#define NEGOTIATION_LEN 8                           // length = 4 + 4 ( features ) bytes
+#define NEGOTIATION_FEATURE_SUMMARY 0x1             // summary handshake
+#define NEGOTIATION_FEATURE_BINARY 0x2              // binary frames
+
+#define SUMMARY_MAGIC 0x4653554d                    // "FSUM"
+#define SUMMARY_LEN ( 12 + SUMMARY_BLOOM_BITS / 8 ) // length = 4 + 4 + 4 + 4096 = 4108 bytes
+
+// Version vector, sent after the summary: header, then an entry per origin seen
+#define VERSIONS_MAGIC 0x46565631                   // "FVV1"
+#define VERSIONS_HEADER_LEN 8                       // length = 4 + 4 ( no. of entries ) bytes
+#define VERSIONS_ENTRY_LEN 8                        // length = 4 ( AEM ) + 4 ( sequence number ) bytes
+#define VERSIONS_WINDOW 64                          // sequence numbers seen out of order that are remembered per origin
+
+#define HANDSHAKE_LEN_MAX ( SUMMARY_LEN + VERSIONS_HEADER_LEN + VERSIONS_ENTRY_LEN * MESSAGE_DEVICES_MAX )
+
+// Delivery receipts, sent ahead of the messages: header, then the key of each delivered message the device holds
+#define RECEIPTS_MAGIC 0x4641434b                   // "FACK"
+#define RECEIPTS_HEADER_LEN 8                       // length = 4 + 4 ( no. of receipts ) bytes
+#define RECEIPTS_ENTRY_LEN 24                       // length = 8 ( created_at ) + 8 ( body hash ) + 4 + 4 bytes
+#define RECEIPTS_LEN_MAX ( RECEIPTS_HEADER_LEN + RECEIPTS_ENTRY_LEN * RECEIPTS_SIZE )
+
+// Binary frame: length prefix ( no. of bytes that follow ), then fixed-width header & body without its NUL, little-endian
+#define FRAME_PREFIX_LEN 2
+#define FRAME_HEADER_LEN 20                         // length = 4 ( sender ) + 4 ( recipient ) + 8 ( created_at ) + 4 ( seq )
+#define FRAME_LEN_MAX ( FRAME_PREFIX_LEN + FRAME_HEADER_LEN + MESSAGE_BODY_LEN - 1 )
 // end
 
 // start: Client.h
@@ -36,12 +103,27 @@
     #define CLIENT_AEM_LIST_LENGTH ( uint32_t )( sizeof( CLIENT_AEM_LIST ) / sizeof( int ) )
 #endif
 
+#ifndef MESSAGE_DEVICES_MAX
+    // Devices a message can be transmitted to ( AEM indices of "list" or "range" source )
+    #define MESSAGE_DEVICES_MAX ( CLIENT_AEM_RANGE_LENGTH > CLIENT_AEM_LIST_LENGTH ? CLIENT_AEM_RANGE_LENGTH : CLIENT_AEM_LIST_LENGTH )
+#endif
+
+#define MESSAGE_DEVICES_WORDS ( ( MESSAGE_DEVICES_MAX + 63 ) / 64 )
+
 #ifndef CLIENT_AEM_SOURCE
     #define CLIENT_AEM_SOURCE "list"    // "list", "range"
 #endif
 
-#ifndef MAX_CONNECTIONS_WITH_SAME_CLIENT
-    #define MAX_CONNECTIONS_WITH_SAME_CLIENT 1000
+#ifndef CLIENT_DISCOVERY_MODE
+    #define CLIENT_DISCOVERY_MODE "sweep"   // "sweep" ( dial every AEM ), "beacon" ( dial only peers heard via UDP beacons )
+#endif
+
+#ifndef POLLING_CONNECTS_IN_FLIGHT_MAX
+    #define POLLING_CONNECTS_IN_FLIGHT_MAX 64       // non-blocking connect() attempts kept open at the same time
+#endif
+
+#ifndef POLLING_CONNECT_TIMEOUT
+    #define POLLING_CONNECT_TIMEOUT 1500            // msecs, deadline of a single connect() attempt
 #endif
 
 #ifndef PRODUCER_DELAY_RANGE    // in seconds
@@ -53,19 +135,74 @@
     #define MESSAGE_BODY_LEN 256
     #define MESSAGE_SERIALIZED_LEN 277  // length = 4 + 4 + 10 + 256 = 277 characters
 #endif
+#define MESSAGE_SEQUENCED_LEN ( MESSAGE_SERIALIZED_LEN + 10 )  // "summary" protocol: + 10-digit sequence number
 // end
 
 // start: Server.h
 #ifndef MESSAGES_PUSH_OVERRIDE_POLICY
-    #define MESSAGES_PUSH_OVERRIDE_POLICY "blind"   // "sent_only", "blind"
+    #define MESSAGES_PUSH_OVERRIDE_POLICY "blind"   // "blind", "sent_only", "oldest_delivered", "most_replicated"
 #endif
 
 #ifndef MESSAGES_SIZE
     #define MESSAGES_SIZE 2000
 #endif
+#define MESSAGES_PENDING_WORDS ( ( MESSAGES_SIZE + 63 ) / 64 )  // 64-bit words of a per-device pending bitset
+
+// Eviction lists: free slots, then one candidates list per rank ( rank of "most_replicated" candidates is their
+// replication count, other policies rank all candidates 0 )
+#define EVICTION_LISTS ( MESSAGE_DEVICES_MAX + 2 )
+#define EVICTION_LIST_FREE 0
+#define EVICTION_LIST_NONE 0xFFFF
+
+#ifndef MESSAGES_INDEX_SIZE
+    #define MESSAGES_INDEX_SIZE 4096    // power of 2, >= 2 * $MESSAGES_SIZE keeps probe sequences short
+#endif
 
 #ifndef INBOX_SIZE
-    #define INBOX_SIZE 1000
+    #define INBOX_SIZE 1000     // ring: oldest message is overwritten when full
+#endif
+
+#ifndef INBOX_INDEX_SIZE
+    #define INBOX_INDEX_SIZE 2048   // power of 2, >= 2 * $INBOX_SIZE
+#endif
+
+#ifndef MESSAGES_RECEIPTS
+    #define MESSAGES_RECEIPTS 1     // 1: delivered messages are purged & their receipts ( anti-packets ) spread, 0: kept
+#endif
+
+#ifndef RECEIPTS_SIZE
+    #define RECEIPTS_SIZE 1000      // ring: oldest receipt is forgotten when full
+#endif
+
+#ifndef RECEIPTS_INDEX_SIZE
+    #define RECEIPTS_INDEX_SIZE 2048    // power of 2, >= 2 * $RECEIPTS_SIZE
+#endif
+
+#ifndef MESSAGES_STORE_FILE
+    #define MESSAGES_STORE_FILE "messages.store"    // memory-mapped store, reattached on restart ( "" keeps it in memory )
+#endif
+#define MESSAGES_STORE_MAGIC "FINALMS"
+#define MESSAGES_STORE_VERSION 3
+
+#ifndef MESSAGES_SEQ_FILE
+    #define MESSAGES_SEQ_FILE "messages.seq"        // last own sequence number, kept apart from the store so that store
+                                                    // resets never renumber own messages ( "" : not kept )
+#endif
+
+#ifndef SERVER_MODE
+    #define SERVER_MODE "reactor"   // "reactor" ( single-threaded epoll loop ), "threaded"
+#endif
+
+#ifndef REACTOR_SESSIONS_MAX
+    #define REACTOR_SESSIONS_MAX 64             // concurrent sessions driven by the reactor; extra peers are dropped
+#endif
+
+#ifndef REACTOR_TICK
+    #define REACTOR_TICK 100                    // msecs, max. time spent in epoll_wait()
+#endif
+
+#ifndef SESSION_IDLE_TIMEOUT
+    #define SESSION_IDLE_TIMEOUT 30000          // msecs, sessions without any progress for that long are dropped
 #endif
 
 #ifndef SOCKET_LISTEN_QUEUE_LEN
@@ -73,18 +210,49 @@
 #endif
 // end
 
+// start: Discovery.h
+#ifndef DISCOVERY_PORT
+    #define DISCOVERY_PORT SOCKET_PORT              // UDP
+#endif
+
+#ifndef DISCOVERY_BEACON_INTERVAL
+    #define DISCOVERY_BEACON_INTERVAL 1000          // msecs
+#endif
+
+#ifndef DISCOVERY_PEER_TTL
+    #define DISCOVERY_PEER_TTL 5000                 // msecs, peers not heard for that long are considered gone
+#endif
+
+#ifndef DISCOVERY_PEERS_MAX
+    #define DISCOVERY_PEERS_MAX 64                  // peers remembered at the same time
+#endif
+
+#ifndef DISCOVERY_BEACON_LEN
+    #define DISCOVERY_BEACON_MAGIC 0x46424e31       // "FBN1"
+    #define DISCOVERY_BEACON_LEN 20                 // length = 4 + 4 + 4 + 8 = 20 bytes
+#endif
+// end
+
+// start: Pool.h
+#ifndef COMMUNICATION_WORKERS_MAX
+    #define COMMUNICATION_WORKERS_MAX 4         // pre-spawned session workers ( one per core ), 0 == serial socket communications
+#endif
+
+#ifndef COMMUNICATION_QUEUE_LEN
+    #define COMMUNICATION_QUEUE_LEN 16          // queued sessions; submitters block while queue is full
+#endif
+// end
+
 // start: Utils.h
 #ifndef SOCKET_PORT
     #define SOCKET_PORT 2278
 #endif
 
-#ifndef ACTIVE_SOCKET_CONNECTIONS_MAX
-    #define ACTIVE_SOCKET_CONNECTIONS_MAX 2     // >=2: 1 ( server ) + 1 ( client ) + ...( other concurrent sockets )...
-#endif
-#ifndef COMMUNICATION_WORKERS_MAX
-    #define COMMUNICATION_WORKERS_MAX (ACTIVE_SOCKET_CONNECTIONS_MAX - 2)   // 0 == serial socket communications
+#ifndef SOCKET_SUBNET
+    #define SOCKET_SUBNET "10.0"                    // devices live in $SOCKET_SUBNET.[xx].[yy]
 #endif
 
+
 #ifndef STRSEP_BASE_10
     #define STRSEP_BASE_10 10
 #endif
@@ -99,6 +267,48 @@
 #endif
 // end
 
+// start: Scan.h
+#ifndef SCAN_KERNEL
+    #define SCAN_KERNEL "auto"      // "auto" ( widest one the CPU runs ), "avx2", "sse2", "neon", "scalar"
+#endif
+#ifndef SCAN_NEON
+    #define SCAN_NEON 0             // 1: build "neon" kernel on ARM ( not yet built & tested on an ARM target ), 0: scalar there
+#endif
+// end
+
+// start: Contacts.h
+#ifndef CONTACTS_HISTOGRAM_LEN
+    #define CONTACTS_HISTOGRAM_LEN 20       // buckets of contact durations: < 1 ms, [ 2^(i-1), 2^i ) ms, last open-ended
+#endif
+
+#ifndef CONTACTS_RECENT_LEN
+    #define CONTACTS_RECENT_LEN 256         // most recent contacts ( of any device ) kept raw for the report, 0: none
+#endif
+// end
+
+// start: Latency.h
+#ifndef LATENCY_PRECISION_BITS
+    #define LATENCY_PRECISION_BITS 5        // 2^bits buckets per power of 2 ( 5: latencies within 3.1 % )
+#endif
+
+#ifndef LATENCY_RANGE_BITS
+    #define LATENCY_RANGE_BITS 40           // latencies up to 2^bits nsecs ( 40: ~18 mins ), longer ones in last bucket
+#endif
+
+#define LATENCY_SUB_BUCKETS ( 1 << LATENCY_PRECISION_BITS )
+#define LATENCY_BUCKETS ( ( LATENCY_RANGE_BITS - LATENCY_PRECISION_BITS + 1 ) * LATENCY_SUB_BUCKETS )
+// end
+
+// start: Stats.h
+#ifndef STATS_SHARDS
+    #define STATS_SHARDS 16                 // threads are spread over shards of counters round-robin, at first update
+#endif
+
+#ifndef STATS_CACHE_LINE
+    #define STATS_CACHE_LINE 64             // bytes; shards are aligned to it, so that no two shards share a line
+#endif
+// end
+
 // start: Log.h
 #ifndef ALSO_LOG_TO_STDOUT
     #define ALSO_LOG_TO_STDOUT 1
@@ -107,6 +317,37 @@
 #ifndef LOG_MESSAGE_MAX_LEN
     #define LOG_MESSAGE_MAX_LEN 512
 #endif
+
+// Session log: "ndjson" appends one record per line ( session.ndjson ) & rebuilds session.json from it at log_tearDown(),
+// "json" writes session.json in place, "binary" appends fixed-size records ( session.bin ) that refer to each body once
+// written ( session2json tool exports session.json from it )
+#ifndef LOG_FORMAT
+    #define LOG_FORMAT "ndjson"
+#endif
+
+#ifndef LOG_FLUSH_INTERVAL
+    #define LOG_FLUSH_INTERVAL 1000         // msecs; longest time written events stay in stdio's buffer while logging goes on
+#endif
+
+#ifndef LOG_MODE
+    #define LOG_MODE "async"                // "async": calls queue records for a writer thread, "sync": calls write the file
+#endif
+
+#ifndef LOG_RING_LEN
+    #define LOG_RING_LEN 4096               // power of 2; queued records ( one per log_event_*() call ), dropped when full
+#endif
+
+#ifndef LOG_BATCH_MAX
+    #define LOG_BATCH_MAX 256               // records the writer formats between two flushes of session.json file
+#endif
+
+#ifndef LOG_WRITER_IDLE
+    #define LOG_WRITER_IDLE 2               // msecs the writer sleeps while the ring is empty
+#endif
+
+#ifndef LOG_BODIES_LEN
+    #define LOG_BODIES_LEN 1024             // power of 2; initial capacity of index of bodies in binary log ( grows by 2 )
+#endif
 // end
 
 #endif //FINAL_CONF_H
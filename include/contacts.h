@@ -0,0 +1,31 @@
+#ifndef FINAL_CONTACTS_H
+#define FINAL_CONTACTS_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Adds contact with device of $aemIndex ( from $start to $end ) to its stats & to the ring of recent contacts.
+/// Caller has the device registered as active ( a single session updates the stats of a device at a time ).
+/// \param aemIndex index of the device in the polled AEMs
+/// \param aem
+/// \param start
+/// \param end
+void contacts_add(int32_t aemIndex, uint32_t aem, const struct timeval *start, const struct timeval *end);
+
+/// \brief Stats of the contacts with device of $aemIndex.
+/// \param aemIndex index of the device in the polled AEMs
+/// \return stats ( count 0: no contacts )
+const ContactStats *contacts_stats(int32_t aemIndex);
+
+/// \brief Copies the most recent contacts with device $aem still in the ring of recent contacts, oldest first.
+/// \param aem
+/// \param contacts
+/// \param contacts_n max no. of contacts to copy
+/// \return no. of contacts copied
+uint32_t contacts_recent(uint32_t aem, Contact *contacts, uint32_t contacts_n);
+
+/// \brief Forgets the stats & recent contacts of every device.
+void contacts_reset(void);
+
+#endif //FINAL_CONTACTS_H
@@ -0,0 +1,46 @@
+#ifndef FINAL_DISCOVERY_H
+#define FINAL_DISCOVERY_H
+
+#include "types.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+/// \brief Beacon transmitter thread. Broadcasts this device's beacon every $DISCOVERY_BEACON_INTERVAL msecs.
+void *discovery_beacon_worker(void);
+
+/// \brief Beacon listener thread. Records every device heard on the subnet.
+void *discovery_listener_worker(void);
+
+/// \brief Serializes $beacon into $DISCOVERY_BEACON_LEN bytes ( network byte order ).
+/// \param beacon
+/// \param packed buffer of at least $DISCOVERY_BEACON_LEN bytes
+void discovery_beacon_pack(const Beacon *beacon, uint8_t *packed);
+
+/// \brief Un-serializes a received datagram into $beacon.
+/// \param beacon the result beacon ( passed as pointer )
+/// \param packed received datagram
+/// \param length length of received datagram
+/// \return FALSE if datagram is not a beacon, TRUE else
+bool discovery_beacon_unpack(Beacon *beacon, const uint8_t *packed, size_t length);
+
+/// \brief Records $beacon as heard just now ( wakes up discovery_targets() ).
+/// \param beacon
+void discovery_heard(const Beacon *beacon);
+
+/// \brief Marks the last dial to $aem as successful: its session ran to the end in both directions.
+/// \param aem
+void discovery_contacted(uint32_t aem);
+
+/// \brief Fills $targets with peers heard since they were last dialed, unless neither side's store summary changed
+/// since last successful contact.
+/// Blocks for up to $timeout msecs while there is no such peer.
+/// \param targets result devices ( passed as pointer )
+/// \param max size of $targets
+/// \param timeout msecs
+/// \return number of devices written to $targets
+uint16_t discovery_targets(Device *targets, uint16_t max, uint32_t timeout);
+
+#endif //FINAL_DISCOVERY_H
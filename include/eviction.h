@@ -0,0 +1,42 @@
+#ifndef FINAL_EVICTION_H
+#define FINAL_EVICTION_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Resolves eviction policy from its $name.
+/// \param name "blind", "sent_only", "oldest_delivered" or "most_replicated"
+/// \return policy, -1 if $name is unknown
+int32_t eviction_policy(const char *name);
+
+/// \brief Initializes $eviction for an empty store: every slot is free.
+/// \param eviction
+/// \param policy
+void eviction_init(Eviction *eviction, EvictionPolicy policy);
+
+/// \brief Picks the slot to place a new message at: a free slot, else the first candidate of the highest rank. The
+/// slot is unlinked.
+/// \param eviction
+/// \return slot index, -1 if there are no free slots & no candidates ( overwrite circle buffer's head )
+int32_t eviction_victim(Eviction *eviction);
+
+/// \brief Removes $slot from its list, if any.
+/// \param eviction
+/// \param slot
+void eviction_unlink(Eviction *eviction, uint16_t slot);
+
+/// \brief Moves emptied $slot to the free slots ( it is picked before any candidate ).
+/// \param eviction
+/// \param slot
+void eviction_free(Eviction *eviction, uint16_t slot);
+
+/// \brief Links $slot as a candidate acc. to the policy, after its message was placed or its metadata changed. A slot
+/// that keeps its rank keeps its place in the candidates list.
+/// \param eviction
+/// \param slot
+/// \param header header of the message in $slot
+/// \param transmittedDevices devices bitset of the message in $slot
+void eviction_update(Eviction *eviction, uint16_t slot, const MessageHeader *header, const uint64_t *transmittedDevices);
+
+#endif //FINAL_EVICTION_H
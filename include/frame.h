@@ -0,0 +1,25 @@
+#ifndef FINAL_FRAME_H
+#define FINAL_FRAME_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Serializes $message into a binary frame: length prefix, fixed-width little-endian header & body of its real
+/// length ( at most $MESSAGE_BODY_LEN - 1 characters ).
+/// \param message
+/// \param frame buffer of at least $FRAME_LEN_MAX bytes
+/// \return no. of bytes of the frame
+uint16_t frame_encode(const Message *message, uint8_t *frame);
+
+/// \brief Reads length prefix of a received frame.
+/// \param frame $FRAME_PREFIX_LEN received bytes
+/// \return no. of bytes of the whole frame, 0 if prefix is not valid
+uint16_t frame_length(const uint8_t *frame);
+
+/// \brief Un-serializes a received binary frame, re-creating initial message ( its metadata are reset ).
+/// \param message the result message ( passed as pointer )
+/// \param frame received bytes ( frame_length() of them )
+void frame_decode(Message *message, const uint8_t *frame);
+
+#endif //FINAL_FRAME_H
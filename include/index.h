@@ -0,0 +1,64 @@
+#ifndef FINAL_INDEX_H
+#define FINAL_INDEX_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Builds the duplicate-detection key of $message.
+/// \param key the result key ( passed as pointer )
+/// \param message
+void index_key(MessageKey *key, const Message *message);
+
+/// \brief Builds the duplicate-detection key of inbox $message ( recipient is this device, left 0 ).
+/// \param key the result key ( passed as pointer )
+/// \param message
+void index_key_inbox(MessageKey *key, const InboxMessage *message);
+
+/// \brief Builds the key of $sender in a per-sender index.
+/// \param key the result key ( passed as pointer )
+/// \param sender
+void index_key_sender(MessageKey *key, uint32_t sender);
+
+/// \brief Hashes $key into a 64-bit value ( MurmurHash3 finalizer over the mixed key fields ).
+/// \param key
+/// \return hash of $key
+uint64_t index_hash(const MessageKey *key);
+
+/// \brief Initializes an empty $index over $entries.
+/// \param index
+/// \param entries backing array of $capacity entries
+/// \param capacity power of 2
+void index_init(MessageIndex *index, MessageIndexEntry *entries, uint32_t capacity);
+
+/// \brief Removes all entries of $index.
+/// \param index
+void index_clear(MessageIndex *index);
+
+/// \brief Looks up $key in $index.
+/// \param index
+/// \param key
+/// \return store slot of $key, -1 if not indexed
+int32_t index_find(const MessageIndex *index, const MessageKey *key);
+
+/// \brief Indexes $key at store $slot, unless $key is already indexed ( insert-if-absent ).
+/// \param index
+/// \param key
+/// \param slot
+/// \return FALSE if $key was already indexed ( or $index is full ), TRUE else
+bool index_insert(MessageIndex *index, const MessageKey *key, uint32_t slot);
+
+/// \brief Indexes $key at store $slot, replacing previous slot of $key if any.
+/// \param index
+/// \param key
+/// \param slot
+void index_put(MessageIndex *index, const MessageKey *key, uint32_t slot);
+
+/// \brief Removes $key from $index, if it is indexed at store $slot.
+/// \param index
+/// \param key
+/// \param slot
+/// \return TRUE if an entry was removed, FALSE else
+bool index_remove(MessageIndex *index, const MessageKey *key, uint32_t slot);
+
+#endif //FINAL_INDEX_H
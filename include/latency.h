@@ -0,0 +1,52 @@
+#ifndef FINAL_LATENCY_H
+#define FINAL_LATENCY_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Returns current time of the monotonic clock in nsecs ( start of a latency ).
+/// \return nsecs
+uint64_t latency_now(void);
+
+/// \brief Records a latency of $phase ( lock-free, from any thread ).
+/// \param phase
+/// \param nanos
+void latency_record(LatencyPhase phase, uint64_t nanos);
+
+/// \brief Records latency of $phase that started at $start & ends now.
+/// \param phase
+/// \param start see latency_now()
+/// \return now ( start of the next phase )
+uint64_t latency_since(LatencyPhase phase, uint64_t start);
+
+/// \brief Get no. of latencies of $phase recorded.
+/// \param phase
+/// \return count
+uint64_t latency_count(LatencyPhase phase);
+
+/// \brief Get latency of $phase at $percentile: highest value of the bucket it falls in ( at most the max recorded ).
+/// \param phase
+/// \param percentile in [0, 100]; 0: min
+/// \return nsecs, 0 if none recorded
+uint64_t latency_percentile(LatencyPhase phase, double percentile);
+
+/// \brief Writes count, mean, min, percentiles & max of every phase as a JSON object ( usecs ).
+/// \param fp
+void latency_dump(FILE *fp);
+
+/// \brief Writes count, mean, min, percentiles & max of every phase as a table ( usecs ), a line per phase.
+/// \param fp
+void latency_print(FILE *fp);
+
+/// \brief Asks for the latencies to be printed at the next latency_print_requested(). Async-signal-safe.
+void latency_request_print(void);
+
+/// \brief Writes the latencies as latency_print() does, if latency_request_print() was called since last time.
+/// \param fp
+void latency_print_requested(FILE *fp);
+
+/// \brief Forgets the latencies of every phase. Not to race recording ( recorded latencies may survive the reset ).
+void latency_reset(void);
+
+#endif //FINAL_LATENCY_H
@@ -12,6 +12,13 @@
 /// \param client
 void log_event_start( const char* type, uint32_t server, uint32_t client );
 
+/// \brief Logs the start of a new event that actually started at $startedAt in session.json file
+/// \param type
+/// \param server
+/// \param client
+/// \param startedAt
+void log_event_start_at( const char* type, uint32_t server, uint32_t client, const struct timeval *startedAt );
+
 /// \brief Logs $message to session.json file
 /// \param action
 /// \param message
@@ -25,6 +32,15 @@ void log_event_message_datetime( uint64_t previous_now, uint64_t new_now );
 /// \brief Logs the end of a new event in session.json file
 void log_event_stop(void);
 
+/// \brief Takes $logEventLock, so that the calls of an event are written together. No-op if log is asynchronous (
+/// records of events are queued & the writer thread assembles each event ).
+/// \param block if FALSE, gives up when $logEventLock is held by another thread
+/// \return FALSE if lock is held by another thread, TRUE else
+bool log_lock(bool block);
+
+/// \brief Releases $logEventLock taken by log_lock().
+void log_unlock(void);
+
 /// \brief Append end of session message and closes log file pointer
 /// \param executionTimeActual
 void log_tearDown( double executionTimeActual);
@@ -0,0 +1,21 @@
+#ifndef FINAL_NDJSON_H
+#define FINAL_NDJSON_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/// \brief Rebuilds session.json document $jsonFileName from session log $ndjsonFileName: a "session" record, "event"
+/// records, then an "end" record followed by "device", "buffer_message" & "inbox_message" records. A log cut short (
+/// session killed ) yields the events logged so far; a last line without its newline is skipped.
+/// \param ndjsonFileName
+/// \param jsonFileName
+/// \return no. of events rebuilt, -1 on error ( files, or no "session" record )
+int32_t ndjson_rebuild(const char *ndjsonFileName, const char *jsonFileName);
+
+/// \brief Rebuilds session.json document from session log $in, to $out ( see ndjson_rebuild() ).
+/// \param in
+/// \param out
+/// \return no. of events rebuilt, -1 if there is no "session" record
+int32_t ndjson_rebuild_stream(FILE *in, FILE *out);
+
+#endif //FINAL_NDJSON_H
@@ -0,0 +1,26 @@
+#ifndef FINAL_POOL_H
+#define FINAL_POOL_H
+
+#include "types.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Spawns $COMMUNICATION_WORKERS_MAX worker threads that run $routine on every submitted job.
+/// \param routine job handler, receives a pointer to the job's own copy of its arguments
+void pool_init(void (*routine)(void *));
+
+/// \brief Queues a job with a copy of $args. Blocks while the queue holds $COMMUNICATION_QUEUE_LEN jobs ( backpressure ).
+/// If pool has no workers, job runs in the calling thread.
+/// \param args job arguments ( copied, may be freed right after the call )
+void pool_submit(const CommunicationWorkerArgs *args);
+
+/// \brief Lets workers drain the queue & joins them.
+void pool_destroy(void);
+
+/// \brief Fraction of workers' time spent running jobs since pool_init().
+/// \return utilisation in range [0, 1]
+double pool_utilisation(void);
+
+#endif //FINAL_POOL_H
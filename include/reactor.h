@@ -0,0 +1,20 @@
+#ifndef FINAL_REACTOR_H
+#define FINAL_REACTOR_H
+
+#include "types.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+/// \brief Single-threaded server loop. Accepts connections on $listen_fd & drives all sessions with epoll,
+/// so that a slow peer never blocks accepts or other sessions. Returns after reactor_stop().
+/// \param listen_fd listening socket
+void reactor_run(int32_t listen_fd);
+
+/// \brief Asks reactor_run() to close all sessions & return ( within $REACTOR_TICK msecs ), or to return as soon as it
+/// starts if it is not running yet. Async-signal-safe.
+void reactor_stop(void);
+
+#endif //FINAL_REACTOR_H
@@ -0,0 +1,39 @@
+#ifndef FINAL_RECEIPTS_H
+#define FINAL_RECEIPTS_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Adds receipt of message of $key to $receipts ring, unless it is already there. Oldest receipt is forgotten
+/// when ring is full.
+/// \param receipts
+/// \param index index of $receipts ( key to ring slot )
+/// \param key
+/// \return FALSE if receipt was known, TRUE else
+bool receipts_add(Receipts *receipts, MessageIndex *index, const MessageKey *key);
+
+/// \brief Rebuilds $index from the slots of $receipts ring.
+/// \param receipts
+/// \param index
+void receipts_rebuild(const Receipts *receipts, MessageIndex *index);
+
+/// \brief Serializes the receipts of messages in $filter ( network byte order ).
+/// \param receipts
+/// \param filter summary of the messages a device holds
+/// \param packed buffer of at least $RECEIPTS_LEN_MAX bytes
+/// \return no. of bytes written
+uint32_t receipts_pack(const Receipts *receipts, const Summary *filter, uint8_t *packed);
+
+/// \brief Reads header of received receipts.
+/// \param packed $RECEIPTS_HEADER_LEN received bytes
+/// \return no. of bytes of all receipts, 0 if bytes are not receipts
+uint32_t receipts_length(const uint8_t *packed);
+
+/// \brief Un-serializes the $receipt_i-th of received receipts.
+/// \param key the result key ( passed as pointer )
+/// \param packed received bytes ( receipts_length() of them )
+/// \param receipt_i
+void receipts_unpack(MessageKey *key, const uint8_t *packed, uint32_t receipt_i);
+
+#endif //FINAL_RECEIPTS_H
@@ -0,0 +1,27 @@
+#ifndef FINAL_SCAN_H
+#define FINAL_SCAN_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Get name of the kernel that classifies bytes, as resolved for $scanKernel & this CPU.
+/// \return "avx2", "sse2", "neon" or "scalar"
+const char *scan_kernel_name(void);
+
+/// \brief Checks if $n bytes of a body are all of the allowed class ( printable ASCII but '_', '\' & '"' ).
+/// \param body
+/// \param n
+/// \return TRUE if body is valid, FALSE else
+bool scan_body(const uint8_t *body, uint16_t n);
+
+/// \brief Validates $records_n text records of $record_length bytes each, back to back at $records, in one pass: three
+/// glues split fields of digits from a body of the allowed class that ends with a NUL ( & a sequence number of digits
+/// follows in sequenced records ).
+/// \param records
+/// \param records_n at most 64
+/// \param record_length $MESSAGE_SERIALIZED_LEN or $MESSAGE_SEQUENCED_LEN
+/// \return bitset of valid records ( bit i set if i-th record is valid )
+uint64_t scan_records(const uint8_t *records, uint16_t records_n, uint16_t record_length);
+
+#endif //FINAL_SCAN_H
@@ -26,16 +26,128 @@ void devices_push(Device device);
 /// \param device
 void devices_remove(Device device);
 
-/// Push message to $INBOX buffer, checking for existence.
+/// \brief Push message to $INBOX ring, unless it is already there. Oldest message is overwritten when ring is full.
 /// \param message
 /// \param device used to keep stats of the first device that gave us our message
-void inbox_push(Message *message, Device *device);
+/// \return FALSE if message was a duplicate, TRUE else
+bool inbox_push(Message *message, Device *device);
+
+/// \brief Copies messages of $INBOX created at or after $since, oldest first. Caller holds $messagesBufferLock.
+/// \param since Linux timestamp
+/// \param messages the result messages ( passed as pointer )
+/// \param messages_n max no. of messages to copy
+/// \return no. of messages copied
+uint16_t inbox_since(uint64_t since, InboxMessage *messages, uint16_t messages_n);
+
+/// \brief Copies messages of $INBOX sent by $sender, newest first. Caller holds $messagesBufferLock.
+/// \param sender
+/// \param messages the result messages ( passed as pointer )
+/// \param messages_n max no. of messages to copy
+/// \return no. of messages copied
+uint16_t inbox_from(uint32_t sender, InboxMessage *messages, uint16_t messages_n);
+
+/// \brief Empties $INBOX ring & its indexes.
+void inbox_reset(void);
 
 /// \brief Push $message to $messages circle buffer. Updates $messageHead acc. to selected override policy.
 /// \param message
 void messages_push(Message *message);
 
-/// \brief Main server loop. Calls communication_thread() on each new connection.
+/// \brief Push $message to $messages circle buffer, unless an equal message is already stored. Check & push are a
+/// single step as long as caller holds $messagesBufferLock.
+/// \param message
+/// \return FALSE if message was a duplicate, TRUE else
+bool messages_push_unique(Message *message);
+
+/// \brief Records that message of $key reached its recipient: its receipt is kept ( & spread ) & the message is
+/// purged, if held.
+/// \param key
+/// \param purged set to TRUE if a message was purged, FALSE else ( passed as pointer )
+/// \return FALSE if receipt was known ( or receipts are off ), TRUE else
+bool messages_receipt(const MessageKey *key, bool *purged);
+
+/// \brief Records that $messages[$message_i] reached its recipient ( see messages_receipt() ).
+/// \param message_i
+/// \return TRUE if message was purged, FALSE else
+bool messages_delivered(uint16_t message_i);
+
+/// \brief Receipts of delivered messages ( ring ). Caller holds $messagesBufferLock.
+/// \return pointer into the store
+const Receipts *messages_receipts(void);
+
+/// \brief Find next slot of $messages circle buffer ( starting from $message_i ) pending for device with $aemIndex.
+/// \param message_i first slot to examine
+/// \param aemIndex
+/// \return slot index, -1 if no more messages are pending for device
+int32_t messages_next_pending(uint16_t message_i, int32_t aemIndex);
+
+/// \brief Find next slot of $messages pending for device with $aemIndex & missing from its $versions: per origin,
+/// messages above the device's version in sequence order, then unsequenced messages. Slots evicted meanwhile are not
+/// revisited, messages placed meanwhile are examined if $cursor did not pass them yet.
+/// \param cursor position of the transmitter, all 0 for the first call ( advanced past the returned slot )
+/// \param versions version vector of the device, by origin
+/// \param aemIndex
+/// \return slot index, -1 if no more messages are missing from device
+int32_t messages_next_missing(MessagesCursor *cursor, const uint32_t *versions, int32_t aemIndex);
+
+/// \brief Marks $messages[$message_i] as transmitted to $device ( if $device is its recipient, message is no longer
+/// pending for any device ).
+/// \param message_i
+/// \param device
+void messages_transmitted(uint16_t message_i, Device device);
+
+/// \brief Header ( sender, recipient, created_at & transmit flags ) of $messages[$message_i].
+/// \param message_i
+/// \return pointer into the store ( created_at is 0 if slot is empty )
+const MessageHeader *messages_header(uint16_t message_i);
+
+/// \brief Copies $messages[$message_i] ( header, body & transmitted devices ) to $message.
+/// \param message_i
+/// \param message the result message ( passed as pointer )
+void messages_get(uint16_t message_i, Message *message);
+
+/// \brief Version vector of the messages this device has seen ( in $messages, $INBOX or evicted since ). Caller holds
+/// $messagesBufferLock.
+/// \return pointer into the store
+const VersionVector *messages_versions(void);
+
+/// \brief Adds all messages of $messages & $INBOX to $summary ( keys are taken from the indexes, bodies are not
+/// hashed again ). Caller holds $messagesBufferLock.
+/// \param summary
+void messages_summary(Summary *summary);
+
+/// \brief Selects the eviction policy of $messages circle buffer & empties it. Pending bitsets are kept only for the
+/// devices of $CLIENT_AEM_SOURCE.
+/// \param policy name of the policy ( see $MESSAGES_PUSH_OVERRIDE_POLICY )
+void messages_init(const char *policy);
+
+/// \brief Empties $messages circle buffer, its index, the version vector & the receipts ( eviction policy is kept ).
+void messages_reset(void);
+
+/// \brief Moves $messages & $INBOX to the memory-mapped file at $path. A file written by this device with the same
+/// store layout is reattached, any other file is reset to an empty store. On failure store stays in memory.
+/// \param path
+/// \return no. of messages reattached, -1 on failure
+int32_t messages_attach(const char *path);
+
+/// \brief Flushes & unmaps the store file, if any. Store is empty & in memory afterwards.
+void messages_detach(void);
+
+/// \brief Keeps own sequence numbers in the file at $path from now on: own messages are numbered after the last one
+/// recorded there, whatever the store holds. A file written by another device counts as empty.
+/// \param path
+/// \return last own sequence number recorded, -1 on failure
+int64_t messages_seq_attach(const char *path);
+
+/// \brief Closes the file of own sequence numbers, if any. Own messages follow the store's version vector afterwards.
+void messages_seq_detach(void);
+
+/// \brief Asks listening_worker() to return: the reactor closes its sessions within $REACTOR_TICK msecs, the threaded
+/// server stops once accept() is interrupted ( by the signal that stopped it ). Async-signal-safe.
+void listening_stop(void);
+
+/// \brief Main server loop. Runs the reactor, or calls communication_worker() on each new connection, until
+/// listening_stop().
 void listening_worker();
 
 #endif //FINAL_SERVER_H
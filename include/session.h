@@ -0,0 +1,43 @@
+#ifndef FINAL_SESSION_H
+#define FINAL_SESSION_H
+
+#include "types.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+
+/// \brief Opens a non-blocking session with connected device. Registers device as active & starts connection stats.
+/// \param session the session ( passed as pointer )
+/// \param socket_fd connected socket ( switched to O_NONBLOCK mode )
+/// \param device connected device
+/// \param server in half-duplex mode, if TRUE transmits first & then receives, else the other way around
+/// \param deferredLog if TRUE the session's messages are logged at session_flush_log(), else as they are exchanged
+/// \return FALSE if session was rejected ( unknown device, active connection with device exists, ... ), TRUE else
+bool session_open(Session *session, int32_t socket_fd, Device device, bool server, bool deferredLog);
+
+/// \brief Receives as much as possible from session's socket without blocking.
+/// \param session
+void session_on_readable(Session *session);
+
+/// \brief Transmits as much as possible to session's socket without blocking.
+/// \param session
+void session_on_writable(Session *session);
+
+/// \brief Get the socket events the session is waiting for.
+/// \param session
+/// \return EPOLLIN / EPOLLOUT mask, 0 when session is done
+uint32_t session_events(const Session *session);
+
+/// \brief Closes session's socket, unregisters device & updates connection stats.
+/// \param session
+void session_close(Session *session);
+
+/// \brief Writes the deferred log of a closed session to session.json file & frees it.
+/// \param session
+/// \param block if FALSE, gives up when $logEventLock is held by another thread ( synchronous log )
+/// \return FALSE if log could not be written ( yet ), TRUE else
+bool session_flush_log(Session *session, bool block);
+
+#endif //FINAL_SESSION_H
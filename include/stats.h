@@ -0,0 +1,51 @@
+#ifndef FINAL_STATS_H
+#define FINAL_STATS_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Adds $n to $counter, in the shard of calling thread ( lock-free; concurrent updates of threads of other shards
+/// touch other cache lines ).
+/// \param counter
+/// \param n
+void stats_add(StatsCounter counter, uint64_t n);
+
+/// \brief Moves $gauge by $delta, in the shard of calling thread ( lock-free ).
+/// \param gauge
+/// \param delta
+void stats_gauge_add(StatsGauge gauge, int64_t delta);
+
+/// \brief Sets level of $gauge to $value ( for gauges whose updaters already know the level, e.g. under a lock; such a
+/// gauge is not moved by stats_gauge_add() ).
+/// \param gauge
+/// \param value
+void stats_gauge_set(StatsGauge gauge, int64_t value);
+
+/// \brief Reads $counter: sum of its shards. Updates racing the read may or may not be counted.
+/// \param counter
+/// \return running total
+uint64_t stats_counter(StatsCounter counter);
+
+/// \brief Reads $gauge: its level plus the deltas of its shards.
+/// \param gauge
+/// \return current level
+int64_t stats_gauge(StatsGauge gauge);
+
+/// \brief Reads messages' counters & buffer occupancy.
+/// \param stats
+void stats_messages(MessagesStats *stats);
+
+/// \brief Reads sessions' counters & active sessions.
+/// \param stats
+void stats_sessions(SessionStats *stats);
+
+/// \brief Reads discovery's counters.
+/// \param stats
+void stats_discovery(DiscoveryStats *stats);
+
+/// \brief Zeroes every counter & the deltas of gauges ( levels set are kept, as they mirror state that is kept ). Not to
+/// race updates ( they may survive the reset ).
+void stats_reset(void);
+
+#endif //FINAL_STATS_H
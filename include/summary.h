@@ -0,0 +1,35 @@
+#ifndef FINAL_SUMMARY_H
+#define FINAL_SUMMARY_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Initializes an empty $summary.
+/// \param summary
+/// \param seed salt of the bit positions ( a fresh one per session )
+void summary_init(Summary *summary, uint32_t seed);
+
+/// \brief Adds message of $key to $summary.
+/// \param summary
+/// \param key
+void summary_add(Summary *summary, const MessageKey *key);
+
+/// \brief Checks if message of $key is in $summary ( false positives are possible, false negatives are not ).
+/// \param summary
+/// \param key
+/// \return TRUE if message is probably in $summary, FALSE if it surely is not
+bool summary_contains(const Summary *summary, const MessageKey *key);
+
+/// \brief Serializes $summary into $SUMMARY_LEN bytes ( network byte order ).
+/// \param summary
+/// \param packed buffer of at least $SUMMARY_LEN bytes
+void summary_pack(const Summary *summary, uint8_t *packed);
+
+/// \brief Un-serializes $SUMMARY_LEN received bytes into $summary.
+/// \param summary the result summary ( passed as pointer )
+/// \param packed received bytes
+/// \return FALSE if bytes are not a summary of the same size, TRUE else
+bool summary_unpack(Summary *summary, const uint8_t *packed);
+
+#endif //FINAL_SUMMARY_H
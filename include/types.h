@@ -2,10 +2,16 @@
 #define FINAL_TYPES_H
 
 #include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
 #include "conf.h"
 
 #define error(status, msg) do { errno = status; perror(msg); exit(EXIT_FAILURE); } while (0)
 
+#define bitset_set(bitset, i) ( (bitset)[(i) / 64] |= (uint64_t) 1 << ( (i) % 64 ) )
+#define bitset_clear(bitset, i) ( (bitset)[(i) / 64] &= ~( (uint64_t) 1 << ( (i) % 64 ) ) )
+#define bitset_test(bitset, i) ( 0 != ( (bitset)[(i) / 64] & ( (uint64_t) 1 << ( (i) % 64 ) ) ) )
+
 // start: Server.h
 typedef uint16_t messages_head_t;
 
@@ -15,6 +21,16 @@ typedef struct device_t {
     int32_t aemIndex;
 } Device;
 
+/* Local hour a thread formatted last ( timestamp2ftime() ): its date & hour, formatted once */
+typedef struct timestamp_cache_t {
+
+    uint64_t hour_start;                // first second of the hour
+    uint64_t hour_end;                  // first second after the hour ( 0 if cache is empty )
+    uint32_t zone;                      // $timestampZone the hour was formatted for
+    char prefix[14];                    // "YYYY-MM-DDTHH:" ( no NUL )
+
+} TimestampCache;
+
 typedef struct message_t {
     // Necessary fields
     uint32_t sender;                    // ΑΕΜ αποστολέα:       uint32
@@ -24,11 +40,23 @@ typedef struct message_t {
 
     // Metadata
     uint8_t transmitted;                // If the message was actually transmitted from this device
-    uint8_t transmitted_devices[CLIENT_AEM_LIST_LENGTH];    // Boolean array, 1 if i-th device has received the message,
-                                                            // 0 otherwise
     uint8_t transmitted_to_recipient;
+    uint64_t transmitted_devices[MESSAGE_DEVICES_WORDS];    // Bitset, i-th bit set if i-th device has received the message
+    uint32_t seq;                       // Per-sender sequence number ( set by sender device, 0 if unknown )
 } Message;
 
+/* Dense part of a stored message: fields scanned on every store lookup ( body & devices bitset are kept apart ) */
+typedef struct message_header_t {
+
+    uint64_t created_at;                // 0 if slot is empty
+    uint32_t sender;
+    uint32_t recipient;
+    uint32_t seq;
+    uint8_t transmitted;
+    uint8_t transmitted_to_recipient;
+
+} MessageHeader;
+
 typedef struct inbox_message_t {
     // Necessary fields
     uint32_t sender;                    // ΑΕΜ αποστολέα:       uint32
@@ -40,35 +68,595 @@ typedef struct inbox_message_t {
     uint32_t first_sender;              // ΑΕΜ της συσκευής που μετέδωσε το μήνυμα
 } InboxMessage;
 
+/* Duplicate-detection key of a message */
+typedef struct message_key_t {
+
+    uint64_t created_at;
+    uint64_t body_hash;                 // FNV-1a of body
+    uint32_t sender;
+    uint32_t recipient;
+
+} MessageKey;
+
+typedef struct message_index_entry_t {
+
+    MessageKey key;
+    uint32_t slot;                      // store slot + 1, 0 if entry is free
+
+} MessageIndexEntry;
+
+/* Open addressing hash index ( linear probing ) from message keys to store slots */
+typedef struct message_index_t {
+
+    MessageIndexEntry *entries;
+    uint32_t mask;                      // capacity - 1 ( capacity is a power of 2 )
+    uint32_t length;
+
+} MessageIndex;
+
+/* Slot eviction policy of $messages ( resolved once from its name, see $MESSAGES_PUSH_OVERRIDE_POLICY ) */
+typedef enum eviction_policy_t {
+
+    EVICTION_BLIND,                     // "blind": overwrite slots in circle buffer order
+    EVICTION_SENT_ONLY,                 // "sent_only": overwrite transmitted messages first, in transmission order
+    EVICTION_OLDEST_DELIVERED,          // "oldest_delivered": overwrite messages delivered to their recipient first,
+                                        // in delivery order
+    EVICTION_MOST_REPLICATED,           // "most_replicated": overwrite messages known to most devices first
+
+} EvictionPolicy;
+
+/* Eviction candidates of $messages: intrusive doubly-linked lists over the slots ( a slot is in one list at most ) */
+typedef struct eviction_t {
+
+    EvictionPolicy policy;
+    uint16_t next[MESSAGES_SIZE];
+    uint16_t prev[MESSAGES_SIZE];
+    uint16_t list[MESSAGES_SIZE];       // list of each slot, $EVICTION_LIST_NONE if unlinked
+    uint16_t heads[EVICTION_LISTS];
+    uint16_t tails[EVICTION_LISTS];
+    uint16_t rankMax;                   // no candidates of higher rank exist
+
+} Eviction;
+
+/* Bloom filter of the messages a device holds ( salted per session, so that false positives differ between contacts ) */
+typedef struct summary_t {
+
+    uint32_t seed;
+    uint8_t bits[SUMMARY_BLOOM_BITS / 8];
+
+} Summary;
+
+/* Version vector: per origin ( index of sender among the devices of $CLIENT_AEM_SOURCE ), the sequence number up to
+   which all messages of the origin were seen */
+typedef struct version_vector_t {
+
+    uint32_t versions[MESSAGE_DEVICES_MAX];
+    uint64_t seen[MESSAGE_DEVICES_MAX]; // bit i set if sequence number $versions + 2 + i was seen ( out of order )
+
+} VersionVector;
+
+/* Position of a transmitter in $messages, by ranges of sequence numbers per origin ( then unsequenced messages ) */
+typedef struct messages_cursor_t {
+
+    uint16_t origin;                    // current origin, no. of origins once unsequenced messages are scanned
+    uint16_t slot;                      // last slot returned for origin ( next slot to examine for unsequenced )
+    uint32_t seq;                       // sequence number of $slot, 0 if no slot was returned for origin yet
+
+} MessagesCursor;
+
+/* Delivery receipts ( anti-packets ): keys of messages known to have reached their recipients, oldest overwritten */
+typedef struct receipts_t {
+
+    uint32_t head;
+    MessageKey keys[RECEIPTS_SIZE];     // created_at is 0 if slot is empty
+
+} Receipts;
+
+/* Header of $MESSAGES_STORE_FILE: a file is reattached only if all fields match */
+typedef struct messages_store_header_t {
+
+    char magic[8];                      // $MESSAGES_STORE_MAGIC
+    uint32_t version;                   // $MESSAGES_STORE_VERSION, bumped on layout changes
+    uint32_t aem;                       // device that owns the store
+    uint64_t size;                      // sizeof( MessagesStore ), differs for other $MESSAGES_SIZE, $INBOX_SIZE etc.
+
+    // Committed heads ( written after the slot they point past )
+    messages_head_t messagesHead;
+    messages_head_t inboxHead;
+
+} MessagesStoreHeader;
+
+/* Persistent part of $messages & $INBOX ( memory-mapped from $MESSAGES_STORE_FILE, index & candidates are rebuilt ).
+   A slot is valid once its created_at is set, which is written last. */
+typedef struct messages_store_t {
+
+    MessagesStoreHeader header;
+    VersionVector versions;             // messages seen ( own sequence number is the entry of this device )
+    Receipts receipts;
+    MessageHeader headers[MESSAGES_SIZE];
+    char bodies[MESSAGES_SIZE][MESSAGE_BODY_LEN];
+    uint64_t transmittedDevices[MESSAGES_SIZE][MESSAGE_DEVICES_WORDS];
+    InboxMessage inbox[INBOX_SIZE];
+
+} MessagesStore;
+
 /* pthread function arguments pointer */
 typedef struct communication_worker_args_t {
 
     Device connected_device;
     int32_t connected_socket_fd;
-    bool concurrent;
     bool server;
 
 } CommunicationWorkerArgs;
+
+/* Queued communication session ( owns its arguments ) */
+typedef struct pool_job_t {
+
+    CommunicationWorkerArgs args;
+    uint64_t queued_at;                 // monotonic usecs
+
+} PoolJob;
+
+typedef struct pool_stats_t {
+
+    // Total
+    uint32_t jobs;                      // jobs run
+    uint32_t backpressured;             // submits that waited for a free queue slot
+
+    // Time ( msecs )
+    double queueWaitAvg;
+    double queueWaitMax;
+    double busyTime;                    // sum of all workers' time spent running jobs
+
+} PoolStats;
+
+/* Snapshot of sessions' stats counters ( see stats_sessions() ) */
+typedef struct session_stats_t {
+
+    // Total
+    uint64_t sessions;                  // sessions closed
+    uint64_t summarized;                // sessions that received the device's summary
+    uint64_t examined;                  // pending messages transmitters looked at
+    uint64_t skipped;                   // pending messages not sent, as the device held them
+    uint64_t receipts;                  // receipts received that were new
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t syscalls;                  // socket reads, writes & options
+    uint64_t rejected;                  // messages received malformed ( fields, or body out of the allowed class )
+
+    // Now
+    int64_t active;                     // sessions open with a registered device
+
+} SessionStats;
+
+typedef struct session_journal_entry_t {
+
+    const char *action;                 // "received", "transmitted"
+    Message message;
+
+} SessionJournalEntry;
+
+/* Message in the transmit batch of a session */
+typedef struct session_batch_entry_t {
+
+    MessageKey key;                     // key of the message, to tell if $slot still holds it once sent
+    uint16_t slot;                      // $messages slot
+    uint16_t end;                       // offset in batch where its bytes end
+    uint64_t serialized_at;             // monotonic nsecs ( latency_now() ) it was serialized at
+
+} SessionBatchEntry;
+
+/* Handshake of a session ( "summary" protocol ) & what the device told about the messages it holds */
+typedef struct session_handshake_t {
+
+    uint8_t tx[HANDSHAKE_LEN_MAX];
+    uint8_t rx[HANDSHAKE_LEN_MAX];
+    Summary summary;
+    uint32_t versions[MESSAGE_DEVICES_MAX];     // device's version vector, by origin
+    uint8_t receipts_tx[RECEIPTS_LEN_MAX];      // receipts of the messages the device holds
+    uint8_t receipts_rx[RECEIPTS_LEN_MAX];
+
+} SessionHandshake;
+
+/* Non-blocking communication session with a connected device */
+typedef struct session_t {
+
+    int32_t socket_fd;
+    Device device;
+    bool server;
+    bool duplex;                        // if transmitter & receiver run at once
+    bool active;                        // if device was registered as active for this session
+    bool transmitting;                  // sending messages the device has not received yet
+    bool receiving;                     // receiving messages until the device shuts its write stream
+    bool tx_finished;                   // if transmitter sent all it had & shut its write stream ( not on errors )
+    bool rx_finished;                   // if receiver got all up to the device's shutdown ( not on errors )
+    uint64_t active_at;                 // monotonic msecs of last progress
+    uint64_t opened_at;                 // monotonic nsecs session opened at, 0 once its first byte arrived
+
+    uint16_t record_length;             // $MESSAGE_SERIALIZED_LEN, $MESSAGE_SEQUENCED_LEN once summaries are negotiated
+    bool binary;                        // if messages travel as binary frames instead ( negotiated by both devices )
+    bool batched;                       // if messages are sent & received in batches ( else one at a time )
+
+    // Negotiation: listening device's opening & dialing device's answer, what both run is settled before anything else
+    bool negotiating;
+    uint8_t negotiation_tx_offset;      // bytes of $negotiation_tx already sent
+    uint8_t negotiation_tx_length;      // 0 until there is something to send ( dialing device answers the opening )
+    uint8_t negotiation_rx_length;      // bytes in $negotiation_rx
+    uint8_t negotiation_tx[NEGOTIATION_LEN];
+    uint8_t negotiation_rx[NEGOTIATION_LEN];
+
+    // Transmitter: batch of serialized messages, marked transmitted as soon as their bytes are sent
+    uint16_t tx_message_i;              // next $messages slot to examine
+    MessagesCursor tx_cursor;           // next range to examine, once device's versions are known
+    bool tx_corked;                     // if TCP_CORK is set on socket
+    uint16_t tx_offset;                 // bytes of $tx_buffer already sent
+    uint16_t tx_length;                 // bytes in $tx_buffer, 0 if batch is empty
+    uint16_t tx_batch_sent;             // messages of $tx_batch already sent
+    uint16_t tx_batch_n;
+    SessionBatchEntry tx_batch[STREAM_BATCH_MAX];
+    uint8_t tx_buffer[STREAM_TX_LEN];
+
+    // Receiver: received bytes, messages are reassembled out of them
+    uint16_t rx_length;                 // bytes in $rx_buffer ( at most one partial message once parsed )
+    uint64_t rx_first_at;               // monotonic nsecs the first byte of the first message in $rx_buffer arrived at
+    uint64_t rx_read_at;                // monotonic nsecs of the last read
+    uint8_t rx_buffer[STREAM_RX_LEN];
+
+    // Handshake ( "summary" protocol ): summary & version vector, messages flow once both handshakes crossed
+    bool handshaking;
+    bool summarized;                    // if device's handshake was received
+    uint16_t handshake_tx_offset;       // bytes of handshake->tx already sent
+    uint16_t handshake_tx_length;
+    uint16_t handshake_rx_length;       // bytes in handshake->rx
+    uint16_t handshake_rx_expected;     // length of device's handshake, as far as known
+    SessionHandshake *handshake;        // allocated while session is open
+
+    // Delivery receipts ( "summary" protocol ): first bytes of each direction, ahead of the messages
+    uint32_t receipts_tx_offset;
+    uint32_t receipts_tx_length;        // set once handshake ends
+    uint32_t receipts_rx_length;
+    uint32_t receipts_rx_expected;      // length of device's receipts, as far as known
+
+    // Stats
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+    uint64_t syscalls;                  // socket reads, writes & options
+    uint32_t examined;                  // pending messages the transmitter looked at
+    uint32_t skipped;                   // pending messages not sent, as the device holds them
+    uint32_t receipts;                  // receipts received that were new to this device
+    uint32_t rejected;                  // messages received malformed
+
+    // Deferred log ( when not holding $logEventLock for the whole session )
+    bool deferred_log;
+    struct timeval started_at;
+    SessionJournalEntry *journal;
+    uint32_t journal_n;
+    uint32_t journal_size;
+
+} Session;
 // end
 
 // start: Log.h
+/* Snapshot of messages' stats counters ( see stats_messages() ) */
 typedef struct messages_stats_t {
 
     // Total
-    uint16_t produced;
-    uint16_t received;
-    uint16_t received_for_me;
-    uint16_t transmitted;
-    uint16_t transmitted_to_recipient;
+    uint64_t produced;
+    uint64_t received;
+    uint64_t received_for_me;
+    uint64_t transmitted;
+    uint64_t transmitted_to_recipient;
+    uint64_t purged;                    // delivered messages freed, on delivery or on receipt
+
+    // Now
+    int64_t buffered;                   // messages in $messages circle buffer
 
     // Time
-    float producedDelayAvg;
+    float producedDelayAvg;             // mins
 
 } MessagesStats;
+
+/* Kind of a queued log record ( one per log_event_*() call ) */
+typedef enum log_record_kind_t {
+
+    LOG_RECORD_START,
+    LOG_RECORD_MESSAGE,
+    LOG_RECORD_DATETIME,
+    LOG_RECORD_STOP
+
+} LogRecordKind;
+
+/* Fixed-size record of the log ring, formatted by the writer thread */
+typedef struct log_record_t {
+
+    LogRecordKind kind;
+    uint32_t event;                     // id of the event the record belongs to ( records of events interleave )
+    struct timeval at;                  // START: event started, STOP: event stopped
+    uint64_t saved_at;                  // MESSAGE, DATETIME: time of the call
+    const char *name;                   // START: event type, MESSAGE: action ( string literals )
+    uint32_t server;                    // START
+    uint32_t client;                    // START
+    uint64_t previous_now;              // DATETIME
+    uint64_t new_now;                   // DATETIME
+    Message message;                    // MESSAGE
+
+} LogRecord;
+
+/* Slot of the log ring: $sequence tells whether the slot is free ( == position ) or holds the record of position
+   ( == position + 1 ) */
+typedef struct log_slot_t {
+
+    uint64_t sequence;
+    LogRecord record;
+
+} LogSlot;
+
+/* Event the writer thread assembles, until its STOP record arrives ( never moved: $stream updates $text & $length
+   in place ) */
+typedef struct log_open_event_t {
+
+    uint32_t event;
+    struct timeval started_at;
+    uint32_t messages_n;
+    FILE *stream;                       // open_memstream() of $text
+    char *text;
+    size_t length;
+
+} LogOpenEvent;
+
+typedef struct log_stats_t {
+
+    uint64_t queued;                    // records pushed to the ring
+    uint64_t dropped;                   // records dropped, ring full ( & the rest of an event whose START was dropped )
+    uint64_t written;                   // records formatted by the writer
+    uint32_t events;                    // events written
+    uint32_t flushes;                   // flushes of session.json file
+    uint32_t bodies;                    // bodies written ( binary log, once per message )
+
+} LogStats;
+
+/* Body written to binary session log ( ids of body & of the devices set written last for it ) */
+typedef struct log_body_t {
+
+    uint64_t devices_hash;              // of transmitted_devices bitset ( 0 if empty )
+    uint32_t devices;                   // id of DEVICES record, 0 if none
+
+} LogBody;
+// end
+
+// start: Binlog.h
+/* Kind of a record of binary session log */
+typedef enum binlog_record_kind_t {
+
+    BINLOG_SESSION = 1,                 // first record of a log
+    BINLOG_NAME,                        // defines a name ( event type, action ): payload is the string
+    BINLOG_BODY,                        // defines a message: payload is the body
+    BINLOG_DEVICES,                     // defines a set of devices: payload is their AEMs ( uint32 each )
+    BINLOG_START,                       // log_event_start()
+    BINLOG_MESSAGE,                     // log_event_message()
+    BINLOG_DATETIME,                    // log_event_message_datetime()
+    BINLOG_STOP,                        // log_event_stop()
+    BINLOG_TEXT                         // records of session.ndjson written at log_tearDown(): payload is the text
+
+} BinlogRecordKind;
+
+/* Fixed-size record of binary session log ( host byte order ). Definitions ( NAME, BODY, DEVICES, TEXT ) are followed
+   by their payload, zero-padded to whole records; later records refer to a definition by its id */
+typedef struct binlog_record_t {
+
+    uint8_t kind;                       // BinlogRecordKind
+    uint8_t flags;                      // MESSAGE: $BINLOG_TRANSMITTED | $BINLOG_TRANSMITTED_TO_RECIPIENT
+    uint16_t name;                      // START: event type, MESSAGE: action ( id of a NAME record )
+    uint32_t id;                        // SESSION: $BINLOG_MAGIC, NAME, BODY & DEVICES: id defined, others: event
+    uint64_t at;                        // SESSION, MESSAGE, DATETIME: secs, START, STOP: usecs, BODY: created_at
+
+    union {
+        struct { uint32_t length; } payload;                                    // NAME, DEVICES, TEXT: bytes
+        struct { uint32_t length, sender, recipient; } body;                    // BODY ( length of body, in bytes )
+        struct { uint32_t client_aem, requested_duration; } session;            // SESSION
+        struct { uint32_t server, client; } start;                              // START
+        struct { uint32_t body, devices; } message;                             // MESSAGE ( devices 0: none )
+        struct { uint64_t previous_now, new_now; } datetime;                    // DATETIME
+    } data;
+
+} BinlogRecord;
+
+/* Message a BODY record defines ( export of binary session log ) */
+typedef struct binlog_body_t {
+
+    uint64_t created_at;
+    uint32_t sender;
+    uint32_t recipient;
+    char *body;                         // NULL if not defined
+
+} BinlogBody;
+
+/* Definitions of a binary session log being exported, by id, & its events started but not stopped yet */
+typedef struct binlog_tables_t {
+
+    char **names;
+    uint32_t names_n;
+    BinlogBody *bodies;
+    uint32_t bodies_n;
+    char **devices;                     // AEMs of each set, as "%04u" joined by commas
+    uint32_t devices_n;
+    LogOpenEvent **events;
+    uint32_t events_n;
+    uint32_t events_size;
+
+} BinlogTables;
+// end
+
+// start: Contacts.h
+/* Contact with a device: a session, from its open to its close */
+typedef struct contact_t {
+
+    uint32_t aem;
+    struct timeval start;
+    struct timeval end;
+
+} Contact;
+
+/* Contacts with a device, aggregated as each one closes */
+typedef struct contact_stats_t {
+
+    uint32_t count;
+    uint64_t sum;                       // usecs
+    uint64_t min;                       // usecs
+    uint64_t max;                       // usecs
+    uint32_t histogram[CONTACTS_HISTOGRAM_LEN];     // contacts by duration ( see $CONTACTS_HISTOGRAM_LEN )
+
+} ContactStats;
+// end
+
+// start: Latency.h
+/* Phase of a contact whose latencies are recorded */
+typedef enum latency_phase_t {
+
+    LATENCY_CONNECT,                    // connect() to connection established ( polling client )
+    LATENCY_FIRST_BYTE,                 // session opened to first byte received
+    LATENCY_SERIALIZE,                  // a message serialized into the transmit batch
+    LATENCY_SEND,                       // a message serialized to its last byte sent
+    LATENCY_RECEIVE,                    // first byte of a message arrived to the message reassembled
+    LATENCY_DEDUP,                      // lookup of a received message in $messages index
+    LATENCY_PUSH,                       // a message pushed to $messages circle buffer
+
+    LATENCY_PHASES_N
+
+} LatencyPhase;
+
+/* HDR-style histogram of latencies ( nsecs ): values below $LATENCY_SUB_BUCKETS are exact, then every power of 2 is
+   split in $LATENCY_SUB_BUCKETS buckets ( relative error under 1 / $LATENCY_SUB_BUCKETS ) */
+typedef struct latency_histogram_t {
+
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[LATENCY_BUCKETS];
+
+} LatencyHistogram;
+// end
+
+// start: Stats.h
+/* Stats counter: a running total that only grows */
+typedef enum stats_counter_t {
+
+    // Messages
+    STATS_PRODUCED,
+    STATS_PRODUCED_DELAY,               // secs producer slept
+    STATS_RECEIVED,
+    STATS_RECEIVED_FOR_ME,
+    STATS_TRANSMITTED,
+    STATS_TRANSMITTED_TO_RECIPIENT,
+    STATS_PURGED,
+
+    // Sessions
+    STATS_SESSIONS,
+    STATS_SUMMARIZED,
+    STATS_EXAMINED,
+    STATS_SKIPPED,
+    STATS_RECEIPTS,
+    STATS_BYTES_SENT,
+    STATS_BYTES_RECEIVED,
+    STATS_SYSCALLS,
+    STATS_REJECTED,
+
+    // Discovery
+    STATS_BEACONS_SENT,
+    STATS_BEACONS_HEARD,
+    STATS_PEERS_DIALED,
+    STATS_DISCOVERY_SYSCALLS,
+
+    STATS_COUNTERS_N
+
+} StatsCounter;
+
+/* Stats gauge: a level that goes up & down */
+typedef enum stats_gauge_t {
+
+    STATS_BUFFERED,                     // messages in $messages circle buffer ( set )
+    STATS_ACTIVE_SESSIONS,              // sessions open with a registered device ( moved by deltas )
+
+    STATS_GAUGES_N
+
+} StatsGauge;
+
+/* Counters & gauges' deltas the threads of a shard update, on cache lines no other shard writes */
+typedef struct stats_shard_t {
+
+    uint64_t counters[STATS_COUNTERS_N];
+    int64_t gauges[STATS_GAUGES_N];
+
+} __attribute__(( aligned( STATS_CACHE_LINE ) )) StatsShard;
 // end
 
 // start: Client.h
+typedef struct polling_stats_t {
+
+    // Total
+    uint32_t rounds;
+    uint32_t attempts;                  // connect() calls issued
+    uint32_t hits;                      // attempts that ended up connected
+    uint32_t timeouts;                  // attempts dropped at their deadline
+    uint32_t syscalls;                  // socket syscalls issued while polling
+
+    // Time ( msecs )
+    double lastRoundDuration;
+    double roundDurationAvg;
+
+} PollingStats;
+
+typedef struct beacon_t {
+
+    uint32_t aem;                       // AEM of broadcasting device
+    uint32_t messages;                  // store summary: no. of messages in $messages
+    uint64_t newest_created_at;         // store summary: latest created_at in $messages
+
+} Beacon;
+
+typedef struct discovery_peer_t {
+
+    Beacon beacon;                      // last beacon heard from peer
+    uint64_t heard_at;                  // monotonic msecs, 0 if slot is free
+    uint64_t dialed_at;                 // monotonic msecs, 0 if never dialed
+    bool contacted;                     // if session of last dial ran to the end in both directions
+
+    // Store summaries at last dial
+    Beacon dialed_beacon;
+    uint32_t dialed_messages;
+    uint64_t dialed_newest_created_at;
+
+} DiscoveryPeer;
+
+typedef struct discovery_stats_t {
+
+    uint64_t beacons_sent;
+    uint64_t beacons_heard;
+    uint64_t peers_dialed;
+    uint64_t syscalls;                  // socket syscalls issued by beacon transmitter & listener
+
+} DiscoveryStats;
+
+typedef struct polling_attempt_t {
+
+    Device device;
+    int32_t socket_fd;                  // -1 if attempt slot is free
+    uint64_t deadline;                  // monotonic msecs
+    uint64_t started_at;                // monotonic nsecs connect() started at
+
+} PollingAttempt;
+// end
+
+// start: Scan.h
+/* Classes of 64 bytes ( bit i of a mask is set if i-th byte is of that class ) */
+typedef struct scan_masks_t {
+
+    uint64_t glue;                      // '_'
+    uint64_t nul;
+    uint64_t bad;                       // not allowed in a body: not printable ASCII, '\' or '"'
+    uint64_t digit;
 
+} ScanMasks;
 // end
 
 #endif //FINAL_TYPES_H
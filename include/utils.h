@@ -19,12 +19,18 @@ const char* aem2ip(uint32_t aem);
 /// \return index [0, N-1] if found, -1 else
 int32_t binary_search_index(const uint32_t *haystack, size_t N, uint32_t needle);
 
-/// \brief Un-serializes message-as-a-string, re-creating initial message.
+/// \brief Parses $n decimal digits at $digits ( fixed width, no sign ).
+/// \param digits
+/// \param n
+/// \return the value
+uint64_t digits2uint(const char *digits, uint8_t n);
+
+/// \brief Un-serializes message-as-a-string, re-creating initial message. Parses in place, reading at most
+/// $MESSAGE_SERIALIZED_LEN - 1 characters ( a received record needs no terminating NUL ).
 /// \param message the result message ( passes as a pointer )
-/// \param glue the connective character(s); acts as the separator between successive message fields
+/// \param glue the connective character; acts as the separator between successive message fields
 /// \param messageSerialized string containing all message fields glued together using $glue
-/// \return a message struct of type message_t
-void explode(Message *message, const char * glue, char * messageSerialized);
+void explode(Message *message, const char * glue, const char * messageSerialized);
 
 /// \brief Generates a new message from this client towards $recipient with $body as content.
 /// \param message result message ( passed as pointer )
@@ -45,7 +51,7 @@ void generateRandomMessage(Message *message);
 /// \return
 const char* getTransmittedDevicesString( const Message* message );
 
-/// \brief Serializes a message ( of message_t type ) into a 277-characters string.
+/// \brief Serializes a message ( of message_t type ) into a 277-characters string ( zero-padded to its end ).
 /// \param glue the connective character(s); to be placed between successive message fields
 /// \param message the message to be serialized
 /// \param messageSerialized a string containing all message fields glued together using $glue
@@ -86,10 +92,36 @@ int32_t resolveAemIndex( Device device );
 /// \return FALSE on error, TRUE on successful connect()
 bool socket_connect( int32_t socket_fd, uint32_t aem, uint16_t port );
 
-/// \brief Convert given UNIX timestamp to a formatted datetime string with given $format.
+/// \brief Starts a non-blocking connect via $socket_fd to given AEM (creating respective IP address) & port.
+/// \param socket_fd ( switched to O_NONBLOCK mode )
+/// \param aem
+/// \param port
+/// \param syscalls incremented by the no. of syscalls made ( passed as pointer, NULL: not counted )
+/// \return FALSE on error, TRUE if connect() completed or is in progress
+bool socket_connect_nonblocking( int32_t socket_fd, uint32_t aem, uint16_t port, uint32_t *syscalls );
+
+/// \brief Switches $socket_fd between blocking and non-blocking mode.
+/// \param socket_fd
+/// \param blocking
+/// \param syscalls incremented by the no. of syscalls made ( passed as pointer, NULL: not counted )
+/// \return FALSE on fcntl() error, TRUE else
+bool socket_set_blocking( int32_t socket_fd, bool blocking, uint32_t *syscalls );
+
+/// \brief Formats $value into $n decimal digits at $digits ( fixed width, zero-padded, no terminating NUL ).
+/// \param value ( only its last $n digits are written )
+/// \param digits buffer of at least $n characters
+/// \param n
+void uint2digits(uint64_t value, char *digits, uint8_t n);
+
+/// \brief Convert given UNIX timestamp to a formatted ( local ) datetime string with given $format, in $buffer.
+/// "%FT%TZ" & "%H:%M:%S" are served from a per-thread cache of the hour formatted last, other formats by strftime().
 /// \param timestamp UNIX timestamp ( uint64 )
 /// \param format strftime-compatible format
-/// \return the resulting datetime string
-const char * timestamp2ftime( uint64_t timestamp, const char *format );
+/// \param buffer at least $STRFTIME_STR_LEN characters
+/// \return $buffer
+char * timestamp2ftime( uint64_t timestamp, const char *format, char *buffer );
+
+/// \brief Invalidates cached hours of timestamp2ftime() in all threads ( call after local time zone changed, tzset() ).
+void timestamp_zone_changed(void);
 
 #endif //FINAL_UTILS_H
@@ -0,0 +1,42 @@
+#ifndef FINAL_VERSIONS_H
+#define FINAL_VERSIONS_H
+
+#include "types.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/// \brief Origin of messages sent by $aem: index of $aem among the devices of $CLIENT_AEM_SOURCE.
+/// \param aem
+/// \return origin index, -1 if $aem is not a device of $CLIENT_AEM_SOURCE
+int32_t versions_origin(uint32_t aem);
+
+/// \brief No. of origins ( devices of $CLIENT_AEM_SOURCE ).
+/// \return uint32
+uint32_t versions_origins(void);
+
+/// \brief Records that message $seq of $origin was seen. The contiguous prefix of $origin advances over any sequence
+/// numbers seen before out of order; ones beyond $VERSIONS_WINDOW above the prefix are forgotten.
+/// \param vector
+/// \param origin
+/// \param seq
+void versions_seen(VersionVector *vector, int32_t origin, uint32_t seq);
+
+/// \brief Serializes contiguous prefixes of $vector ( non-zero ones, as AEM & sequence number pairs ) in network byte
+/// order.
+/// \param vector
+/// \param packed buffer of at least $VERSIONS_HEADER_LEN + $VERSIONS_ENTRY_LEN * $MESSAGE_DEVICES_MAX bytes
+/// \return no. of bytes written
+uint32_t versions_pack(const VersionVector *vector, uint8_t *packed);
+
+/// \brief Reads header of received version vector.
+/// \param packed $VERSIONS_HEADER_LEN received bytes
+/// \return no. of bytes of the whole vector, 0 if bytes are not a version vector
+uint32_t versions_length(const uint8_t *packed);
+
+/// \brief Un-serializes a received version vector into $versions ( by origin; AEMs of other sources are ignored ).
+/// \param versions the result prefixes ( $MESSAGE_DEVICES_MAX, passed as pointer )
+/// \param packed received bytes ( versions_length() of them )
+/// \return FALSE if bytes are not a version vector, TRUE else
+bool versions_unpack(uint32_t *versions, const uint8_t *packed);
+
+#endif //FINAL_VERSIONS_H
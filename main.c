@@ -4,6 +4,10 @@
 #include "server.h"
 #include "utils.h"
 #include "communication.h"
+#include "discovery.h"
+#include "latency.h"
+#include "pool.h"
+#include "stats.h"
 #include <signal.h>
 
 //------------------------------------------------------------------------------------------------
@@ -11,37 +15,37 @@
 uint32_t executionTimeRequested;         // secs
 static struct timespec executionTimeActualStart, executionTimeActualFinish;
 
-pthread_t communicationThreads[COMMUNICATION_WORKERS_MAX];
-uint8_t communicationThreadsAvailable = COMMUNICATION_WORKERS_MAX;
-
-static pthread_t pollingThread, producerThread, datetimeListenerThread;
-pthread_mutex_t messagesBufferLock, activeDevicesLock, availableThreadsLock, messagesStatsLock, logLock, logEventLock;
-
-MessagesStats messagesStats;
+static pthread_t pollingThread, producerThread, datetimeListenerThread, beaconThread, discoveryThread;
+pthread_mutex_t messagesBufferLock, activeDevicesLock, logLock, logEventLock;
 
 uint32_t CLIENT_AEM;
 uint32_t setupDatetimeAem;
 
-// Communication time for each device
-struct timeval CLIENT_AEM_CONN_START_LIST[CLIENT_AEM_LIST_LENGTH][MAX_CONNECTIONS_WITH_SAME_CLIENT] = {0, 0};
-struct timeval CLIENT_AEM_CONN_END_LIST[CLIENT_AEM_LIST_LENGTH][MAX_CONNECTIONS_WITH_SAME_CLIENT] = {0, 0};
-uint8_t CLIENT_AEM_CONN_N_LIST[CLIENT_AEM_LIST_LENGTH] = {0};
-
 //------------------------------------------------------------------------------------------------
 
 extern messages_head_t messagesHead;
 extern messages_head_t inboxHead;
 
-/// \brief Handler of SIGALRM signal. Used to terminate execution when MAX_EXECUTION_TIME finishes.
+/// \brief Handler of SIGALRM signal. Used to stop the listening server when MAX_EXECUTION_TIME finishes: main() then
+/// tears down & terminates execution.
 /// \param signo
-/// \return void - Actually this function terminates program execution.
 static void onAlarm(int signo);
 
+/// \brief Stops all threads & communication workers, writes the log & detaches the store. Called once the listening
+/// server stopped.
+/// \return void - This function terminates program execution.
+static void tearDown(void);
+
 /// \brief Handler of SIGALRM signal. Used to terminate setup process if exceeds timeout.
 /// \param signo
 /// \return void - This function terminates program execution.
 static void onSetupAlarm(int signo);
 
+/// \brief Handler of SIGUSR1 signal. Used to dump latency histograms of each phase on demand ( `kill -USR1 <pid>` ):
+/// only flags the dump, the listening server prints it ( at the next reactor tick ).
+/// \param signo
+static void onDumpSignal(int signo);
+
 /// \brief
 /// \example ./Final [MAX_EXECUTION_TIME] [SETUP_DATE_TIME_AEM]
 /// \param argc
@@ -90,12 +94,6 @@ int main( int argc, char **argv )
     status = pthread_mutex_init( &activeDevicesLock, NULL );
     if ( status != 0 )
         error( status, "\tmain(): pthread_mutex_init( activeDevicesLock ) failed" );
-    status = pthread_mutex_init( &availableThreadsLock, NULL );
-    if ( status != 0 )
-        error( status, "\tmain(): pthread_mutex_init( activeDevicesLock ) failed" );
-    status = pthread_mutex_init( &messagesStatsLock, NULL );
-    if ( status != 0 )
-        error( status, "\tmain(): pthread_mutex_init( messagesStatsLock ) failed" );
     status = pthread_mutex_init( &logEventLock, NULL );
     if ( status != 0 )
         error( status, "\tmain(): pthread_mutex_init( logEventLock ) failed" );
@@ -105,16 +103,40 @@ int main( int argc, char **argv )
     printf( "AEM = %d\n", CLIENT_AEM );
 
     // Initialize types
-    messagesHead = 0;
+    messages_init( MESSAGES_PUSH_OVERRIDE_POLICY );
     inboxHead = 0;
 
+    // Reattach messages carried before last restart
+    if ( 0 != strcmp( "", MESSAGES_STORE_FILE ) )
+    {
+        struct timespec attachStart, attachFinish;
+        clock_gettime( CLOCK_MONOTONIC, &attachStart );
+        int32_t reattached = messages_attach( MESSAGES_STORE_FILE );
+        clock_gettime( CLOCK_MONOTONIC, &attachFinish );
+
+        printf( "store = %s: reattached %d messages in %.2fms\n", MESSAGES_STORE_FILE, reattached,
+                ( attachFinish.tv_sec - attachStart.tv_sec ) * 1e3 + ( attachFinish.tv_nsec - attachStart.tv_nsec ) / 1e6 );
+    }
+
+    // Own sequence numbers carry on across restarts & store resets, so that peers holding a higher version of this
+    // device never skip its new messages
+    if ( 0 != strcmp( "", MESSAGES_SEQ_FILE ) )
+        printf( "seq = %s: last own sequence number %lld\n", MESSAGES_SEQ_FILE,
+                (long long) messages_seq_attach( MESSAGES_SEQ_FILE ) );
+
+    // Signals are handled by main thread only: threads started from now on inherit them blocked
+    sigset_t signals, alarmSignal;
+    sigemptyset( &signals );
+    sigaddset( &signals, SIGALRM );
+    sigaddset( &signals, SIGUSR1 );
+    sigemptyset( &alarmSignal );
+    sigaddset( &alarmSignal, SIGALRM );
+    pthread_sigmask( SIG_BLOCK, &signals, NULL );
+
     // Initialize logger
     log_tearUp( "session1.json" );
-    messagesStats.produced = 0;
-    messagesStats.received = 0;
-    messagesStats.received_for_me = 0;
-    messagesStats.transmitted = 0;
-    messagesStats.transmitted_to_recipient = 0;
+    stats_reset();
+    latency_reset();
 
     // Setup datetime
     if ( 1 == SYNC_DATETIME )
@@ -134,10 +156,12 @@ int main( int argc, char **argv )
                 // Setup alarm for setup
                 alarm( SETUP_DATETIME_TIMEOUT );
                 signal( SIGALRM, onSetupAlarm );
+                pthread_sigmask( SIG_UNBLOCK, &alarmSignal, NULL );
 
                 // Receive & set datetime from datetime server
                 if ( false == communication_datetime_receiver() )
                     error( -1, "\tmain(): communication_datetime_receiver() failed" );
+                pthread_sigmask( SIG_BLOCK, &alarmSignal, NULL );
             }
         }
     }
@@ -145,9 +169,29 @@ int main( int argc, char **argv )
     // Start recording actual time
     clock_gettime(CLOCK_REALTIME, &executionTimeActualStart);
 
-    // Setup alarm
+    // Setup alarm & dump signal ( not restarting accept(), so that the threaded server sees them )
+    struct sigaction action = { .sa_flags = 0 };
+    sigemptyset( &action.sa_mask );
+    action.sa_handler = onAlarm;
+    sigaction( SIGALRM, &action, NULL );
+    action.sa_handler = onDumpSignal;
+    sigaction( SIGUSR1, &action, NULL );
     alarm( executionTimeRequested );
-    signal( SIGALRM, onAlarm );
+
+    // Start beacon transmitter & listener ( in new threads )
+    if ( 0 == strcmp( "beacon", CLIENT_DISCOVERY_MODE ) )
+    {
+        status = pthread_create(&beaconThread, NULL, (void *) discovery_beacon_worker, NULL);
+        if ( status != 0 )
+            error( status, "\tmain(): pthread_create( beaconThread ) failed" );
+
+        status = pthread_create(&discoveryThread, NULL, (void *) discovery_listener_worker, NULL);
+        if ( status != 0 )
+            error( status, "\tmain(): pthread_create( discoveryThread ) failed" );
+    }
+
+    // Start communication workers ( in new threads )
+    pool_init( communication_worker );
 
     // Start polling client ( in a new thread )
     status = pthread_create(&pollingThread, NULL, (void *) polling_worker, NULL);
@@ -159,47 +203,73 @@ int main( int argc, char **argv )
     if ( status != 0 )
         error( status, "\tmain(): pthread_create( producerThread ) failed" );
 
-    // Start listening server ( main thread )
+    // Start listening server ( main thread, until onAlarm() )
+    pthread_sigmask( SIG_UNBLOCK, &signals, NULL );
     listening_worker();
 
+    tearDown();
     return EXIT_SUCCESS;
 }
 
 static void onAlarm( int signo )
+{
+    (void) signo;
+    listening_stop();
+}
+
+static void tearDown(void)
 {
     int status;
-    fprintf( stdout, "Caught the SIGALRM signal ( signo = %d )", signo );
+    fprintf( stdout, "Execution time finished ( %u secs ). Tearing down...\n", executionTimeRequested );
 
     // Kill Producer Thread
     status = pthread_cancel( producerThread );
     if ( status != 0 )
-        error( status, "\tonAlarm(): pthread_cancel() on producerThread failed" );
+        error( status, "\ttearDown(): pthread_cancel() on producerThread failed" );
 
     status = pthread_join( producerThread, NULL );
     if ( status != 0 )
-        error( status, "\tonAlarm(): pthread_join() on producerThread failed" );
+        error( status, "\ttearDown(): pthread_join() on producerThread failed" );
 
     // Kill Polling Thread
     status = pthread_cancel( pollingThread );
     if ( status != 0 )
-        error( status, "\tonAlarm(): pthread_cancel() on pollingThread failed" );
+        error( status, "\ttearDown(): pthread_cancel() on pollingThread failed" );
 
     status = pthread_join( pollingThread, NULL );
     if ( status != 0 )
-        error( status, "\tonAlarm(): pthread_join() on pollingThread failed" );
+        error( status, "\ttearDown(): pthread_join() on pollingThread failed" );
+
+    // Kill Beacon Transmitter & Listener Threads
+    if ( 0 == strcmp( "beacon", CLIENT_DISCOVERY_MODE ) )
+    {
+        status = pthread_cancel( beaconThread );
+        if ( status != 0 )
+            error( status, "\ttearDown(): pthread_cancel() on beaconThread failed" );
+
+        status = pthread_cancel( discoveryThread );
+        if ( status != 0 )
+            error( status, "\ttearDown(): pthread_cancel() on discoveryThread failed" );
+
+        pthread_join( beaconThread, NULL );
+        pthread_join( discoveryThread, NULL );
+    }
 
     // Kill Datetime Listener Thread
-    if ( CLIENT_AEM == setupDatetimeAem )
+    if ( setupDatetimeAem > 0 && CLIENT_AEM == setupDatetimeAem )
     {
         status = pthread_cancel( datetimeListenerThread );
         if ( status != 0 )
-            error( status, "\tonAlarm(): pthread_cancel() on datetimeListenerThread failed" );
+            error( status, "\ttearDown(): pthread_cancel() on datetimeListenerThread failed" );
 
         status = pthread_join( datetimeListenerThread, NULL );
         if ( status != 0 )
-            error( status, "\tonAlarm(): pthread_join() on datetimeListenerThread failed" );
+            error( status, "\ttearDown(): pthread_join() on datetimeListenerThread failed" );
     }
 
+    // Let communication workers finish their sessions ( none is queued after polling stopped )
+    pool_destroy();
+
     // Find actual execution time
     clock_gettime(CLOCK_REALTIME, &executionTimeActualFinish);
     long executionTimeActualSeconds = executionTimeActualFinish.tv_sec - executionTimeActualStart.tv_sec;
@@ -214,10 +284,14 @@ static void onAlarm( int signo )
     double executionTimeActual = (double)executionTimeActualSeconds + (double)executionTimeActualNanoSeconds/(double)1e9;
 
     // Close logger
-    messagesStats.producedDelayAvg /= ( float ) messagesStats.produced; // avg
-    messagesStats.producedDelayAvg /= 60.0;                             // sec --> min
     log_tearDown(executionTimeActual);
 
+    // Unmap store ( no session runs anymore, the lock keeps out any other reader )
+    pthread_mutex_lock( &messagesBufferLock );
+        messages_detach();
+        messages_seq_detach();
+    pthread_mutex_unlock( &messagesBufferLock );
+
     exit( EXIT_SUCCESS );
 }
 
@@ -225,4 +299,10 @@ static void onSetupAlarm( int signo )
 {
     fprintf( stderr, "onSetupAlarm(): Setup timeout (%d sec) reached! Exiting...\n", SETUP_DATETIME_TIMEOUT );
     exit( EXIT_FAILURE );
-}
\ No newline at end of file
+}
+
+static void onDumpSignal( int signo )
+{
+    (void) signo;
+    latency_request_print();
+}
@@ -0,0 +1,349 @@
+#include "binlog.h"
+#include "ndjson.h"
+#include <string.h>
+#include <time.h>
+
+//------------------------------------------------------------------------------------------------
+
+#define BINLOG_PAYLOAD_MAX ( 1U << 26 )         // bytes; longer payloads ( or ids over it ) mean a corrupt log
+#define BINLOG_TIME_LEN 50
+
+static const uint8_t binlogPadding[sizeof( BinlogRecord )];
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Writes $record to $fp, followed by its payload ( $record->data.payload.length bytes of $payload, zero-padded
+/// to whole records ) if $payload is not NULL.
+/// \param fp
+/// \param record
+/// \param payload
+/// \return bytes written
+size_t binlog_write(FILE *fp, const BinlogRecord *record, const void *payload)
+{
+    size_t written = fwrite( record, 1, BINLOG_RECORD_LEN, fp );
+
+    if ( NULL != payload )
+    {
+        size_t length = record->data.payload.length;
+        written += fwrite( payload, 1, length, fp );
+        if ( 0 != length % BINLOG_RECORD_LEN )
+            written += fwrite( binlogPadding, 1, BINLOG_RECORD_LEN - length % BINLOG_RECORD_LEN, fp );
+    }
+
+    return written;
+}
+
+/// \brief Formats $timestamp in local time as $format, into $buffer of $BINLOG_TIME_LEN characters.
+static const char *binlog_ftime(uint64_t timestamp, const char *format, char *buffer)
+{
+    time_t time = (time_t) timestamp;
+    struct tm local;
+
+    if ( NULL == localtime_r( &time, &local ) || 0 == strftime( buffer, BINLOG_TIME_LEN, format, &local ) )
+        snprintf( buffer, BINLOG_TIME_LEN, "%llu", (unsigned long long) timestamp );
+
+    return buffer;
+}
+
+/// \brief Makes room for entry $id in $entries, a table of $size entries of $entrySize bytes ( new entries zeroed ).
+/// \return FALSE if $id is out of range, TRUE else
+static bool binlog_table_fit(void **entries, uint32_t *size, uint32_t id, size_t entrySize)
+{
+    uint32_t newSize = 0 == *size ? 64 : *size;
+    void *grown;
+
+    if ( id < *size )
+        return true;
+    if ( id >= BINLOG_PAYLOAD_MAX )
+        return false;
+
+    while ( newSize <= id )
+        newSize *= 2;
+    grown = realloc( *entries, newSize * entrySize );
+    if ( NULL == grown )
+        return false;
+
+    memset( (char *) grown + *size * entrySize, 0, ( newSize - *size ) * entrySize );
+    *entries = grown;
+    *size = newSize;
+
+    return true;
+}
+
+/// \brief Finds string $id of table $strings ( of $strings_n entries ).
+/// \return "" if not defined
+static const char *binlog_string(char **strings, uint32_t strings_n, uint32_t id)
+{
+    return id < strings_n && NULL != strings[id] ? strings[id] : "";
+}
+
+/// \brief Finds the event with id $event, started but not stopped yet.
+/// \return NULL if event is not open
+static LogOpenEvent *binlog_event(BinlogTables *tables, uint32_t event)
+{
+    for ( uint32_t event_i = 0; event_i < tables->events_n; event_i++ )
+        if ( event == tables->events[event_i]->event )
+            return tables->events[event_i];
+
+    return NULL;
+}
+
+/// \brief Writes record $record ( of $payload, if a definition ) as "session" or "event" records of session log to
+/// $out, or stores it in $tables ( events are written once stopped ).
+/// \return no. of events written, -1 if record is out of place
+static int32_t binlog_record_ndjson(BinlogTables *tables, const BinlogRecord *record, char *payload, FILE *out)
+{
+    char at[BINLOG_TIME_LEN], createdAt[BINLOG_TIME_LEN], previousNow[BINLOG_TIME_LEN], newNow[BINLOG_TIME_LEN];
+    LogOpenEvent *event = binlog_event( tables, record->id );
+
+    switch ( record->kind )
+    {
+        case BINLOG_SESSION:
+            fprintf( out, "{\"record\": \"session\", \"start\": \"%s\", \"client_aem\": \"%u\", \"requested_duration\":\"%u secs\"}\n",
+                     binlog_ftime( record->at, "%FT%TZ", at ), record->data.session.client_aem,
+                     record->data.session.requested_duration );
+            return 0;
+
+        case BINLOG_NAME:
+            if ( !binlog_table_fit( (void **) &tables->names, &tables->names_n, record->id, sizeof( char * ) ) )
+            {
+                free( payload );
+                return -1;
+            }
+            free( tables->names[record->id] );
+            tables->names[record->id] = payload;
+            return 0;
+
+        case BINLOG_BODY:
+            if ( !binlog_table_fit( (void **) &tables->bodies, &tables->bodies_n, record->id, sizeof( BinlogBody ) ) )
+            {
+                free( payload );
+                return -1;
+            }
+            free( tables->bodies[record->id].body );
+            tables->bodies[record->id].created_at = record->at;
+            tables->bodies[record->id].sender = record->data.body.sender;
+            tables->bodies[record->id].recipient = record->data.body.recipient;
+            tables->bodies[record->id].body = payload;
+            return 0;
+
+        case BINLOG_DEVICES:
+        {
+            uint32_t aems_n = record->data.payload.length / sizeof( uint32_t );
+            char *devices = malloc( (size_t) aems_n * 11 + 1 );
+            size_t length = 0;
+
+            if ( NULL == devices ||
+                 !binlog_table_fit( (void **) &tables->devices, &tables->devices_n, record->id, sizeof( char * ) ) )
+            {
+                free( devices );
+                free( payload );
+                return -1;
+            }
+
+            devices[0] = '\0';
+            for ( uint32_t aem_i = 0; aem_i < aems_n; aem_i++ )
+            {
+                uint32_t aem;
+                memcpy( &aem, payload + aem_i * sizeof( uint32_t ), sizeof( uint32_t ) );
+                length += (size_t) sprintf( devices + length, "%s%04u", aem_i > 0 ? "," : "", aem );
+            }
+
+            free( payload );
+            free( tables->devices[record->id] );
+            tables->devices[record->id] = devices;
+            return 0;
+        }
+
+        case BINLOG_START:
+            if ( NULL != event )
+                return 0;
+            if ( tables->events_n == tables->events_size &&
+                 !binlog_table_fit( (void **) &tables->events, &tables->events_size, tables->events_n, sizeof( LogOpenEvent * ) ) )
+                return -1;
+
+            // Never moved: its stream updates $text & $length in place
+            event = malloc( sizeof( LogOpenEvent ) );
+            if ( NULL == event )
+                return -1;
+            event->stream = open_memstream( &event->text, &event->length );
+            if ( NULL == event->stream )
+            {
+                free( event );
+                return -1;
+            }
+            event->event = record->id;
+            event->started_at.tv_sec = (time_t) ( record->at / 1000000 );
+            event->started_at.tv_usec = (suseconds_t) ( record->at % 1000000 );
+            event->messages_n = 0;
+            tables->events[tables->events_n++] = event;
+
+            fprintf( event->stream, "{\"record\": \"event\", \"occured_at\": \"%s\", \"type\": \"%s\", \"server\": \"%u\", \"client\": \"%u\", \"messages\": [",
+                     binlog_ftime( record->at / 1000000, "%H:%M:%S", at ),
+                     binlog_string( tables->names, tables->names_n, record->name ),
+                     record->data.start.server, record->data.start.client );
+            return 0;
+
+        case BINLOG_MESSAGE:
+        {
+            BinlogBody noBody = { 0, 0, 0, NULL };
+            const BinlogBody *body = record->data.message.body < tables->bodies_n ?
+                    &tables->bodies[record->data.message.body] : &noBody;
+
+            if ( NULL == event )
+                return 0;
+
+            fprintf( event->stream, "%s{\"saved_at\": \"%s\", \"action\": \"%s\", \"sender\": \"%u\", \"recipient\": \"%u\", \"created_at\": \"%s\", \"body\": \"%s\", \"transmitted\": \"%s\", \"transmitted_devices\": \"%s\", \"transmitted_to_recipient\": \"%s\"}",
+                     event->messages_n++ > 0 ? "," : "",
+                     binlog_ftime( record->at, "%FT%TZ", at ), binlog_string( tables->names, tables->names_n, record->name ),
+                     body->sender, body->recipient, binlog_ftime( body->created_at, "%FT%TZ", createdAt ),
+                     NULL == body->body ? "" : body->body,
+                     0 != ( record->flags & BINLOG_TRANSMITTED ) ? "TRUE" : "FALSE",
+                     binlog_string( tables->devices, tables->devices_n, record->data.message.devices ),
+                     0 != ( record->flags & BINLOG_TRANSMITTED_TO_RECIPIENT ) ? "TRUE" : "FALSE" );
+            return 0;
+        }
+
+        case BINLOG_DATETIME:
+            if ( NULL == event )
+                return 0;
+
+            fprintf( event->stream, "%s{\"saved_at\": \"%s\", \"action\": \"%s\", \"previous_now\": \"%s\", \"new_now\": \"%s\"}",
+                     event->messages_n++ > 0 ? "," : "",
+                     binlog_ftime( record->at, "%FT%TZ", at ), "datetime",
+                     binlog_ftime( record->data.datetime.previous_now, "%FT%TZ", previousNow ),
+                     binlog_ftime( record->data.datetime.new_now, "%FT%TZ", newNow ) );
+            return 0;
+
+        case BINLOG_STOP:
+        {
+            if ( NULL == event )
+                return 0;
+
+            double duration = (double) ( (int64_t) ( record->at / 1000000 ) - event->started_at.tv_sec ) * 1000 +
+                    (double) ( (int64_t) ( record->at % 1000000 ) - event->started_at.tv_usec ) / 1000;
+            fprintf( event->stream, "], \"duration\": \"%f ms\"}\n", duration );
+            fclose( event->stream );
+
+            fwrite( event->text, 1, event->length, out );
+            free( event->text );
+            for ( uint32_t event_i = 0; event_i < tables->events_n; event_i++ )
+            {
+                if ( event == tables->events[event_i] )
+                {
+                    tables->events[event_i] = tables->events[--tables->events_n];
+                    break;
+                }
+            }
+            free( event );
+            return 1;
+        }
+
+        default:
+            return -1;
+    }
+}
+
+/// \brief Exports session.json document $jsonFileName from binary session log $binlogFileName ( same layout as the one
+/// "json" & "ndjson" logs produce, times in local time zone of the export ). A log cut short ( session killed ) yields
+/// the events stopped so far.
+/// \param binlogFileName
+/// \param jsonFileName
+/// \return no. of events exported, -1 on error ( files, or not a binary session log )
+int32_t binlog_export(const char *binlogFileName, const char *jsonFileName)
+{
+    FILE *in, *out, *records;
+    BinlogTables tables;
+    BinlogRecord record;
+    char *ndjson = NULL;
+    size_t ndjsonLength = 0;
+    int32_t events_n = -1;
+
+    in = fopen( binlogFileName, "rb" );
+    if ( NULL == in )
+        return -1;
+
+    // First record tells a binary session log
+    if ( 1 != fread( &record, BINLOG_RECORD_LEN, 1, in ) || BINLOG_SESSION != record.kind || BINLOG_MAGIC != record.id )
+    {
+        fclose( in );
+        return -1;
+    }
+
+    // Records of session.ndjson, in memory
+    memset( &tables, 0, sizeof( BinlogTables ) );
+    records = open_memstream( &ndjson, &ndjsonLength );
+    if ( NULL == records )
+    {
+        fclose( in );
+        return -1;
+    }
+
+    do
+    {
+        char *payload = NULL;
+
+        if ( BINLOG_NAME == record.kind || BINLOG_BODY == record.kind || BINLOG_DEVICES == record.kind ||
+             BINLOG_TEXT == record.kind )
+        {
+            uint32_t length = record.data.payload.length;
+            size_t padded = ( length + BINLOG_RECORD_LEN - 1 ) / BINLOG_RECORD_LEN * BINLOG_RECORD_LEN;
+
+            // Payload cut short
+            if ( length > BINLOG_PAYLOAD_MAX || NULL == ( payload = malloc( padded + 1 ) ) ||
+                 padded != fread( payload, 1, padded, in ) )
+            {
+                free( payload );
+                break;
+            }
+            payload[length] = '\0';
+
+            if ( BINLOG_TEXT == record.kind )
+            {
+                fwrite( payload, 1, length, records );
+                free( payload );
+                continue;
+            }
+        }
+
+        if ( -1 == binlog_record_ndjson( &tables, &record, payload, records ) )
+            break;
+    }
+    while ( 1 == fread( &record, BINLOG_RECORD_LEN, 1, in ) );
+    fclose( in );
+    fclose( records );
+
+    // Events never stopped are left out
+    for ( uint32_t event_i = 0; event_i < tables.events_n; event_i++ )
+    {
+        fclose( tables.events[event_i]->stream );
+        free( tables.events[event_i]->text );
+        free( tables.events[event_i] );
+    }
+    for ( uint32_t name_i = 0; name_i < tables.names_n; name_i++ )
+        free( tables.names[name_i] );
+    for ( uint32_t body_i = 0; body_i < tables.bodies_n; body_i++ )
+        free( tables.bodies[body_i].body );
+    for ( uint32_t devices_i = 0; devices_i < tables.devices_n; devices_i++ )
+        free( tables.devices[devices_i] );
+    free( tables.events );
+    free( tables.names );
+    free( tables.bodies );
+    free( tables.devices );
+
+    // session.ndjson --> session.json
+    out = fopen( jsonFileName, "w" );
+    if ( NULL != out )
+    {
+        records = fmemopen( ndjson, ndjsonLength, "r" );
+        if ( NULL != records )
+        {
+            events_n = ndjson_rebuild_stream( records, out );
+            fclose( records );
+        }
+        fclose( out );
+    }
+    free( ndjson );
+
+    return events_n;
+}
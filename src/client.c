@@ -4,20 +4,25 @@
 #include "server.h"
 #include "utils.h"
 #include "communication.h"
+#include "discovery.h"
+#include "latency.h"
+#include "pool.h"
+#include "stats.h"
+#include <sys/epoll.h>
+#include <time.h>
 
 //------------------------------------------------------------------------------------------------
 
-extern pthread_mutex_t messagesBufferLock, availableThreadsLock, logEventLock;
-extern MessagesStats messagesStats;
-extern Message MESSAGES_BUFFER[MESSAGES_SIZE];
-
-extern pthread_t communicationThreads[COMMUNICATION_WORKERS_MAX];
-extern uint8_t communicationThreadsAvailable;
+extern pthread_mutex_t messagesBufferLock;
 
 extern uint32_t CLIENT_AEM;
 
 //------------------------------------------------------------------------------------------------
 
+PollingStats pollingStats;
+
+//------------------------------------------------------------------------------------------------
+
 /// \brief Fetches AEM of running device from $interface network interface
 /// \param interface usually this is "wlan0"
 /// \return uint32_t ( 4-digits )
@@ -46,87 +51,237 @@ uint32_t getClientAem(const char *interface)
     return 0 != aem || 0 == strcmp( interface, "wlp6s0" ) ? aem : getClientAem( "wlp6s0" );
 }
 
-/// \brief Polling thread. Starts polling to find active servers. Creates a new thread for each server found.
-void *polling_worker(void)
+/// \brief Returns current time of the monotonic clock in msecs.
+static uint64_t polling_now(void)
 {
-    uint16_t pollingListLength = ( 0 == strcmp("list", CLIENT_AEM_SOURCE) ) ?
-            CLIENT_AEM_LIST_LENGTH : CLIENT_AEM_RANGE_LENGTH;
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
 
+/// \brief Offloads a connected socket to the communication workers' pool ( blocks while pool's queue is full ).
+/// \param socket_fd connected socket ( in blocking mode )
+/// \param device connected device
+static void polling_dispatch(int32_t socket_fd, Device device)
+{
     int status;
-    int32_t socket_fd;
-    uint32_t aem;
-    uint32_t round_i;
 
-    // Polling loop
-    round_i = 0;
-    do
-    {
-        fprintf( stdout, "\tpolling_worker(): round_i = %04d\n", round_i );
+    //----- NON-CANCELABLE SECTION
+    status = pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+    if ( status != 0 )
+        error( status, "\tpolling_worker(): pthread_setcancelstate( DISABLE ) failed" );
+
+    // Connected > OffLoad to communication worker
+    //  - format arguments
+    CommunicationWorkerArgs args = {
+            .connected_socket_fd = socket_fd,
+            .server = false
+    };
+    memcpy( &args.connected_device, &device, sizeof( Device ) );
+
+    //  - queue session ( pool copies $args )
+    pool_submit( &args );
+
+    status = pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
+    if ( status != 0 )
+        error( status, "\tpolling_worker(): pthread_setcancelstate( ENABLE ) failed" );
+    //-----:end
+}
 
-        // Start a new polling round in the list of AEMs
-        for ( uint16_t client_aem_i = 0; client_aem_i < pollingListLength; client_aem_i++ )
+/// \brief Runs a single polling round: dials all $targets keeping up to $POLLING_CONNECTS_IN_FLIGHT_MAX non-blocking
+/// connects open at once. Each connect is given $POLLING_CONNECT_TIMEOUT msecs before being dropped ( time spent
+/// dispatching other connected devices excluded ).
+/// \param epoll_fd epoll instance used to wait for connect() completions
+/// \param targets devices to dial
+/// \param targets_n size of $targets
+void polling_round(int epoll_fd, const Device *targets, uint16_t targets_n)
+{
+    PollingAttempt attempts[POLLING_CONNECTS_IN_FLIGHT_MAX];
+    struct epoll_event events[POLLING_CONNECTS_IN_FLIGHT_MAX];
+    uint16_t inFlight;
+    uint16_t target_i;
+    uint32_t roundAttempts;
+    uint32_t roundHits;
+    uint64_t roundStart;
+    uint64_t dispatchStart;
+    uint64_t dispatchDuration;
+    uint64_t now;
+    int socket_error;
+    int n;
+
+    for ( uint16_t attempt_i = 0; attempt_i < POLLING_CONNECTS_IN_FLIGHT_MAX; attempt_i++ )
+        attempts[attempt_i].socket_fd = -1;
+
+    roundStart = polling_now();
+    roundAttempts = 0;
+    roundHits = 0;
+    inFlight = 0;
+    target_i = 0;
+    while ( target_i < targets_n || inFlight > 0 )
+    {
+        // Fill free attempt slots with the next targets
+        for ( uint16_t attempt_i = 0; attempt_i < POLLING_CONNECTS_IN_FLIGHT_MAX && target_i < targets_n; attempt_i++ )
         {
-            // Get aem
-            aem = ( pollingListLength == CLIENT_AEM_RANGE_LENGTH ) ?
-                  ( CLIENT_AEM_RANGE_MIN + client_aem_i ):
-                  CLIENT_AEM_LIST[ client_aem_i ];
+            if ( attempts[attempt_i].socket_fd >= 0 )
+                continue;
 
-            // Get socket
-            socket_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
-
-            // Try connecting
-            if ( true == socket_connect( socket_fd, aem, SOCKET_PORT ) )
+            for ( ; target_i < targets_n; target_i++ )
             {
-                //----- NON-CANCELABLE SECTION
-                status = pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
-                if ( status != 0 )
-                    error( status, "\tpolling_worker(): pthread_setcancelstate( DISABLE ) failed" );
-
-                // Connected > OffLoad to communication worker
-                //  - format arguments
-                Device device = {
-                        .AEM = aem,
-                        .aemIndex = client_aem_i
-                };
-                CommunicationWorkerArgs args = {
-                        .connected_socket_fd = (int32_t) socket_fd,
-                        .server = false
-                };
-                memcpy( &args.connected_device, &device, sizeof( Device ) );
+                PollingAttempt *attempt = &attempts[attempt_i];
+                attempt->device = targets[target_i];
+
+                // Get socket & start connecting
+                attempt->socket_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+                pollingStats.syscalls++;
+                if ( attempt->socket_fd < 0 )
+                    error( errno, "\tpolling_worker(): socket() failed" );
 
-                //  - open thread
-                if ( communicationThreadsAvailable > 0 )
+                attempt->started_at = latency_now();
+                if ( false == socket_connect_nonblocking( attempt->socket_fd, attempt->device.AEM, SOCKET_PORT, &pollingStats.syscalls ) )
                 {
-                    pthread_mutex_lock( &availableThreadsLock );
-                    pthread_t communicationThread = communicationThreads[ COMMUNICATION_WORKERS_MAX - communicationThreadsAvailable ];
-                    communicationThreadsAvailable--;
-                    pthread_mutex_unlock( &availableThreadsLock );
+                    close( attempt->socket_fd );
+                    attempt->socket_fd = -1;
+                    pollingStats.syscalls++;
+                    continue;
+                }
+
+                struct epoll_event event = {
+                        .events = EPOLLOUT,
+                        .data.u32 = attempt_i
+                };
+                pollingStats.syscalls++;
+                if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, attempt->socket_fd, &event ) < 0 )
+                    error( errno, "\tpolling_worker(): epoll_ctl( ADD ) failed" );
+
+                attempt->deadline = polling_now() + POLLING_CONNECT_TIMEOUT;
+                roundAttempts++;
+                inFlight++;
+                target_i++;
+                break;
+            }
+        }
 
-                    args.concurrent = true;
+        if ( 0 == inFlight )
+            break;
 
-                    status = pthread_create( &communicationThread, NULL, (void *) communication_worker, &args );
-                    if ( status != 0 )
-                        error( status, "\tpolling_worker(): pthread_create() failed" );
+        // Wait until the nearest deadline for any connect() to complete
+        now = polling_now();
+        uint64_t nearestDeadline = UINT64_MAX;
+        for ( uint16_t attempt_i = 0; attempt_i < POLLING_CONNECTS_IN_FLIGHT_MAX; attempt_i++ )
+        {
+            if ( attempts[attempt_i].socket_fd >= 0 && attempts[attempt_i].deadline < nearestDeadline )
+                nearestDeadline = attempts[attempt_i].deadline;
+        }
 
-                    status = pthread_detach( communicationThread );
-                    if ( status != 0 )
-                        error( status, "\tpolling_worker(): pthread_detach() failed" );
-                }
-                else
+        n = epoll_wait( epoll_fd, events, POLLING_CONNECTS_IN_FLIGHT_MAX, nearestDeadline > now ? (int) ( nearestDeadline - now ) : 0 );
+        if ( n < 0 && EINTR != errno )
+            error( errno, "\tpolling_worker(): epoll_wait() failed" );
+        pollingStats.syscalls++;
+
+        for ( int event_i = 0; event_i < n; event_i++ )
+        {
+            PollingAttempt *attempt = &attempts[ events[event_i].data.u32 ];
+
+            epoll_ctl( epoll_fd, EPOLL_CTL_DEL, attempt->socket_fd, NULL );
+            pollingStats.syscalls++;
+            inFlight--;
+
+            socket_error = 0;
+            getsockopt( attempt->socket_fd, SOL_SOCKET, SO_ERROR, &socket_error, &(socklen_t){ sizeof( int ) } );
+            pollingStats.syscalls++;
+            if ( 0 == socket_error && true == socket_set_blocking( attempt->socket_fd, true, &pollingStats.syscalls ) )
+            {
+                latency_since( LATENCY_CONNECT, attempt->started_at );
+                roundHits++;
+
+                // Dispatch may block ( serial sessions run inline, a full pool queue backpressures ): that time does
+                // not count against the connects still in flight
+                dispatchStart = polling_now();
+                polling_dispatch( attempt->socket_fd, attempt->device );
+                dispatchDuration = polling_now() - dispatchStart;
+                for ( uint16_t attempt_i = 0; dispatchDuration > 0 && attempt_i < POLLING_CONNECTS_IN_FLIGHT_MAX; attempt_i++ )
                 {
-                    // run in current thread
-                    args.concurrent = false;
-                    communication_worker( &args );
+                    if ( attempts[attempt_i].socket_fd >= 0 && &attempts[attempt_i] != attempt )
+                        attempts[attempt_i].deadline += dispatchDuration;
                 }
-
-                status = pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
-                if ( status != 0 )
-                    error( status, "\tpolling_worker(): pthread_setcancelstate( ENABLE ) failed" );
-                //-----:end
             }
+            else
+            {
+                close( attempt->socket_fd );
+                pollingStats.syscalls++;
+            }
+
+            attempt->socket_fd = -1;
+        }
+
+        // Drop attempts that reached their deadline
+        now = polling_now();
+        for ( uint16_t attempt_i = 0; attempt_i < POLLING_CONNECTS_IN_FLIGHT_MAX; attempt_i++ )
+        {
+            PollingAttempt *attempt = &attempts[attempt_i];
+            if ( attempt->socket_fd < 0 || attempt->deadline > now )
+                continue;
+
+            epoll_ctl( epoll_fd, EPOLL_CTL_DEL, attempt->socket_fd, NULL );
+            close( attempt->socket_fd );
+            attempt->socket_fd = -1;
+
+            pollingStats.syscalls += 2;     // epoll_ctl & close above
+            pollingStats.timeouts++;
+            inFlight--;
+        }
+    }
+
+    // Update stats
+    pollingStats.lastRoundDuration = (double) ( polling_now() - roundStart );
+    pollingStats.roundDurationAvg += ( pollingStats.lastRoundDuration - pollingStats.roundDurationAvg ) / (double) ++pollingStats.rounds;
+    pollingStats.attempts += roundAttempts;
+    pollingStats.hits += roundHits;
+
+    fprintf( stdout, "\tpolling_worker(): round_i = %04d | duration = %.0fms ( avg. %.0fms ) | hits = %u / %u\n",
+            pollingStats.rounds - 1, pollingStats.lastRoundDuration, pollingStats.roundDurationAvg, roundHits, roundAttempts );
+}
+
+/// \brief Polling thread. Starts polling to find active servers. Offloads each server found to the communication worker.
+void *polling_worker(void)
+{
+    uint16_t pollingListLength = ( 0 == strcmp("list", CLIENT_AEM_SOURCE) ) ?
+            CLIENT_AEM_LIST_LENGTH : CLIENT_AEM_RANGE_LENGTH;
+
+    Device targets[pollingListLength];
+    uint16_t targets_n;
+    int epoll_fd;
+
+    epoll_fd = epoll_create1( 0 );
+    if ( epoll_fd < 0 )
+        error( errno, "\tpolling_worker(): epoll_create1() failed" );
+
+    // Sweep targets are all AEMs of the list ( or range )
+    for ( uint16_t client_aem_i = 0; client_aem_i < pollingListLength; client_aem_i++ )
+    {
+        targets[client_aem_i].AEM = ( pollingListLength == CLIENT_AEM_RANGE_LENGTH ) ?
+                                    ( CLIENT_AEM_RANGE_MIN + client_aem_i ):
+                                    CLIENT_AEM_LIST[ client_aem_i ];
+        targets[client_aem_i].aemIndex = client_aem_i;
+    }
+
+    // Polling loop
+    do
+    {
+        if ( 0 == strcmp( "beacon", CLIENT_DISCOVERY_MODE ) )
+        {
+            // Dial only peers heard via beacons
+            targets_n = discovery_targets( targets, pollingListLength, DISCOVERY_BEACON_INTERVAL );
+            if ( 0 == targets_n )
+                continue;
+        }
+        else
+        {
+            targets_n = pollingListLength;
         }
 
-        round_i++;
+        polling_round( epoll_fd, targets, targets_n );
     }
     while( 1 );
 }
@@ -140,7 +295,7 @@ void *producer_worker(void)
 
     do
     {
-        pthread_mutex_lock( &logEventLock );
+        log_lock( true );
 
             log_event_start( "production", 0, 0 );
 
@@ -155,16 +310,18 @@ void *producer_worker(void)
 
             // Store
             pthread_mutex_lock( &messagesBufferLock );
+                uint64_t pushStart = latency_now();
                 messages_push( &message );
+                latency_since( LATENCY_PUSH, pushStart );
             pthread_mutex_unlock( &messagesBufferLock );
 
             // Log to session.json
             log_event_message( "produced", &message );
             log_event_stop();
 
-        pthread_mutex_unlock( &logEventLock );
+        log_unlock();
 
-        messagesStats.produced++;
+        stats_add( STATS_PRODUCED, 1 );
 
         status = pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
         if ( status != 0 )
@@ -173,7 +330,7 @@ void *producer_worker(void)
 
         // Sleep
         delay = (uint32_t) (rand() % (PRODUCER_DELAY_RANGE_MAX + 1 - PRODUCER_DELAY_RANGE_MIN ) + PRODUCER_DELAY_RANGE_MIN);
-        messagesStats.producedDelayAvg += delay;
+        stats_add( STATS_PRODUCED_DELAY, delay );
         sleep( delay );
     }
     while( 1 );
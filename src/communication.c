@@ -1,25 +1,32 @@
 #include "conf.h"
 #include "communication.h"
+#include "discovery.h"
+#include "index.h"
 #include "log.h"
+#include "receipts.h"
 #include "server.h"
+#include "session.h"
+#include "stats.h"
 #include <arpa/inet.h>
+#include <poll.h>
 #include <pthread.h>
+#include <sys/epoll.h>
 #include <sys/time.h>
 
 //------------------------------------------------------------------------------------------------
 
 extern uint32_t CLIENT_AEM;
-extern struct timeval CLIENT_AEM_CONN_START_LIST[CLIENT_AEM_LIST_LENGTH][MAX_CONNECTIONS_WITH_SAME_CLIENT];
-extern struct timeval CLIENT_AEM_CONN_END_LIST[CLIENT_AEM_LIST_LENGTH][MAX_CONNECTIONS_WITH_SAME_CLIENT];
-extern uint8_t CLIENT_AEM_CONN_N_LIST[CLIENT_AEM_LIST_LENGTH];
 
-extern pthread_mutex_t messagesBufferLock, activeDevicesLock, availableThreadsLock, messagesStatsLock, logEventLock;
-extern MessagesStats messagesStats;
+extern pthread_mutex_t messagesBufferLock, logEventLock;
 
-extern pthread_t communicationThreads[ COMMUNICATION_WORKERS_MAX ];
-extern uint8_t communicationThreadsAvailable;
+extern MessageIndex messagesIndex;
 
-extern Message MESSAGES_BUFFER[ MESSAGES_SIZE ];
+//------------------------------------------------------------------------------------------------
+
+const char *communicationSessionMode = COMMUNICATION_SESSION_MODE;
+const char *communicationProtocol = COMMUNICATION_PROTOCOL;
+const char *communicationFraming = COMMUNICATION_FRAMING;
+const char *communicationStreamMode = COMMUNICATION_STREAM_MODE;
 
 //------------------------------------------------------------------------------------------------
 
@@ -133,6 +140,7 @@ bool communication_datetime_receiver()
                 // Set timezone
                 setenv( "TZ", "Europe/Athens", 1 );
                 tzset();
+                timestamp_zone_changed();
 
                 // Set timeval
                 settimeofday( &tv, NULL );
@@ -165,173 +173,174 @@ bool communication_datetime_receiver()
 void communication_worker(void *thread_args)
 {
     CommunicationWorkerArgs *args = (CommunicationWorkerArgs *) thread_args;
-    bool deviceExists;
+    struct pollfd pollFd;
+    uint32_t events;
+    Session session;
+    int n;
 
-    // Check if there is an active connection with given device
-    deviceExists = devices_exists( args->connected_device );
+    // Register device & start connection stats ( session's log is written at the end, in one go )
+    if ( true == session_open( &session, args->connected_socket_fd, args->connected_device, args->server, true ) )
+    {
+        pollFd.fd = session.socket_fd;
+        while ( 0 != ( events = session_events( &session ) ) )
+        {
+            pollFd.events = (short) ( ( events & EPOLLIN ? POLLIN : 0 ) | ( events & EPOLLOUT ? POLLOUT : 0 ) );
+            n = poll( &pollFd, 1, SESSION_IDLE_TIMEOUT );
+            if ( n < 0 && EINTR == errno )
+                continue;
+            if ( n <= 0 )
+            {
+                fprintf( stderr, "\tcommunication_worker(): session with AEM = %04d idle. Dropping...\n", session.device.AEM );
+                break;
+            }
 
-    pthread_mutex_lock( &logEventLock );
-        log_event_start( "connection", args->server ? CLIENT_AEM : args->connected_device.AEM,
-                         args->server ? args->connected_device.AEM : CLIENT_AEM );
+            // Progress both directions as far as possible ( errors & hang-ups are detected by the read / write calls )
+            if ( session.transmitting )
+                session_on_writable( &session );
+            if ( session.receiving )
+                session_on_readable( &session );
+        }
+    }
 
-        // If no active connection with given device exists
-        if ( !deviceExists && CLIENT_AEM_CONN_N_LIST[ args->connected_device.aemIndex ] <= MAX_CONNECTIONS_WITH_SAME_CLIENT )
-        {
-            // Update active devices
-            pthread_mutex_lock( &activeDevicesLock );
-                devices_push( args->connected_device );
-            pthread_mutex_unlock( &activeDevicesLock );
+    // Dialed device is contacted only if nothing was cut short: else it is dialed again at its next beacon
+    if ( !args->server && session.tx_finished && session.rx_finished )
+        discovery_contacted( session.device.AEM );
 
-            gettimeofday( &(CLIENT_AEM_CONN_START_LIST[args->connected_device.aemIndex][CLIENT_AEM_CONN_N_LIST[ args->connected_device.aemIndex ]]), NULL );
+    // Close socket, update connection stats & log
+    session_close( &session );
+    session_flush_log( &session, true );
+}
 
-            // If device is server, act as transmitter, else act as receiver.
-            //  - forward communication
-            if ( args->server )
-            {
-                communication_transmitter_worker( args->connected_socket_fd, args->connected_device );
-                shutdown( args->connected_socket_fd, SHUT_WR );
+/// \brief Stores $message received from $connectedDevice, unless it is a duplicate.
+/// \param message received message ( its metadata are updated )
+/// \param connectedDevice device that sent the message
+/// \return FALSE if message was a duplicate, TRUE else
+bool communication_store_message(Message *message, Device connectedDevice)
+{
+    bool stored = true;
 
-                communication_receiver_worker( args->connected_socket_fd, args->connected_device );
-                shutdown( args->connected_socket_fd, SHUT_RD );
-            }
-            //  - reverse communication
-            else
-            {
-                communication_receiver_worker( args->connected_socket_fd, args->connected_device );
-                shutdown( args->connected_socket_fd, SHUT_RD );
+    // Update message's transmitted devices to include sender ( so as not to send back )
+    bitset_set( message->transmitted_devices, connectedDevice.aemIndex );
 
-                communication_transmitter_worker( args->connected_socket_fd, args->connected_device );
-                shutdown( args->connected_socket_fd, SHUT_WR );
-            }
+    // Store in $messages buffer, unless a duplicate is already stored there ( checked by the same lock )
+    pthread_mutex_lock( &messagesBufferLock );
+        if ( CLIENT_AEM == message->recipient )
+            stored = inbox_push( message, &connectedDevice );
+        else
+            stored = messages_push_unique( message );
+    pthread_mutex_unlock( &messagesBufferLock );
 
-            // Update connection time stats
-            gettimeofday( &(CLIENT_AEM_CONN_END_LIST[args->connected_device.aemIndex][CLIENT_AEM_CONN_N_LIST[ args->connected_device.aemIndex ]]), NULL );
+    if ( !stored )
+        return false;
 
-            // Update connection time stats
-            CLIENT_AEM_CONN_N_LIST[ args->connected_device.aemIndex ]++;
+    // Update stats
+    stats_add( STATS_RECEIVED, 1 );
 
-            // Update active devices
-            pthread_mutex_lock( &activeDevicesLock );
-                devices_remove( args->connected_device );
-            pthread_mutex_unlock( &activeDevicesLock );
-        }
-        else
-        {
-            fprintf( stderr, deviceExists ?
-                "Active connection with device found: AEM = %04d. Skipping...":
-                "Max no. of connections with device reached: AEM = %04d. Skipping...", args->connected_device.AEM
-            );
-        }
+    return true;
+}
 
-        // Close Socket
-        close( args->connected_socket_fd );
+/// \brief Stores receipts received from a device & purges the delivered messages they name.
+/// \param packed received receipts ( receipts_length() bytes )
+/// \return no. of receipts that were new
+uint32_t communication_store_receipts(const uint8_t *packed)
+{
+    uint32_t receipts_n = ( receipts_length( packed ) - RECEIPTS_HEADER_LEN ) / RECEIPTS_ENTRY_LEN;
+    uint32_t stored = 0, purged_n = 0;
+    MessageKey key;
+    bool purged;
 
-        // Update number of threads ( since, if this function is called in a new thread, then that thread was detached )
-        if ( args->concurrent )
+    pthread_mutex_lock( &messagesBufferLock );
+        for ( uint32_t receipt_i = 0; receipt_i < receipts_n; receipt_i++ )
         {
-            pthread_mutex_lock( &availableThreadsLock );
-            communicationThreadsAvailable++;
-            pthread_mutex_unlock( &availableThreadsLock );
+            receipts_unpack( &key, packed, receipt_i );
+            stored += messages_receipt( &key, &purged ) ? 1 : 0;
+            purged_n += purged ? 1 : 0;
         }
+    pthread_mutex_unlock( &messagesBufferLock );
 
-        // Finalize event log
-        log_event_stop();
-    pthread_mutex_unlock( &logEventLock );
+    stats_add( STATS_PURGED, purged_n );
+
+    return stored;
 }
 
-/// \brief Receiver sub-worker of communication worker ( POSIX thread compatible function ).
-/// \param connectedSocket socket file descriptor with connected device
-/// \param connectedDevice connected device that will send messages
-void communication_receiver_worker(int32_t connectedSocket, Device connectedDevice)
+/// \brief Find next message of $messages ( starting from $message_i ) that has to be transmitted to $connectedDevice.
+/// \param message_i first slot to examine
+/// \param connectedDevice
+/// \param message copy of the pending message ( passed as pointer )
+/// \return slot index, -1 if no more messages are pending for device
+int32_t communication_next_pending(uint16_t message_i, Device connectedDevice, Message *message)
 {
-    Message message;
-    char messageSerialized[MESSAGE_SERIALIZED_LEN];
+    int32_t pending_i;
 
-    next_loop:
-    while ( read( connectedSocket, messageSerialized, MESSAGE_SERIALIZED_LEN ) == MESSAGE_SERIALIZED_LEN )
+    if (-1 == connectedDevice.aemIndex )
     {
-        // Reconstruct message
-        explode( &message, "_", messageSerialized );
+        error(-1, "connectedDevice.aemIndex equals -1. Exiting...");
+    }
 
-        // Check for duplicates
-        for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
-        {
-            if ( 1 == isMessageEqual(message, MESSAGES_BUFFER[message_i] ) )
-                goto next_loop;
+    pthread_mutex_lock( &messagesBufferLock );
+        pending_i = messages_next_pending( message_i, connectedDevice.aemIndex );
+        if ( pending_i >= 0 )
+            messages_get( (uint16_t) pending_i, message );
+    pthread_mutex_unlock( &messagesBufferLock );
 
-            if (MESSAGES_BUFFER[message_i].created_at == 0 )
-                break;
-        }
+    // ASSERTION
+    if ( pending_i >= 0 && CLIENT_AEM == message->recipient )
+        error( -1, "communication_next_pending(): \"Assertion CLIENT_AEM == message->recipient\" failed" );
 
-        // Update message's transmitted devices to include sender ( so as not to send back )
-        message.transmitted_devices[ connectedDevice.aemIndex ] = 1;
+    return pending_i;
+}
 
-        // Store in $MESSAGES_BUFFER buffer
-        pthread_mutex_lock( &messagesBufferLock );
-            CLIENT_AEM == message.recipient ?
-                inbox_push( &message, &connectedDevice ):
-                messages_push( &message );
-        pthread_mutex_unlock( &messagesBufferLock );
+/// \brief Find next message of $messages that $connectedDevice is missing, as far as its $versions tell.
+/// \param cursor position in $messages ( advanced past the returned slot )
+/// \param versions version vector of $connectedDevice, by origin
+/// \param connectedDevice
+/// \param message copy of the missing message ( passed as pointer )
+/// \return slot index, -1 if no more messages are missing from device
+int32_t communication_next_missing(MessagesCursor *cursor, const uint32_t *versions, Device connectedDevice, Message *message)
+{
+    int32_t missing_i;
 
-        // Update stats
-        pthread_mutex_lock( &messagesStatsLock );
-            messagesStats.received++;
-        pthread_mutex_unlock( &messagesStatsLock );
+    pthread_mutex_lock( &messagesBufferLock );
+        missing_i = messages_next_missing( cursor, versions, connectedDevice.aemIndex );
+        if ( missing_i >= 0 )
+            messages_get( (uint16_t) missing_i, message );
+    pthread_mutex_unlock( &messagesBufferLock );
 
-        // Log received message
-        log_event_message( "received", &message );
-    }
+    return missing_i;
 }
 
-/// \brief Transmitter sub-worker of communication worker ( POSIX thread compatible function ).
-/// \param connectedSocket socket file descriptor with connected device
-/// \param connectedDevice connected device that will receive messages
-void communication_transmitter_worker(int32_t connectedSocket, Device connectedDevice)
+/// \brief Marks $messages[$message_i] as transmitted to $connectedDevice & updates stats, if the slot still holds the
+/// message of $key ( it may have been purged & reused since the message was serialized ).
+/// \param message_i
+/// \param key key of the message transmitted
+/// \param connectedDevice
+/// \param message copy of the message, refreshed with its updated metadata ( passed as pointer )
+/// \return FALSE if slot no longer holds the message, TRUE else
+bool communication_mark_transmitted(uint16_t message_i, const MessageKey *key, Device connectedDevice, Message *message)
 {
-    char messageSerialized[MESSAGE_SERIALIZED_LEN + 1];
+    bool purged = false, held;
 
-    for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
-    {
-        if (-1 == connectedDevice.aemIndex )
+    // Update Status in $messages buffer ( delivered messages are purged )
+    pthread_mutex_lock( &messagesBufferLock );
+        held = index_find( &messagesIndex, key ) == (int32_t) message_i;
+        if ( held )
         {
-            error(-1, "connectedDevice.aemIndex equals -1. Exiting...");
+            messages_transmitted( message_i, connectedDevice );
+            messages_get( message_i, message );
+            if ( connectedDevice.AEM == message->recipient )
+                purged = messages_delivered( message_i );
         }
+    pthread_mutex_unlock( &messagesBufferLock );
 
-        if (MESSAGES_BUFFER[message_i].created_at > 0
-            && 0 == MESSAGES_BUFFER[message_i].transmitted_devices[ connectedDevice.aemIndex ]
-            && 0 == MESSAGES_BUFFER[message_i].transmitted_to_recipient
-        )
-        {
-            // ASSERTION
-            if ( CLIENT_AEM == MESSAGES_BUFFER[message_i].recipient )
-                error( -1, "communication_transmitter_worker(): \"Assertion CLIENT_AEM == MESSAGES_BUFFER[message_i].recipient\" failed" );
-
-            // Serialize
-            implode("_", MESSAGES_BUFFER[message_i], messageSerialized );
-
-            // Transmit
-            send(connectedSocket, messageSerialized , MESSAGE_SERIALIZED_LEN, 0 );
-
-            // Update Status in $MESSAGES_BUFFER buffer
-            pthread_mutex_lock( &messagesBufferLock );
-                MESSAGES_BUFFER[message_i].transmitted = 1;
-                MESSAGES_BUFFER[message_i].transmitted_devices[ connectedDevice.aemIndex ] = 1;
-                    if (connectedDevice.AEM == MESSAGES_BUFFER[message_i].recipient )
-                    {
-                        MESSAGES_BUFFER[message_i].transmitted_to_recipient = 1;
-                    }
-            pthread_mutex_unlock( &messagesBufferLock );
-
-            // Update stats
-            pthread_mutex_lock( &messagesStatsLock );
-                messagesStats.transmitted++;
-                if (connectedDevice.AEM == MESSAGES_BUFFER[message_i].recipient )
-                {
-                    messagesStats.transmitted_to_recipient++;
-                }
-            pthread_mutex_unlock( &messagesStatsLock );
-
-            log_event_message( "transmitted", &MESSAGES_BUFFER[message_i] );
-        }
-    }
+    if ( !held )
+        return false;
+
+    // Update stats
+    stats_add( STATS_TRANSMITTED, 1 );
+    if ( connectedDevice.AEM == message->recipient )
+        stats_add( STATS_TRANSMITTED_TO_RECIPIENT, 1 );
+    if ( purged )
+        stats_add( STATS_PURGED, 1 );
+
+    return true;
 }
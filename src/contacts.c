@@ -0,0 +1,101 @@
+#include "conf.h"
+#include "contacts.h"
+#include <string.h>
+
+//------------------------------------------------------------------------------------------------
+
+#define CONTACTS_RING_LEN ( CONTACTS_RECENT_LEN > 0 ? CONTACTS_RECENT_LEN : 1 )
+
+// Stats of the contacts of each device ( by index in the polled AEMs, of either source )
+static ContactStats contactsStats[MESSAGE_DEVICES_MAX];
+
+// Ring of the most recent contacts: contact #i is at slot i % $CONTACTS_RECENT_LEN
+static Contact contactsRecent[CONTACTS_RING_LEN];
+static uint64_t contactsRecentN;
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Histogram bucket of contacts lasting $duration.
+/// \param duration usecs
+/// \return bucket
+static uint32_t contacts_bucket(uint64_t duration)
+{
+    uint64_t msecs = duration / 1000;
+    uint32_t bucket = 0 == msecs ? 0 : 64 - (uint32_t) __builtin_clzll( msecs );
+
+    return bucket < CONTACTS_HISTOGRAM_LEN ? bucket : CONTACTS_HISTOGRAM_LEN - 1;
+}
+
+/// \brief Adds contact with device of $aemIndex ( from $start to $end ) to its stats & to the ring of recent contacts.
+/// Caller has the device registered as active ( a single session updates the stats of a device at a time ).
+/// \param aemIndex index of the device in the polled AEMs
+/// \param aem
+/// \param start
+/// \param end
+void contacts_add(int32_t aemIndex, uint32_t aem, const struct timeval *start, const struct timeval *end)
+{
+    ContactStats *stats = &contactsStats[aemIndex];
+    int64_t micros = ( (int64_t) end->tv_sec - start->tv_sec ) * 1000000 + ( end->tv_usec - start->tv_usec );
+    uint64_t duration = micros > 0 ? (uint64_t) micros : 0;     // clock may be set back by datetime setup
+
+    if ( 0 == stats->count || duration < stats->min )
+        stats->min = duration;
+    if ( duration > stats->max )
+        stats->max = duration;
+    stats->sum += duration;
+    stats->histogram[contacts_bucket( duration )]++;
+    stats->count++;
+
+    if ( CONTACTS_RECENT_LEN > 0 )
+    {
+        Contact *contact = &contactsRecent[__atomic_fetch_add( &contactsRecentN, 1, __ATOMIC_RELAXED ) % CONTACTS_RING_LEN];
+        contact->aem = aem;
+        contact->start = *start;
+        contact->end = *end;
+    }
+}
+
+/// \brief Stats of the contacts with device of $aemIndex.
+/// \param aemIndex index of the device in the polled AEMs
+/// \return stats ( count 0: no contacts )
+const ContactStats *contacts_stats(int32_t aemIndex)
+{
+    return &contactsStats[aemIndex];
+}
+
+/// \brief Copies the most recent contacts with device $aem still in the ring of recent contacts, oldest first.
+/// \param aem
+/// \param contacts
+/// \param contacts_n max no. of contacts to copy
+/// \return no. of contacts copied
+uint32_t contacts_recent(uint32_t aem, Contact *contacts, uint32_t contacts_n)
+{
+    uint64_t recentN = __atomic_load_n( &contactsRecentN, __ATOMIC_RELAXED );
+    uint64_t oldest = recentN > CONTACTS_RECENT_LEN ? recentN - CONTACTS_RECENT_LEN : 0;
+    uint32_t copied = 0;
+
+    // Newest first, then reversed
+    for ( uint64_t contact_i = recentN; contact_i > oldest && copied < contacts_n; contact_i-- )
+    {
+        const Contact *contact = &contactsRecent[( contact_i - 1 ) % CONTACTS_RING_LEN];
+        if ( aem == contact->aem )
+            contacts[copied++] = *contact;
+    }
+
+    for ( uint32_t contact_i = 0; contact_i < copied / 2; contact_i++ )
+    {
+        Contact swapped = contacts[contact_i];
+        contacts[contact_i] = contacts[copied - 1 - contact_i];
+        contacts[copied - 1 - contact_i] = swapped;
+    }
+
+    return copied;
+}
+
+/// \brief Forgets the stats & recent contacts of every device.
+void contacts_reset(void)
+{
+    memset( contactsStats, 0, sizeof( contactsStats ) );
+    memset( contactsRecent, 0, sizeof( contactsRecent ) );
+    contactsRecentN = 0;
+}
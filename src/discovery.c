@@ -0,0 +1,305 @@
+#include "conf.h"
+#include "discovery.h"
+#include "server.h"
+#include "stats.h"
+#include "utils.h"
+#include <arpa/inet.h>
+#include <time.h>
+#include <unistd.h>
+
+//------------------------------------------------------------------------------------------------
+
+extern pthread_mutex_t messagesBufferLock;
+extern uint32_t messagesCount;
+extern uint64_t messagesNewestCreatedAt;
+
+extern uint32_t CLIENT_AEM;
+extern const char *socketSubnet;
+
+//------------------------------------------------------------------------------------------------
+
+static DiscoveryPeer discoveryPeers[ DISCOVERY_PEERS_MAX ];
+static pthread_mutex_t discoveryPeersLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t discoveryPeersHeard = PTHREAD_COND_INITIALIZER;
+
+/// \brief Returns current time of the monotonic clock in msecs.
+static uint64_t discovery_now(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+/// \brief Resolves index of $aem in the polled AEMs ( $CLIENT_AEM_LIST or $CLIENT_AEM_RANGE_* ).
+/// \param aem
+/// \return index if $aem is polled, -1 else
+static int32_t discovery_aem_index(uint32_t aem)
+{
+    if ( 0 == strcmp( "list", CLIENT_AEM_SOURCE ) )
+        return binary_search_index( CLIENT_AEM_LIST, CLIENT_AEM_LIST_LENGTH, aem );
+
+    return ( aem >= CLIENT_AEM_RANGE_MIN && aem <= CLIENT_AEM_RANGE_MAX ) ? (int32_t) ( aem - CLIENT_AEM_RANGE_MIN ) : -1;
+}
+
+/// \brief Beacon transmitter thread. Broadcasts this device's beacon every $DISCOVERY_BEACON_INTERVAL msecs.
+void *discovery_beacon_worker(void)
+{
+    struct sockaddr_in broadcastAddress;
+    char broadcastIp[INET_ADDRSTRLEN];
+    uint8_t packed[DISCOVERY_BEACON_LEN];
+    Beacon beacon = { .aem = CLIENT_AEM };
+    int socket_fd;
+    int status;
+
+    socket_fd = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+    if ( socket_fd < 0 )
+        error( errno, "\tdiscovery_beacon_worker(): socket() failed" );
+
+    status = 1;
+    stats_add( STATS_DISCOVERY_SYSCALLS, 2 );      // socket & setsockopt
+    if ( setsockopt( socket_fd, SOL_SOCKET, SO_BROADCAST, (const void *)&status, sizeof(int) ) < 0 )
+        perror( "setsockopt ( SO_BROADCAST )" );
+
+    // Broadcast address of the devices' subnet: $SOCKET_SUBNET.255.255
+    snprintf( broadcastIp, INET_ADDRSTRLEN, "%s.255.255", socketSubnet );
+    bzero((char *)&broadcastAddress, sizeof(broadcastAddress));
+    broadcastAddress.sin_family = AF_INET;
+    broadcastAddress.sin_port = htons( DISCOVERY_PORT );
+    broadcastAddress.sin_addr.s_addr = inet_addr( broadcastIp );
+
+    do
+    {
+        // Fetch store summary
+        pthread_mutex_lock( &messagesBufferLock );
+            beacon.messages = messagesCount;
+            beacon.newest_created_at = messagesNewestCreatedAt;
+        pthread_mutex_unlock( &messagesBufferLock );
+
+        // Broadcast
+        discovery_beacon_pack( &beacon, packed );
+        if ( sendto( socket_fd, packed, DISCOVERY_BEACON_LEN, 0, (struct sockaddr *)&broadcastAddress, sizeof(struct sockaddr_in) ) < 0 )
+            perror( "\tdiscovery_beacon_worker(): sendto() failed" );
+
+        stats_add( STATS_BEACONS_SENT, 1 );
+        stats_add( STATS_DISCOVERY_SYSCALLS, 1 );
+
+        usleep( DISCOVERY_BEACON_INTERVAL * 1000 );
+    }
+    while( 1 );
+}
+
+/// \brief Beacon listener thread. Records every device heard on the subnet.
+void *discovery_listener_worker(void)
+{
+    struct sockaddr_in listenAddress;
+    uint8_t packed[DISCOVERY_BEACON_LEN + 1];
+    Beacon beacon;
+    ssize_t length;
+    int socket_fd;
+    int status;
+
+    socket_fd = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+    if ( socket_fd < 0 )
+        error( errno, "\tdiscovery_listener_worker(): socket() failed" );
+
+    status = 1;
+    stats_add( STATS_DISCOVERY_SYSCALLS, 2 );      // socket & setsockopt
+    if ( setsockopt( socket_fd, SOL_SOCKET, SO_REUSEADDR, (const void *)&status, sizeof(int) ) < 0 )
+        perror( "setsockopt ( SO_REUSEADDR )" );
+
+    // Listen on any address, since broadcasts are not delivered to sockets bound to a unicast address
+    bzero((char *)&listenAddress, sizeof(listenAddress));
+    listenAddress.sin_family = AF_INET;
+    listenAddress.sin_port = htons( DISCOVERY_PORT );
+    listenAddress.sin_addr.s_addr = htonl( INADDR_ANY );
+
+    if ( ( status = bind( socket_fd, (struct sockaddr *)&listenAddress, sizeof(struct sockaddr_in) ) ) < 0 )
+        error( errno, "\tdiscovery_listener_worker(): bind() failed" );
+    stats_add( STATS_DISCOVERY_SYSCALLS, 1 );
+
+    do
+    {
+        length = recv( socket_fd, packed, sizeof( packed ), 0 );
+        stats_add( STATS_DISCOVERY_SYSCALLS, 1 );
+
+        if ( length < 0 )
+        {
+            if ( EINTR != errno )
+                perror( "\tdiscovery_listener_worker(): recv() failed" );
+            continue;
+        }
+
+        if ( true == discovery_beacon_unpack( &beacon, packed, (size_t) length ) && CLIENT_AEM != beacon.aem )
+            discovery_heard( &beacon );
+    }
+    while( 1 );
+}
+
+/// \brief Serializes $beacon into $DISCOVERY_BEACON_LEN bytes ( network byte order ).
+/// \param beacon
+/// \param packed buffer of at least $DISCOVERY_BEACON_LEN bytes
+void discovery_beacon_pack(const Beacon *beacon, uint8_t *packed)
+{
+    uint32_t fields[5] = {
+            htonl( DISCOVERY_BEACON_MAGIC ),
+            htonl( beacon->aem ),
+            htonl( beacon->messages ),
+            htonl( (uint32_t) ( beacon->newest_created_at >> 32 ) ),
+            htonl( (uint32_t) beacon->newest_created_at )
+    };
+
+    memcpy( packed, fields, DISCOVERY_BEACON_LEN );
+}
+
+/// \brief Un-serializes a received datagram into $beacon.
+/// \param beacon the result beacon ( passed as pointer )
+/// \param packed received datagram
+/// \param length length of received datagram
+/// \return FALSE if datagram is not a beacon, TRUE else
+bool discovery_beacon_unpack(Beacon *beacon, const uint8_t *packed, size_t length)
+{
+    uint32_t fields[5];
+
+    if ( DISCOVERY_BEACON_LEN != length )
+        return false;
+
+    memcpy( fields, packed, DISCOVERY_BEACON_LEN );
+    if ( DISCOVERY_BEACON_MAGIC != ntohl( fields[0] ) )
+        return false;
+
+    beacon->aem = ntohl( fields[1] );
+    beacon->messages = ntohl( fields[2] );
+    beacon->newest_created_at = (uint64_t) ntohl( fields[3] ) << 32 | (uint64_t) ntohl( fields[4] );
+
+    return true;
+}
+
+/// \brief Records $beacon as heard just now ( wakes up discovery_targets() ).
+/// \param beacon
+void discovery_heard(const Beacon *beacon)
+{
+    DiscoveryPeer *peer = NULL;
+    uint64_t now = discovery_now();
+
+    pthread_mutex_lock( &discoveryPeersLock );
+
+        // Find peer's slot, else a free ( or expired ) one
+        for ( uint16_t peer_i = 0; peer_i < DISCOVERY_PEERS_MAX; peer_i++ )
+        {
+            if ( discoveryPeers[peer_i].heard_at > 0 && discoveryPeers[peer_i].beacon.aem == beacon->aem )
+            {
+                peer = &discoveryPeers[peer_i];
+                break;
+            }
+
+            if ( NULL == peer && ( 0 == discoveryPeers[peer_i].heard_at || discoveryPeers[peer_i].heard_at + DISCOVERY_PEER_TTL < now ) )
+                peer = &discoveryPeers[peer_i];
+        }
+
+        if ( NULL != peer )
+        {
+            if ( peer->beacon.aem != beacon->aem || 0 == peer->heard_at )
+                bzero( peer, sizeof( DiscoveryPeer ) );
+
+            peer->beacon = *beacon;
+            peer->heard_at = now;
+
+            stats_add( STATS_BEACONS_HEARD, 1 );
+            pthread_cond_signal( &discoveryPeersHeard );
+        }
+
+    pthread_mutex_unlock( &discoveryPeersLock );
+}
+
+/// \brief Marks the last dial to $aem as successful: its session ran to the end in both directions.
+/// \param aem
+void discovery_contacted(uint32_t aem)
+{
+    pthread_mutex_lock( &discoveryPeersLock );
+
+        for ( uint16_t peer_i = 0; peer_i < DISCOVERY_PEERS_MAX; peer_i++ )
+        {
+            if ( discoveryPeers[peer_i].heard_at > 0 && discoveryPeers[peer_i].beacon.aem == aem )
+            {
+                discoveryPeers[peer_i].contacted = true;
+                break;
+            }
+        }
+
+    pthread_mutex_unlock( &discoveryPeersLock );
+}
+
+/// \brief Fills $targets with peers heard since they were last dialed, unless neither side's store summary changed
+/// since last successful contact.
+/// Blocks for up to $timeout msecs while there is no such peer.
+/// \param targets result devices ( passed as pointer )
+/// \param max size of $targets
+/// \param timeout msecs
+/// \return number of devices written to $targets
+uint16_t discovery_targets(Device *targets, uint16_t max, uint32_t timeout)
+{
+    struct timespec deadline;
+    uint32_t ownMessages;
+    uint64_t ownNewestCreatedAt;
+    uint64_t now;
+    uint16_t targets_n;
+
+    clock_gettime( CLOCK_REALTIME, &deadline );
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (long) ( timeout % 1000 ) * 1000000;
+    if ( deadline.tv_nsec >= 1000000000L )
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock( &messagesBufferLock );
+        ownMessages = messagesCount;
+        ownNewestCreatedAt = messagesNewestCreatedAt;
+    pthread_mutex_unlock( &messagesBufferLock );
+
+    pthread_mutex_lock( &discoveryPeersLock );
+    do
+    {
+        now = discovery_now();
+        targets_n = 0;
+
+        for ( uint16_t peer_i = 0; peer_i < DISCOVERY_PEERS_MAX && targets_n < max; peer_i++ )
+        {
+            DiscoveryPeer *peer = &discoveryPeers[peer_i];
+
+            // Skip free slots, peers gone & peers not heard again since last dial
+            if ( 0 == peer->heard_at || peer->heard_at + DISCOVERY_PEER_TTL < now || peer->heard_at <= peer->dialed_at )
+                continue;
+
+            // Skip peers with whom there is nothing new to exchange since last contact
+            if ( peer->contacted
+                && peer->dialed_beacon.messages == peer->beacon.messages
+                && peer->dialed_beacon.newest_created_at == peer->beacon.newest_created_at
+                && peer->dialed_messages == ownMessages
+                && peer->dialed_newest_created_at == ownNewestCreatedAt
+            )
+                continue;
+
+            int32_t aemIndex = discovery_aem_index( peer->beacon.aem );
+            if ( -1 == aemIndex )
+                continue;
+
+            targets[targets_n].AEM = peer->beacon.aem;
+            targets[targets_n].aemIndex = aemIndex;
+            targets_n++;
+
+            peer->dialed_at = now;
+            peer->contacted = false;
+            peer->dialed_beacon = peer->beacon;
+            peer->dialed_messages = ownMessages;
+            peer->dialed_newest_created_at = ownNewestCreatedAt;
+            stats_add( STATS_PEERS_DIALED, 1 );
+        }
+    }
+    while ( 0 == targets_n && 0 == pthread_cond_timedwait( &discoveryPeersHeard, &discoveryPeersLock, &deadline ) );
+    pthread_mutex_unlock( &discoveryPeersLock );
+
+    return targets_n;
+}
@@ -0,0 +1,152 @@
+#include "conf.h"
+#include "eviction.h"
+#include <string.h>
+
+//------------------------------------------------------------------------------------------------
+
+static const char *evictionPolicyNames[] = { "blind", "sent_only", "oldest_delivered", "most_replicated" };
+
+/// \brief Appends $slot to the tail of list $list_i.
+static void eviction_append(Eviction *eviction, uint16_t list_i, uint16_t slot)
+{
+    eviction->list[slot] = list_i;
+    eviction->next[slot] = EVICTION_LIST_NONE;
+    eviction->prev[slot] = eviction->tails[list_i];
+
+    if ( EVICTION_LIST_NONE == eviction->tails[list_i] )
+        eviction->heads[list_i] = slot;
+    else
+        eviction->next[ eviction->tails[list_i] ] = slot;
+    eviction->tails[list_i] = slot;
+}
+
+/// \brief Rank of the message in $slot as an eviction candidate.
+/// \return rank, -1 if message may not be evicted before the circle buffer wraps around to it
+static int32_t eviction_rank(const Eviction *eviction, const MessageHeader *header, const uint64_t *transmittedDevices)
+{
+    uint32_t replication = 0;
+
+    switch ( eviction->policy )
+    {
+        case EVICTION_SENT_ONLY:
+            return header->transmitted ? 0 : -1;
+
+        case EVICTION_OLDEST_DELIVERED:
+            return header->transmitted_to_recipient ? 0 : -1;
+
+        case EVICTION_MOST_REPLICATED:
+            for ( uint32_t word_i = 0; word_i < MESSAGE_DEVICES_WORDS; word_i++ )
+                replication += (uint32_t) __builtin_popcountll( transmittedDevices[word_i] );
+            return replication > 0 ? (int32_t) replication : -1;
+
+        default:
+            return -1;
+    }
+}
+
+/// \brief Resolves eviction policy from its $name.
+/// \param name "blind", "sent_only", "oldest_delivered" or "most_replicated"
+/// \return policy, -1 if $name is unknown
+int32_t eviction_policy(const char *name)
+{
+    for ( int32_t policy_i = 0; policy_i < (int32_t) ( sizeof( evictionPolicyNames ) / sizeof( char * ) ); policy_i++ )
+        if ( 0 == strcmp( evictionPolicyNames[policy_i], name ) )
+            return policy_i;
+
+    return -1;
+}
+
+/// \brief Initializes $eviction for an empty store: every slot is free.
+/// \param eviction
+/// \param policy
+void eviction_init(Eviction *eviction, EvictionPolicy policy)
+{
+    eviction->policy = policy;
+    eviction->rankMax = 0;
+    memset( eviction->list, 0xFF, sizeof( eviction->list ) );
+    memset( eviction->heads, 0xFF, sizeof( eviction->heads ) );
+    memset( eviction->tails, 0xFF, sizeof( eviction->tails ) );
+
+    // "blind" fills the circle buffer in order anyway
+    if ( EVICTION_BLIND == policy )
+        return;
+
+    for ( uint16_t slot = 0; slot < MESSAGES_SIZE; slot++ )
+        eviction_append( eviction, EVICTION_LIST_FREE, slot );
+}
+
+/// \brief Picks the slot to place a new message at: a free slot, else the first candidate of the highest rank. The
+/// slot is unlinked.
+/// \param eviction
+/// \return slot index, -1 if there are no free slots & no candidates ( overwrite circle buffer's head )
+int32_t eviction_victim(Eviction *eviction)
+{
+    uint16_t slot = eviction->heads[EVICTION_LIST_FREE];
+
+    // Ranks above $rankMax are empty; lower $rankMax past emptied ranks ( each rank is skipped once per raise )
+    while ( EVICTION_LIST_NONE == slot )
+    {
+        slot = eviction->heads[ 1 + eviction->rankMax ];
+        if ( EVICTION_LIST_NONE != slot || 0 == eviction->rankMax )
+            break;
+
+        eviction->rankMax--;
+    }
+
+    if ( EVICTION_LIST_NONE == slot )
+        return -1;
+
+    eviction_unlink( eviction, slot );
+    return slot;
+}
+
+/// \brief Removes $slot from its list, if any.
+/// \param eviction
+/// \param slot
+void eviction_unlink(Eviction *eviction, uint16_t slot)
+{
+    uint16_t list_i = eviction->list[slot];
+
+    if ( EVICTION_LIST_NONE == list_i )
+        return;
+
+    if ( EVICTION_LIST_NONE == eviction->prev[slot] )
+        eviction->heads[list_i] = eviction->next[slot];
+    else
+        eviction->next[ eviction->prev[slot] ] = eviction->next[slot];
+
+    if ( EVICTION_LIST_NONE == eviction->next[slot] )
+        eviction->tails[list_i] = eviction->prev[slot];
+    else
+        eviction->prev[ eviction->next[slot] ] = eviction->prev[slot];
+
+    eviction->list[slot] = EVICTION_LIST_NONE;
+}
+
+/// \brief Moves emptied $slot to the free slots ( it is picked before any candidate ).
+/// \param eviction
+/// \param slot
+void eviction_free(Eviction *eviction, uint16_t slot)
+{
+    eviction_unlink( eviction, slot );
+    eviction_append( eviction, EVICTION_LIST_FREE, slot );
+}
+
+/// \brief Links $slot as a candidate acc. to the policy, after its message was placed or its metadata changed. A slot
+/// that keeps its rank keeps its place in the candidates list.
+/// \param eviction
+/// \param slot
+/// \param header header of the message in $slot
+/// \param transmittedDevices devices bitset of the message in $slot
+void eviction_update(Eviction *eviction, uint16_t slot, const MessageHeader *header, const uint64_t *transmittedDevices)
+{
+    int32_t rank = eviction_rank( eviction, header, transmittedDevices );
+
+    if ( rank < 0 || 1 + rank == eviction->list[slot] )
+        return;
+
+    eviction_unlink( eviction, slot );
+    eviction_append( eviction, (uint16_t) ( 1 + rank ), slot );
+    if ( rank > eviction->rankMax )
+        eviction->rankMax = (uint16_t) rank;
+}
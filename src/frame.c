@@ -0,0 +1,75 @@
+#include "conf.h"
+#include "frame.h"
+#include <string.h>
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Writes $value at $bytes, little-endian.
+static inline void frame_put32(uint8_t *bytes, uint32_t value)
+{
+    bytes[0] = (uint8_t) value;
+    bytes[1] = (uint8_t) ( value >> 8 );
+    bytes[2] = (uint8_t) ( value >> 16 );
+    bytes[3] = (uint8_t) ( value >> 24 );
+}
+
+/// \brief Reads little-endian value at $bytes.
+static inline uint32_t frame_get32(const uint8_t *bytes)
+{
+    return (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+/// \brief Serializes $message into a binary frame: length prefix, fixed-width little-endian header & body of its real
+/// length ( at most $MESSAGE_BODY_LEN - 1 characters ).
+/// \param message
+/// \param frame buffer of at least $FRAME_LEN_MAX bytes
+/// \return no. of bytes of the frame
+uint16_t frame_encode(const Message *message, uint8_t *frame)
+{
+    uint16_t bodyLength = (uint16_t) strnlen( message->body, MESSAGE_BODY_LEN - 1 );
+    uint16_t length = (uint16_t) ( FRAME_HEADER_LEN + bodyLength );
+
+    frame[0] = (uint8_t) length;
+    frame[1] = (uint8_t) ( length >> 8 );
+    frame_put32( frame + 2, message->sender );
+    frame_put32( frame + 6, message->recipient );
+    frame_put32( frame + 10, (uint32_t) message->created_at );
+    frame_put32( frame + 14, (uint32_t) ( message->created_at >> 32 ) );
+    frame_put32( frame + 18, message->seq );
+    memcpy( frame + FRAME_PREFIX_LEN + FRAME_HEADER_LEN, message->body, bodyLength );
+
+    return (uint16_t) ( FRAME_PREFIX_LEN + length );
+}
+
+/// \brief Reads length prefix of a received frame.
+/// \param frame $FRAME_PREFIX_LEN received bytes
+/// \return no. of bytes of the whole frame, 0 if prefix is not valid
+uint16_t frame_length(const uint8_t *frame)
+{
+    uint16_t length = (uint16_t) ( frame[0] | frame[1] << 8 );
+
+    if ( length < FRAME_HEADER_LEN || length > FRAME_HEADER_LEN + MESSAGE_BODY_LEN - 1 )
+        return 0;
+
+    return (uint16_t) ( FRAME_PREFIX_LEN + length );
+}
+
+/// \brief Un-serializes a received binary frame, re-creating initial message ( its metadata are reset ).
+/// \param message the result message ( passed as pointer )
+/// \param frame received bytes ( frame_length() of them )
+void frame_decode(Message *message, const uint8_t *frame)
+{
+    uint16_t bodyLength = (uint16_t) ( frame_length( frame ) - FRAME_PREFIX_LEN - FRAME_HEADER_LEN );
+
+    message->sender = frame_get32( frame + 2 );
+    message->recipient = frame_get32( frame + 6 );
+    message->created_at = (uint64_t) frame_get32( frame + 10 ) | (uint64_t) frame_get32( frame + 14 ) << 32;
+    message->seq = frame_get32( frame + 18 );
+    memcpy( message->body, frame + FRAME_PREFIX_LEN + FRAME_HEADER_LEN, bodyLength );
+    message->body[bodyLength] = '\0';
+
+    // Set message's metadata
+    message->transmitted = 0;
+    message->transmitted_to_recipient = 0;
+    memset( message->transmitted_devices, 0, sizeof( message->transmitted_devices ) );
+}
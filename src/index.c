@@ -0,0 +1,210 @@
+#include "conf.h"
+#include "index.h"
+#include <string.h>
+
+//------------------------------------------------------------------------------------------------
+
+#define INDEX_FNV_OFFSET 0xcbf29ce484222325ULL
+#define INDEX_FNV_PRIME 0x100000001b3ULL
+
+/// \brief Hashes $key into a 64-bit value ( MurmurHash3 finalizer over the mixed key fields ).
+/// \param key
+/// \return hash of $key
+uint64_t index_hash(const MessageKey *key)
+{
+    uint64_t h = key->body_hash;
+
+    h ^= key->created_at * 0x9e3779b97f4a7c15ULL;
+    h ^= ( ( (uint64_t) key->sender << 32 ) | key->recipient ) * 0xc2b2ae3d27d4eb4fULL;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+
+    return h;
+}
+
+/// \brief Check if two keys are equal.
+static bool index_key_equal(const MessageKey *key1, const MessageKey *key2)
+{
+    return key1->created_at == key2->created_at && key1->body_hash == key2->body_hash &&
+           key1->sender == key2->sender && key1->recipient == key2->recipient;
+}
+
+/// \brief Probes $index for $key.
+/// \param position the entry of $key, or the first free entry of its probe sequence ( -1 if $index is full )
+/// \return TRUE if $key was found, FALSE else
+static bool index_probe(const MessageIndex *index, const MessageKey *key, int64_t *position)
+{
+    uint32_t entry_i = (uint32_t) index_hash( key ) & index->mask;
+
+    for ( uint32_t probe_i = 0; probe_i <= index->mask; probe_i++ )
+    {
+        if ( 0 == index->entries[entry_i].slot )
+        {
+            *position = entry_i;
+            return false;
+        }
+
+        if ( index_key_equal( &index->entries[entry_i].key, key ) )
+        {
+            *position = entry_i;
+            return true;
+        }
+
+        entry_i = ( entry_i + 1 ) & index->mask;
+    }
+
+    *position = -1;
+    return false;
+}
+
+/// \brief Hashes $body ( FNV-1a, up to its terminating NUL ).
+static uint64_t index_body_hash(const char *body)
+{
+    uint64_t h = INDEX_FNV_OFFSET;
+
+    for ( uint16_t char_i = 0; char_i < MESSAGE_BODY_LEN && '\0' != body[char_i]; char_i++ )
+    {
+        h ^= (uint8_t) body[char_i];
+        h *= INDEX_FNV_PRIME;
+    }
+
+    return h;
+}
+
+/// \brief Builds the duplicate-detection key of $message.
+/// \param key the result key ( passed as pointer )
+/// \param message
+void index_key(MessageKey *key, const Message *message)
+{
+    key->created_at = message->created_at;
+    key->body_hash = index_body_hash( message->body );
+    key->sender = message->sender;
+    key->recipient = message->recipient;
+}
+
+/// \brief Builds the duplicate-detection key of inbox $message ( recipient is this device, left 0 ).
+/// \param key the result key ( passed as pointer )
+/// \param message
+void index_key_inbox(MessageKey *key, const InboxMessage *message)
+{
+    key->created_at = message->created_at;
+    key->body_hash = index_body_hash( message->body );
+    key->sender = message->sender;
+    key->recipient = 0;
+}
+
+/// \brief Builds the key of $sender in a per-sender index.
+/// \param key the result key ( passed as pointer )
+/// \param sender
+void index_key_sender(MessageKey *key, uint32_t sender)
+{
+    memset( key, 0, sizeof( MessageKey ) );
+    key->sender = sender;
+}
+
+/// \brief Initializes an empty $index over $entries.
+/// \param index
+/// \param entries backing array of $capacity entries
+/// \param capacity power of 2
+void index_init(MessageIndex *index, MessageIndexEntry *entries, uint32_t capacity)
+{
+    index->entries = entries;
+    index->mask = capacity - 1;
+    index_clear( index );
+}
+
+/// \brief Removes all entries of $index.
+/// \param index
+void index_clear(MessageIndex *index)
+{
+    memset( index->entries, 0, ( (size_t) index->mask + 1 ) * sizeof( MessageIndexEntry ) );
+    index->length = 0;
+}
+
+/// \brief Looks up $key in $index.
+/// \param index
+/// \param key
+/// \return store slot of $key, -1 if not indexed
+int32_t index_find(const MessageIndex *index, const MessageKey *key)
+{
+    int64_t position;
+
+    if ( !index_probe( index, key, &position ) )
+        return -1;
+
+    return (int32_t) index->entries[position].slot - 1;
+}
+
+/// \brief Indexes $key at store $slot, unless $key is already indexed ( insert-if-absent ).
+/// \param index
+/// \param key
+/// \param slot
+/// \return FALSE if $key was already indexed ( or $index is full ), TRUE else
+bool index_insert(MessageIndex *index, const MessageKey *key, uint32_t slot)
+{
+    int64_t position;
+
+    if ( index_probe( index, key, &position ) || -1 == position )
+        return false;
+
+    memcpy( &index->entries[position].key, key, sizeof( MessageKey ) );
+    index->entries[position].slot = slot + 1;
+    index->length++;
+
+    return true;
+}
+
+/// \brief Indexes $key at store $slot, replacing previous slot of $key if any.
+/// \param index
+/// \param key
+/// \param slot
+void index_put(MessageIndex *index, const MessageKey *key, uint32_t slot)
+{
+    int64_t position;
+
+    if ( index_probe( index, key, &position ) )
+        index->entries[position].slot = slot + 1;
+    else if ( -1 != position )
+        index_insert( index, key, slot );
+}
+
+/// \brief Removes $key from $index, if it is indexed at store $slot.
+/// \param index
+/// \param key
+/// \param slot
+/// \return TRUE if an entry was removed, FALSE else
+bool index_remove(MessageIndex *index, const MessageKey *key, uint32_t slot)
+{
+    int64_t position;
+    uint32_t hole_i, entry_i, home_i;
+
+    if ( !index_probe( index, key, &position ) || slot + 1 != index->entries[position].slot )
+        return false;
+
+    // Backward-shift deletion: move later entries of the cluster into the hole, unless that would place them
+    // before their home entry ( keeps probe sequences unbroken without tombstones )
+    hole_i = (uint32_t) position;
+    entry_i = hole_i;
+    while ( 1 )
+    {
+        entry_i = ( entry_i + 1 ) & index->mask;
+        if ( 0 == index->entries[entry_i].slot )
+            break;
+
+        home_i = (uint32_t) index_hash( &index->entries[entry_i].key ) & index->mask;
+        if ( ( ( entry_i - home_i ) & index->mask ) >= ( ( entry_i - hole_i ) & index->mask ) )
+        {
+            memcpy( &index->entries[hole_i], &index->entries[entry_i], sizeof( MessageIndexEntry ) );
+            hole_i = entry_i;
+        }
+    }
+
+    index->entries[hole_i].slot = 0;
+    index->length--;
+
+    return true;
+}
@@ -0,0 +1,206 @@
+#include "conf.h"
+#include "latency.h"
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+//------------------------------------------------------------------------------------------------
+
+static LatencyHistogram latencyHistograms[LATENCY_PHASES_N];
+
+// Set by signal handlers, printed by the reactor ( see latency_print_requested() )
+static volatile sig_atomic_t latencyPrintRequested;
+
+static const char *latencyPhases[] = { "connect", "first_byte", "serialize", "send", "receive", "dedup", "push" };
+
+// Percentiles reported ( besides min & max ), & their names
+static const double latencyPercentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+static const char *latencyPercentileNames[] = { "p50", "p90", "p99", "p99.9" };
+
+#define LATENCY_PERCENTILES_N ( sizeof( latencyPercentiles ) / sizeof( double ) )
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Bucket of latencies that $value falls in.
+/// \param value nsecs
+/// \return bucket
+static uint32_t latency_bucket(uint64_t value)
+{
+    if ( value < LATENCY_SUB_BUCKETS )
+        return (uint32_t) value;
+
+    uint32_t magnitude = 63 - (uint32_t) __builtin_clzll( value );
+    if ( magnitude >= LATENCY_RANGE_BITS )
+        return LATENCY_BUCKETS - 1;
+
+    uint32_t shift = magnitude - LATENCY_PRECISION_BITS;
+    return ( shift + 1 ) * LATENCY_SUB_BUCKETS + (uint32_t) ( ( value >> shift ) - LATENCY_SUB_BUCKETS );
+}
+
+/// \brief Lowest value of $bucket.
+/// \param bucket
+/// \param width values the bucket holds ( passed as pointer )
+/// \return nsecs
+static uint64_t latency_bucket_low(uint32_t bucket, uint64_t *width)
+{
+    *width = 1;
+    if ( bucket < LATENCY_SUB_BUCKETS )
+        return bucket;
+
+    uint32_t shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    *width = (uint64_t) 1 << shift;
+    return (uint64_t) ( LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS ) << shift;
+}
+
+/// \brief Returns current time of the monotonic clock in nsecs ( start of a latency ).
+/// \return nsecs
+uint64_t latency_now(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Records a latency of $phase ( lock-free, from any thread ).
+/// \param phase
+/// \param nanos
+void latency_record(LatencyPhase phase, uint64_t nanos)
+{
+    LatencyHistogram *histogram = &latencyHistograms[phase];
+    uint64_t max = __atomic_load_n( &histogram->max, __ATOMIC_RELAXED );
+
+    __atomic_fetch_add( &histogram->buckets[latency_bucket( nanos )], 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &histogram->count, 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &histogram->sum, nanos, __ATOMIC_RELAXED );
+    while ( nanos > max && !__atomic_compare_exchange_n( &histogram->max, &max, nanos, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
+}
+
+/// \brief Records latency of $phase that started at $start & ends now.
+/// \param phase
+/// \param start see latency_now()
+/// \return now ( start of the next phase )
+uint64_t latency_since(LatencyPhase phase, uint64_t start)
+{
+    uint64_t now = latency_now();
+
+    latency_record( phase, now > start ? now - start : 0 );
+    return now;
+}
+
+/// \brief Get no. of latencies of $phase recorded.
+/// \param phase
+/// \return count
+uint64_t latency_count(LatencyPhase phase)
+{
+    return __atomic_load_n( &latencyHistograms[phase].count, __ATOMIC_RELAXED );
+}
+
+/// \brief Get latency of $phase at $percentile: highest value of the bucket it falls in ( at most the max recorded ).
+/// \param phase
+/// \param percentile in [0, 100]; 0: min
+/// \return nsecs, 0 if none recorded
+uint64_t latency_percentile(LatencyPhase phase, double percentile)
+{
+    const LatencyHistogram *histogram = &latencyHistograms[phase];
+    uint64_t total = 0, seen = 0, width;
+
+    // Buckets may move while they are read: percentiles are of the latencies the walk sees
+    for ( uint32_t bucket_i = 0; bucket_i < LATENCY_BUCKETS; bucket_i++ )
+        total += __atomic_load_n( &histogram->buckets[bucket_i], __ATOMIC_RELAXED );
+    if ( 0 == total )
+        return 0;
+
+    // Rank of the latency at $percentile ( rounded up )
+    double exactRank = percentile / 100.0 * (double) total;
+    uint64_t rank = (uint64_t) exactRank;
+    if ( (double) rank < exactRank )
+        rank++;
+    if ( rank < 1 )
+        rank = 1;
+    if ( rank > total )
+        rank = total;
+
+    for ( uint32_t bucket_i = 0; bucket_i < LATENCY_BUCKETS; bucket_i++ )
+    {
+        seen += __atomic_load_n( &histogram->buckets[bucket_i], __ATOMIC_RELAXED );
+        if ( seen < rank )
+            continue;
+
+        uint64_t low = latency_bucket_low( bucket_i, &width );
+        uint64_t max = __atomic_load_n( &histogram->max, __ATOMIC_RELAXED );
+        if ( 0 == percentile )
+            return low;
+        if ( LATENCY_BUCKETS - 1 == bucket_i )
+            return max;     // last bucket holds every latency past the range
+        return low + width - 1 < max ? low + width - 1 : max;
+    }
+
+    return __atomic_load_n( &histogram->max, __ATOMIC_RELAXED );
+}
+
+/// \brief Writes count, mean, min, percentiles & max of every phase as a JSON object ( usecs ).
+/// \param fp
+void latency_dump(FILE *fp)
+{
+    fputc( '{', fp );
+    for ( uint32_t phase = 0; phase < LATENCY_PHASES_N; phase++ )
+    {
+        uint64_t count = latency_count( (LatencyPhase) phase );
+        double mean = 0 == count ? 0.0 : (double) __atomic_load_n( &latencyHistograms[phase].sum, __ATOMIC_RELAXED ) / (double) count;
+
+        fprintf( fp, "%s\"%s\": { \"count\": \"%llu\", \"mean\": \"%.1fus\", \"min\": \"%.1fus\"", phase > 0 ? ", " : "",
+                 latencyPhases[phase], (unsigned long long) count, mean * 1e-3, (double) latency_percentile( (LatencyPhase) phase, 0 ) * 1e-3 );
+        for ( uint32_t percentile_i = 0; percentile_i < LATENCY_PERCENTILES_N; percentile_i++ )
+            fprintf( fp, ", \"%s\": \"%.1fus\"", latencyPercentileNames[percentile_i],
+                     (double) latency_percentile( (LatencyPhase) phase, latencyPercentiles[percentile_i] ) * 1e-3 );
+        fprintf( fp, ", \"max\": \"%.1fus\" }", (double) __atomic_load_n( &latencyHistograms[phase].max, __ATOMIC_RELAXED ) * 1e-3 );
+    }
+    fputc( '}', fp );
+}
+
+/// \brief Writes count, mean, min, percentiles & max of every phase as a table ( usecs ), a line per phase.
+/// \param fp
+void latency_print(FILE *fp)
+{
+    fprintf( fp, "| Latency ( usecs )   : %10s %10s %10s", "count", "mean", "min" );
+    for ( uint32_t percentile_i = 0; percentile_i < LATENCY_PERCENTILES_N; percentile_i++ )
+        fprintf( fp, " %10s", latencyPercentileNames[percentile_i] );
+    fprintf( fp, " %10s\n", "max" );
+
+    for ( uint32_t phase = 0; phase < LATENCY_PHASES_N; phase++ )
+    {
+        uint64_t count = latency_count( (LatencyPhase) phase );
+        double mean = 0 == count ? 0.0 : (double) __atomic_load_n( &latencyHistograms[phase].sum, __ATOMIC_RELAXED ) / (double) count;
+
+        fprintf( fp, "|   %-18s: %10llu %10.1f %10.1f", latencyPhases[phase], (unsigned long long) count, mean * 1e-3,
+                 (double) latency_percentile( (LatencyPhase) phase, 0 ) * 1e-3 );
+        for ( uint32_t percentile_i = 0; percentile_i < LATENCY_PERCENTILES_N; percentile_i++ )
+            fprintf( fp, " %10.1f", (double) latency_percentile( (LatencyPhase) phase, latencyPercentiles[percentile_i] ) * 1e-3 );
+        fprintf( fp, " %10.1f\n", (double) __atomic_load_n( &latencyHistograms[phase].max, __ATOMIC_RELAXED ) * 1e-3 );
+    }
+}
+
+/// \brief Asks for the latencies to be printed at the next latency_print_requested(). Async-signal-safe.
+void latency_request_print(void)
+{
+    latencyPrintRequested = 1;
+}
+
+/// \brief Writes the latencies as latency_print() does, if latency_request_print() was called since last time.
+/// \param fp
+void latency_print_requested(FILE *fp)
+{
+    if ( 0 == latencyPrintRequested )
+        return;
+
+    latencyPrintRequested = 0;
+    latency_print( fp );
+    fflush( fp );
+}
+
+/// \brief Forgets the latencies of every phase. Not to race recording ( recorded latencies may survive the reset ).
+void latency_reset(void)
+{
+    memset( latencyHistograms, 0, sizeof( latencyHistograms ) );
+}
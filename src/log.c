@@ -1,27 +1,570 @@
 #include "conf.h"
+#include "binlog.h"
+#include "contacts.h"
+#include "index.h"
+#include "latency.h"
 #include "log.h"
+#include "ndjson.h"
+#include "pool.h"
+#include "server.h"
+#include "stats.h"
 #include "utils.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
 #include <sys/time.h>
 
 //------------------------------------------------------------------------------------------------
 
 extern uint32_t CLIENT_AEM;
-extern struct timeval CLIENT_AEM_CONN_START_LIST[CLIENT_AEM_LIST_LENGTH][MAX_CONNECTIONS_WITH_SAME_CLIENT];
-extern struct timeval CLIENT_AEM_CONN_END_LIST[CLIENT_AEM_LIST_LENGTH][MAX_CONNECTIONS_WITH_SAME_CLIENT];
-extern uint8_t CLIENT_AEM_CONN_N_LIST[CLIENT_AEM_LIST_LENGTH];
 
 extern uint32_t executionTimeRequested;
-extern MessagesStats messagesStats;
+extern PollingStats pollingStats;
+extern PoolStats poolStats;
 
-extern Message MESSAGES_BUFFER[ MESSAGES_SIZE ];
-extern InboxMessage INBOX[ INBOX_SIZE ];
+extern InboxMessage *INBOX;
 extern messages_head_t inboxHead;
 
+extern pthread_mutex_t logEventLock;
+
+//------------------------------------------------------------------------------------------------
+
+const char *logFormat = LOG_FORMAT;
+const char *logMode = LOG_MODE;
+
+LogStats logStats;
+
 //------------------------------------------------------------------------------------------------
 
 static FILE *jsonFilePointer;
+static char logFileName[FILENAME_MAX];          // session.ndjson / session.bin file ( $LOG_FORMAT "ndjson" / "binary" ),
+                                                // or session.json file
+static char logJsonFileName[FILENAME_MAX];
+static bool logNdjson;                          // records are lines of session.ndjson ( also the ones binary log ends with )
+static bool logBinary;
+
+// Binary log: names & bodies written so far, by id - 1 ( writer only, or the thread that holds $logEventLock )
+static const char **logNames;
+static uint16_t logNamesN;
+static MessageIndex logBodies;
+static LogBody *logBodiesWritten;
+static uint32_t logDevicesN;
 
 struct timeval lastEventStart, lastEventStop;
+static uint32_t lastEventMessagesN;
+
+// Flushes of session log file ( by the writer thread, or by the thread that holds $logEventLock )
+static bool logUnflushed;
+static uint64_t logFlushedAt;
+
+// Log ring ( lock-free, many producers & the writer thread as the only consumer ): producers claim a position with a
+// CAS on $logRingTail & publish the record through the slot's sequence
+static LogSlot logRing[LOG_RING_LEN];
+static uint64_t logRingTail;
+static uint64_t logRingHead;                // writer only
+
+static bool logAsync;
+static bool logWriterRunning;
+static pthread_t logWriterThread;
+static uint32_t logEventsN;
+
+// Event of the calling thread ( asynchronous log )
+static __thread uint32_t logEvent;
+static __thread bool logEventDropped;
+
+// Events the writer assembles ( writer only; allocated one by one, their streams update them in place )
+static LogOpenEvent **logOpenEvents;
+static uint32_t logOpenEventsN;
+static uint32_t logOpenEventsSize;
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Returns current time of the monotonic clock in msecs.
+static uint64_t log_now(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+/// \brief Opens record $record: a line of session.ndjson file, or an element of an array of session.json file.
+static void log_record_open(FILE *fp, const char *record)
+{
+    if ( logNdjson )
+        fprintf( fp, "{\"record\": \"%s\", ", record );
+    else
+        fputc( '{', fp );
+}
+
+/// \brief Closes a record opened by log_record_open().
+static void log_record_close(FILE *fp)
+{
+    fputs( logNdjson ? "}\n" : "},", fp );
+}
+
+/// \brief Closes current array of session.json file & writes $next ( no-op for session.ndjson file, its records are
+/// put in arrays when session.json is rebuilt ).
+static void log_array_next(const char *next)
+{
+    if ( logNdjson )
+        return;
+
+    removeTrailingCommaFromJson();
+    fputs( next, jsonFilePointer );
+}
+
+/// \brief Flushes events written to session log file, if $force or once $LOG_FLUSH_INTERVAL elapsed since last flush.
+static void log_flush(bool force)
+{
+    uint64_t now = log_now();
+
+    if ( !logUnflushed || ( !force && now - logFlushedAt < LOG_FLUSH_INTERVAL ) )
+        return;
+
+    fflush( jsonFilePointer );
+    logUnflushed = false;
+    logFlushedAt = now;
+    logStats.flushes++;
+}
+
+/// \brief Prints start of an event ( up to its messages' array ) to $fp.
+static void log_print_start(FILE *fp, const char* type, uint32_t server, uint32_t client, const struct timeval *startedAt)
+{
+    char occuredAt[STRFTIME_STR_LEN];
+
+    log_record_open( fp, "event" );
+    fprintf( fp, "\"occured_at\": \"%s\", \"type\": \"%s\", \"server\": \"%u\", \"client\": \"%u\", \"messages\": [",
+            timestamp2ftime( (uint64_t) startedAt->tv_sec, "%H:%M:%S", occuredAt ), type,
+            server, client );
+}
+
+/// \brief Prints $message logged at $savedAt to $fp.
+static void log_print_message(FILE *fp, uint64_t savedAt, const char* action, const Message* message)
+{
+    char savedAtString[STRFTIME_STR_LEN], createdAt[STRFTIME_STR_LEN];
+
+    fprintf( fp, "{\"saved_at\": \"%s\", \"action\": \"%s\", \"sender\": \"%u\", \"recipient\": \"%u\", \"created_at\": \"%s\", \"body\": \"%s\", \"transmitted\": \"%s\", \"transmitted_devices\": \"%s\", \"transmitted_to_recipient\": \"%s\"}",
+     timestamp2ftime( savedAt, "%FT%TZ", savedAtString ), action,
+         message->sender, message->recipient, timestamp2ftime( message->created_at, "%FT%TZ", createdAt ), message->body,
+         message->transmitted == 1 ? "TRUE" : "FALSE", getTransmittedDevicesString( message ),
+         message->transmitted_to_recipient == 1 ? "TRUE" : "FALSE"
+     );
+}
+
+/// \brief Prints datetime syncing logged at $savedAt to $fp.
+static void log_print_datetime(FILE *fp, uint64_t savedAt, uint64_t previous_now, uint64_t new_now)
+{
+    char savedAtString[STRFTIME_STR_LEN], previousNow[STRFTIME_STR_LEN], newNow[STRFTIME_STR_LEN];
+
+    fprintf( fp, "{\"saved_at\": \"%s\", \"action\": \"%s\", \"previous_now\": \"%s\", \"new_now\": \"%s\"}",
+             timestamp2ftime( savedAt, "%FT%TZ", savedAtString ), "datetime",
+             timestamp2ftime( previous_now, "%FT%TZ", previousNow ), timestamp2ftime( new_now, "%FT%TZ", newNow ) );
+}
+
+/// \brief Prints end of an event ( after its messages' array ) to $fp.
+static void log_print_stop(FILE *fp, const struct timeval *startedAt, const struct timeval *stoppedAt)
+{
+    double duration = (double) ( stoppedAt->tv_sec - startedAt->tv_sec ) * 1000 +
+            (double) ( stoppedAt->tv_usec - startedAt->tv_usec ) / 1000;
+
+    fprintf( fp, "], \"duration\": \"%f ms\"", duration );
+    log_record_close( fp );
+}
+
+/// \brief Id of $name in binary log, defined first if new.
+/// \param fp
+/// \param name string literal
+static uint16_t log_binary_name(FILE *fp, const char *name)
+{
+    for ( uint16_t name_i = 0; name_i < logNamesN; name_i++ )
+        if ( name == logNames[name_i] || 0 == strcmp( name, logNames[name_i] ) )
+            return (uint16_t) ( name_i + 1 );
+
+    if ( UINT16_MAX == logNamesN )
+        return 0;
+    const char **names = realloc( logNames, ( logNamesN + 1 ) * sizeof( const char * ) );
+    if ( NULL == names )
+        return 0;
+    logNames = names;
+    logNames[logNamesN++] = name;
+
+    BinlogRecord record = { .kind = BINLOG_NAME, .id = logNamesN };
+    record.data.payload.length = (uint32_t) strlen( name );
+    binlog_write( fp, &record, name );
+
+    return logNamesN;
+}
+
+/// \brief Doubles capacity of the index of bodies written to binary log.
+/// \return FALSE if out of memory
+static bool log_binary_grow(void)
+{
+    uint32_t capacity = 2 * ( logBodies.mask + 1 );
+    MessageIndexEntry *entries = malloc( capacity * sizeof( MessageIndexEntry ) );
+    LogBody *bodiesWritten = realloc( logBodiesWritten, capacity / 2 * sizeof( LogBody ) );
+    MessageIndex bodies;
+
+    if ( NULL == entries || NULL == bodiesWritten )
+    {
+        free( entries );
+        if ( NULL != bodiesWritten )
+            logBodiesWritten = bodiesWritten;
+        return false;
+    }
+    logBodiesWritten = bodiesWritten;
+
+    index_init( &bodies, entries, capacity );
+    for ( uint32_t entry_i = 0; entry_i <= logBodies.mask; entry_i++ )
+        if ( 0 != logBodies.entries[entry_i].slot )
+            index_insert( &bodies, &logBodies.entries[entry_i].key, logBodies.entries[entry_i].slot - 1 );
+
+    free( logBodies.entries );
+    logBodies = bodies;
+
+    return true;
+}
+
+/// \brief Id of body of $message in binary log, defined first if new, & id of its transmitted devices, defined first if
+/// they changed since last written.
+/// \param fp
+/// \param message
+/// \param devices id of devices set, 0 if none ( passed as pointer )
+/// \return id of body, 0 if out of memory
+static uint32_t log_binary_body(FILE *fp, const Message *message, uint32_t *devices)
+{
+    MessageKey key;
+    BinlogRecord record;
+    int32_t body_i;
+    uint64_t devicesHash = 0;
+
+    index_key( &key, message );
+    body_i = index_find( &logBodies, &key );
+    if ( -1 == body_i )
+    {
+        if ( 2 * ( logBodies.length + 1 ) > logBodies.mask + 1 && !log_binary_grow() )
+            return 0;
+
+        body_i = (int32_t) logBodies.length;
+        index_insert( &logBodies, &key, (uint32_t) body_i );
+        logBodiesWritten[body_i].devices_hash = 0;
+        logBodiesWritten[body_i].devices = 0;
+
+        memset( &record, 0, sizeof( BinlogRecord ) );
+        record.kind = BINLOG_BODY;
+        record.id = (uint32_t) body_i + 1;
+        record.at = message->created_at;
+        record.data.body.length = (uint32_t) strnlen( message->body, MESSAGE_BODY_LEN );
+        record.data.body.sender = message->sender;
+        record.data.body.recipient = message->recipient;
+        binlog_write( fp, &record, message->body );
+        logStats.bodies++;
+    }
+
+    // Devices set, unless unchanged ( hash of an empty set is 0, written as none )
+    for ( uint32_t word_i = 0; word_i < MESSAGE_DEVICES_WORDS; word_i++ )
+        devicesHash = ( devicesHash ^ message->transmitted_devices[word_i] ) * 0x100000001b3ULL;
+
+    if ( 0 == devicesHash )
+    {
+        logBodiesWritten[body_i].devices_hash = 0;
+        logBodiesWritten[body_i].devices = 0;
+    }
+    else if ( devicesHash != logBodiesWritten[body_i].devices_hash )
+    {
+        bool range = 0 == strcmp( "range", CLIENT_AEM_SOURCE );
+        uint32_t devicesLength = range ? CLIENT_AEM_RANGE_LENGTH : CLIENT_AEM_LIST_LENGTH;
+        uint32_t aems[MESSAGE_DEVICES_MAX];
+        uint32_t aems_n = 0;
+
+        for ( uint32_t aem_i = 0; aem_i < devicesLength; aem_i++ )
+            if ( bitset_test( message->transmitted_devices, aem_i ) )
+                aems[aems_n++] = range ? CLIENT_AEM_RANGE_MIN + aem_i : CLIENT_AEM_LIST[aem_i];
+
+        memset( &record, 0, sizeof( BinlogRecord ) );
+        record.kind = BINLOG_DEVICES;
+        record.id = ++logDevicesN;
+        record.data.payload.length = aems_n * (uint32_t) sizeof( uint32_t );
+        binlog_write( fp, &record, aems );
+
+        logBodiesWritten[body_i].devices_hash = devicesHash;
+        logBodiesWritten[body_i].devices = logDevicesN;
+    }
+
+    *devices = logBodiesWritten[body_i].devices;
+    return (uint32_t) body_i + 1;
+}
+
+/// \brief Writes start of $event ( of $type, started at $startedAt ) to binary log $fp.
+static void log_binary_start(FILE *fp, uint32_t event, const char* type, uint32_t server, uint32_t client, const struct timeval *startedAt)
+{
+    BinlogRecord record;
+
+    memset( &record, 0, sizeof( BinlogRecord ) );
+    record.kind = BINLOG_START;
+    record.name = log_binary_name( fp, type );
+    record.id = event;
+    record.at = (uint64_t) startedAt->tv_sec * 1000000 + (uint64_t) startedAt->tv_usec;
+    record.data.start.server = server;
+    record.data.start.client = client;
+    binlog_write( fp, &record, NULL );
+}
+
+/// \brief Writes $message of $event, logged at $savedAt, to binary log $fp ( its body only the first time ).
+static void log_binary_message(FILE *fp, uint32_t event, uint64_t savedAt, const char* action, const Message* message)
+{
+    BinlogRecord record;
+    uint32_t devices = 0;
+
+    memset( &record, 0, sizeof( BinlogRecord ) );
+    record.kind = BINLOG_MESSAGE;
+    record.flags = (uint8_t) ( ( 1 == message->transmitted ? BINLOG_TRANSMITTED : 0 ) |
+                               ( 1 == message->transmitted_to_recipient ? BINLOG_TRANSMITTED_TO_RECIPIENT : 0 ) );
+    record.name = log_binary_name( fp, action );
+    record.data.message.body = log_binary_body( fp, message, &devices );
+    record.data.message.devices = devices;
+    record.id = event;
+    record.at = savedAt;
+    binlog_write( fp, &record, NULL );
+}
+
+/// \brief Writes datetime syncing of $event, logged at $savedAt, to binary log $fp.
+static void log_binary_datetime(FILE *fp, uint32_t event, uint64_t savedAt, uint64_t previous_now, uint64_t new_now)
+{
+    BinlogRecord record;
+
+    memset( &record, 0, sizeof( BinlogRecord ) );
+    record.kind = BINLOG_DATETIME;
+    record.id = event;
+    record.at = savedAt;
+    record.data.datetime.previous_now = previous_now;
+    record.data.datetime.new_now = new_now;
+    binlog_write( fp, &record, NULL );
+}
+
+/// \brief Writes end of $event ( stopped at $stoppedAt ) to binary log $fp.
+static void log_binary_stop(FILE *fp, uint32_t event, const struct timeval *stoppedAt)
+{
+    BinlogRecord record;
+
+    memset( &record, 0, sizeof( BinlogRecord ) );
+    record.kind = BINLOG_STOP;
+    record.id = event;
+    record.at = (uint64_t) stoppedAt->tv_sec * 1000000 + (uint64_t) stoppedAt->tv_usec;
+    binlog_write( fp, &record, NULL );
+}
+
+/// \brief Pushes $record to the log ring, for the event of the calling thread. Once a START record is dropped, records
+/// of the same event are dropped too ( so that the writer never sees a part of an event ).
+/// \param record filled but for $event
+static void log_push(LogRecord *record)
+{
+    LogSlot *slot;
+    uint64_t position;
+    int64_t lag;
+
+    if ( LOG_RECORD_START == record->kind )
+    {
+        logEvent = __atomic_add_fetch( &logEventsN, 1, __ATOMIC_RELAXED );
+        logEventDropped = false;
+    }
+    if ( logEventDropped )
+    {
+        __atomic_add_fetch( &logStats.dropped, 1, __ATOMIC_RELAXED );
+        return;
+    }
+
+    // Claim a position ( slot is free once the writer consumed the previous record of it )
+    position = __atomic_load_n( &logRingTail, __ATOMIC_RELAXED );
+    while (1)
+    {
+        slot = &logRing[position & ( LOG_RING_LEN - 1 )];
+        lag = (int64_t) ( __atomic_load_n( &slot->sequence, __ATOMIC_ACQUIRE ) - position );
+        if ( 0 == lag )
+        {
+            if ( __atomic_compare_exchange_n( &logRingTail, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+                break;
+        }
+        else if ( lag < 0 )
+        {
+            // Ring full
+            logEventDropped = LOG_RECORD_START == record->kind;
+            __atomic_add_fetch( &logStats.dropped, 1, __ATOMIC_RELAXED );
+            return;
+        }
+        else
+        {
+            position = __atomic_load_n( &logRingTail, __ATOMIC_RELAXED );
+        }
+    }
+
+    record->event = logEvent;
+    memcpy( &slot->record, record, LOG_RECORD_MESSAGE == record->kind ? sizeof( LogRecord ) : offsetof( LogRecord, message ) );
+    __atomic_store_n( &slot->sequence, position + 1, __ATOMIC_RELEASE );
+    __atomic_add_fetch( &logStats.queued, 1, __ATOMIC_RELAXED );
+}
+
+/// \brief Finds the event the writer assembles with id $event.
+/// \return NULL if event is not open
+static LogOpenEvent *log_open_event(uint32_t event)
+{
+    for ( uint32_t event_i = 0; event_i < logOpenEventsN; event_i++ )
+        if ( event == logOpenEvents[event_i]->event )
+            return logOpenEvents[event_i];
+
+    return NULL;
+}
+
+/// \brief Writes assembled $openEvent to session.json file, as stopped at $stoppedAt, & forgets it.
+static void log_close_event(LogOpenEvent *openEvent, const struct timeval *stoppedAt)
+{
+    log_print_stop( openEvent->stream, &openEvent->started_at, stoppedAt );
+    fclose( openEvent->stream );
+
+    fwrite( openEvent->text, 1, openEvent->length, jsonFilePointer );
+    free( openEvent->text );
+    logStats.events++;
+    logUnflushed = true;
+
+    for ( uint32_t event_i = 0; event_i < logOpenEventsN; event_i++ )
+    {
+        if ( openEvent == logOpenEvents[event_i] )
+        {
+            logOpenEvents[event_i] = logOpenEvents[--logOpenEventsN];
+            break;
+        }
+    }
+    free( openEvent );
+}
+
+/// \brief Formats $record into the event it belongs to ( writer only ).
+static void log_format(const LogRecord *record)
+{
+    LogOpenEvent *openEvent;
+
+    // Binary log: records of events interleave in session.bin too
+    if ( logBinary )
+    {
+        switch ( record->kind )
+        {
+            case LOG_RECORD_START:
+                log_binary_start( jsonFilePointer, record->event, record->name, record->server, record->client, &record->at );
+                break;
+            case LOG_RECORD_MESSAGE:
+                log_binary_message( jsonFilePointer, record->event, record->saved_at, record->name, &record->message );
+                break;
+            case LOG_RECORD_DATETIME:
+                log_binary_datetime( jsonFilePointer, record->event, record->saved_at, record->previous_now, record->new_now );
+                break;
+            default:
+                log_binary_stop( jsonFilePointer, record->event, &record->at );
+                logStats.events++;
+                break;
+        }
+        logUnflushed = true;
+        return;
+    }
+
+    openEvent = log_open_event( record->event );
+
+    if ( LOG_RECORD_START == record->kind )
+    {
+        if ( logOpenEventsN == logOpenEventsSize )
+        {
+            uint32_t openEventsSize = 0 == logOpenEventsSize ? 16 : 2 * logOpenEventsSize;
+            LogOpenEvent **openEvents = realloc( logOpenEvents, openEventsSize * sizeof( LogOpenEvent * ) );
+            if ( NULL == openEvents )
+                return;
+
+            logOpenEvents = openEvents;
+            logOpenEventsSize = openEventsSize;
+        }
+
+        openEvent = malloc( sizeof( LogOpenEvent ) );
+        if ( NULL == openEvent )
+            return;
+        openEvent->stream = open_memstream( &openEvent->text, &openEvent->length );
+        if ( NULL == openEvent->stream )
+        {
+            free( openEvent );
+            return;
+        }
+
+        openEvent->event = record->event;
+        openEvent->started_at = record->at;
+        openEvent->messages_n = 0;
+        logOpenEvents[logOpenEventsN++] = openEvent;
+
+        log_print_start( openEvent->stream, record->name, record->server, record->client, &record->at );
+        return;
+    }
+
+    if ( NULL == openEvent )
+        return;
+
+    switch ( record->kind )
+    {
+        case LOG_RECORD_MESSAGE:
+            if ( openEvent->messages_n++ > 0 )
+                fputc( ',', openEvent->stream );
+            log_print_message( openEvent->stream, record->saved_at, record->name, &record->message );
+            break;
+        case LOG_RECORD_DATETIME:
+            if ( openEvent->messages_n++ > 0 )
+                fputc( ',', openEvent->stream );
+            log_print_datetime( openEvent->stream, record->saved_at, record->previous_now, record->new_now );
+            break;
+        default:
+            log_close_event( openEvent, &record->at );
+            break;
+    }
+}
+
+/// \brief Formats up to $LOG_BATCH_MAX records of the log ring ( writer only ).
+/// \return no. of records formatted
+static uint32_t log_drain(void)
+{
+    uint32_t records_n = 0;
+
+    while ( records_n < LOG_BATCH_MAX )
+    {
+        LogSlot *slot = &logRing[logRingHead & ( LOG_RING_LEN - 1 )];
+        if ( __atomic_load_n( &slot->sequence, __ATOMIC_ACQUIRE ) != logRingHead + 1 )
+            break;
+
+        log_format( &slot->record );
+        __atomic_store_n( &slot->sequence, logRingHead + LOG_RING_LEN, __ATOMIC_RELEASE );
+        logRingHead++;
+        records_n++;
+    }
+
+    logStats.written += records_n;
+    log_flush( false );
+
+    return records_n;
+}
+
+/// \brief Log writer thread. Formats queued records in batches & flushes them every $LOG_FLUSH_INTERVAL msecs ( or once
+/// the ring is empty ), until log_tearDown() & the ring is drained.
+static void *log_writer_worker(void *arg)
+{
+    struct timespec idle = { 0, LOG_WRITER_IDLE * 1000000L };
+
+    (void) arg;
+    while (1)
+    {
+        if ( 0 < log_drain() )
+            continue;
+
+        log_flush( true );
+        if ( !__atomic_load_n( &logWriterRunning, __ATOMIC_ACQUIRE ) )
+            break;
+
+        nanosleep( &idle, NULL );
+    }
+
+    return NULL;
+}
 
 /// \brief Logs the start of a new event in session.json file
 /// \param type
@@ -29,11 +572,32 @@ struct timeval lastEventStart, lastEventStop;
 /// \param client
 void log_event_start( const char* type, uint32_t server, uint32_t client )
 {
-    gettimeofday( &lastEventStart, NULL );
+    struct timeval now;
+    gettimeofday( &now, NULL );
 
-    fprintf( jsonFilePointer, "{\"occured_at\": \"%s\", \"type\": \"%s\", \"server\": \"%u\", \"client\": \"%u\", \"messages\": [",
-            timestamp2ftime( (uint64_t) time(NULL), "%H:%M:%S" ), type,
-            server, client );
+    log_event_start_at( type, server, client, &now );
+}
+
+/// \brief Logs the start of a new event that actually started at $startedAt in session.json file
+/// \param type
+/// \param server
+/// \param client
+/// \param startedAt
+void log_event_start_at( const char* type, uint32_t server, uint32_t client, const struct timeval *startedAt )
+{
+    if ( logAsync )
+    {
+        LogRecord record = { .kind = LOG_RECORD_START, .at = *startedAt, .name = type, .server = server, .client = client };
+        log_push( &record );
+        return;
+    }
+
+    lastEventStart = *startedAt;
+    lastEventMessagesN = 0;
+    if ( logBinary )
+        log_binary_start( jsonFilePointer, ++logEventsN, type, server, client, startedAt );
+    else
+        log_print_start( jsonFilePointer, type, server, client, startedAt );
 }
 
 /// \brief Logs $message to session.json file
@@ -41,12 +605,23 @@ void log_event_start( const char* type, uint32_t server, uint32_t client )
 /// \param message
 void log_event_message( const char* action, const Message* message )
 {
-    fprintf( jsonFilePointer, "{\"saved_at\": \"%s\", \"action\": \"%s\", \"sender\": \"%u\", \"recipient\": \"%u\", \"created_at\": \"%s\", \"body\": \"%s\", \"transmitted\": \"%s\", \"transmitted_devices\": \"%s\", \"transmitted_to_recipient\": \"%s\"},",
-     timestamp2ftime( (uint64_t) time(NULL), "%FT%TZ" ), action,
-         message->sender, message->recipient, timestamp2ftime( message->created_at, "%FT%TZ" ), message->body,
-         message->transmitted == 1 ? "TRUE" : "FALSE", getTransmittedDevicesString( message ),
-         message->transmitted_to_recipient == 1 ? "TRUE" : "FALSE"
-     );
+    if ( logAsync )
+    {
+        LogRecord record = { .kind = LOG_RECORD_MESSAGE, .saved_at = (uint64_t) time(NULL), .name = action };
+        record.message = *message;
+        log_push( &record );
+        return;
+    }
+
+    if ( logBinary )
+    {
+        log_binary_message( jsonFilePointer, logEventsN, (uint64_t) time(NULL), action, message );
+        return;
+    }
+
+    if ( lastEventMessagesN++ > 0 )
+        fputc( ',', jsonFilePointer );
+    log_print_message( jsonFilePointer, (uint64_t) time(NULL), action, message );
 }
 
 /// \brief Logs datetime syncing to session.json file
@@ -54,27 +629,96 @@ void log_event_message( const char* action, const Message* message )
 /// \param new_now
 void log_event_message_datetime( uint64_t previous_now, uint64_t new_now )
 {
-    fprintf( jsonFilePointer, "{\"saved_at\": \"%s\", \"action\": \"%s\", \"previous_now\": \"%s\", \"new_now\": \"%s\"},",
-             timestamp2ftime( (uint64_t) time(NULL), "%FT%TZ" ), "datetime",
-             timestamp2ftime( previous_now, "%FT%TZ" ), timestamp2ftime( new_now, "%FT%TZ" ) );
+    if ( logAsync )
+    {
+        LogRecord record = { .kind = LOG_RECORD_DATETIME, .saved_at = (uint64_t) time(NULL), .previous_now = previous_now, .new_now = new_now };
+        log_push( &record );
+        return;
+    }
+
+    if ( logBinary )
+    {
+        log_binary_datetime( jsonFilePointer, logEventsN, (uint64_t) time(NULL), previous_now, new_now );
+        return;
+    }
+
+    if ( lastEventMessagesN++ > 0 )
+        fputc( ',', jsonFilePointer );
+    log_print_datetime( jsonFilePointer, (uint64_t) time(NULL), previous_now, new_now );
 }
 
 /// \brief Logs the end of a new event in session.json file
 void log_event_stop(void)
 {
+    if ( logAsync )
+    {
+        LogRecord record = { .kind = LOG_RECORD_STOP };
+        gettimeofday( &record.at, NULL );
+        log_push( &record );
+        return;
+    }
+
     gettimeofday( &lastEventStop, NULL );
 
-    double duration = (double) ( lastEventStop.tv_sec - lastEventStart.tv_sec ) * 1000 +
-            (double) ( lastEventStop.tv_usec - lastEventStart.tv_usec ) / 1000;
+    if ( logBinary )
+        log_binary_stop( jsonFilePointer, logEventsN, &lastEventStop );
+    else
+        log_print_stop( jsonFilePointer, &lastEventStart, &lastEventStop );
+    logUnflushed = true;
+    log_flush( false );
+}
 
-    removeTrailingCommaFromJson();
-    fprintf( jsonFilePointer, "], \"duration\": \"%f ms\"},", duration );
+/// \brief Takes $logEventLock, so that the calls of an event are written together. No-op if log is asynchronous (
+/// records of events are queued & the writer thread assembles each event ).
+/// \param block if FALSE, gives up when $logEventLock is held by another thread
+/// \return FALSE if lock is held by another thread, TRUE else
+bool log_lock(bool block)
+{
+    if ( logAsync )
+        return true;
+
+    if ( block )
+        return 0 == pthread_mutex_lock( &logEventLock );
+
+    return 0 == pthread_mutex_trylock( &logEventLock );
+}
+
+/// \brief Releases $logEventLock taken by log_lock().
+void log_unlock(void)
+{
+    if ( !logAsync )
+        pthread_mutex_unlock( &logEventLock );
 }
 
 /// Append end of session message and closes log file pointer.
 /// \param executionTimeRequested
 void log_tearDown(const double executionTimeActual)
 {
+    char start[STRFTIME_STR_LEN], end[STRFTIME_STR_LEN], createdAt[STRFTIME_STR_LEN], savedAt[STRFTIME_STR_LEN];
+    MessagesStats messagesStats;
+    SessionStats sessionStats;
+    DiscoveryStats discoveryStats;
+
+    // Stop writer thread ( it drains the ring first ) & write events left open ( their STOP record was dropped )
+    if ( logAsync )
+    {
+        __atomic_store_n( &logWriterRunning, false, __ATOMIC_RELEASE );
+        pthread_join( logWriterThread, NULL );
+
+        struct timeval now;
+        gettimeofday( &now, NULL );
+        while ( logOpenEventsN > 0 )
+            log_close_event( logOpenEvents[0], &now );
+
+        free( logOpenEvents );
+        logOpenEvents = NULL;
+        logOpenEventsSize = 0;
+    }
+
+    stats_messages( &messagesStats );
+    stats_sessions( &sessionStats );
+    stats_discovery( &discoveryStats );
+
     if ( ALSO_LOG_TO_STDOUT )
     {
         fprintf(stdout, "\n/*\n"
@@ -86,112 +730,224 @@ void log_tearDown(const double executionTimeActual)
                         "| Duration Requested  : %u secs\n"
                         "| Devices Connected   : %d\n"
                         "|\n"
-                        "| Messages Produced   : %u ( avg. delay = %.03f min )\n"
-                        "| Messages Received   : %u (for me: %u)\n"
-                        "| Messages Transmitted: %u (to recipient: %u)\n"
+                        "| Messages Produced   : %llu ( avg. delay = %.03f min )\n"
+                        "| Messages Received   : %llu (for me: %llu)\n"
+                        "| Messages Transmitted: %llu (to recipient: %llu)\n"
+                        "| Messages Purged     : %llu ( delivered )\n"
+                        "| Messages Buffered   : %lld ( sessions active: %lld )\n"
                         "|\n"
-                        "*/\n\n\n",
+                        "| Polling Rounds      : %u ( avg. duration = %.0f ms )\n"
+                        "| Polling Hits        : %u / %u ( timeouts: %u )\n"
+                        "| Beacons Sent        : %llu (heard: %llu, dialed: %llu)\n"
+                        "| Sessions Run        : %u ( utilisation = %.1f %%, queue full: %u )\n"
+                        "| Sessions Queue Wait : %.2f ms avg. ( max = %.2f ms )\n"
+                        "| Sessions Wire Bytes : %llu sent, %llu received ( socket syscalls: %llu, malformed messages: %llu )\n"
+                        "| Sessions Summarized : %llu / %llu ( messages examined: %llu, skipped: %llu, receipts: %llu )\n"
+                        "| Log Records         : %llu queued, %llu dropped ( events: %u, flushes: %u, bodies: %u )\n"
+                        "|\n",
                 executionTimeActual, executionTimeRequested, 0,
-                messagesStats.produced, messagesStats.producedDelayAvg,
-                messagesStats.received, messagesStats.received_for_me,
-                messagesStats.transmitted, messagesStats.transmitted_to_recipient );
+                (unsigned long long) messagesStats.produced, messagesStats.producedDelayAvg,
+                (unsigned long long) messagesStats.received, (unsigned long long) messagesStats.received_for_me,
+                (unsigned long long) messagesStats.transmitted, (unsigned long long) messagesStats.transmitted_to_recipient,
+                (unsigned long long) messagesStats.purged,
+                (long long) messagesStats.buffered, (long long) sessionStats.active,
+                pollingStats.rounds, pollingStats.roundDurationAvg,
+                pollingStats.hits, pollingStats.attempts, pollingStats.timeouts,
+                (unsigned long long) discoveryStats.beacons_sent, (unsigned long long) discoveryStats.beacons_heard,
+                (unsigned long long) discoveryStats.peers_dialed,
+                poolStats.jobs, 100.0 * pool_utilisation(), poolStats.backpressured,
+                poolStats.queueWaitAvg, poolStats.queueWaitMax,
+                (unsigned long long) sessionStats.bytes_sent, (unsigned long long) sessionStats.bytes_received,
+                (unsigned long long) sessionStats.syscalls, (unsigned long long) sessionStats.rejected,
+                (unsigned long long) sessionStats.summarized, (unsigned long long) sessionStats.sessions,
+                (unsigned long long) sessionStats.examined, (unsigned long long) sessionStats.skipped,
+                (unsigned long long) sessionStats.receipts,
+                (unsigned long long) logStats.queued, (unsigned long long) logStats.dropped, logStats.events, logStats.flushes,
+                logStats.bodies );
+        latency_print( stdout );
+        fprintf( stdout, "|\n*/\n\n\n" );
     }
 
-    removeTrailingCommaFromJson();
-    fprintf( jsonFilePointer, "], \"duration\": \"%f s\", \"end\": \"%s\", \"stats\": { \"produced\": \"%d\", \"received\": \"%d\", \"received_for_me\": \"%d\", \"transmitted\": \"%d\", \"transmitted_to_recipient\": \"%d\", \"producedDelayAvg\": \"%.2fmin\", \"devices\": [",
-            executionTimeActual, timestamp2ftime( (uint64_t) time(NULL), "%FT%TZ" ),
-            messagesStats.produced, messagesStats.received, messagesStats.received_for_me,
-            messagesStats.transmitted, messagesStats.transmitted_to_recipient, messagesStats.producedDelayAvg );
+    // Binary log ends with the records of session.ndjson that follow the events, in a TEXT record
+    FILE *logFilePointer = jsonFilePointer;
+    char *logTail = NULL;
+    size_t logTailLength = 0;
+    if ( logBinary )
+    {
+        jsonFilePointer = open_memstream( &logTail, &logTailLength );
+        if ( NULL == jsonFilePointer )
+            error( errno, "\tlog_tearDown(): open_memstream() failed" );
+    }
 
-    // Inspect connections
+    if ( logNdjson )
+        log_record_open( jsonFilePointer, "end" );
+    else
+        log_array_next( "], " );
+    fprintf( jsonFilePointer, "\"duration\": \"%f s\", \"end\": \"%s\", \"stats\": { \"produced\": \"%llu\", \"received\": \"%llu\", \"received_for_me\": \"%llu\", \"transmitted\": \"%llu\", \"transmitted_to_recipient\": \"%llu\", \"purged\": \"%llu\", \"producedDelayAvg\": \"%.2fmin\", \"polling\": { \"rounds\": \"%u\", \"round_duration_avg\": \"%.0fms\", \"attempts\": \"%u\", \"hits\": \"%u\", \"timeouts\": \"%u\" }, \"discovery\": { \"beacons_sent\": \"%llu\", \"beacons_heard\": \"%llu\", \"peers_dialed\": \"%llu\" }, \"pool\": { \"jobs\": \"%u\", \"utilisation\": \"%.3f\", \"backpressured\": \"%u\", \"queue_wait_avg\": \"%.2fms\", \"queue_wait_max\": \"%.2fms\" }, \"sessions\": { \"closed\": \"%llu\", \"summarized\": \"%llu\", \"examined\": \"%llu\", \"skipped\": \"%llu\", \"receipts\": \"%llu\", \"bytes_sent\": \"%llu\", \"bytes_received\": \"%llu\", \"syscalls\": \"%llu\", \"rejected\": \"%llu\" }, \"log\": { \"format\": \"%s\", \"mode\": \"%s\", \"queued\": \"%llu\", \"dropped\": \"%llu\", \"events\": \"%u\", \"flushes\": \"%u\", \"bodies\": \"%u\" }, \"latency\": ",
+            executionTimeActual, timestamp2ftime( (uint64_t) time(NULL), "%FT%TZ", end ),
+            (unsigned long long) messagesStats.produced, (unsigned long long) messagesStats.received,
+            (unsigned long long) messagesStats.received_for_me, (unsigned long long) messagesStats.transmitted,
+            (unsigned long long) messagesStats.transmitted_to_recipient, (unsigned long long) messagesStats.purged,
+            messagesStats.producedDelayAvg,
+            pollingStats.rounds, pollingStats.roundDurationAvg, pollingStats.attempts, pollingStats.hits, pollingStats.timeouts,
+            (unsigned long long) discoveryStats.beacons_sent, (unsigned long long) discoveryStats.beacons_heard,
+            (unsigned long long) discoveryStats.peers_dialed,
+            poolStats.jobs, pool_utilisation(), poolStats.backpressured, poolStats.queueWaitAvg, poolStats.queueWaitMax,
+            (unsigned long long) sessionStats.sessions, (unsigned long long) sessionStats.summarized,
+            (unsigned long long) sessionStats.examined, (unsigned long long) sessionStats.skipped,
+            (unsigned long long) sessionStats.receipts, (unsigned long long) sessionStats.bytes_sent,
+            (unsigned long long) sessionStats.bytes_received, (unsigned long long) sessionStats.syscalls,
+            (unsigned long long) sessionStats.rejected,
+            logFormat, logMode, (unsigned long long) logStats.queued, (unsigned long long) logStats.dropped, logStats.events,
+            logStats.flushes, logStats.bodies );
+    latency_dump( jsonFilePointer );
+    fputs( logNdjson ? "}}\n" : ", \"devices\": [", jsonFilePointer );
+
+    // Inspect connections: stats of the contacts with each device & its most recent contacts
     if ( ALSO_LOG_TO_STDOUT )
         fprintf( stdout, "\n\n-------------------- start: DEVICES INSPECTION --------------------\n" );
 
-    for ( uint32_t device_i = 0; device_i < CLIENT_AEM_LIST_LENGTH; device_i++ )
+    bool range = 0 == strcmp( "range", CLIENT_AEM_SOURCE );
+    uint32_t devicesLength = range ? CLIENT_AEM_RANGE_LENGTH : CLIENT_AEM_LIST_LENGTH;
+    Contact recent[CONTACTS_RECENT_LEN > 0 ? CONTACTS_RECENT_LEN : 1];
+
+    for ( uint32_t device_i = 0; device_i < devicesLength; device_i++ )
     {
-        uint32_t aem = CLIENT_AEM_LIST[device_i];
+        uint32_t aem = range ? CLIENT_AEM_RANGE_MIN + device_i : CLIENT_AEM_LIST[device_i];
+        const ContactStats *contacts = contacts_stats( (int32_t) device_i );
 
+        if ( 0 == contacts->count )
+            continue;
+
+        double averageDuration = (double) contacts->sum / (double) contacts->count * 1e-3;
         if ( ALSO_LOG_TO_STDOUT )
-            fprintf( stdout, "\t- %04d\n", aem );
+            fprintf( stdout, "\t- %04d: %u contacts ( duration: avg. %.2fms, min %.2fms, max %.2fms )\n", aem,
+                     contacts->count, averageDuration, (double) contacts->min * 1e-3, (double) contacts->max * 1e-3 );
+
+        log_record_open( jsonFilePointer, "device" );
+        fprintf( jsonFilePointer, "\"aem\": \"%04d\", \"contacts\": \"%u\", \"connections\": [", aem, contacts->count );
 
-        if ( 0 < CLIENT_AEM_CONN_N_LIST[device_i] )
+        uint32_t recent_n = contacts_recent( aem, recent, CONTACTS_RECENT_LEN );
+        for ( uint32_t contact_i = 0; contact_i < recent_n; contact_i++ )
         {
-            fprintf( jsonFilePointer, "{ \"aem\": \"%04d\", \"connections\": [", aem );
-
-            double averageDuration = 0.0;
-            for ( uint8_t n = 0; n < CLIENT_AEM_CONN_N_LIST[device_i]; n++ )
-            {
-                double duration = (double)( CLIENT_AEM_CONN_END_LIST[device_i][n].tv_sec - CLIENT_AEM_CONN_START_LIST[device_i][n].tv_sec ) * 1e3 +
-                        (double)( CLIENT_AEM_CONN_END_LIST[device_i][n].tv_usec - CLIENT_AEM_CONN_START_LIST[device_i][n].tv_usec ) * 1e-3;
-
-                if ( ALSO_LOG_TO_STDOUT )
-                    fprintf( stdout, "\t\t start: %lf | end %lf ( duration: %lfms )\n",
-                        CLIENT_AEM_CONN_START_LIST[device_i][n].tv_sec + CLIENT_AEM_CONN_START_LIST[device_i][n].tv_usec * 1e-6,
-                        CLIENT_AEM_CONN_END_LIST[device_i][n].tv_sec + CLIENT_AEM_CONN_END_LIST[device_i][n].tv_usec * 1e-6,
-                        duration
-                    );
-
-                fprintf( jsonFilePointer, "{\"start\": \"%s.%03d\", \"end\": \"%s.%03d\", \"duration\": \"%.2fms\" },",
-                    timestamp2ftime( CLIENT_AEM_CONN_START_LIST[device_i][n].tv_sec, "%H:%M:%S" ), (int)(CLIENT_AEM_CONN_START_LIST[device_i][n].tv_usec * 1e-3),
-                    timestamp2ftime( CLIENT_AEM_CONN_END_LIST[device_i][n].tv_sec, "%H:%M:%S" ), (int)(CLIENT_AEM_CONN_END_LIST[device_i][n].tv_usec * 1e-3),
+            const Contact *contact = &recent[contact_i];
+            double duration = (double)( contact->end.tv_sec - contact->start.tv_sec ) * 1e3 +
+                    (double)( contact->end.tv_usec - contact->start.tv_usec ) * 1e-3;
+
+            if ( ALSO_LOG_TO_STDOUT )
+                fprintf( stdout, "\t\t start: %lf | end %lf ( duration: %lfms )\n",
+                    contact->start.tv_sec + contact->start.tv_usec * 1e-6, contact->end.tv_sec + contact->end.tv_usec * 1e-6,
                     duration
                 );
 
-                averageDuration += duration;
-            }
-
-            removeTrailingCommaFromJson();
-            fprintf( jsonFilePointer, "], \"average_duration\": \"%.2fms\"},", averageDuration / (double) CLIENT_AEM_CONN_N_LIST[device_i] );
+            fprintf( jsonFilePointer, "%s{\"start\": \"%s.%03d\", \"end\": \"%s.%03d\", \"duration\": \"%.2fms\" }", contact_i > 0 ? "," : "",
+                timestamp2ftime( contact->start.tv_sec, "%H:%M:%S", start ), (int)(contact->start.tv_usec * 1e-3),
+                timestamp2ftime( contact->end.tv_sec, "%H:%M:%S", end ), (int)(contact->end.tv_usec * 1e-3),
+                duration
+            );
         }
+
+        // Histogram, up to its last bucket that is not empty
+        uint32_t buckets_n = CONTACTS_HISTOGRAM_LEN;
+        while ( buckets_n > 1 && 0 == contacts->histogram[buckets_n - 1] )
+            buckets_n--;
+
+        fprintf( jsonFilePointer, "], \"average_duration\": \"%.2fms\", \"min_duration\": \"%.2fms\", \"max_duration\": \"%.2fms\", \"durations_histogram\": [",
+                 averageDuration, (double) contacts->min * 1e-3, (double) contacts->max * 1e-3 );
+        for ( uint32_t bucket_i = 0; bucket_i < buckets_n; bucket_i++ )
+            fprintf( jsonFilePointer, "%s%u", bucket_i > 0 ? ", " : "", contacts->histogram[bucket_i] );
+        fputc( ']', jsonFilePointer );
+        log_record_close( jsonFilePointer );
     }
 
     if ( ALSO_LOG_TO_STDOUT )
         fprintf( stdout, "\n-------------------- end: DEVICES INSPECTION --------------------\n\n" );
 
     // Finalize & close json file pointer
-    removeTrailingCommaFromJson();
-    fprintf( jsonFilePointer, "], \"buffer_messages\": [" );
+    log_array_next( "], \"buffer_messages\": [" );
 
     for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
     {
-        Message message = MESSAGES_BUFFER[message_i];
-        if ( 0 == message.created_at ) continue;
+        if ( 0 == messages_header( message_i )->created_at ) continue;
+
+        Message message;
+        messages_get( message_i, &message );
 
-        fprintf( jsonFilePointer, "{\"sender\": \"%u\", \"recipient\": \"%u\", \"created_at\": \"%s\", \"body\": \"%s\"},",
-             message.sender, message.recipient, timestamp2ftime( message.created_at, "%FT%TZ" ), message.body
+        log_record_open( jsonFilePointer, "buffer_message" );
+        fprintf( jsonFilePointer, "\"sender\": \"%u\", \"recipient\": \"%u\", \"created_at\": \"%s\", \"body\": \"%s\"",
+             message.sender, message.recipient, timestamp2ftime( message.created_at, "%FT%TZ", createdAt ), message.body
          );
+        log_record_close( jsonFilePointer );
     }
 
-    removeTrailingCommaFromJson();
-    fprintf( jsonFilePointer, "], \"inbox_messages\": [" );
+    log_array_next( "], \"inbox_messages\": [" );
 
-    for (uint16_t inbox_message_i = 0; inbox_message_i < inboxHead; inbox_message_i++ )
+    for (uint16_t inbox_message_i = 0; inbox_message_i < INBOX_SIZE; inbox_message_i++ )
     {
-        #define inboxMessage INBOX[inbox_message_i]
+        #define inboxMessage INBOX[( inboxHead + inbox_message_i ) % INBOX_SIZE]
         if ( 0 == inboxMessage.created_at ) continue;
 
-        fprintf( jsonFilePointer, "{\"sender\": \"%u\", \"created_at\": \"%s\", \"saved_at\": \"%s\", \"body\": \"%s\", \"first_sender\": \"%u\"},",
+        log_record_open( jsonFilePointer, "inbox_message" );
+        fprintf( jsonFilePointer, "\"sender\": \"%u\", \"created_at\": \"%s\", \"saved_at\": \"%s\", \"body\": \"%s\", \"first_sender\": \"%u\"",
                  inboxMessage.sender,
-                 timestamp2ftime( inboxMessage.created_at, "%FT%TZ" ),
-                 timestamp2ftime( inboxMessage.saved_at, "%FT%TZ" ),
+                 timestamp2ftime( inboxMessage.created_at, "%FT%TZ", createdAt ),
+                 timestamp2ftime( inboxMessage.saved_at, "%FT%TZ", savedAt ),
                  inboxMessage.body, inboxMessage.first_sender
         );
+        log_record_close( jsonFilePointer );
     }
 
-    removeTrailingCommaFromJson();
-    fprintf( jsonFilePointer, "]}}" );
+    log_array_next( "]}}" );
     fclose( jsonFilePointer );
+
+    if ( logBinary )
+    {
+        BinlogRecord record = { .kind = BINLOG_TEXT };
+        record.data.payload.length = (uint32_t) logTailLength;
+        binlog_write( logFilePointer, &record, logTail );
+        fclose( logFilePointer );
+        free( logTail );
+
+        free( logNames );
+        free( logBodies.entries );
+        free( logBodiesWritten );
+        logNames = NULL;
+        logBodies.entries = NULL;
+        logBodiesWritten = NULL;
+    }
+
+    // Rebuild session.json file from session log ( binary log is exported by session2json tool )
+    if ( logNdjson && !logBinary && -1 == ndjson_rebuild( logFileName, logJsonFileName ) )
+        perror( "\tlog_tearDown(): ndjson_rebuild() failed" );
 }
 
 /// Creates / Opens file and add the new session messages
 /// \param jsonFileName
 void log_tearUp(const char *jsonFileName)
 {
+    // Session log is appended to session.ndjson / session.bin file ( next to session.json file ), or written in place to
+    // session.json file ( needs reading back, to remove trailing commas )
+    logBinary = 0 == strcmp( "binary", logFormat );
+    logNdjson = logBinary || 0 == strcmp( "ndjson", logFormat );
+    snprintf( logJsonFileName, FILENAME_MAX, "%s", jsonFileName );
+    snprintf( logFileName, FILENAME_MAX, "%s", jsonFileName );
+    if ( logNdjson )
+    {
+        size_t nameLength = strlen( jsonFileName );
+        if ( nameLength >= 5 && 0 == strcmp( ".json", jsonFileName + nameLength - 5 ) )
+            nameLength -= 5;
+        snprintf( logFileName, FILENAME_MAX, "%.*s.%s", (int) nameLength, jsonFileName, logBinary ? "bin" : "ndjson" );
+    }
+
     // Check if session.json file exists
-    remove( jsonFileName );
-    jsonFilePointer = fopen( jsonFileName, "w+" );
+    remove( logFileName );
+    jsonFilePointer = fopen( logFileName, logNdjson ? "a" : "w+" );
+    if ( NULL == jsonFilePointer )
+        error( errno, "\tlog_tearUp(): fopen() failed" );
 
-    const char* nowAsString = timestamp2ftime( (uint64_t) time(NULL), "%FT%TZ" );
+    uint64_t now = (uint64_t) time(NULL);
+    char nowAsString[STRFTIME_STR_LEN];
+    timestamp2ftime( now, "%FT%TZ", nowAsString );
 
     if ( ALSO_LOG_TO_STDOUT )
     {
@@ -204,12 +960,51 @@ void log_tearUp(const char *jsonFileName)
                              "| Client  : %s\n"
                              "| FileName: %s\n"
                              "|\n"
-                             "*/\n\n", nowAsString, aem2ip( CLIENT_AEM ), jsonFileName );
+                             "*/\n\n", nowAsString, aem2ip( CLIENT_AEM ), logFileName );
     }
 
     // JSON file start
-    fprintf( jsonFilePointer, "{\"start\": \"%s\", \"client_aem\": \"%d\", \"requested_duration\":\"%u secs\", \"events\": [",
-            nowAsString, CLIENT_AEM, executionTimeRequested );
+    if ( logBinary )
+    {
+        BinlogRecord record = { .kind = BINLOG_SESSION, .id = BINLOG_MAGIC, .at = now };
+        record.data.session.client_aem = CLIENT_AEM;
+        record.data.session.requested_duration = executionTimeRequested;
+        binlog_write( jsonFilePointer, &record, NULL );
+
+        // Nothing written yet
+        logNamesN = 0;
+        logDevicesN = 0;
+        logBodiesWritten = malloc( LOG_BODIES_LEN / 2 * sizeof( LogBody ) );
+        MessageIndexEntry *bodiesEntries = malloc( LOG_BODIES_LEN * sizeof( MessageIndexEntry ) );
+        if ( NULL == logBodiesWritten || NULL == bodiesEntries )
+            error( ENOMEM, "\tlog_tearUp(): malloc() failed" );
+        index_init( &logBodies, bodiesEntries, LOG_BODIES_LEN );
+    }
+    else
+    {
+        log_record_open( jsonFilePointer, "session" );
+        fprintf( jsonFilePointer, "\"start\": \"%s\", \"client_aem\": \"%d\", \"requested_duration\":\"%u secs\"%s",
+                nowAsString, CLIENT_AEM, executionTimeRequested, logNdjson ? "}\n" : ", \"events\": [" );
+    }
+    fflush( jsonFilePointer );
+    logUnflushed = false;
+    logFlushedAt = log_now();
+
+    // Start writer thread ( asynchronous log )
+    logAsync = 0 == strcmp( "async", logMode );
+    memset( &logStats, 0, sizeof( LogStats ) );
+    if ( logAsync )
+    {
+        for ( uint32_t slot_i = 0; slot_i < LOG_RING_LEN; slot_i++ )
+            logRing[slot_i].sequence = slot_i;
+        logRingTail = 0;
+        logRingHead = 0;
+
+        logWriterRunning = true;
+        int status = pthread_create( &logWriterThread, NULL, log_writer_worker, NULL );
+        if ( status != 0 )
+            error( status, "\tlog_tearUp(): pthread_create( logWriterThread ) failed" );
+    }
 }
 
 /// \brief Removes last character from session.json file
@@ -0,0 +1,162 @@
+#include "ndjson.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+//------------------------------------------------------------------------------------------------
+
+// Records of session log, in the order they are logged ( index of section of session.json they belong to )
+#define NDJSON_SESSION 0
+#define NDJSON_EVENT 1
+#define NDJSON_END 2
+#define NDJSON_DEVICE 3
+#define NDJSON_BUFFER_MESSAGE 4
+#define NDJSON_INBOX_MESSAGE 5
+
+static const char *ndjsonRecords[] = { "session", "event", "end", "device", "buffer_message", "inbox_message" };
+
+// Arrays of session.json opened after "end" record, by section
+static const char *ndjsonArrays[] = { "", "", "", ", \"devices\": [", "], \"buffer_messages\": [", "], \"inbox_messages\": [" };
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Finds section of record at $line ( '{"record": "<name>", <fields>}' ).
+/// \param line
+/// \param fields first of the fields that follow record's name ( passed as pointer )
+/// \return section, -1 if line is not a record
+static int32_t ndjson_section(const char *line, const char **fields)
+{
+    static const char prefix[] = "{\"record\": \"";
+    const char *name = line + sizeof( prefix ) - 1;
+    const char *nameEnd;
+
+    if ( 0 != strncmp( line, prefix, sizeof( prefix ) - 1 ) )
+        return -1;
+
+    nameEnd = strchr( name, '"' );
+    if ( NULL == nameEnd || 0 != strncmp( nameEnd, "\", ", 3 ) )
+        return -1;
+
+    for ( int32_t section = NDJSON_SESSION; section <= NDJSON_INBOX_MESSAGE; section++ )
+    {
+        if ( strlen( ndjsonRecords[section] ) == (size_t) ( nameEnd - name ) &&
+             0 == strncmp( name, ndjsonRecords[section], (size_t) ( nameEnd - name ) ) )
+        {
+            *fields = nameEnd + 3;
+            return section;
+        }
+    }
+
+    return -1;
+}
+
+/// \brief Rebuilds session.json document from session log $in, to $out ( see ndjson_rebuild() ).
+/// \param in
+/// \param out
+/// \return no. of events rebuilt, -1 if there is no "session" record
+int32_t ndjson_rebuild_stream(FILE *in, FILE *out)
+{
+    char *line = NULL;
+    size_t lineSize = 0;
+    ssize_t length;
+    const char *fields;
+    int32_t section = -1, events_n = 0;
+    uint32_t items_n = 0;
+
+    while ( ( length = getline( &line, &lineSize, in ) ) > 0 )
+    {
+        // Last line of a log cut short
+        if ( '\n' != line[length - 1] )
+            break;
+        line[--length] = '\0';
+
+        int32_t lineSection = ndjson_section( line, &fields );
+        size_t fieldsLength = (size_t) ( line + length - fields );
+        if ( lineSection < 0 || fieldsLength < 2 )
+            continue;
+
+        switch ( lineSection )
+        {
+            case NDJSON_SESSION:
+                if ( -1 != section )
+                    continue;
+
+                // Session's fields, then events' array
+                fputc( '{', out );
+                fwrite( fields, 1, fieldsLength - 1, out );
+                fputs( ", \"events\": [", out );
+                break;
+
+            case NDJSON_END:
+                if ( NDJSON_EVENT < section || -1 == section )
+                    continue;
+
+                // Session's duration & stats, then devices' array ( inside stats )
+                fputs( "], ", out );
+                fwrite( fields, 1, fieldsLength - 2, out );
+                break;
+
+            default:
+                if ( ( NDJSON_EVENT == lineSection && NDJSON_EVENT < section ) || -1 == section ||
+                     ( NDJSON_EVENT < lineSection && ( section < NDJSON_END || lineSection < section ) ) )
+                    continue;
+
+                for ( ; section < lineSection; section++, items_n = 0 )
+                    fputs( ndjsonArrays[section + 1], out );
+
+                if ( items_n++ > 0 )
+                    fputc( ',', out );
+                fputc( '{', out );
+                fwrite( fields, 1, fieldsLength, out );
+                events_n += NDJSON_EVENT == lineSection ? 1 : 0;
+                break;
+        }
+
+        section = lineSection;
+    }
+
+    // Close arrays & objects left open
+    if ( NDJSON_END <= section )
+    {
+        for ( ; section < NDJSON_INBOX_MESSAGE; section++ )
+            fputs( ndjsonArrays[section + 1], out );
+        fputs( "]}}", out );
+    }
+    else if ( -1 != section )
+    {
+        fputs( "]}", out );
+    }
+
+    free( line );
+
+    return -1 == section ? -1 : events_n;
+}
+
+/// \brief Rebuilds session.json document $jsonFileName from session log $ndjsonFileName: a "session" record, "event"
+/// records, then an "end" record followed by "device", "buffer_message" & "inbox_message" records. A log cut short (
+/// session killed ) yields the events logged so far; a last line without its newline is skipped.
+/// \param ndjsonFileName
+/// \param jsonFileName
+/// \return no. of events rebuilt, -1 on error ( files, or no "session" record )
+int32_t ndjson_rebuild(const char *ndjsonFileName, const char *jsonFileName)
+{
+    FILE *in, *out;
+    int32_t events_n;
+
+    in = fopen( ndjsonFileName, "r" );
+    if ( NULL == in )
+        return -1;
+
+    out = fopen( jsonFileName, "w" );
+    if ( NULL == out )
+    {
+        fclose( in );
+        return -1;
+    }
+
+    events_n = ndjson_rebuild_stream( in, out );
+    fclose( in );
+    fclose( out );
+
+    return events_n;
+}
@@ -0,0 +1,167 @@
+#include "conf.h"
+#include "pool.h"
+#include "utils.h"
+#include <time.h>
+
+//------------------------------------------------------------------------------------------------
+
+PoolStats poolStats;
+
+static pthread_t poolWorkers[ COMMUNICATION_WORKERS_MAX ];
+static PoolJob poolQueue[ COMMUNICATION_QUEUE_LEN ];
+static uint16_t poolQueueHead, poolQueueLength;
+static bool poolStopping;
+static uint64_t poolStartedAt;
+static void (*poolRoutine)(void *);
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolNotEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t poolNotFull = PTHREAD_COND_INITIALIZER;
+
+/// \brief Returns current time of the monotonic clock in usecs.
+static uint64_t pool_now(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_nsec / 1000;
+}
+
+/// \brief Runs $job & accounts its queue wait & run time in $poolStats.
+/// \param job
+static void pool_run(PoolJob *job)
+{
+    uint64_t startedAt = pool_now();
+    poolRoutine( &job->args );
+    uint64_t finishedAt = pool_now();
+
+    double queueWait = (double) ( startedAt - job->queued_at ) / 1000.0;
+
+    pthread_mutex_lock( &poolLock );
+        poolStats.jobs++;
+        poolStats.queueWaitAvg += ( queueWait - poolStats.queueWaitAvg ) / (double) poolStats.jobs;
+        if ( queueWait > poolStats.queueWaitMax )
+            poolStats.queueWaitMax = queueWait;
+        poolStats.busyTime += (double) ( finishedAt - startedAt ) / 1000.0;
+    pthread_mutex_unlock( &poolLock );
+}
+
+/// \brief Worker thread. Pops & runs jobs until pool_destroy() is called & queue is empty.
+static void *pool_worker(void *unused)
+{
+    PoolJob job;
+
+    (void) unused;
+
+    while (1)
+    {
+        pthread_mutex_lock( &poolLock );
+            while ( 0 == poolQueueLength && !poolStopping )
+                pthread_cond_wait( &poolNotEmpty, &poolLock );
+
+            if ( 0 == poolQueueLength )
+            {
+                pthread_mutex_unlock( &poolLock );
+                break;
+            }
+
+            // Copy job out, so that its slot can be reused right away
+            memcpy( &job, &poolQueue[poolQueueHead], sizeof( PoolJob ) );
+            poolQueueHead = (uint16_t) ( ( poolQueueHead + 1 ) % COMMUNICATION_QUEUE_LEN );
+            poolQueueLength--;
+            pthread_cond_signal( &poolNotFull );
+        pthread_mutex_unlock( &poolLock );
+
+        pool_run( &job );
+    }
+
+    return NULL;
+}
+
+/// \brief Spawns $COMMUNICATION_WORKERS_MAX worker threads that run $routine on every submitted job.
+/// \param routine job handler, receives a pointer to the job's own copy of its arguments
+void pool_init(void (*routine)(void *))
+{
+    int status;
+
+    poolRoutine = routine;
+    poolQueueHead = 0;
+    poolQueueLength = 0;
+    poolStopping = false;
+    poolStartedAt = pool_now();
+    memset( &poolStats, 0, sizeof( PoolStats ) );
+
+    for ( uint16_t worker_i = 0; worker_i < COMMUNICATION_WORKERS_MAX; worker_i++ )
+    {
+        status = pthread_create( &poolWorkers[worker_i], NULL, pool_worker, NULL );
+        if ( status != 0 )
+            error( status, "\tpool_init(): pthread_create() failed" );
+    }
+}
+
+/// \brief Queues a job with a copy of $args. Blocks while the queue holds $COMMUNICATION_QUEUE_LEN jobs ( backpressure ).
+/// If pool has no workers, job runs in the calling thread.
+/// \param args job arguments ( copied, may be freed right after the call )
+void pool_submit(const CommunicationWorkerArgs *args)
+{
+    PoolJob *job;
+
+    // Serial socket communications
+    if ( 0 == COMMUNICATION_WORKERS_MAX )
+    {
+        PoolJob inlineJob = { .queued_at = pool_now() };
+        memcpy( &inlineJob.args, args, sizeof( CommunicationWorkerArgs ) );
+        pool_run( &inlineJob );
+        return;
+    }
+
+    pthread_mutex_lock( &poolLock );
+        if ( COMMUNICATION_QUEUE_LEN == poolQueueLength )
+            poolStats.backpressured++;
+
+        while ( COMMUNICATION_QUEUE_LEN == poolQueueLength )
+            pthread_cond_wait( &poolNotFull, &poolLock );
+
+        job = &poolQueue[ ( poolQueueHead + poolQueueLength ) % COMMUNICATION_QUEUE_LEN ];
+        memcpy( &job->args, args, sizeof( CommunicationWorkerArgs ) );
+        job->queued_at = pool_now();
+        poolQueueLength++;
+
+        pthread_cond_signal( &poolNotEmpty );
+    pthread_mutex_unlock( &poolLock );
+}
+
+/// \brief Lets workers drain the queue & joins them.
+void pool_destroy(void)
+{
+    int status;
+
+    pthread_mutex_lock( &poolLock );
+        poolStopping = true;
+        pthread_cond_broadcast( &poolNotEmpty );
+    pthread_mutex_unlock( &poolLock );
+
+    for ( uint16_t worker_i = 0; worker_i < COMMUNICATION_WORKERS_MAX; worker_i++ )
+    {
+        status = pthread_join( poolWorkers[worker_i], NULL );
+        if ( status != 0 )
+            error( status, "\tpool_destroy(): pthread_join() failed" );
+    }
+}
+
+/// \brief Fraction of workers' time spent running jobs since pool_init().
+/// \return utilisation in range [0, 1]
+double pool_utilisation(void)
+{
+    double uptime = (double) ( pool_now() - poolStartedAt ) / 1000.0;
+    double workers = COMMUNICATION_WORKERS_MAX > 0 ? COMMUNICATION_WORKERS_MAX : 1;
+
+    if ( uptime <= 0.0 )
+        return 0.0;
+
+    pthread_mutex_lock( &poolLock );
+        double utilisation = poolStats.busyTime / ( workers * uptime );
+    pthread_mutex_unlock( &poolLock );
+
+    return utilisation;
+}
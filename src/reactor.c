@@ -0,0 +1,220 @@
+#include "conf.h"
+#include "latency.h"
+#include "reactor.h"
+#include "session.h"
+#include "utils.h"
+#include <arpa/inet.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <time.h>
+#include <unistd.h>
+
+//------------------------------------------------------------------------------------------------
+
+#define REACTOR_LISTENER UINT32_MAX
+
+typedef enum reactor_slot_state_t {
+
+    REACTOR_SLOT_FREE,
+    REACTOR_SLOT_OPEN,                  // session's socket is watched by epoll
+    REACTOR_SLOT_CLOSING                // session closed, its deferred log is not written yet
+
+} ReactorSlotState;
+
+static Session reactorSessions[ REACTOR_SESSIONS_MAX ];
+static ReactorSlotState reactorSlots[ REACTOR_SESSIONS_MAX ];
+static volatile sig_atomic_t reactorStopping;      // set by reactor_stop(), until reactor_run() returns
+
+/// \brief Returns current time of the monotonic clock in msecs.
+static uint64_t reactor_now(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+/// \brief Closes session in $slot_i & tries to write its log ( slot is freed once log is written ).
+/// \param epoll_fd
+/// \param slot_i
+static void reactor_finish(int epoll_fd, uint32_t slot_i)
+{
+    if ( REACTOR_SLOT_OPEN == reactorSlots[slot_i] )
+    {
+        epoll_ctl( epoll_fd, EPOLL_CTL_DEL, reactorSessions[slot_i].socket_fd, NULL );
+        session_close( &reactorSessions[slot_i] );
+        reactorSlots[slot_i] = REACTOR_SLOT_CLOSING;
+    }
+
+    if ( true == session_flush_log( &reactorSessions[slot_i], 0 != reactorStopping ) )
+        reactorSlots[slot_i] = REACTOR_SLOT_FREE;
+}
+
+/// \brief Updates epoll interest of session in $slot_i according to its state ( finishes it if done ).
+/// \param epoll_fd
+/// \param slot_i
+static void reactor_update(int epoll_fd, uint32_t slot_i)
+{
+    uint32_t events = session_events( &reactorSessions[slot_i] );
+
+    if ( 0 == events )
+    {
+        reactor_finish( epoll_fd, slot_i );
+        return;
+    }
+
+    struct epoll_event event = {
+            .events = events,
+            .data.u32 = slot_i
+    };
+    epoll_ctl( epoll_fd, EPOLL_CTL_MOD, reactorSessions[slot_i].socket_fd, &event );
+}
+
+/// \brief Accepts all pending connections on $listen_fd, opening a session for each one.
+/// \param epoll_fd
+/// \param listen_fd
+static void reactor_accept(int epoll_fd, int32_t listen_fd)
+{
+    struct sockaddr_in clientAddress;
+    char ip[INET_ADDRSTRLEN];
+    int client_socket_fd;
+    uint32_t slot_i;
+
+    while ( 1 )
+    {
+        client_socket_fd = accept( listen_fd, (struct sockaddr *) &clientAddress, &(socklen_t){ sizeof( struct sockaddr_in ) } );
+        if ( client_socket_fd < 0 )
+        {
+            if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno && ECONNABORTED != errno )
+                perror( "\treactor_accept(): accept() failed" );
+            return;
+        }
+
+        // Find a free session slot
+        for ( slot_i = 0; slot_i < REACTOR_SESSIONS_MAX; slot_i++ )
+            if ( REACTOR_SLOT_FREE == reactorSlots[slot_i] )
+                break;
+
+        if ( REACTOR_SESSIONS_MAX == slot_i )
+        {
+            fprintf( stderr, "\treactor_accept(): max no. of sessions ( %d ) reached. Dropping connection...\n", REACTOR_SESSIONS_MAX );
+            close( client_socket_fd );
+            continue;
+        }
+
+        // Connected > Open session
+        //  - get client address
+        inet_ntop( AF_INET, &( clientAddress.sin_addr ), ip, INET_ADDRSTRLEN );
+
+        //  - format device
+        uint32_t clientAem = ip2aem( ip );
+        Device device = {
+                .AEM = clientAem,
+                .aemIndex = binary_search_index( CLIENT_AEM_LIST, CLIENT_AEM_LIST_LENGTH, clientAem )
+        };
+
+        reactorSlots[slot_i] = REACTOR_SLOT_OPEN;
+        if ( false == session_open( &reactorSessions[slot_i], client_socket_fd, device, true, true ) )
+        {
+            reactor_finish( epoll_fd, slot_i );
+            continue;
+        }
+
+        struct epoll_event event = {
+                .events = session_events( &reactorSessions[slot_i] ),
+                .data.u32 = slot_i
+        };
+        if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, client_socket_fd, &event ) < 0 )
+        {
+            perror( "\treactor_accept(): epoll_ctl( ADD ) failed" );
+            reactor_finish( epoll_fd, slot_i );
+        }
+    }
+}
+
+/// \brief Single-threaded server loop. Accepts connections on $listen_fd & drives all sessions with epoll,
+/// so that a slow peer never blocks accepts or other sessions. Returns after reactor_stop().
+/// \param listen_fd listening socket
+void reactor_run(int32_t listen_fd)
+{
+    struct epoll_event events[ REACTOR_SESSIONS_MAX + 1 ];
+    uint64_t now;
+    int epoll_fd;
+    int n;
+
+    epoll_fd = epoll_create1( 0 );
+    if ( epoll_fd < 0 )
+        error( errno, "\treactor_run(): epoll_create1() failed" );
+
+    socket_set_blocking( listen_fd, false, NULL );
+
+    struct epoll_event listenEvent = {
+            .events = EPOLLIN,
+            .data.u32 = REACTOR_LISTENER
+    };
+    if ( epoll_ctl( epoll_fd, EPOLL_CTL_ADD, listen_fd, &listenEvent ) < 0 )
+        error( errno, "\treactor_run(): epoll_ctl( ADD ) failed" );
+
+    while ( 0 == reactorStopping )
+    {
+        n = epoll_wait( epoll_fd, events, REACTOR_SESSIONS_MAX + 1, REACTOR_TICK );
+        if ( n < 0 && EINTR != errno )
+            error( errno, "\treactor_run(): epoll_wait() failed" );
+
+        for ( int event_i = 0; event_i < n; event_i++ )
+        {
+            uint32_t slot_i = events[event_i].data.u32;
+            if ( REACTOR_LISTENER == slot_i )
+            {
+                reactor_accept( epoll_fd, listen_fd );
+                continue;
+            }
+
+            if ( REACTOR_SLOT_OPEN != reactorSlots[slot_i] )
+                continue;
+
+            // Progress session as far as possible ( errors & hang-ups are detected by the read / write calls )
+            Session *session = &reactorSessions[slot_i];
+            if ( session->transmitting )
+                session_on_writable( session );
+            if ( session->receiving )
+                session_on_readable( session );
+
+            reactor_update( epoll_fd, slot_i );
+        }
+
+        // Latencies asked for by SIGUSR1
+        latency_print_requested( stdout );
+
+        // Drop idle sessions & retry writing logs of closed ones
+        now = reactor_now();
+        for ( uint32_t slot_i = 0; slot_i < REACTOR_SESSIONS_MAX; slot_i++ )
+        {
+            if ( REACTOR_SLOT_OPEN == reactorSlots[slot_i] && reactorSessions[slot_i].active_at + SESSION_IDLE_TIMEOUT < now )
+            {
+                fprintf( stderr, "\treactor_run(): session with AEM = %04d idle. Dropping...\n", reactorSessions[slot_i].device.AEM );
+                reactor_finish( epoll_fd, slot_i );
+            }
+            else if ( REACTOR_SLOT_CLOSING == reactorSlots[slot_i] )
+            {
+                reactor_finish( epoll_fd, slot_i );
+            }
+        }
+    }
+
+    // Stopped > Close all sessions
+    for ( uint32_t slot_i = 0; slot_i < REACTOR_SESSIONS_MAX; slot_i++ )
+        if ( REACTOR_SLOT_FREE != reactorSlots[slot_i] )
+            reactor_finish( epoll_fd, slot_i );
+
+    epoll_ctl( epoll_fd, EPOLL_CTL_DEL, listen_fd, NULL );
+    close( epoll_fd );
+    reactorStopping = 0;
+}
+
+/// \brief Asks reactor_run() to close all sessions & return ( within $REACTOR_TICK msecs ), or to return as soon as it
+/// starts if it is not running yet. Async-signal-safe.
+void reactor_stop(void)
+{
+    reactorStopping = 1;
+}
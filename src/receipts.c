@@ -0,0 +1,103 @@
+#include "conf.h"
+#include "receipts.h"
+#include "index.h"
+#include "summary.h"
+#include <arpa/inet.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Adds receipt of message of $key to $receipts ring, unless it is already there. Oldest receipt is forgotten
+/// when ring is full.
+/// \param receipts
+/// \param index index of $receipts ( key to ring slot )
+/// \param key
+/// \return FALSE if receipt was known, TRUE else
+bool receipts_add(Receipts *receipts, MessageIndex *index, const MessageKey *key)
+{
+    uint32_t slot = receipts->head % RECEIPTS_SIZE;
+
+    if ( index_find( index, key ) >= 0 )
+        return false;
+
+    if ( 0 != receipts->keys[slot].created_at )
+        index_remove( index, &receipts->keys[slot], slot );
+
+    receipts->keys[slot] = *key;
+    receipts->head = ( slot + 1 ) % RECEIPTS_SIZE;
+    index_insert( index, key, slot );
+
+    return true;
+}
+
+/// \brief Rebuilds $index from the slots of $receipts ring.
+/// \param receipts
+/// \param index
+void receipts_rebuild(const Receipts *receipts, MessageIndex *index)
+{
+    index_clear( index );
+    for ( uint32_t slot = 0; slot < RECEIPTS_SIZE; slot++ )
+        if ( 0 != receipts->keys[slot].created_at )
+            index_insert( index, &receipts->keys[slot], slot );
+}
+
+/// \brief Serializes the receipts of messages in $filter ( network byte order ).
+/// \param receipts
+/// \param filter summary of the messages a device holds
+/// \param packed buffer of at least $RECEIPTS_LEN_MAX bytes
+/// \return no. of bytes written
+uint32_t receipts_pack(const Receipts *receipts, const Summary *filter, uint8_t *packed)
+{
+    uint32_t receipts_n = 0;
+
+    for ( uint32_t slot = 0; slot < RECEIPTS_SIZE; slot++ )
+    {
+        const MessageKey *key = &receipts->keys[slot];
+        if ( 0 == key->created_at || !summary_contains( filter, key ) )
+            continue;
+
+        uint32_t fields[6] = {
+                htonl( (uint32_t) ( key->created_at >> 32 ) ),
+                htonl( (uint32_t) key->created_at ),
+                htonl( (uint32_t) ( key->body_hash >> 32 ) ),
+                htonl( (uint32_t) key->body_hash ),
+                htonl( key->sender ),
+                htonl( key->recipient )
+        };
+        memcpy( packed + RECEIPTS_HEADER_LEN + receipts_n++ * RECEIPTS_ENTRY_LEN, fields, sizeof( fields ) );
+    }
+
+    uint32_t header[2] = { htonl( RECEIPTS_MAGIC ), htonl( receipts_n ) };
+    memcpy( packed, header, sizeof( header ) );
+
+    return RECEIPTS_HEADER_LEN + receipts_n * RECEIPTS_ENTRY_LEN;
+}
+
+/// \brief Reads header of received receipts.
+/// \param packed $RECEIPTS_HEADER_LEN received bytes
+/// \return no. of bytes of all receipts, 0 if bytes are not receipts
+uint32_t receipts_length(const uint8_t *packed)
+{
+    uint32_t header[2];
+
+    memcpy( header, packed, sizeof( header ) );
+    if ( RECEIPTS_MAGIC != ntohl( header[0] ) || ntohl( header[1] ) > RECEIPTS_SIZE )
+        return 0;
+
+    return RECEIPTS_HEADER_LEN + ntohl( header[1] ) * RECEIPTS_ENTRY_LEN;
+}
+
+/// \brief Un-serializes the $receipt_i-th of received receipts.
+/// \param key the result key ( passed as pointer )
+/// \param packed received bytes ( receipts_length() of them )
+/// \param receipt_i
+void receipts_unpack(MessageKey *key, const uint8_t *packed, uint32_t receipt_i)
+{
+    uint32_t fields[6];
+
+    memcpy( fields, packed + RECEIPTS_HEADER_LEN + receipt_i * RECEIPTS_ENTRY_LEN, sizeof( fields ) );
+    key->created_at = (uint64_t) ntohl( fields[0] ) << 32 | ntohl( fields[1] );
+    key->body_hash = (uint64_t) ntohl( fields[2] ) << 32 | ntohl( fields[3] );
+    key->sender = ntohl( fields[4] );
+    key->recipient = ntohl( fields[5] );
+}
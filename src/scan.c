@@ -0,0 +1,305 @@
+#include "conf.h"
+#include "scan.h"
+#include <string.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+    #include <immintrin.h>
+#endif
+#if defined( __ARM_NEON ) && SCAN_NEON
+    #include <arm_neon.h>
+#endif
+
+//------------------------------------------------------------------------------------------------
+
+#define SCAN_BODY_MIN 32                // allowed class of bodies: printable ASCII, but '_', '\' & '"'
+#define SCAN_BODY_MAX 126
+#define SCAN_RECORD_WORDS ( ( MESSAGE_SEQUENCED_LEN + 63 ) / 64 )
+
+/* Kernel that classifies 64 bytes */
+typedef void (*ScanClassify)(const uint8_t *bytes, ScanMasks *masks);
+
+//------------------------------------------------------------------------------------------------
+
+const char *scanKernel = SCAN_KERNEL;
+
+static const char *scanResolvedFor;     // $scanKernel the kernel was resolved for
+static const char *scanResolvedName;
+static ScanClassify scanClassify;
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Classifies $n bytes ( at most 64 ), one at a time.
+static void scan_classify_scalar_n(const uint8_t *bytes, uint16_t n, ScanMasks *masks)
+{
+    memset( masks, 0, sizeof( ScanMasks ) );
+
+    for ( uint16_t byte_i = 0; byte_i < n; byte_i++ )
+    {
+        uint8_t byte = bytes[byte_i];
+        uint64_t bit = (uint64_t) 1 << byte_i;
+
+        masks->glue |= '_' == byte ? bit : 0;
+        masks->nul |= 0 == byte ? bit : 0;
+        masks->bad |= byte < SCAN_BODY_MIN || byte > SCAN_BODY_MAX || '\\' == byte || '"' == byte ? bit : 0;
+        masks->digit |= byte >= '0' && byte <= '9' ? bit : 0;
+    }
+}
+
+/// \brief Classifies 64 bytes, one at a time.
+static void scan_classify_scalar(const uint8_t *bytes, ScanMasks *masks)
+{
+    scan_classify_scalar_n( bytes, 64, masks );
+}
+
+#if defined( __SSE2__ )
+/// \brief Classifies 64 bytes, 16 at a time ( signed compares: bytes over 127 are negative, so below $SCAN_BODY_MIN ).
+static void scan_classify_sse2(const uint8_t *bytes, ScanMasks *masks)
+{
+    const __m128i glue = _mm_set1_epi8( '_' ), backslash = _mm_set1_epi8( '\\' ), quote = _mm_set1_epi8( '"' );
+    const __m128i min = _mm_set1_epi8( SCAN_BODY_MIN ), del = _mm_set1_epi8( SCAN_BODY_MAX + 1 );
+    const __m128i digitMin = _mm_set1_epi8( '0' - 1 ), digitMax = _mm_set1_epi8( '9' + 1 );
+
+    memset( masks, 0, sizeof( ScanMasks ) );
+    for ( uint8_t block_i = 0; block_i < 4; block_i++ )
+    {
+        __m128i block = _mm_loadu_si128( (const __m128i *) ( bytes + 16 * block_i ) );
+        __m128i bad = _mm_or_si128( _mm_or_si128( _mm_cmpgt_epi8( min, block ), _mm_cmpeq_epi8( block, del ) ),
+                                    _mm_or_si128( _mm_cmpeq_epi8( block, backslash ), _mm_cmpeq_epi8( block, quote ) ) );
+        __m128i digit = _mm_and_si128( _mm_cmpgt_epi8( block, digitMin ), _mm_cmpgt_epi8( digitMax, block ) );
+
+        masks->glue |= (uint64_t) (uint16_t) _mm_movemask_epi8( _mm_cmpeq_epi8( block, glue ) ) << ( 16 * block_i );
+        masks->nul |= (uint64_t) (uint16_t) _mm_movemask_epi8( _mm_cmpeq_epi8( block, _mm_setzero_si128() ) ) << ( 16 * block_i );
+        masks->bad |= (uint64_t) (uint16_t) _mm_movemask_epi8( bad ) << ( 16 * block_i );
+        masks->digit |= (uint64_t) (uint16_t) _mm_movemask_epi8( digit ) << ( 16 * block_i );
+    }
+}
+#endif
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+/// \brief Classifies 64 bytes, 32 at a time ( as scan_classify_sse2() ).
+__attribute__(( target( "avx2" ) ))
+static void scan_classify_avx2(const uint8_t *bytes, ScanMasks *masks)
+{
+    const __m256i glue = _mm256_set1_epi8( '_' ), backslash = _mm256_set1_epi8( '\\' ), quote = _mm256_set1_epi8( '"' );
+    const __m256i min = _mm256_set1_epi8( SCAN_BODY_MIN ), del = _mm256_set1_epi8( SCAN_BODY_MAX + 1 );
+    const __m256i digitMin = _mm256_set1_epi8( '0' - 1 ), digitMax = _mm256_set1_epi8( '9' + 1 );
+
+    memset( masks, 0, sizeof( ScanMasks ) );
+    for ( uint8_t block_i = 0; block_i < 2; block_i++ )
+    {
+        __m256i block = _mm256_loadu_si256( (const __m256i *) ( bytes + 32 * block_i ) );
+        __m256i bad = _mm256_or_si256( _mm256_or_si256( _mm256_cmpgt_epi8( min, block ), _mm256_cmpeq_epi8( block, del ) ),
+                                       _mm256_or_si256( _mm256_cmpeq_epi8( block, backslash ), _mm256_cmpeq_epi8( block, quote ) ) );
+        __m256i digit = _mm256_and_si256( _mm256_cmpgt_epi8( block, digitMin ), _mm256_cmpgt_epi8( digitMax, block ) );
+
+        masks->glue |= (uint64_t) (uint32_t) _mm256_movemask_epi8( _mm256_cmpeq_epi8( block, glue ) ) << ( 32 * block_i );
+        masks->nul |= (uint64_t) (uint32_t) _mm256_movemask_epi8( _mm256_cmpeq_epi8( block, _mm256_setzero_si256() ) ) << ( 32 * block_i );
+        masks->bad |= (uint64_t) (uint32_t) _mm256_movemask_epi8( bad ) << ( 32 * block_i );
+        masks->digit |= (uint64_t) (uint32_t) _mm256_movemask_epi8( digit ) << ( 32 * block_i );
+    }
+}
+#endif
+
+#if defined( __ARM_NEON ) && SCAN_NEON
+/// \brief Packs the top bits of 16 compare results into 16 bits ( NEON has no movemask ).
+static inline uint64_t scan_movemask_neon(uint8x16_t compared)
+{
+    static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t bits = vandq_u8( compared, vld1q_u8( weights ) );
+    uint8x8_t sums = vpadd_u8( vget_low_u8( bits ), vget_high_u8( bits ) );
+
+    sums = vpadd_u8( sums, sums );
+    sums = vpadd_u8( sums, sums );
+
+    return (uint64_t) vget_lane_u8( sums, 0 ) | (uint64_t) vget_lane_u8( sums, 1 ) << 8;
+}
+
+/// \brief Classifies 64 bytes, 16 at a time.
+static void scan_classify_neon(const uint8_t *bytes, ScanMasks *masks)
+{
+    const uint8x16_t glue = vdupq_n_u8( '_' ), backslash = vdupq_n_u8( '\\' ), quote = vdupq_n_u8( '"' );
+    const uint8x16_t min = vdupq_n_u8( SCAN_BODY_MIN ), max = vdupq_n_u8( SCAN_BODY_MAX );
+    const uint8x16_t digitMin = vdupq_n_u8( '0' ), digitMax = vdupq_n_u8( '9' );
+
+    memset( masks, 0, sizeof( ScanMasks ) );
+    for ( uint8_t block_i = 0; block_i < 4; block_i++ )
+    {
+        uint8x16_t block = vld1q_u8( bytes + 16 * block_i );
+        uint8x16_t bad = vorrq_u8( vorrq_u8( vcltq_u8( block, min ), vcgtq_u8( block, max ) ),
+                                   vorrq_u8( vceqq_u8( block, backslash ), vceqq_u8( block, quote ) ) );
+        uint8x16_t digit = vandq_u8( vcgeq_u8( block, digitMin ), vcleq_u8( block, digitMax ) );
+
+        masks->glue |= scan_movemask_neon( vceqq_u8( block, glue ) ) << ( 16 * block_i );
+        masks->nul |= scan_movemask_neon( vceqq_u8( block, vdupq_n_u8( 0 ) ) ) << ( 16 * block_i );
+        masks->bad |= scan_movemask_neon( bad ) << ( 16 * block_i );
+        masks->digit |= scan_movemask_neon( digit ) << ( 16 * block_i );
+    }
+}
+#endif
+
+/// \brief Get the kernel resolved for $scanKernel ( once per value of it ).
+static ScanClassify scan_kernel(void)
+{
+    const char *name = scanKernel;
+    bool automatic = 0 == strcmp( "auto", name );
+
+    if ( __atomic_load_n( &scanResolvedFor, __ATOMIC_ACQUIRE ) == name )
+        return scanClassify;
+
+    scanClassify = scan_classify_scalar;
+    scanResolvedName = "scalar";
+
+#if defined( __ARM_NEON ) && SCAN_NEON
+    if ( automatic || 0 == strcmp( "neon", name ) )
+    {
+        scanClassify = scan_classify_neon;
+        scanResolvedName = "neon";
+    }
+#endif
+#if defined( __SSE2__ )
+    if ( automatic || 0 == strcmp( "sse2", name ) )
+    {
+        scanClassify = scan_classify_sse2;
+        scanResolvedName = "sse2";
+    }
+#endif
+#if defined( __x86_64__ ) || defined( __i386__ )
+    __builtin_cpu_init();
+    if ( ( automatic || 0 == strcmp( "avx2", name ) ) && __builtin_cpu_supports( "avx2" ) )
+    {
+        scanClassify = scan_classify_avx2;
+        scanResolvedName = "avx2";
+    }
+#endif
+
+    __atomic_store_n( &scanResolvedFor, name, __ATOMIC_RELEASE );
+    return scanClassify;
+}
+
+/// \brief Classifies $n bytes ( at most 64 ) with $kernel, or one at a time if they are fewer.
+static inline void scan_classify(ScanClassify kernel, const uint8_t *bytes, uint16_t n, ScanMasks *masks)
+{
+    if ( 64 == n )
+        kernel( bytes, masks );
+    else
+        scan_classify_scalar_n( bytes, n, masks );
+}
+
+/// \brief Get the bits of [$from, $to) that fall in $word_i-th 64-bit word.
+static inline uint64_t scan_range(uint16_t word_i, uint16_t from, uint16_t to)
+{
+    uint16_t first = (uint16_t) ( 64 * word_i );
+    uint16_t low = from > first ? (uint16_t) ( from - first ) : 0;
+    uint16_t high = to < first + 64 ? ( to > first ? (uint16_t) ( to - first ) : 0 ) : 64;
+
+    if ( low >= high )
+        return 0;
+
+    return ( 64 == high ? ~(uint64_t) 0 : ( (uint64_t) 1 << high ) - 1 ) & ~( ( (uint64_t) 1 << low ) - 1 );
+}
+
+/// \brief Checks a text record out of the masks of its bytes.
+static bool scan_record(const ScanMasks *masks, uint16_t record_length)
+{
+    uint16_t words_n = (uint16_t) ( ( record_length + 63 ) / 64 );
+    uint16_t end = 0, body = 0, glues = 0;
+    bool terminated = false;
+
+    // Body ends with a NUL
+    for ( uint16_t word_i = 0; word_i < words_n && !terminated; word_i++ )
+    {
+        uint64_t nul = masks[word_i].nul & scan_range( word_i, 0, MESSAGE_SERIALIZED_LEN );
+        if ( 0 != nul )
+        {
+            end = (uint16_t) ( 64 * word_i + __builtin_ctzll( nul ) );
+            terminated = true;
+        }
+    }
+    if ( !terminated )
+        return false;
+
+    // Exactly three glues before it: the body follows the third one
+    for ( uint16_t word_i = 0; word_i < words_n; word_i++ )
+    {
+        uint64_t glue = masks[word_i].glue & scan_range( word_i, 0, end );
+        uint16_t glues_n = (uint16_t) __builtin_popcountll( glue );
+
+        if ( glues < 3 && glues + glues_n >= 3 )
+        {
+            for ( uint16_t glue_i = glues; glue_i < 2; glue_i++ )
+                glue &= glue - 1;
+            body = (uint16_t) ( 64 * word_i + __builtin_ctzll( glue ) + 1 );
+        }
+        glues += glues_n;
+    }
+    if ( 3 != glues )
+        return false;
+
+    // Fields of digits, body of the allowed class, sequence number of digits
+    for ( uint16_t word_i = 0; word_i < words_n; word_i++ )
+    {
+        if ( 0 != ( ~( masks[word_i].digit | masks[word_i].glue ) & scan_range( word_i, 0, body ) ) )
+            return false;
+        if ( 0 != ( masks[word_i].bad & scan_range( word_i, body, end ) ) )
+            return false;
+        if ( 0 != ( ~masks[word_i].digit & scan_range( word_i, MESSAGE_SERIALIZED_LEN, record_length ) ) )
+            return false;
+    }
+
+    return true;
+}
+
+/// \brief Get name of the kernel that classifies bytes, as resolved for $scanKernel & this CPU.
+/// \return "avx2", "sse2", "neon" or "scalar"
+const char *scan_kernel_name(void)
+{
+    scan_kernel();
+
+    return scanResolvedName;
+}
+
+/// \brief Checks if $n bytes of a body are all of the allowed class ( printable ASCII but '_', '\' & '"' ).
+/// \param body
+/// \param n
+/// \return TRUE if body is valid, FALSE else
+bool scan_body(const uint8_t *body, uint16_t n)
+{
+    ScanClassify kernel = scan_kernel();
+    ScanMasks masks;
+
+    for ( uint16_t offset = 0; offset < n; offset += 64 )
+    {
+        uint16_t chunk = n - offset < 64 ? (uint16_t) ( n - offset ) : 64;
+        scan_classify( kernel, body + offset, chunk, &masks );
+        if ( 0 != ( masks.bad | masks.glue ) )
+            return false;
+    }
+
+    return true;
+}
+
+/// \brief Validates $records_n text records of $record_length bytes each, back to back at $records, in one pass: three
+/// glues split fields of digits from a body of the allowed class that ends with a NUL ( & a sequence number of digits
+/// follows in sequenced records ).
+/// \param records
+/// \param records_n at most 64
+/// \param record_length $MESSAGE_SERIALIZED_LEN or $MESSAGE_SEQUENCED_LEN
+/// \return bitset of valid records ( bit i set if i-th record is valid )
+uint64_t scan_records(const uint8_t *records, uint16_t records_n, uint16_t record_length)
+{
+    ScanClassify kernel = scan_kernel();
+    ScanMasks masks[SCAN_RECORD_WORDS];
+    uint64_t valid = 0;
+
+    for ( uint16_t record_i = 0; record_i < records_n; record_i++ )
+    {
+        const uint8_t *record = records + (size_t) record_i * record_length;
+
+        for ( uint16_t offset = 0, word_i = 0; offset < record_length; offset += 64, word_i++ )
+            scan_classify( kernel, record + offset, record_length - offset < 64 ? (uint16_t) ( record_length - offset ) : 64, &masks[word_i] );
+
+        valid |= scan_record( masks, record_length ) ? (uint64_t) 1 << record_i : 0;
+    }
+
+    return valid;
+}
@@ -3,25 +3,90 @@
 #include "log.h"
 #include "utils.h"
 #include "communication.h"
+#include "eviction.h"
+#include "index.h"
+#include "latency.h"
+#include "pool.h"
+#include "reactor.h"
+#include "receipts.h"
+#include "stats.h"
+#include "summary.h"
+#include "versions.h"
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 //------------------------------------------------------------------------------------------------
 
-extern MessagesStats messagesStats;
-extern pthread_mutex_t messagesBufferLock, availableThreadsLock;
-
-extern pthread_t communicationThreads[COMMUNICATION_WORKERS_MAX];
-extern uint8_t communicationThreadsAvailable;
+extern pthread_mutex_t messagesBufferLock;
 
 extern uint32_t CLIENT_AEM;
 
+#define INBOX_SLOT_NONE 0xFFFF
+#define MESSAGES_SLOT_NONE 0xFFFF
+
 //------------------------------------------------------------------------------------------------
 
 /* messagesHead is in range: [0, $MESSAGES_SIZE - 1] */
 messages_head_t messagesHead;
 messages_head_t inboxHead;
-Message MESSAGES_BUFFER[ MESSAGES_SIZE ];
-InboxMessage INBOX[ INBOX_SIZE ];
+
+// $messages circle buffer & $INBOX, one array per field group ( guarded by $messagesBufferLock ): headers are scanned,
+// bodies are only copied out when a message is transmitted or logged. In memory until messages_attach() maps a file.
+static MessagesStore messagesStoreMemory;
+static MessagesStore *messagesStore = &messagesStoreMemory;
+static int messagesStoreFd = -1;
+
+// Last own sequence number handed out, kept in a file of its own ( -1: not kept, own messages follow the store's vector )
+static int messagesSeqFd = -1;
+static uint32_t messagesSeqLast;
+InboxMessage *INBOX = messagesStoreMemory.inbox;
+
+// Indexes of $INBOX ring ( guarded by $messagesBufferLock, as the ring ): duplicate detection, newest message per sender
+// with per-sender chains, & valid slots sorted by created_at
+static MessageIndexEntry inboxIndexEntries[ INBOX_INDEX_SIZE ];
+static MessageIndex inboxIndex = { .entries = inboxIndexEntries, .mask = INBOX_INDEX_SIZE - 1 };
+static MessageIndexEntry inboxSendersEntries[ INBOX_INDEX_SIZE ];
+static MessageIndex inboxSenders = { .entries = inboxSendersEntries, .mask = INBOX_INDEX_SIZE - 1 };
+static uint16_t inboxOlderBySender[ INBOX_SIZE ];
+static uint16_t inboxNewerBySender[ INBOX_SIZE ];
+static uint16_t inboxByCreatedAt[ INBOX_SIZE ];
+uint16_t inboxCount;
+
+// Duplicate-detection index of $messages ( guarded by $messagesBufferLock, as the buffer )
+static MessageIndexEntry messagesIndexEntries[ MESSAGES_INDEX_SIZE ];
+MessageIndex messagesIndex = { .entries = messagesIndexEntries, .mask = MESSAGES_INDEX_SIZE - 1 };
+
+// Eviction candidates of $messages ( guarded by $messagesBufferLock, policy is set by messages_init() )
+static Eviction messagesEviction;
+
+// Per-device bitsets of $messages slots still to be transmitted to the device ( guarded by $messagesBufferLock )
+static uint64_t messagesPending[ MESSAGE_DEVICES_MAX ][ MESSAGES_PENDING_WORDS ];
+static uint32_t messagesDevicesLength = MESSAGE_DEVICES_MAX;    // devices of $CLIENT_AEM_SOURCE
+
+// Per-origin chains of $messages slots sorted by sequence number, so that transmitters look up the ranges a device is
+// missing ( guarded by $messagesBufferLock ). Unsequenced messages are kept in a bitset & scanned apart.
+static uint16_t messagesOrigins[ MESSAGES_SIZE ];               // origin of each slot, $MESSAGES_SLOT_NONE if unsequenced
+static uint16_t messagesSeqNext[ MESSAGES_SIZE ];
+static uint16_t messagesSeqPrev[ MESSAGES_SIZE ];
+static uint16_t messagesSeqHeads[ MESSAGE_DEVICES_MAX ];
+static uint16_t messagesSeqTails[ MESSAGE_DEVICES_MAX ];
+static uint64_t messagesUnsequenced[ MESSAGES_PENDING_WORDS ];
+
+// Index of delivery receipts ( guarded by $messagesBufferLock, the ring lives in the store )
+static MessageIndexEntry receiptsIndexEntries[ RECEIPTS_INDEX_SIZE ];
+static MessageIndex receiptsIndex = { .entries = receiptsIndexEntries, .mask = RECEIPTS_INDEX_SIZE - 1 };
+bool messagesReceipts = MESSAGES_RECEIPTS;
+
+// Store summary ( advertised in discovery beacons )
+uint32_t messagesCount;
+uint64_t messagesNewestCreatedAt;
+
+// Set by listening_stop() ( from signal handlers )
+static volatile sig_atomic_t listeningStopping;
 
 // Active flag for each AEM
 bool CLIENT_AEM_ACTIVE_LIST[ CLIENT_AEM_LIST_LENGTH ] = {false};
@@ -65,11 +130,96 @@ void devices_remove(Device device)
         CLIENT_AEM_ACTIVE_LIST[ device.aemIndex ] = 0;
 }
 
-/// Push message to $INBOX buffer, checking for existence.
+/// \brief Advances version vector of the store over $message.
+/// \return origin of $message, -1 if it is unsequenced
+static int32_t messages_seen(const Message *message)
+{
+    int32_t origin = versions_origin( message->sender );
+    if ( origin < 0 || 0 == message->seq )
+        return -1;
+
+    versions_seen( &messagesStore->versions, origin, message->seq );
+    return origin;
+}
+
+/// \brief Position of ( $created_at, $slot ) in $inboxByCreatedAt ( first position not before it ).
+static uint16_t inbox_created_at_position(uint64_t created_at, uint16_t slot)
+{
+    uint16_t low = 0, high = inboxCount;
+
+    while ( low < high )
+    {
+        uint16_t middle = (uint16_t) ( ( low + high ) / 2 );
+        uint64_t middleCreatedAt = INBOX[ inboxByCreatedAt[middle] ].created_at;
+
+        if ( middleCreatedAt < created_at || ( middleCreatedAt == created_at && inboxByCreatedAt[middle] < slot ) )
+            low = (uint16_t) ( middle + 1 );
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/// \brief Adds message of $INBOX[$slot] to the inbox indexes ( as the newest message of its sender ).
+static void inbox_track(uint16_t slot)
+{
+    const InboxMessage *message = &INBOX[slot];
+    MessageKey key;
+
+    index_key_inbox( &key, message );
+    index_insert( &inboxIndex, &key, slot );
+
+    index_key_sender( &key, message->sender );
+    int32_t newest = index_find( &inboxSenders, &key );
+    inboxOlderBySender[slot] = newest >= 0 ? (uint16_t) newest : INBOX_SLOT_NONE;
+    inboxNewerBySender[slot] = INBOX_SLOT_NONE;
+    if ( newest >= 0 )
+        inboxNewerBySender[newest] = slot;
+    index_put( &inboxSenders, &key, slot );
+
+    // Sorted insert ( shifts at most $INBOX_SIZE slot numbers )
+    uint16_t position = inbox_created_at_position( message->created_at, slot );
+    memmove( inboxByCreatedAt + position + 1, inboxByCreatedAt + position, ( inboxCount - position ) * sizeof( uint16_t ) );
+    inboxByCreatedAt[position] = slot;
+    inboxCount++;
+}
+
+/// \brief Removes message of $INBOX[$slot] from the inbox indexes.
+static void inbox_untrack(uint16_t slot)
+{
+    const InboxMessage *message = &INBOX[slot];
+    uint16_t older = inboxOlderBySender[slot];
+    uint16_t newer = inboxNewerBySender[slot];
+    MessageKey key;
+
+    index_key_inbox( &key, message );
+    index_remove( &inboxIndex, &key, slot );
+
+    // Unlink from sender's chain
+    index_key_sender( &key, message->sender );
+    if ( INBOX_SLOT_NONE != newer )
+        inboxOlderBySender[newer] = older;
+    else if ( INBOX_SLOT_NONE != older )
+        index_put( &inboxSenders, &key, older );
+    else
+        index_remove( &inboxSenders, &key, slot );
+    if ( INBOX_SLOT_NONE != older )
+        inboxNewerBySender[older] = newer;
+
+    uint16_t position = inbox_created_at_position( message->created_at, slot );
+    inboxCount--;
+    memmove( inboxByCreatedAt + position, inboxByCreatedAt + position + 1, ( inboxCount - position ) * sizeof( uint16_t ) );
+}
+
+/// \brief Push message to $INBOX ring, unless it is already there. Oldest message is overwritten when ring is full.
 /// \param message
 /// \param device used to keep stats of the first device that gave us our message
-void inbox_push(Message *message, Device *device)
+/// \return FALSE if message was a duplicate, TRUE else
+bool inbox_push(Message *message, Device *device)
 {
+    MessageKey key;
+
     // Cast Message to InboxMessage
     InboxMessage inboxMessage = {
             .sender = message->sender,
@@ -77,73 +227,700 @@ void inbox_push(Message *message, Device *device)
             .saved_at = (uint64_t) time( NULL ),
             .first_sender = device->AEM
     };
-    strcpy( inboxMessage.body, message->body );
+    strncpy( inboxMessage.body, message->body, MESSAGE_BODY_LEN - 1 );
+    inboxMessage.body[MESSAGE_BODY_LEN - 1] = '\0';
 
     // Check if message exists
-    for (uint16_t inbox_message_i = 0; inbox_message_i < inboxHead; inbox_message_i++ )
+    uint64_t start = latency_now();
+    index_key_inbox( &key, &inboxMessage );
+    bool duplicate = index_find( &inboxIndex, &key ) >= 0;
+    latency_since( LATENCY_DEDUP, start );
+    if ( duplicate )
+        return false;
+
+    // Evict oldest message
+    messages_head_t slot = inboxHead;
+    if ( 0 != INBOX[slot].created_at )
+        inbox_untrack( slot );
+
+    // Place message at ring's head: slot is emptied & head committed first ( as in messages_push() )
+    __atomic_store_n( &INBOX[slot].created_at, 0, __ATOMIC_RELEASE );
+    if ( ++inboxHead == INBOX_SIZE )
     {
-        if ( 1 == isMessageEqualInbox( inboxMessage, INBOX[inbox_message_i] ) )
-            return;
-
-        if ( INBOX[inbox_message_i].created_at == 0 )
-            break;
+        inboxHead = 0;
     }
+    __atomic_store_n( &messagesStore->header.inboxHead, inboxHead, __ATOMIC_RELEASE );
 
-    // Place message at buffer's head
-    memcpy((void *) ( INBOX + inboxHead ), (void *) &inboxMessage, sizeof( InboxMessage ) );
+    inboxMessage.created_at = 0;
+    memcpy((void *) ( INBOX + slot ), (void *) &inboxMessage, sizeof( InboxMessage ) );
+    __atomic_store_n( &INBOX[slot].created_at, message->created_at, __ATOMIC_RELEASE );
 
-    // Increment head
-    inboxHead++;
+    inbox_track( slot );
+    messages_seen( message );
+
+    // Delivered: its receipt spreads to the devices that still hold it
+    if ( messagesReceipts )
+    {
+        index_key( &key, message );
+        receipts_add( &messagesStore->receipts, &receiptsIndex, &key );
+    }
 
     // Update stats
-    messagesStats.received_for_me++;
+    stats_add( STATS_RECEIVED_FOR_ME, 1 );
+
+    return true;
+}
+
+/// \brief Copies messages of $INBOX created at or after $since, oldest first. Caller holds $messagesBufferLock.
+/// \param since Linux timestamp
+/// \param messages the result messages ( passed as pointer )
+/// \param messages_n max no. of messages to copy
+/// \return no. of messages copied
+uint16_t inbox_since(uint64_t since, InboxMessage *messages, uint16_t messages_n)
+{
+    uint16_t copied = 0;
+
+    for ( uint16_t position = inbox_created_at_position( since, 0 ); position < inboxCount && copied < messages_n; position++ )
+        memcpy( &messages[copied++], &INBOX[ inboxByCreatedAt[position] ], sizeof( InboxMessage ) );
+
+    return copied;
+}
+
+/// \brief Copies messages of $INBOX sent by $sender, newest first. Caller holds $messagesBufferLock.
+/// \param sender
+/// \param messages the result messages ( passed as pointer )
+/// \param messages_n max no. of messages to copy
+/// \return no. of messages copied
+uint16_t inbox_from(uint32_t sender, InboxMessage *messages, uint16_t messages_n)
+{
+    MessageKey key;
+    uint16_t copied = 0;
+
+    index_key_sender( &key, sender );
+    int32_t slot = index_find( &inboxSenders, &key );
+    for ( ; slot >= 0 && INBOX_SLOT_NONE != slot && copied < messages_n; slot = inboxOlderBySender[slot] )
+        memcpy( &messages[copied++], &INBOX[slot], sizeof( InboxMessage ) );
+
+    return copied;
+}
+
+/// \brief Rebuilds the inbox indexes from the slots of $INBOX, oldest first from $inboxHead.
+static void inbox_rebuild(void)
+{
+    index_clear( &inboxIndex );
+    index_clear( &inboxSenders );
+    inboxCount = 0;
+
+    for ( uint16_t message_i = 0; message_i < INBOX_SIZE; message_i++ )
+    {
+        uint16_t slot = (uint16_t) ( ( inboxHead + message_i ) % INBOX_SIZE );
+        if ( 0 != INBOX[slot].created_at )
+            inbox_track( slot );
+    }
+}
+
+/// \brief Empties $INBOX ring & its indexes.
+void inbox_reset(void)
+{
+    memset( INBOX, 0, INBOX_SIZE * sizeof( InboxMessage ) );
+    inboxHead = 0;
+    messagesStore->header.inboxHead = 0;
+    inbox_rebuild();
+}
+
+/// \brief Links $slot into the chain of $origin, after the slots of lower sequence numbers ( searched from the tail, as
+/// messages mostly arrive in order ).
+static void messages_sequence_link(uint16_t slot, uint16_t origin, uint32_t seq)
+{
+    uint16_t prev = messagesSeqTails[origin];
+    while ( MESSAGES_SLOT_NONE != prev && messagesStore->headers[prev].seq > seq )
+        prev = messagesSeqPrev[prev];
+
+    uint16_t next = MESSAGES_SLOT_NONE == prev ? messagesSeqHeads[origin] : messagesSeqNext[prev];
+    messagesSeqPrev[slot] = prev;
+    messagesSeqNext[slot] = next;
+    if ( MESSAGES_SLOT_NONE == prev )
+        messagesSeqHeads[origin] = slot;
+    else
+        messagesSeqNext[prev] = slot;
+    if ( MESSAGES_SLOT_NONE == next )
+        messagesSeqTails[origin] = slot;
+    else
+        messagesSeqPrev[next] = slot;
+
+    messagesOrigins[slot] = origin;
+}
+
+/// \brief Unlinks $slot from the chain of its origin, or from the unsequenced messages.
+static void messages_sequence_unlink(uint16_t slot)
+{
+    uint16_t origin = messagesOrigins[slot];
+    if ( MESSAGES_SLOT_NONE == origin )
+    {
+        bitset_clear( messagesUnsequenced, slot );
+        return;
+    }
+
+    uint16_t prev = messagesSeqPrev[slot], next = messagesSeqNext[slot];
+    if ( MESSAGES_SLOT_NONE == prev )
+        messagesSeqHeads[origin] = next;
+    else
+        messagesSeqNext[prev] = next;
+    if ( MESSAGES_SLOT_NONE == next )
+        messagesSeqTails[origin] = prev;
+    else
+        messagesSeqPrev[next] = prev;
+
+    messagesOrigins[slot] = MESSAGES_SLOT_NONE;
+}
+
+/// \brief Empties the per-origin chains & the unsequenced messages.
+static void messages_sequence_clear(void)
+{
+    memset( messagesOrigins, 0xFF, sizeof( messagesOrigins ) );
+    memset( messagesSeqHeads, 0xFF, sizeof( messagesSeqHeads ) );
+    memset( messagesSeqTails, 0xFF, sizeof( messagesSeqTails ) );
+    memset( messagesUnsequenced, 0, sizeof( messagesUnsequenced ) );
+}
+
+/// \brief Updates store summary, index, pending bitsets & eviction candidates for $message, placed at $slot.
+/// \param slot
+/// \param message
+static void messages_track(uint16_t slot, const Message *message)
+{
+    MessageKey key;
+
+    messagesCount++;
+    if ( message->created_at > messagesNewestCreatedAt )
+        messagesNewestCreatedAt = message->created_at;
+
+    index_key( &key, message );
+    index_put( &messagesIndex, &key, slot );
+
+    // Pending for every device that has not received it
+    for ( uint32_t device_i = 0; device_i < messagesDevicesLength; device_i++ )
+    {
+        if ( !bitset_test( message->transmitted_devices, device_i ) && 0 == message->transmitted_to_recipient )
+            bitset_set( messagesPending[device_i], slot );
+        else
+            bitset_clear( messagesPending[device_i], slot );
+    }
+
+    eviction_update( &messagesEviction, slot, &messagesStore->headers[slot], messagesStore->transmittedDevices[slot] );
+
+    // Sequence chain of its origin
+    int32_t origin = messages_seen( message );
+    if ( origin >= 0 )
+        messages_sequence_link( slot, (uint16_t) origin, message->seq );
+    else
+        bitset_set( messagesUnsequenced, slot );
+
+    stats_gauge_set( STATS_BUFFERED, messagesCount );
+}
+
+/// \brief Empties $messages[$slot] & frees it for the next message placed.
+/// \param slot
+/// \param key key of the message in $slot
+static void messages_remove(uint16_t slot, const MessageKey *key)
+{
+    index_remove( &messagesIndex, key, slot );
+    messages_sequence_unlink( slot );
+    for ( uint32_t device_i = 0; device_i < messagesDevicesLength; device_i++ )
+        bitset_clear( messagesPending[device_i], slot );
+
+    __atomic_store_n( &messagesStore->headers[slot].created_at, 0, __ATOMIC_RELEASE );
+    messagesCount--;
+    eviction_free( &messagesEviction, slot );
+    stats_gauge_set( STATS_BUFFERED, messagesCount );
+}
+
+/// \brief Writes $message to empty $slot ( valid once its created_at is written ) & tracks it.
+/// \param slot
+/// \param message
+static void messages_place(messages_head_t slot, const Message *message)
+{
+    MessageHeader *header = &messagesStore->headers[slot];
+
+    header->sender = message->sender;
+    header->recipient = message->recipient;
+    header->seq = message->seq;
+    header->transmitted = message->transmitted;
+    header->transmitted_to_recipient = message->transmitted_to_recipient;
+    memcpy( messagesStore->bodies[slot], message->body, MESSAGE_BODY_LEN );
+    memcpy( messagesStore->transmittedDevices[slot], message->transmitted_devices, sizeof( message->transmitted_devices ) );
+    __atomic_store_n( &header->created_at, message->created_at, __ATOMIC_RELEASE );
+
+    messages_track( slot, message );
 }
 
 /// \brief Push $message to $messages circle buffer. Updates $messageHead acc. to selected override policy.
 /// \param message
 void messages_push(Message *message)
 {
-    // Find where to place new message
-    if ( 0 == strcmp( "sent_only", MESSAGES_PUSH_OVERRIDE_POLICY ) )
+    // Own messages are numbered here, next to the last one produced ( even if the store was reset since )
+    int32_t origin = versions_origin( CLIENT_AEM );
+    if ( CLIENT_AEM == message->sender && 0 == message->seq && origin >= 0 )
     {
-        messages_head_t messagesHeadOriginal = messagesHead;
-
-        // start searching for a hole from buffer's head
-        do
+        message->seq = messagesStore->versions.versions[origin] + 1;
+        if ( messagesSeqFd >= 0 )
         {
-            if (0 == MESSAGES_BUFFER[messagesHead].created_at ) break;    // found empty message: hole
-            if ( MESSAGES_BUFFER[messagesHead].transmitted ) break;       // found message that was transmitted: "hole"
+            // Store was reset since: own prefix resumes right below ( own earlier messages need not come back )
+            if ( message->seq <= messagesSeqLast )
+            {
+                message->seq = messagesSeqLast + 1;
+                messagesStore->versions.versions[origin] = messagesSeqLast;
+                messagesStore->versions.seen[origin] = 0;
+            }
+            messagesSeqLast = message->seq;
+
+            uint32_t record[2] = { CLIENT_AEM, messagesSeqLast };
+            if ( pwrite( messagesSeqFd, record, sizeof( record ), 0 ) != (ssize_t) sizeof( record ) )
+                perror( "\tmessages_push(): pwrite() of own sequence number failed" );
         }
-        while ( ++messagesHead < MESSAGES_SIZE );
+    }
+
+    // Find where to place new message: a free slot or a candidate of selected policy, else circle buffer's head. "blind"
+    // fills slots freed by receipts in place, so that its head keeps pointing at the oldest message.
+    int32_t victim = eviction_victim( &messagesEviction );
+    if ( victim >= 0 && EVICTION_BLIND == messagesEviction.policy )
+    {
+        messages_place( (messages_head_t) victim, message );
+        return;
+    }
 
-        // if reached buffer's end, rewind at start and search until original buffer's head
-        if ( MESSAGES_SIZE == messagesHead )
+    if ( victim >= 0 )
+        messagesHead = (messages_head_t) victim;
+    else
+        eviction_unlink( &messagesEviction, messagesHead );
+
+    // Unindex evicted message
+    if ( 0 != messagesStore->headers[messagesHead].created_at )
+    {
+        Message evicted;
+        MessageKey key;
+
+        messages_get( messagesHead, &evicted );
+        index_key( &key, &evicted );
+        index_remove( &messagesIndex, &key, messagesHead );
+        messages_sequence_unlink( messagesHead );
+        messagesCount--;
+    }
+
+    // Place message at buffer's head: slot is emptied & head committed first, so that a crash while the slot is being
+    // written leaves it empty ( slot is valid again once its created_at is written )
+    messages_head_t slot = messagesHead;
+    MessageHeader *header = &messagesStore->headers[slot];
+
+    __atomic_store_n( &header->created_at, 0, __ATOMIC_RELEASE );
+    if ( ++messagesHead == MESSAGES_SIZE )
+    {
+        messagesHead = 0;
+    }
+    __atomic_store_n( &messagesStore->header.messagesHead, messagesHead, __ATOMIC_RELEASE );
+
+    messages_place( slot, message );
+}
+
+/// \brief Push $message to $messages circle buffer, unless an equal message is already stored. Check & push are a
+/// single step as long as caller holds $messagesBufferLock.
+/// \param message
+/// \return FALSE if message was a duplicate, TRUE else
+bool messages_push_unique(Message *message)
+{
+    MessageKey key;
+    uint64_t start = latency_now();
+
+    index_key( &key, message );
+    bool duplicate = index_find( &messagesIndex, &key ) >= 0 || index_find( &receiptsIndex, &key ) >= 0;
+    start = latency_since( LATENCY_DEDUP, start );
+    if ( duplicate )
+        return false;
+
+    messages_push( message );
+    latency_since( LATENCY_PUSH, start );
+    return true;
+}
+
+/// \brief Records that message of $key reached its recipient: its receipt is kept ( & spread ) & the message is
+/// purged, if held.
+/// \param key
+/// \param purged set to TRUE if a message was purged, FALSE else ( passed as pointer )
+/// \return FALSE if receipt was known ( or receipts are off ), TRUE else
+bool messages_receipt(const MessageKey *key, bool *purged)
+{
+    *purged = false;
+    if ( !messagesReceipts || !receipts_add( &messagesStore->receipts, &receiptsIndex, key ) )
+        return false;
+
+    int32_t slot = index_find( &messagesIndex, key );
+    if ( slot >= 0 )
+    {
+        messages_remove( (uint16_t) slot, key );
+        *purged = true;
+    }
+
+    return true;
+}
+
+/// \brief Records that $messages[$message_i] reached its recipient ( see messages_receipt() ).
+/// \param message_i
+/// \return TRUE if message was purged, FALSE else
+bool messages_delivered(uint16_t message_i)
+{
+    Message message;
+    MessageKey key;
+    bool purged;
+
+    messages_get( message_i, &message );
+    index_key( &key, &message );
+    messages_receipt( &key, &purged );
+
+    return purged;
+}
+
+/// \brief Receipts of delivered messages ( ring ). Caller holds $messagesBufferLock.
+/// \return pointer into the store
+const Receipts *messages_receipts(void)
+{
+    return &messagesStore->receipts;
+}
+
+/// \brief Find next slot of $messages circle buffer ( starting from $message_i ) pending for device with $aemIndex.
+/// \param message_i first slot to examine
+/// \param aemIndex
+/// \return slot index, -1 if no more messages are pending for device
+int32_t messages_next_pending(uint16_t message_i, int32_t aemIndex)
+{
+    uint32_t word_i = message_i / 64;
+    uint64_t word;
+
+    if ( message_i >= MESSAGES_SIZE )
+        return -1;
+
+    // Skip slots before $message_i in first word
+    word = messagesPending[aemIndex][word_i] & ( ~(uint64_t) 0 << ( message_i % 64 ) );
+    while ( 0 == word )
+    {
+        if ( ++word_i == MESSAGES_PENDING_WORDS )
+            return -1;
+        word = messagesPending[aemIndex][word_i];
+    }
+
+    return (int32_t) ( word_i * 64 + (uint32_t) __builtin_ctzll( word ) );
+}
+
+/// \brief Find next slot of $messages pending for device with $aemIndex & missing from its $versions: per origin,
+/// messages above the device's version in sequence order, then unsequenced messages. Slots evicted meanwhile are not
+/// revisited, messages placed meanwhile are examined if $cursor did not pass them yet.
+/// \param cursor position of the transmitter, all 0 for the first call ( advanced past the returned slot )
+/// \param versions version vector of the device, by origin
+/// \param aemIndex
+/// \return slot index, -1 if no more messages are missing from device
+int32_t messages_next_missing(MessagesCursor *cursor, const uint32_t *versions, int32_t aemIndex)
+{
+    for ( ; cursor->origin < messagesDevicesLength; cursor->origin++, cursor->slot = 0, cursor->seq = 0 )
+    {
+        uint16_t origin = cursor->origin;
+        uint32_t above = cursor->seq > versions[origin] ? cursor->seq : versions[origin];
+        uint16_t slot;
+
+        // Resume after last returned slot, unless it was evicted; else first slot above device's version
+        if ( 0 != cursor->seq && origin == messagesOrigins[cursor->slot] && cursor->seq == messagesStore->headers[cursor->slot].seq )
         {
-            messagesHead = 0;
+            slot = messagesSeqNext[cursor->slot];
+        }
+        else
+        {
+            slot = MESSAGES_SLOT_NONE;
+            for ( uint16_t prev = messagesSeqTails[origin]; MESSAGES_SLOT_NONE != prev && messagesStore->headers[prev].seq > above; prev = messagesSeqPrev[prev] )
+                slot = prev;
+        }
 
-            while ( messagesHead < messagesHeadOriginal )
+        for ( ; MESSAGES_SLOT_NONE != slot; slot = messagesSeqNext[slot] )
+        {
+            if ( messagesStore->headers[slot].seq > above && bitset_test( messagesPending[aemIndex], slot ) )
             {
-                if (0 == MESSAGES_BUFFER[messagesHead].created_at ) break;
-                if ( MESSAGES_BUFFER[messagesHead].transmitted ) break;
-
-                messagesHead++;
+                cursor->slot = slot;
+                cursor->seq = messagesStore->headers[slot].seq;
+                return slot;
             }
+        }
+    }
 
-            // after this loop, if no break executed, messagesHead === messagesHeadOriginal
+    // Unsequenced messages: $slot is the next one to examine
+    for ( uint32_t word_i = cursor->slot / 64; cursor->slot < MESSAGES_SIZE; word_i++, cursor->slot = (uint16_t) ( word_i * 64 ) )
+    {
+        uint64_t word = messagesPending[aemIndex][word_i] & messagesUnsequenced[word_i] & ( ~(uint64_t) 0 << ( cursor->slot % 64 ) );
+        if ( 0 != word )
+        {
+            int32_t slot = (int32_t) ( word_i * 64 + (uint32_t) __builtin_ctzll( word ) );
+            cursor->slot = (uint16_t) ( slot + 1 );
+            return slot;
         }
     }
 
-    // Place message at buffer's head
-    memcpy((void *) (MESSAGES_BUFFER + messagesHead ), (void *) message, sizeof( Message ) );
+    return -1;
+}
 
-    // Increment head
-    if ( ++messagesHead == MESSAGES_SIZE )
+/// \brief Marks $messages[$message_i] as transmitted to $device ( if $device is its recipient, message is no longer
+/// pending for any device ).
+/// \param message_i
+/// \param device
+void messages_transmitted(uint16_t message_i, Device device)
+{
+    messagesStore->headers[message_i].transmitted = 1;
+    bitset_set( messagesStore->transmittedDevices[message_i], device.aemIndex );
+    bitset_clear( messagesPending[device.aemIndex], message_i );
+
+    if ( device.AEM == messagesStore->headers[message_i].recipient )
     {
-        messagesHead = 0;
+        messagesStore->headers[message_i].transmitted_to_recipient = 1;
+        for ( uint32_t device_i = 0; device_i < messagesDevicesLength; device_i++ )
+            bitset_clear( messagesPending[device_i], message_i );
     }
+
+    eviction_update( &messagesEviction, message_i, &messagesStore->headers[message_i], messagesStore->transmittedDevices[message_i] );
+}
+
+/// \brief Header ( sender, recipient, created_at & transmit flags ) of $messages[$message_i].
+/// \param message_i
+/// \return pointer into the store ( created_at is 0 if slot is empty )
+const MessageHeader *messages_header(uint16_t message_i)
+{
+    return &messagesStore->headers[message_i];
 }
 
-/// \brief Main server loop. Calls communication_thread() on each new connection.
+/// \brief Copies $messages[$message_i] ( header, body & transmitted devices ) to $message.
+/// \param message_i
+/// \param message the result message ( passed as pointer )
+void messages_get(uint16_t message_i, Message *message)
+{
+    const MessageHeader *header = &messagesStore->headers[message_i];
+
+    message->sender = header->sender;
+    message->recipient = header->recipient;
+    message->created_at = header->created_at;
+    message->seq = header->seq;
+    message->transmitted = header->transmitted;
+    message->transmitted_to_recipient = header->transmitted_to_recipient;
+    memcpy( message->body, messagesStore->bodies[message_i], MESSAGE_BODY_LEN );
+    memcpy( message->transmitted_devices, messagesStore->transmittedDevices[message_i], sizeof( message->transmitted_devices ) );
+}
+
+/// \brief Version vector of the messages this device has seen ( in $messages, $INBOX or evicted since ). Caller holds
+/// $messagesBufferLock.
+/// \return pointer into the store
+const VersionVector *messages_versions(void)
+{
+    return &messagesStore->versions;
+}
+
+/// \brief Adds all messages of $messages & $INBOX to $summary ( keys are taken from the indexes, bodies are not
+/// hashed again ). Caller holds $messagesBufferLock.
+/// \param summary
+void messages_summary(Summary *summary)
+{
+    MessageKey key;
+
+    for ( uint32_t entry_i = 0; entry_i <= messagesIndex.mask; entry_i++ )
+        if ( 0 != messagesIndex.entries[entry_i].slot )
+            summary_add( summary, &messagesIndex.entries[entry_i].key );
+
+    // Inbox keys leave recipient out ( it is this device )
+    for ( uint32_t entry_i = 0; entry_i <= inboxIndex.mask; entry_i++ )
+    {
+        if ( 0 == inboxIndex.entries[entry_i].slot )
+            continue;
+
+        key = inboxIndex.entries[entry_i].key;
+        key.recipient = CLIENT_AEM;
+        summary_add( summary, &key );
+    }
+}
+
+/// \brief Selects the eviction policy of $messages circle buffer & empties it. Pending bitsets are kept only for the
+/// devices of $CLIENT_AEM_SOURCE.
+/// \param policy name of the policy ( see $MESSAGES_PUSH_OVERRIDE_POLICY )
+void messages_init(const char *policy)
+{
+    int32_t evictionPolicy = eviction_policy( policy );
+    if ( -1 == evictionPolicy )
+        error( -1, "\tmessages_init(): unknown eviction policy" );
+
+    messagesEviction.policy = (EvictionPolicy) evictionPolicy;
+    messagesDevicesLength = 0 == strcmp( "list", CLIENT_AEM_SOURCE ) ? CLIENT_AEM_LIST_LENGTH : CLIENT_AEM_RANGE_LENGTH;
+    messages_reset();
+}
+
+/// \brief Empties $messages circle buffer, its index, the version vector & the receipts ( eviction policy is kept ).
+void messages_reset(void)
+{
+    memset( messagesStore->headers, 0, sizeof( messagesStore->headers ) );
+    memset( messagesStore->bodies, 0, sizeof( messagesStore->bodies ) );
+    memset( messagesStore->transmittedDevices, 0, sizeof( messagesStore->transmittedDevices ) );
+    memset( &messagesStore->versions, 0, sizeof( messagesStore->versions ) );
+    memset( &messagesStore->receipts, 0, sizeof( messagesStore->receipts ) );
+    index_clear( &receiptsIndex );
+    memset( messagesPending, 0, sizeof( messagesPending ) );
+    index_clear( &messagesIndex );
+    messages_sequence_clear();
+    eviction_init( &messagesEviction, messagesEviction.policy );
+    messagesHead = 0;
+    messagesCount = 0;
+    messagesNewestCreatedAt = 0;
+    messagesStore->header.messagesHead = 0;
+    stats_gauge_set( STATS_BUFFERED, 0 );
+}
+
+/// \brief Rebuilds indexes, pending bitsets, eviction candidates & heads from the slots of $messagesStore.
+static void messages_rebuild(void)
+{
+    Message message;
+
+    memset( messagesPending, 0, sizeof( messagesPending ) );
+    index_clear( &messagesIndex );
+    messages_sequence_clear();
+    receipts_rebuild( &messagesStore->receipts, &receiptsIndex );
+    eviction_init( &messagesEviction, messagesEviction.policy );
+    messagesCount = 0;
+    messagesNewestCreatedAt = 0;
+
+    for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+    {
+        if ( 0 == messagesStore->headers[message_i].created_at )
+            continue;
+
+        messages_get( message_i, &message );
+        eviction_unlink( &messagesEviction, message_i );
+        messages_track( message_i, &message );
+    }
+
+    messagesHead = (messages_head_t) ( messagesStore->header.messagesHead % MESSAGES_SIZE );
+    stats_gauge_set( STATS_BUFFERED, messagesCount );
+
+    inboxHead = (messages_head_t) ( messagesStore->header.inboxHead % INBOX_SIZE );
+    inbox_rebuild();
+}
+
+/// \brief Moves $messages & $INBOX to the memory-mapped file at $path. A file written by this device with the same
+/// store layout is reattached, any other file is reset to an empty store. On failure store stays in memory.
+/// \param path
+/// \return no. of messages reattached, -1 on failure
+int32_t messages_attach(const char *path)
+{
+    MessagesStore *store;
+    struct stat fileStat;
+    int fd;
+
+    fd = open( path, O_RDWR | O_CREAT, 0644 );
+    if ( fd < 0 || fstat( fd, &fileStat ) < 0 )
+    {
+        perror( "\tmessages_attach(): open() failed" );
+        if ( fd >= 0 )
+            close( fd );
+        return -1;
+    }
+
+    if ( (uint64_t) fileStat.st_size != sizeof( MessagesStore ) && ftruncate( fd, sizeof( MessagesStore ) ) < 0 )
+    {
+        perror( "\tmessages_attach(): ftruncate() failed" );
+        close( fd );
+        return -1;
+    }
+
+    store = mmap( NULL, sizeof( MessagesStore ), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if ( MAP_FAILED == store )
+    {
+        perror( "\tmessages_attach(): mmap() failed" );
+        close( fd );
+        return -1;
+    }
+
+    // Other version, layout or owner > start empty
+    if ( 0 != memcmp( store->header.magic, MESSAGES_STORE_MAGIC, sizeof( MESSAGES_STORE_MAGIC ) )
+         || MESSAGES_STORE_VERSION != store->header.version || sizeof( MessagesStore ) != store->header.size
+         || CLIENT_AEM != store->header.aem )
+    {
+        memset( store, 0, sizeof( MessagesStore ) );
+        memcpy( store->header.magic, MESSAGES_STORE_MAGIC, sizeof( MESSAGES_STORE_MAGIC ) );
+        store->header.version = MESSAGES_STORE_VERSION;
+        store->header.size = sizeof( MessagesStore );
+        store->header.aem = CLIENT_AEM;
+    }
+
+    messages_detach();
+    messagesStore = store;
+    messagesStoreFd = fd;
+    INBOX = store->inbox;
+    messages_rebuild();
+
+    return (int32_t) messagesCount;
+}
+
+/// \brief Flushes & unmaps the store file, if any. Store is empty & in memory afterwards.
+void messages_detach(void)
+{
+    if ( -1 == messagesStoreFd )
+        return;
+
+    msync( messagesStore, sizeof( MessagesStore ), MS_SYNC );
+    munmap( messagesStore, sizeof( MessagesStore ) );
+    close( messagesStoreFd );
+
+    messagesStoreFd = -1;
+    messagesStore = &messagesStoreMemory;
+    INBOX = messagesStoreMemory.inbox;
+    messages_reset();
+    inbox_reset();
+}
+
+/// \brief Keeps own sequence numbers in the file at $path from now on: own messages are numbered after the last one
+/// recorded there, whatever the store holds. A file written by another device counts as empty.
+/// \param path
+/// \return last own sequence number recorded, -1 on failure
+int64_t messages_seq_attach(const char *path)
+{
+    uint32_t record[2] = { 0, 0 };
+    int fd;
+
+    fd = open( path, O_RDWR | O_CREAT, 0644 );
+    if ( fd < 0 )
+    {
+        perror( "\tmessages_seq_attach(): open() failed" );
+        return -1;
+    }
+
+    if ( pread( fd, record, sizeof( record ), 0 ) != (ssize_t) sizeof( record ) || CLIENT_AEM != record[0] )
+        record[1] = 0;
+
+    messages_seq_detach();
+    messagesSeqFd = fd;
+    messagesSeqLast = record[1];
+
+    return messagesSeqLast;
+}
+
+/// \brief Closes the file of own sequence numbers, if any. Own messages follow the store's version vector afterwards.
+void messages_seq_detach(void)
+{
+    if ( -1 == messagesSeqFd )
+        return;
+
+    close( messagesSeqFd );
+    messagesSeqFd = -1;
+    messagesSeqLast = 0;
+}
+
+/// \brief Asks listening_worker() to return: the reactor closes its sessions within $REACTOR_TICK msecs, the threaded
+/// server stops once accept() is interrupted ( by the signal that stopped it ). Async-signal-safe.
+void listening_stop(void)
+{
+    listeningStopping = 1;
+    reactor_stop();
+}
+
+/// \brief Main server loop. Runs the reactor, or calls communication_worker() on each new connection, until
+/// listening_stop().
 void listening_worker()
 {
     int server_socket_fd;
@@ -180,9 +957,23 @@ void listening_worker()
         error(status, "ERROR on binding");
 
     listen( server_socket_fd, SOCKET_LISTEN_QUEUE_LEN );
-    while (1)
+
+    // Drive all sessions from a single-threaded epoll loop
+    if ( 0 == strcmp( "reactor", SERVER_MODE ) )
+    {
+        reactor_run( server_socket_fd );
+        close( server_socket_fd );
+        return;
+    }
+
+    while ( 0 == listeningStopping )
     {
         client_socket_fd = accept(server_socket_fd, (struct sockaddr *) &clientAddress, &(socklen_t){ sizeof( struct sockaddr_in ) } );
+        if ( client_socket_fd < 0 && EINTR == errno )
+        {
+            latency_print_requested( stdout );
+            continue;
+        }
         if (client_socket_fd < 0)
             error(client_socket_fd, "ERROR on accept");
 
@@ -203,30 +994,9 @@ void listening_worker()
         };
         memcpy( &args.connected_device, &device, sizeof( Device ) );
 
-        //  - open thread
-        if ( communicationThreadsAvailable > 0 )
-        {
-            // Update available treads count
-            pthread_mutex_lock( &availableThreadsLock );
-                pthread_t communicationThread = communicationThreads[ COMMUNICATION_WORKERS_MAX - communicationThreadsAvailable ];
-                communicationThreadsAvailable--;
-            pthread_mutex_unlock( &availableThreadsLock );
-
-            args.concurrent = true;
-
-            status = pthread_create( &communicationThread, NULL, (void *) communication_worker, &args );
-            if ( status != 0 )
-                error( status, "\tserver_listen(): pthread_create() failed" );
-
-            status = pthread_detach( communicationThread );
-            if ( status != 0 )
-                error( status, "\tserver_listen(): pthread_detach() failed" );
-        }
-        else
-        {
-            // run in main thread
-            args.concurrent = false;
-            communication_worker( &args );
-        }
+        //  - queue session ( pool copies $args, accepts pause while pool's queue is full )
+        pool_submit( &args );
     }
+
+    close( server_socket_fd );
 }
@@ -0,0 +1,847 @@
+#include "conf.h"
+#include "session.h"
+#include "communication.h"
+#include "contacts.h"
+#include "frame.h"
+#include "log.h"
+#include "index.h"
+#include "latency.h"
+#include "receipts.h"
+#include "scan.h"
+#include "server.h"
+#include "stats.h"
+#include "summary.h"
+#include "utils.h"
+#include "versions.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+
+extern pthread_mutex_t activeDevicesLock, messagesBufferLock;
+
+extern const char *communicationSessionMode;
+extern const char *communicationProtocol;
+extern const char *communicationFraming;
+extern const char *communicationStreamMode;
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Returns current time of the monotonic clock in msecs.
+static uint64_t session_now(void)
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+/// \brief Records session's time to first byte, when the first bytes of the device arrived.
+/// \param session
+static void session_first_byte(Session *session)
+{
+    if ( 0 == session->opened_at )
+        return;
+
+    latency_since( LATENCY_FIRST_BYTE, session->opened_at );
+    session->opened_at = 0;
+}
+
+/// \brief Logs $message now, or appends it to session's journal if session's log is deferred.
+/// \param session
+/// \param action
+/// \param message
+static void session_log_message(Session *session, const char *action, const Message *message)
+{
+    if ( !session->deferred_log )
+    {
+        log_event_message( action, message );
+        return;
+    }
+
+    if ( session->journal_n == session->journal_size )
+    {
+        uint32_t journalSize = 0 == session->journal_size ? 64 : 2 * session->journal_size;
+        SessionJournalEntry *journal = realloc( session->journal, journalSize * sizeof( SessionJournalEntry ) );
+        if ( NULL == journal )
+            return;
+
+        session->journal = journal;
+        session->journal_size = journalSize;
+    }
+
+    session->journal[session->journal_n].action = action;
+    memcpy( &session->journal[session->journal_n].message, message, sizeof( Message ) );
+    session->journal_n++;
+}
+
+/// \brief Moves session to its next stage after its transmitter ( or receiver ) finished. In half-duplex mode the
+/// other direction starts only now.
+/// \param session
+/// \param transmitterFinished
+static void session_next_state(Session *session, bool transmitterFinished)
+{
+    if ( transmitterFinished )
+    {
+        shutdown( session->socket_fd, SHUT_WR );
+        session->transmitting = false;
+        session->tx_finished = true;
+        if ( !session->duplex && session->server )
+            session->receiving = true;
+    }
+    else
+    {
+        shutdown( session->socket_fd, SHUT_RD );
+        session->receiving = false;
+        session->rx_finished = true;
+        if ( !session->duplex && !session->server )
+            session->transmitting = true;
+    }
+}
+
+/// \brief Ends handshake once both handshakes crossed: receipts of the messages the device holds, then messages flow
+/// from now on, acc. to session's mode.
+/// \param session
+static void session_handshake_next(Session *session)
+{
+    if ( session->handshake_tx_offset < session->handshake_tx_length || !session->summarized )
+        return;
+
+    pthread_mutex_lock( &messagesBufferLock );
+        session->receipts_tx_length = receipts_pack( messages_receipts(), &session->handshake->summary, session->handshake->receipts_tx );
+    pthread_mutex_unlock( &messagesBufferLock );
+
+    session->handshaking = false;
+    session->transmitting = session->duplex || session->server;
+    session->receiving = session->duplex || !session->server;
+}
+
+/// \brief Sets ( or clears ) TCP_CORK on session's socket: while set, partial segments wait until they fill up.
+/// \param session
+/// \param cork
+static void session_cork(Session *session, bool cork)
+{
+    int value = cork ? 1 : 0;
+
+    if ( !session->batched || session->tx_corked == cork )
+        return;
+
+    setsockopt( session->socket_fd, IPPROTO_TCP, TCP_CORK, &value, sizeof( int ) );
+    session->syscalls++;
+    session->tx_corked = cork;
+}
+
+/// \brief Serializes the next pending messages into session's transmit batch, as many as it holds ( one if session is
+/// not batched ).
+/// \param session
+static void session_batch_fill(Session *session)
+{
+    uint16_t batchMax = session->batched ? STREAM_BATCH_MAX : 1;
+    uint16_t lengthMax = session->binary ? FRAME_LEN_MAX : session->record_length;
+    MessageKey key;
+    Message message;
+
+    session->tx_offset = 0;
+    session->tx_length = 0;
+    session->tx_batch_sent = 0;
+    session->tx_batch_n = 0;
+
+    while ( session->tx_batch_n < batchMax && session->tx_length + lengthMax <= STREAM_TX_LEN )
+    {
+        // Next pending message ( only the ranges the device is missing, once its versions are known )
+        int32_t pending_i = session->summarized ?
+            communication_next_missing( &session->tx_cursor, session->handshake->versions, session->device, &message ) :
+            communication_next_pending( session->tx_message_i, session->device, &message );
+        if ( -1 == pending_i )
+            return;
+
+        session->tx_message_i = (uint16_t) ( pending_i + 1 );
+        session->examined++;
+
+        // Skip messages the device already holds ( as far as its summary tells )
+        index_key( &key, &message );
+        if ( session->summarized && summary_contains( &session->handshake->summary, &key ) )
+        {
+            session->skipped++;
+            continue;
+        }
+
+        uint64_t serializeStart = latency_now();
+        uint8_t *record = session->tx_buffer + session->tx_length;
+        if ( session->binary )
+        {
+            session->tx_length += frame_encode( &message, record );
+        }
+        else
+        {
+            implode( "_", message, (char *) record );
+            if ( MESSAGE_SEQUENCED_LEN == session->record_length )
+                uint2digits( message.seq, (char *) record + MESSAGE_SERIALIZED_LEN, 10 );
+            session->tx_length += session->record_length;
+        }
+
+        session->tx_batch[session->tx_batch_n].key = key;
+        session->tx_batch[session->tx_batch_n].slot = (uint16_t) pending_i;
+        session->tx_batch[session->tx_batch_n].end = session->tx_length;
+        session->tx_batch[session->tx_batch_n].serialized_at = latency_since( LATENCY_SERIALIZE, serializeStart );
+        session->tx_batch_n++;
+    }
+}
+
+/// \brief Reassembles messages out of the bytes session received: stores & logs the valid ones, keeps the bytes of the
+/// last partial message. Text records are validated in batches ( one pass over all complete ones ).
+/// \param session
+/// \return FALSE if device sent a bad frame, TRUE else
+static bool session_stream_parse(Session *session)
+{
+    uint16_t offset = 0, length, record_i = 0;
+    uint64_t valid = 0, firstAt = session->rx_first_at;
+    Message message;
+
+    while ( true )
+    {
+        uint8_t *bytes = session->rx_buffer + offset;
+        uint16_t available = (uint16_t) ( session->rx_length - offset );
+
+        // Reconstruct message ( sequence number follows the text record in "summary" protocol )
+        if ( session->binary )
+        {
+            if ( available < FRAME_PREFIX_LEN )
+                break;
+
+            length = frame_length( bytes );
+            if ( 0 == length )
+                return false;
+            if ( available < length )
+                break;
+
+            // Message complete: its first byte arrived with an earlier read only if it is the first one
+            latency_since( LATENCY_RECEIVE, firstAt );
+            firstAt = session->rx_read_at;
+
+            offset += length;
+            if ( !scan_body( bytes + FRAME_PREFIX_LEN + FRAME_HEADER_LEN, (uint16_t) ( length - FRAME_PREFIX_LEN - FRAME_HEADER_LEN ) ) )
+            {
+                session->rejected++;
+                continue;
+            }
+
+            frame_decode( &message, bytes );
+        }
+        else
+        {
+            length = session->record_length;
+            if ( available < length )
+                break;
+
+            if ( 0 == record_i % 64 )
+                valid = scan_records( bytes, available / length < 64 ? available / length : 64, length );
+
+            latency_since( LATENCY_RECEIVE, firstAt );
+            firstAt = session->rx_read_at;
+
+            offset += length;
+            if ( 0 == ( valid >> ( record_i++ % 64 ) & 1 ) )
+            {
+                session->rejected++;
+                continue;
+            }
+
+            explode( &message, "_", (const char *) bytes );
+            message.seq = MESSAGE_SEQUENCED_LEN == length ? (uint32_t) digits2uint( (const char *) bytes + MESSAGE_SERIALIZED_LEN, 10 ) : 0;
+        }
+
+        // Store & log message
+        if ( true == communication_store_message( &message, session->device ) )
+            session_log_message( session, "received", &message );
+    }
+
+    memmove( session->rx_buffer, session->rx_buffer + offset, session->rx_length - offset );
+    session->rx_length -= offset;
+    session->rx_first_at = firstAt;
+
+    return true;
+}
+
+/// \brief Get how many bytes session reads next: as many as its buffer holds, or only the rest of the message ( or
+/// frame prefix ) being received if session is not batched.
+/// \param session
+/// \return no. of bytes
+static uint16_t session_stream_wanted(const Session *session)
+{
+    if ( session->batched )
+        return (uint16_t) ( STREAM_RX_LEN - session->rx_length );
+
+    if ( !session->binary )
+        return (uint16_t) ( session->record_length - session->rx_length );
+
+    return (uint16_t) ( session->rx_length < FRAME_PREFIX_LEN ?
+        FRAME_PREFIX_LEN - session->rx_length : frame_length( session->rx_buffer ) - session->rx_length );
+}
+
+/// \brief Ends session after a socket error, in both directions.
+/// \param session
+static void session_fail(Session *session)
+{
+    session->transmitting = false;
+    session->receiving = false;
+}
+
+/// \brief Get what this device runs, as $NEGOTIATION_FEATURE_* bits.
+/// \return features
+static uint32_t session_features(void)
+{
+    return ( 0 == strcmp( "summary", communicationProtocol ) ? NEGOTIATION_FEATURE_SUMMARY : 0 ) |
+           ( 0 == strcmp( "binary", communicationFraming ) ? NEGOTIATION_FEATURE_BINARY : 0 );
+}
+
+/// \brief Packs session's opening ( or answer ): magic & features of this device.
+/// \param session
+static void session_negotiation_pack(Session *session)
+{
+    uint32_t fields[2] = { htonl( NEGOTIATION_MAGIC ), htonl( session_features() ) };
+
+    memcpy( session->negotiation_tx, fields, NEGOTIATION_LEN );
+    session->negotiation_tx_length = NEGOTIATION_LEN;
+}
+
+/// \brief Starts the summary handshake: both devices send the summary & version vector of the messages they hold first
+/// ( in both modes ).
+/// \param session
+static void session_handshake_start(Session *session)
+{
+    Summary summary;
+    summary_init( &summary, (uint32_t) rand() );
+
+    session->handshake = malloc( sizeof( SessionHandshake ) );
+    if ( NULL == session->handshake )
+    {
+        perror( "\tsession_handshake_start(): malloc() failed" );
+        session_fail( session );        // neither direction is open: session ends at once
+        return;
+    }
+
+    pthread_mutex_lock( &messagesBufferLock );
+        messages_summary( &summary );
+        session->handshake_tx_length = (uint16_t) ( SUMMARY_LEN + versions_pack( messages_versions(), session->handshake->tx + SUMMARY_LEN ) );
+    pthread_mutex_unlock( &messagesBufferLock );
+
+    summary_pack( &summary, session->handshake->tx );
+    session->handshake_rx_expected = SUMMARY_LEN + VERSIONS_HEADER_LEN;
+    session->receipts_rx_expected = RECEIPTS_HEADER_LEN;
+    session->record_length = MESSAGE_SEQUENCED_LEN;
+    session->handshaking = true;
+    session->transmitting = true;
+    session->receiving = true;
+}
+
+/// \brief Ends negotiation once own opening ( or answer ) went out & the device's one arrived: binary frames & summary
+/// handshake if both devices run them, else text records & messages flow acc. to session's mode.
+/// \param session
+static void session_negotiation_next(Session *session)
+{
+    uint32_t features;
+
+    if ( session->negotiation_tx_offset < session->negotiation_tx_length || session->negotiation_rx_length < NEGOTIATION_LEN )
+        return;
+
+    memcpy( &features, session->negotiation_rx + 4, sizeof( uint32_t ) );
+    features = ntohl( features ) & session_features();
+
+    session->negotiating = false;
+    session->binary = 0 != ( features & NEGOTIATION_FEATURE_BINARY );
+    if ( 0 != ( features & NEGOTIATION_FEATURE_SUMMARY ) )
+    {
+        session_handshake_start( session );
+        return;
+    }
+
+    session->transmitting = session->duplex || session->server;
+    session->receiving = session->duplex || !session->server;
+}
+
+/// \brief Serves a device that does not negotiate ( it predates negotiation, or listens with no feature to negotiate )
+/// as devices without it do: baseline text records, of which the bytes it sent so far are the first ones.
+/// \param session
+/// \param closed if device already closed its write stream
+static void session_negotiation_skip(Session *session, bool closed)
+{
+    memcpy( session->rx_buffer, session->negotiation_rx, session->negotiation_rx_length );
+    session->rx_length = session->negotiation_rx_length;
+    session->rx_read_at = latency_now();
+    session->rx_first_at = session->rx_read_at;
+    session->negotiating = false;
+
+    // Dialing device read the opening as a short record, so it receives nothing more: it transmits only
+    if ( session->server )
+    {
+        shutdown( session->socket_fd, SHUT_WR );
+        session->transmitting = false;
+    }
+    else
+    {
+        session->transmitting = session->duplex;
+    }
+    session->receiving = true;
+
+    if ( closed )
+        session_next_state( session, false );
+}
+
+/// \brief Opens a non-blocking session with connected device. Registers device as active.
+/// \param session the session ( passed as pointer )
+/// \param socket_fd connected socket ( switched to O_NONBLOCK mode )
+/// \param device connected device
+/// \param server in half-duplex mode, if TRUE transmits first & then receives, else the other way around
+/// \param deferredLog if TRUE the session's messages are logged at session_flush_log(), else as they are exchanged
+/// \return FALSE if session was rejected ( unknown device, active connection with device exists, ... ), TRUE else
+bool session_open(Session *session, int32_t socket_fd, Device device, bool server, bool deferredLog)
+{
+    bool deviceExists;
+
+    bzero( session, sizeof( Session ) );
+    session->socket_fd = socket_fd;
+    session->device = device;
+    session->server = server;
+    session->duplex = 0 == strcmp( "full-duplex", communicationSessionMode );
+    session->deferred_log = deferredLog;
+    session->active_at = session_now();
+    session->opened_at = latency_now();
+    gettimeofday( &session->started_at, NULL );
+
+    if ( -1 == device.aemIndex )
+    {
+        fprintf( stderr, "Unknown device: AEM = %04d. Skipping...", device.AEM );
+        return false;
+    }
+
+    // Check if there is an active connection with given device, else register it
+    pthread_mutex_lock( &activeDevicesLock );
+        deviceExists = devices_exists( device );
+        if ( !deviceExists )
+        {
+            devices_push( device );
+            session->active = true;
+        }
+    pthread_mutex_unlock( &activeDevicesLock );
+
+    if ( !session->active )
+    {
+        fprintf( stderr, "Active connection with device found: AEM = %04d. Skipping...", device.AEM );
+        return false;
+    }
+    stats_gauge_add( STATS_ACTIVE_SESSIONS, 1 );
+
+    socket_set_blocking( socket_fd, false, NULL );
+    session->record_length = MESSAGE_SERIALIZED_LEN;
+    session->batched = 0 == strcmp( "batched", communicationStreamMode );
+
+    // Negotiation: listening device that runs any feature opens with them. Dialing device sends nothing before the
+    // listening device's first bytes: the opening ( it answers it ), or the messages of a device that does not negotiate
+    // ( listening devices transmit first, or at once )
+    if ( !server || 0 != session_features() )
+    {
+        if ( server )
+            session_negotiation_pack( session );
+        session->negotiating = true;
+        session->transmitting = server;
+        session->receiving = true;
+        return true;
+    }
+
+    // Full-duplex: transmit & receive at once. Half-duplex: if device is server, act as transmitter, else act as receiver.
+    session->transmitting = session->duplex || server;
+    session->receiving = session->duplex || !server;
+    return true;
+}
+
+/// \brief Receives as much as possible from session's socket without blocking.
+/// \param session
+void session_on_readable(Session *session)
+{
+    SessionHandshake *handshake;
+    ssize_t n;
+
+    // Device's negotiation first: listening device's opening, or dialing device's answer
+    while ( session->negotiating && session->negotiation_rx_length < NEGOTIATION_LEN )
+    {
+        n = read( session->socket_fd, session->negotiation_rx + session->negotiation_rx_length, NEGOTIATION_LEN - session->negotiation_rx_length );
+        session->syscalls++;
+        if ( n < 0 )
+        {
+            if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno )
+                session_fail( session );
+            return;
+        }
+
+        // Device closed its write stream without negotiating ( e.g. it had no messages to send )
+        if ( 0 == n )
+        {
+            session_negotiation_skip( session, true );
+            return;
+        }
+
+        session->active_at = session_now();
+        session_first_byte( session );
+        session->bytes_received += n;
+        session->negotiation_rx_length += n;
+    }
+
+    if ( session->negotiating )
+    {
+        uint32_t magic;
+        memcpy( &magic, session->negotiation_rx, sizeof( uint32_t ) );
+
+        // Text records start with digits, never with the magic
+        if ( NEGOTIATION_MAGIC != ntohl( magic ) )
+        {
+            session_negotiation_skip( session, false );
+        }
+        else
+        {
+            if ( !session->server )
+            {
+                session_negotiation_pack( session );
+                session->transmitting = true;
+            }
+
+            session_negotiation_next( session );
+            if ( session->negotiating )
+                return;
+        }
+    }
+
+    handshake = session->handshake;
+
+    // Device's handshake first: summary, then version vector ( its length is known after its header )
+    while ( session->handshaking && !session->summarized )
+    {
+        n = read( session->socket_fd, handshake->rx + session->handshake_rx_length, session->handshake_rx_expected - session->handshake_rx_length );
+        session->syscalls++;
+        if ( n < 0 )
+        {
+            if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno )
+                session_fail( session );
+            return;
+        }
+
+        // Device closed its write stream before its handshake
+        if ( 0 == n )
+        {
+            session_fail( session );
+            return;
+        }
+
+        session->active_at = session_now();
+        session_first_byte( session );
+        session->bytes_received += n;
+        session->handshake_rx_length += n;
+        if ( session->handshake_rx_expected != session->handshake_rx_length )
+            continue;
+
+        // Summary & version vector's header arrived: the entries follow
+        if ( SUMMARY_LEN + VERSIONS_HEADER_LEN == session->handshake_rx_length )
+        {
+            uint32_t versionsLength = versions_length( handshake->rx + SUMMARY_LEN );
+            if ( !summary_unpack( &handshake->summary, handshake->rx ) || 0 == versionsLength )
+            {
+                fprintf( stderr, "\tsession_on_readable(): AEM = %04d sent no handshake. Dropping...\n", session->device.AEM );
+                session_fail( session );
+                return;
+            }
+
+            session->handshake_rx_expected = (uint16_t) ( SUMMARY_LEN + versionsLength );
+            if ( session->handshake_rx_expected != session->handshake_rx_length )
+                continue;
+        }
+
+        session->summarized = versions_unpack( handshake->versions, handshake->rx + SUMMARY_LEN );
+    }
+
+    if ( session->handshaking )
+    {
+        session_handshake_next( session );
+        if ( session->handshaking )
+            return;
+    }
+
+    // Device's receipts first ( their length is known after their header )
+    while ( session->receiving && session->receipts_rx_length < session->receipts_rx_expected )
+    {
+        n = read( session->socket_fd, handshake->receipts_rx + session->receipts_rx_length, session->receipts_rx_expected - session->receipts_rx_length );
+        session->syscalls++;
+        if ( n < 0 )
+        {
+            if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno )
+                session_fail( session );
+            return;
+        }
+
+        if ( 0 == n )
+        {
+            session_next_state( session, false );
+            return;
+        }
+
+        session->active_at = session_now();
+        session_first_byte( session );
+        session->bytes_received += n;
+        session->receipts_rx_length += n;
+        if ( RECEIPTS_HEADER_LEN == session->receipts_rx_length )
+        {
+            session->receipts_rx_expected = receipts_length( handshake->receipts_rx );
+            if ( 0 == session->receipts_rx_expected )
+            {
+                fprintf( stderr, "\tsession_on_readable(): AEM = %04d sent no receipts. Dropping...\n", session->device.AEM );
+                session_fail( session );
+                return;
+            }
+        }
+
+        if ( session->receipts_rx_expected == session->receipts_rx_length )
+            session->receipts += communication_store_receipts( handshake->receipts_rx );
+    }
+
+    while ( session->receiving )
+    {
+        n = read( session->socket_fd, session->rx_buffer + session->rx_length, session_stream_wanted( session ) );
+        session->syscalls++;
+        if ( n < 0 )
+        {
+            if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno )
+                session_fail( session );
+            return;
+        }
+
+        // Device closed its write stream ( a partially received message is dropped )
+        if ( 0 == n )
+        {
+            session_next_state( session, false );
+            return;
+        }
+
+        session->active_at = session_now();
+        session_first_byte( session );
+        session->rx_read_at = latency_now();
+        if ( 0 == session->rx_length )
+            session->rx_first_at = session->rx_read_at;
+        session->bytes_received += n;
+        session->rx_length += n;
+        if ( !session_stream_parse( session ) )
+        {
+            fprintf( stderr, "\tsession_on_readable(): AEM = %04d sent a bad frame. Dropping...\n", session->device.AEM );
+            session_fail( session );
+            return;
+        }
+    }
+}
+
+/// \brief Transmits as much as possible to session's socket without blocking.
+/// \param session
+void session_on_writable(Session *session)
+{
+    ssize_t n;
+
+    // Own opening ( or answer ) first
+    while ( session->negotiating && session->negotiation_tx_offset < session->negotiation_tx_length )
+    {
+        n = send( session->socket_fd, session->negotiation_tx + session->negotiation_tx_offset, session->negotiation_tx_length - session->negotiation_tx_offset, MSG_NOSIGNAL );
+        session->syscalls++;
+        if ( n < 0 )
+        {
+            if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno )
+                session_fail( session );
+            return;
+        }
+
+        session->active_at = session_now();
+        session->bytes_sent += n;
+        session->negotiation_tx_offset += n;
+    }
+
+    if ( session->negotiating )
+    {
+        session_negotiation_next( session );
+        if ( session->negotiating )
+            return;
+    }
+
+    // Own handshake then
+    while ( session->handshaking && session->handshake_tx_offset < session->handshake_tx_length )
+    {
+        n = send( session->socket_fd, session->handshake->tx + session->handshake_tx_offset, session->handshake_tx_length - session->handshake_tx_offset, MSG_NOSIGNAL );
+        session->syscalls++;
+        if ( n < 0 )
+        {
+            if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno )
+                session_fail( session );
+            return;
+        }
+
+        session->active_at = session_now();
+        session->bytes_sent += n;
+        session->handshake_tx_offset += n;
+    }
+
+    if ( session->handshaking )
+    {
+        session_handshake_next( session );
+        if ( session->handshaking )
+            return;
+    }
+
+    // Own receipts first, then batches of messages ( the receipts & the first batch go out in one gather write )
+    while ( session->transmitting )
+    {
+        struct iovec chunks[2];
+        int chunks_n = 0;
+
+        if ( session->tx_offset == session->tx_length )
+        {
+            session_batch_fill( session );
+            if ( 0 == session->tx_length && session->receipts_tx_offset == session->receipts_tx_length )
+            {
+                session_cork( session, false );
+                session_next_state( session, true );
+                return;
+            }
+        }
+
+        if ( session->receipts_tx_offset < session->receipts_tx_length )
+        {
+            chunks[chunks_n].iov_base = session->handshake->receipts_tx + session->receipts_tx_offset;
+            chunks[chunks_n++].iov_len = session->receipts_tx_length - session->receipts_tx_offset;
+        }
+        if ( session->tx_offset < session->tx_length )
+        {
+            chunks[chunks_n].iov_base = session->tx_buffer + session->tx_offset;
+            chunks[chunks_n++].iov_len = (size_t) ( session->tx_length - session->tx_offset );
+        }
+
+        struct msghdr batch = { .msg_iov = chunks, .msg_iovlen = (size_t) chunks_n };
+        session_cork( session, true );
+        n = sendmsg( session->socket_fd, &batch, MSG_NOSIGNAL );
+        session->syscalls++;
+        if ( n < 0 )
+        {
+            if ( EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno )
+                session_fail( session );
+            return;
+        }
+
+        session->active_at = session_now();
+        session->bytes_sent += n;
+        uint64_t sentAt = latency_now();
+
+        uint32_t receiptsSent = session->receipts_tx_length - session->receipts_tx_offset;
+        if ( receiptsSent > (uint32_t) n )
+            receiptsSent = (uint32_t) n;
+        session->receipts_tx_offset += receiptsSent;
+        session->tx_offset += (uint16_t) ( n - receiptsSent );
+
+        // Update Status in $messages buffer, stats & log of the messages sent
+        while ( session->tx_batch_sent < session->tx_batch_n && session->tx_batch[session->tx_batch_sent].end <= session->tx_offset )
+        {
+            SessionBatchEntry *entry = &session->tx_batch[session->tx_batch_sent++];
+            Message message;
+            latency_record( LATENCY_SEND, sentAt - entry->serialized_at );
+            if ( communication_mark_transmitted( entry->slot, &entry->key, session->device, &message ) )
+                session_log_message( session, "transmitted", &message );
+        }
+    }
+}
+
+/// \brief Get the socket events the session is waiting for.
+/// \param session
+/// \return EPOLLIN / EPOLLOUT mask, 0 when session is done
+uint32_t session_events(const Session *session)
+{
+    // Negotiation: wait for own opening ( or answer ) to go out & for the device's one
+    if ( session->negotiating && ( session->transmitting || session->receiving ) )
+        return ( session->negotiation_tx_offset < session->negotiation_tx_length ? EPOLLOUT : 0 ) |
+               ( session->negotiation_rx_length < NEGOTIATION_LEN ? EPOLLIN : 0 );
+
+    // Handshake: wait only for the handshakes still in flight
+    if ( session->handshaking && ( session->transmitting || session->receiving ) )
+        return ( session->handshake_tx_offset < session->handshake_tx_length ? EPOLLOUT : 0 ) | ( session->summarized ? 0 : EPOLLIN );
+
+    return ( session->transmitting ? EPOLLOUT : 0 ) | ( session->receiving ? EPOLLIN : 0 );
+}
+
+/// \brief Closes session's socket, unregisters device & updates connection stats.
+/// \param session
+void session_close(Session *session)
+{
+    if ( session->active )
+    {
+        // Update contact stats
+        struct timeval end;
+        gettimeofday( &end, NULL );
+        contacts_add( session->device.aemIndex, session->device.AEM, &session->started_at, &end );
+
+        // Update active devices
+        pthread_mutex_lock( &activeDevicesLock );
+            devices_remove( session->device );
+        pthread_mutex_unlock( &activeDevicesLock );
+
+        // Update wire stats
+        stats_add( STATS_SESSIONS, 1 );
+        stats_add( STATS_SUMMARIZED, session->summarized ? 1 : 0 );
+        stats_add( STATS_EXAMINED, session->examined );
+        stats_add( STATS_SKIPPED, session->skipped );
+        stats_add( STATS_RECEIPTS, session->receipts );
+        stats_add( STATS_BYTES_SENT, session->bytes_sent );
+        stats_add( STATS_BYTES_RECEIVED, session->bytes_received );
+        stats_add( STATS_SYSCALLS, session->syscalls );
+        stats_add( STATS_REJECTED, session->rejected );
+        stats_gauge_add( STATS_ACTIVE_SESSIONS, -1 );
+
+        session->active = false;
+    }
+
+    session_fail( session );
+    free( session->handshake );
+    session->handshake = NULL;
+    if ( session->socket_fd >= 0 )
+    {
+        close( session->socket_fd );
+        session->socket_fd = -1;
+    }
+}
+
+/// \brief Writes the deferred log of a closed session to session.json file & frees it.
+/// \param session
+/// \param block if FALSE, gives up when $logEventLock is held by another thread ( synchronous log )
+/// \return FALSE if log could not be written ( yet ), TRUE else
+bool session_flush_log(Session *session, bool block)
+{
+    if ( !session->deferred_log )
+        return true;
+
+    if ( !log_lock( block ) )
+        return false;
+
+    log_event_start_at( "connection", session->server ? CLIENT_AEM : session->device.AEM,
+                        session->server ? session->device.AEM : CLIENT_AEM, &session->started_at );
+
+    for ( uint32_t entry_i = 0; entry_i < session->journal_n; entry_i++ )
+        log_event_message( session->journal[entry_i].action, &session->journal[entry_i].message );
+
+    log_event_stop();
+    log_unlock();
+
+    free( session->journal );
+    session->journal = NULL;
+    session->journal_n = 0;
+    session->journal_size = 0;
+    session->deferred_log = false;
+
+    return true;
+}
@@ -0,0 +1,132 @@
+#include "conf.h"
+#include "stats.h"
+
+//------------------------------------------------------------------------------------------------
+
+// Shards of counters: a thread updates the shard it drew at its first update only
+static StatsShard statsShards[STATS_SHARDS];
+static uint32_t statsShardsNext;
+static __thread StatsShard *statsShard;
+
+// Levels of the gauges that are set
+static int64_t statsLevels[STATS_GAUGES_N] __attribute__(( aligned( STATS_CACHE_LINE ) ));
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Shard of calling thread, drawn round-robin at its first update.
+/// \return shard
+static StatsShard *stats_shard(void)
+{
+    if ( NULL == statsShard )
+        statsShard = &statsShards[__atomic_fetch_add( &statsShardsNext, 1, __ATOMIC_RELAXED ) % STATS_SHARDS];
+
+    return statsShard;
+}
+
+/// \brief Adds $n to $counter, in the shard of calling thread ( lock-free; concurrent updates of threads of other shards
+/// touch other cache lines ).
+/// \param counter
+/// \param n
+void stats_add(StatsCounter counter, uint64_t n)
+{
+    __atomic_fetch_add( &stats_shard()->counters[counter], n, __ATOMIC_RELAXED );
+}
+
+/// \brief Moves $gauge by $delta, in the shard of calling thread ( lock-free ).
+/// \param gauge
+/// \param delta
+void stats_gauge_add(StatsGauge gauge, int64_t delta)
+{
+    __atomic_fetch_add( &stats_shard()->gauges[gauge], delta, __ATOMIC_RELAXED );
+}
+
+/// \brief Sets level of $gauge to $value ( for gauges whose updaters already know the level, e.g. under a lock; such a
+/// gauge is not moved by stats_gauge_add() ).
+/// \param gauge
+/// \param value
+void stats_gauge_set(StatsGauge gauge, int64_t value)
+{
+    __atomic_store_n( &statsLevels[gauge], value, __ATOMIC_RELAXED );
+}
+
+/// \brief Reads $counter: sum of its shards. Updates racing the read may or may not be counted.
+/// \param counter
+/// \return running total
+uint64_t stats_counter(StatsCounter counter)
+{
+    uint64_t total = 0;
+
+    for ( uint32_t shard_i = 0; shard_i < STATS_SHARDS; shard_i++ )
+        total += __atomic_load_n( &statsShards[shard_i].counters[counter], __ATOMIC_RELAXED );
+
+    return total;
+}
+
+/// \brief Reads $gauge: its level plus the deltas of its shards.
+/// \param gauge
+/// \return current level
+int64_t stats_gauge(StatsGauge gauge)
+{
+    int64_t level = __atomic_load_n( &statsLevels[gauge], __ATOMIC_RELAXED );
+
+    for ( uint32_t shard_i = 0; shard_i < STATS_SHARDS; shard_i++ )
+        level += __atomic_load_n( &statsShards[shard_i].gauges[gauge], __ATOMIC_RELAXED );
+
+    return level;
+}
+
+/// \brief Reads messages' counters & buffer occupancy.
+/// \param stats
+void stats_messages(MessagesStats *stats)
+{
+    stats->produced = stats_counter( STATS_PRODUCED );
+    stats->received = stats_counter( STATS_RECEIVED );
+    stats->received_for_me = stats_counter( STATS_RECEIVED_FOR_ME );
+    stats->transmitted = stats_counter( STATS_TRANSMITTED );
+    stats->transmitted_to_recipient = stats_counter( STATS_TRANSMITTED_TO_RECIPIENT );
+    stats->purged = stats_counter( STATS_PURGED );
+    stats->buffered = stats_gauge( STATS_BUFFERED );
+
+    // Avg. delay, sec --> min
+    stats->producedDelayAvg = 0 == stats->produced ? 0.0F :
+            (float) stats_counter( STATS_PRODUCED_DELAY ) / (float) stats->produced / 60.0F;
+}
+
+/// \brief Reads sessions' counters & active sessions.
+/// \param stats
+void stats_sessions(SessionStats *stats)
+{
+    stats->sessions = stats_counter( STATS_SESSIONS );
+    stats->summarized = stats_counter( STATS_SUMMARIZED );
+    stats->examined = stats_counter( STATS_EXAMINED );
+    stats->skipped = stats_counter( STATS_SKIPPED );
+    stats->receipts = stats_counter( STATS_RECEIPTS );
+    stats->bytes_sent = stats_counter( STATS_BYTES_SENT );
+    stats->bytes_received = stats_counter( STATS_BYTES_RECEIVED );
+    stats->syscalls = stats_counter( STATS_SYSCALLS );
+    stats->rejected = stats_counter( STATS_REJECTED );
+    stats->active = stats_gauge( STATS_ACTIVE_SESSIONS );
+}
+
+/// \brief Reads discovery's counters.
+/// \param stats
+void stats_discovery(DiscoveryStats *stats)
+{
+    stats->beacons_sent = stats_counter( STATS_BEACONS_SENT );
+    stats->beacons_heard = stats_counter( STATS_BEACONS_HEARD );
+    stats->peers_dialed = stats_counter( STATS_PEERS_DIALED );
+    stats->syscalls = stats_counter( STATS_DISCOVERY_SYSCALLS );
+}
+
+/// \brief Zeroes every counter & the deltas of gauges ( levels set are kept, as they mirror state that is kept ). Not to
+/// race updates ( they may survive the reset ).
+void stats_reset(void)
+{
+    for ( uint32_t shard_i = 0; shard_i < STATS_SHARDS; shard_i++ )
+    {
+        for ( uint32_t counter_i = 0; counter_i < STATS_COUNTERS_N; counter_i++ )
+            __atomic_store_n( &statsShards[shard_i].counters[counter_i], 0, __ATOMIC_RELAXED );
+        for ( uint32_t gauge_i = 0; gauge_i < STATS_GAUGES_N; gauge_i++ )
+            __atomic_store_n( &statsShards[shard_i].gauges[gauge_i], 0, __ATOMIC_RELAXED );
+    }
+}
@@ -0,0 +1,98 @@
+#include "conf.h"
+#include "summary.h"
+#include "index.h"
+#include <arpa/inet.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Salts hash of $key with $seed ( SplitMix64 finalizer ).
+static uint64_t summary_hash(const MessageKey *key, uint32_t seed)
+{
+    uint64_t h = index_hash( key ) ^ ( (uint64_t) seed * 0x9e3779b97f4a7c15ULL );
+
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+
+    return h;
+}
+
+/// \brief Initializes an empty $summary.
+/// \param summary
+/// \param seed salt of the bit positions ( a fresh one per session )
+void summary_init(Summary *summary, uint32_t seed)
+{
+    summary->seed = seed;
+    memset( summary->bits, 0, sizeof( summary->bits ) );
+}
+
+/// \brief Adds message of $key to $summary.
+/// \param summary
+/// \param key
+void summary_add(Summary *summary, const MessageKey *key)
+{
+    uint64_t h = summary_hash( key, summary->seed );
+    uint32_t h1 = (uint32_t) h, h2 = (uint32_t) ( h >> 32 ) | 1;
+
+    // Double hashing: i-th position is h1 + i * h2
+    for ( uint32_t hash_i = 0; hash_i < SUMMARY_BLOOM_HASHES; hash_i++ )
+    {
+        uint32_t bit_i = ( h1 + hash_i * h2 ) & ( SUMMARY_BLOOM_BITS - 1 );
+        summary->bits[bit_i / 8] |= (uint8_t) ( 1 << ( bit_i % 8 ) );
+    }
+}
+
+/// \brief Checks if message of $key is in $summary ( false positives are possible, false negatives are not ).
+/// \param summary
+/// \param key
+/// \return TRUE if message is probably in $summary, FALSE if it surely is not
+bool summary_contains(const Summary *summary, const MessageKey *key)
+{
+    uint64_t h = summary_hash( key, summary->seed );
+    uint32_t h1 = (uint32_t) h, h2 = (uint32_t) ( h >> 32 ) | 1;
+
+    for ( uint32_t hash_i = 0; hash_i < SUMMARY_BLOOM_HASHES; hash_i++ )
+    {
+        uint32_t bit_i = ( h1 + hash_i * h2 ) & ( SUMMARY_BLOOM_BITS - 1 );
+        if ( 0 == ( summary->bits[bit_i / 8] & ( 1 << ( bit_i % 8 ) ) ) )
+            return false;
+    }
+
+    return true;
+}
+
+/// \brief Serializes $summary into $SUMMARY_LEN bytes ( network byte order ).
+/// \param summary
+/// \param packed buffer of at least $SUMMARY_LEN bytes
+void summary_pack(const Summary *summary, uint8_t *packed)
+{
+    uint32_t fields[3] = {
+            htonl( SUMMARY_MAGIC ),
+            htonl( summary->seed ),
+            htonl( SUMMARY_BLOOM_BITS )
+    };
+
+    memcpy( packed, fields, sizeof( fields ) );
+    memcpy( packed + sizeof( fields ), summary->bits, sizeof( summary->bits ) );
+}
+
+/// \brief Un-serializes $SUMMARY_LEN received bytes into $summary.
+/// \param summary the result summary ( passed as pointer )
+/// \param packed received bytes
+/// \return FALSE if bytes are not a summary of the same size, TRUE else
+bool summary_unpack(Summary *summary, const uint8_t *packed)
+{
+    uint32_t fields[3];
+
+    memcpy( fields, packed, sizeof( fields ) );
+    if ( SUMMARY_MAGIC != ntohl( fields[0] ) || SUMMARY_BLOOM_BITS != ntohl( fields[2] ) )
+        return false;
+
+    summary->seed = ntohl( fields[1] );
+    memcpy( summary->bits, packed + sizeof( fields ), sizeof( summary->bits ) );
+
+    return true;
+}
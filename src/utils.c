@@ -3,22 +3,32 @@
 #include "log.h"
 #include "server.h"
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdbool.h>
 
 //------------------------------------------------------------------------------------------------
 
 extern uint32_t CLIENT_AEM;
-extern struct timeval CLIENT_AEM_CONN_START_LIST[CLIENT_AEM_LIST_LENGTH][MAX_CONNECTIONS_WITH_SAME_CLIENT];
-extern struct timeval CLIENT_AEM_CONN_END_LIST[CLIENT_AEM_LIST_LENGTH][MAX_CONNECTIONS_WITH_SAME_CLIENT];
-extern uint8_t CLIENT_AEM_CONN_N_LIST[CLIENT_AEM_LIST_LENGTH];
 
-extern pthread_mutex_t messagesBufferLock, activeDevicesLock, availableThreadsLock, messagesStatsLock;
-extern MessagesStats messagesStats;
+extern pthread_mutex_t messagesBufferLock, activeDevicesLock;
 
-extern pthread_t communicationThreads[COMMUNICATION_WORKERS_MAX];
-extern uint8_t communicationThreadsAvailable;
 
-extern Message MESSAGES_BUFFER[ MESSAGES_SIZE ];
+//------------------------------------------------------------------------------------------------
+
+const char *socketSubnet = SOCKET_SUBNET;
+
+// Hour timestamp2ftime() formatted last, per thread, & generation of local time zone ( older generations are stale )
+static __thread TimestampCache timestampCache;
+static uint32_t timestampZone;
+
+// Decimal digits of 00 to 99, two at a time
+static const char digitPairs[201] =
+        "0001020304050607080910111213141516171819"
+        "2021222324252627282930313233343536373839"
+        "4041424344454647484950515253545556575859"
+        "6061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
 
 //------------------------------------------------------------------------------------------------
 
@@ -28,7 +38,7 @@ extern Message MESSAGES_BUFFER[ MESSAGES_SIZE ];
 const char* aem2ip(uint32_t aem)
 {
     static char ip[INET_ADDRSTRLEN];
-    sprintf( ip, "10.0.%02d.%02d", (int) aem / 100, aem % 100 );
+    snprintf( ip, INET_ADDRSTRLEN, "%s.%02d.%02d", socketSubnet, (int) aem / 100, aem % 100 );
 
     return ip;
 }
@@ -72,28 +82,88 @@ int32_t binary_search_index(const uint32_t *haystack, size_t N, uint32_t needle)
     return -1;
 }
 
-/// \brief Un-serializes message-as-a-string, re-creating initial message.
+/// \brief Parses $n decimal digits at $digits ( fixed width, no sign ).
+/// \param digits
+/// \param n
+/// \return the value
+uint64_t digits2uint(const char *digits, uint8_t n)
+{
+    uint64_t value = 0;
+
+    for ( uint8_t digit_i = 0; digit_i < n; digit_i++ )
+        value = value * 10 + (uint64_t) ( digits[digit_i] - '0' );
+
+    return value;
+}
+
+/// \brief Checks if the header of $messageSerialized has fixed-width fields, as implode() writes them.
+static bool explode_fixed(const char *messageSerialized, char separator)
+{
+    if ( separator != messageSerialized[4] || separator != messageSerialized[9] || separator != messageSerialized[20] )
+        return false;
+
+    for ( uint8_t char_i = 0; char_i < 20; char_i++ )
+    {
+        if ( 4 != char_i && 9 != char_i && ( messageSerialized[char_i] < '0' || messageSerialized[char_i] > '9' ) )
+            return false;
+    }
+
+    return true;
+}
+
+/// \brief Parses the leading digits of field at $field & moves $field past its separator ( up to $end ).
+static uint64_t explode_field(const char **field, const char *end, char separator)
+{
+    uint64_t value = 0;
+
+    for ( ; *field < end && **field >= '0' && **field <= '9'; (*field)++ )
+        value = value * 10 + (uint64_t) ( **field - '0' );
+    for ( ; *field < end && '\0' != **field && separator != **field; (*field)++ );
+    if ( *field < end && separator == **field )
+        (*field)++;
+
+    return value;
+}
+
+/// \brief Un-serializes message-as-a-string, re-creating initial message. Parses in place, reading at most
+/// $MESSAGE_SERIALIZED_LEN - 1 characters ( a received record needs no terminating NUL ).
 /// \param message the result message ( passes as a pointer )
-/// \param glue the connective character(s); acts as the separator between successive message fields
+/// \param glue the connective character; acts as the separator between successive message fields
 /// \param messageSerialized string containing all message fields glued together using $glue
-/// \return a message struct of type message_t
-void explode(Message *message, const char *glue, char *messageSerialized)
+void explode(Message *message, const char *glue, const char *messageSerialized)
 {
-    char *messageCopy = strdup( messageSerialized );
+    const char *end = messageSerialized + MESSAGE_SERIALIZED_LEN - 1;
+    const char *field = messageSerialized;
 
-    // Start exploding string
-    message->sender = (uint32_t) strtol( strsep( &messageCopy, glue ), (char **)NULL, STRSEP_BASE_10 );
-    message->recipient = (uint32_t) strtol( strsep( &messageCopy, glue ), (char **)NULL, STRSEP_BASE_10 );
-    message->created_at = (uint64_t) strtoll(strsep(&messageCopy, glue ), (char **)NULL, STRSEP_BASE_10 );
+    // Fixed-width fields ( as implode() writes them ), else fields of any width
+    if ( explode_fixed( messageSerialized, glue[0] ) )
+    {
+        message->sender = (uint32_t) digits2uint( messageSerialized, 4 );
+        message->recipient = (uint32_t) digits2uint( messageSerialized + 5, 4 );
+        message->created_at = digits2uint( messageSerialized + 10, 10 );
+        field += 21;
+    }
+    else
+    {
+        message->sender = (uint32_t) explode_field( &field, end, glue[0] );
+        message->recipient = (uint32_t) explode_field( &field, end, glue[0] );
+        message->created_at = explode_field( &field, end, glue[0] );
+    }
+
+    // Body: up to its NUL or next glue
+    size_t bodyLength = strnlen( field, (size_t) ( end - field ) < MESSAGE_BODY_LEN - 1 ? (size_t) ( end - field ) : MESSAGE_BODY_LEN - 1 );
+    const char *bodyEnd = memchr( field, glue[0], bodyLength );
+    if ( NULL != bodyEnd )
+        bodyLength = (size_t) ( bodyEnd - field );
 
-    memcpy( message->body, strsep( &messageCopy, glue ), MESSAGE_BODY_LEN );
-    free( messageCopy );
+    memcpy( message->body, field, bodyLength );
+    memset( message->body + bodyLength, 0, MESSAGE_BODY_LEN - bodyLength );
 
     // Set message's metadata
+    message->seq = 0;
     message->transmitted = 0;
     message->transmitted_to_recipient = 0;
-    for ( uint32_t device_i = 0; device_i < CLIENT_AEM_LIST_LENGTH; device_i++ )
-        message->transmitted_devices[device_i] = 0;
+    memset( message->transmitted_devices, 0, sizeof( message->transmitted_devices ) );
 }
 
 /// \brief Generates a new message from this client towards $recipient with $body as content.
@@ -108,9 +178,10 @@ void generateMessage(Message *message, uint32_t recipient, const char * body)
 
     memcpy( message->body, body, MESSAGE_BODY_LEN );
 
+    message->seq = 0;                   // numbered once pushed to $messages
     message->transmitted = 0;
-    for ( uint32_t device_i = 0; device_i < CLIENT_AEM_LIST_LENGTH; device_i++ )
-        message->transmitted_devices[device_i] = 0;
+    message->transmitted_to_recipient = 0;
+    memset( message->transmitted_devices, 0, sizeof( message->transmitted_devices ) );
 }
 
 /// \brief Generates a new random message composed of:
@@ -148,21 +219,39 @@ void generateRandomMessage(Message *message)
     generateMessage( message, recipient, body );
 }
 
-/// \brief Serializes a message ( of message_t type ) into a 277-characters string.
+/// \brief Serializes a message ( of message_t type ) into a 277-characters string ( zero-padded to its end ).
 /// \param glue the connective character(s); to be placed between successive message fields
 /// \param message the message to be serialized
 /// \param messageSerialized a string containing all message fields glued together using $glue
 void implode(const char *glue, const Message message, char *messageSerialized)
 {
-    // Begin copying fields and adding glue
+    // Fields wider than 4 ( AEMs ) & 10 digits ( created_at ) or glue of many characters are rare: formatted as before
     //  - sender{glue}recipient{glue}created_at{glue}body
-    // sprintf(messageSerialized, MESSAGE_SERIALIZED_LEN, "%04d%s%04d%s%010ld%s%s",
-    snprintf(messageSerialized, MESSAGE_SERIALIZED_LEN, "%04d%s%04d%s%010llu%s%s",
-             message.sender, glue,
-             message.recipient, glue,
-             message.created_at, glue,
-             message.body
-    );
+    if ( message.sender > 9999 || message.recipient > 9999 || message.created_at > 9999999999ULL || '\0' != glue[1] )
+    {
+        int length = snprintf(messageSerialized, MESSAGE_SERIALIZED_LEN, "%04d%s%04d%s%010llu%s%s",
+                 message.sender, glue,
+                 message.recipient, glue,
+                 message.created_at, glue,
+                 message.body
+        );
+        if ( length >= 0 && length < MESSAGE_SERIALIZED_LEN )
+            memset( messageSerialized + length, 0, MESSAGE_SERIALIZED_LEN - (size_t) length );
+        return;
+    }
+
+    uint2digits( message.sender, messageSerialized, 4 );
+    messageSerialized[4] = glue[0];
+    uint2digits( message.recipient, messageSerialized + 5, 4 );
+    messageSerialized[9] = glue[0];
+    uint2digits( message.created_at, messageSerialized + 10, 10 );
+    messageSerialized[20] = glue[0];
+
+    size_t bodyLength = strnlen( message.body, MESSAGE_SERIALIZED_LEN - 22 );
+    memcpy( messageSerialized + 21, message.body, bodyLength );
+
+    // Record is sent & stored whole: no stale bytes of the previous message after the body
+    memset( messageSerialized + 21 + bodyLength, 0, MESSAGE_SERIALIZED_LEN - 21 - bodyLength );
 }
 
 /// \brief Get a string with CSV of transmitted devices of given $message
@@ -170,20 +259,23 @@ void implode(const char *glue, const Message message, char *messageSerialized)
 /// \return
 const char* getTransmittedDevicesString( const Message* message )
 {
-    static char transmittedDevicesString[CLIENT_AEM_LIST_LENGTH * 6];
+    static char transmittedDevicesString[MESSAGE_DEVICES_MAX * 5 + 1];
+    bool range = 0 == strcmp( "range", CLIENT_AEM_SOURCE );
+    uint32_t devicesLength = range ? CLIENT_AEM_RANGE_LENGTH : CLIENT_AEM_LIST_LENGTH;
     uint32_t writePosition;
     uint32_t aem_i;
 
-    for ( writePosition = 0, aem_i = 0; aem_i < CLIENT_AEM_LIST_LENGTH; aem_i++ )
+    for ( writePosition = 0, aem_i = 0; aem_i < devicesLength; aem_i++ )
     {
-        if ( 1 == message->transmitted_devices[ aem_i ] )
+        if ( bitset_test( message->transmitted_devices, aem_i ) )
         {
-            snprintf( transmittedDevicesString + writePosition, 6, "%04d,", CLIENT_AEM_LIST[aem_i] );
+            snprintf( transmittedDevicesString + writePosition, 6, "%04d,",
+                    range ? CLIENT_AEM_RANGE_MIN + aem_i : CLIENT_AEM_LIST[aem_i] );
             writePosition += 5;
         }
     }
 
-    *( transmittedDevicesString + writePosition - 1 ) = '\0';
+    *( transmittedDevicesString + ( writePosition > 0 ? writePosition - 1 : 0 ) ) = '\0';
 
     return transmittedDevicesString;
 }
@@ -193,10 +285,12 @@ const char* getTransmittedDevicesString( const Message* message )
 /// \param metadata show/hide metadata information from message
 void inspect(const Message message, bool metadata, FILE *fp)
 {
+    char createdAt[STRFTIME_STR_LEN];
+
     // Print main fields
     fprintf( fp, "message = {\n\tsender = %04d,\n\trecipient = %04d,\n\tcreated_at = %lu ( %s ),\n\tbody = %s\n",
             message.sender, message.recipient, message.created_at,
-            timestamp2ftime( message.created_at, "%a, %d %b %Y @ %T" ), message.body
+            timestamp2ftime( message.created_at, "%a, %d %b %Y @ %T", createdAt ), message.body
     );
 
     // Print metadata
@@ -219,24 +313,22 @@ void inspect(const Message message, bool metadata, FILE *fp)
 /// \return aem uint32_t
 uint32_t ip2aem(const char *ip)
 {
-    char *ipCopy = strdup( ip );
-    void *ipCopyPointer = ( void * ) ipCopy;
-    unsigned char ipParts[4];
-    char *glue = ".";
-    uint32_t aem;
-
-    // Explode IP string
-    ipParts[0] = (unsigned char) strtol( strsep( &ipCopy, glue ), (char **)NULL, STRSEP_BASE_10 );
-    ipParts[1] = (unsigned char) strtol( strsep( &ipCopy, glue ), (char **)NULL, STRSEP_BASE_10 );
-    ipParts[2] = (unsigned char) strtol( strsep( &ipCopy, glue ), (char **)NULL, STRSEP_BASE_10 );
-    ipParts[3] = (unsigned char) strtol( strsep( &ipCopy, glue ), (char **)NULL, STRSEP_BASE_10 );
+    uint32_t ipParts[4] = { 0, 0, 0, 0 };
+    uint8_t part_i = 0;
 
-    // Compose AEM
-    aem = (uint32_t) ( ipParts[2] * 100 );
-    aem += (uint32_t) ipParts[3];
+    // Explode IP string ( up to the first character that is neither a digit nor a dot )
+    for ( ; '\0' != *ip; ip++ )
+    {
+        if ( '.' == *ip && part_i < 3 )
+            part_i++;
+        else if ( *ip >= '0' && *ip <= '9' )
+            ipParts[part_i] = ipParts[part_i] * 10 + (uint32_t) ( *ip - '0' );
+        else
+            break;
+    }
 
-    free( ipCopyPointer );
-    return aem;
+    // Compose AEM
+    return (uint32_t) ( (unsigned char) ipParts[2] * 100 + (unsigned char) ipParts[3] );
 }
 
 /// \brief Check if two messages have exactly the same values in ALL of their fields.
@@ -312,30 +404,157 @@ bool socket_connect( int32_t socket_fd, uint32_t aem, uint16_t port )
     return return_value;
 }
 
-/// \brief Convert given UNIX timestamp to a formatted datetime string with given $format.
+/// \brief Starts a non-blocking connect via $socket_fd to given AEM (creating respective IP address) & port.
+/// \param socket_fd ( switched to O_NONBLOCK mode )
+/// \param aem
+/// \param port
+/// \param syscalls incremented by the no. of syscalls made ( passed as pointer, NULL: not counted )
+/// \return FALSE on error, TRUE if connect() completed or is in progress
+bool socket_connect_nonblocking( int32_t socket_fd, uint32_t aem, uint16_t port, uint32_t *syscalls )
+{
+    struct sockaddr_in serverAddress;
+
+    if ( CLIENT_AEM == aem || devices_exists_aem( aem ) )
+        return false;
+
+    if ( false == socket_set_blocking( socket_fd, false, syscalls ) )
+        return false;
+
+    // Set "server" address
+    bzero((char *)&serverAddress, sizeof(serverAddress));
+    serverAddress.sin_family = AF_INET;
+    serverAddress.sin_port = htons( port );
+    serverAddress.sin_addr.s_addr = inet_addr( aem2ip( aem ) );
+
+    if ( NULL != syscalls )
+        ( *syscalls )++;
+    return connect( socket_fd, (struct sockaddr *)&serverAddress, sizeof(struct sockaddr) ) >= 0 || EINPROGRESS == errno ?
+            true : false;
+}
+
+/// \brief Switches $socket_fd between blocking and non-blocking mode.
+/// \param socket_fd
+/// \param blocking
+/// \param syscalls incremented by the no. of syscalls made ( passed as pointer, NULL: not counted )
+/// \return FALSE on fcntl() error, TRUE else
+bool socket_set_blocking( int32_t socket_fd, bool blocking, uint32_t *syscalls )
+{
+    int flags = fcntl( socket_fd, F_GETFL, 0 );
+    if ( NULL != syscalls )
+        ( *syscalls )++;
+    if ( flags < 0 )
+        return false;
+
+    flags = blocking ? ( flags & ~O_NONBLOCK ) : ( flags | O_NONBLOCK );
+    if ( NULL != syscalls )
+        ( *syscalls )++;
+    return 0 == fcntl( socket_fd, F_SETFL, flags );
+}
+
+/// \brief Formats $value into $n decimal digits at $digits ( fixed width, zero-padded, no terminating NUL ).
+/// \param value ( only its last $n digits are written )
+/// \param digits buffer of at least $n characters
+/// \param n
+void uint2digits(uint64_t value, char *digits, uint8_t n)
+{
+    while ( n >= 2 )
+    {
+        n -= 2;
+        memcpy( digits + n, digitPairs + 2 * ( value % 100 ), 2 );
+        value /= 100;
+    }
+
+    if ( 1 == n )
+        digits[0] = (char) ( '0' + value % 10 );
+}
+
+/// \brief Formats the local hour of $timestamp into $cache ( date & hour, as a "YYYY-MM-DDTHH:" prefix ).
+/// \param cache
+/// \param timestamp UNIX timestamp ( uint64_t )
+/// \return FALSE if $timestamp has no four-digit local year ( cache is left empty ), TRUE else
+static bool timestamp_cache_fill(TimestampCache *cache, uint64_t timestamp)
+{
+    time_t time = (time_t) timestamp;
+    struct tm local;
+
+    cache->hour_end = 0;
+    if ( NULL == localtime_r( &time, &local ) || local.tm_year < -1900 || local.tm_year > 9999 - 1900 )
+        return false;
+
+    // Zones change their offset at the turn of an hour, so a formatted hour stays valid for all of its seconds
+    cache->zone = __atomic_load_n( &timestampZone, __ATOMIC_ACQUIRE );
+    cache->hour_start = timestamp - (uint64_t) ( local.tm_min * 60 + local.tm_sec );
+    cache->hour_end = cache->hour_start + 3600;
+
+    uint2digits( (uint64_t) ( local.tm_year + 1900 ), cache->prefix, 4 );
+    cache->prefix[4] = '-';
+    uint2digits( (uint64_t) ( local.tm_mon + 1 ), cache->prefix + 5, 2 );
+    cache->prefix[7] = '-';
+    uint2digits( (uint64_t) local.tm_mday, cache->prefix + 8, 2 );
+    cache->prefix[10] = 'T';
+    uint2digits( (uint64_t) local.tm_hour, cache->prefix + 11, 2 );
+    cache->prefix[13] = ':';
+
+    return true;
+}
+
+/// \brief Convert given UNIX timestamp to a formatted ( local ) datetime string with given $format, in $buffer.
+/// "%FT%TZ" & "%H:%M:%S" are served from a per-thread cache of the hour formatted last, other formats by strftime().
 /// \param timestamp UNIX timestamp ( uint64_t )
 /// \param format strftime-compatible format
-/// \return the resulting datetime string
-const char* timestamp2ftime( const uint64_t timestamp, const char *format )
+/// \param buffer at least $STRFTIME_STR_LEN characters
+/// \return $buffer
+char* timestamp2ftime( const uint64_t timestamp, const char *format, char *buffer )
 {
 //    // Format datetime stings in Greek
 //    setlocale( LC_TIME, "el_GR.UTF-8" );
 
-    static char* returnString;
-    struct tm* tmp;
+    bool dateTime = 0 == strcmp( "%FT%TZ", format );
 
-    returnString = malloc( 50 * sizeof( char ) );
-    tmp = localtime((const time_t *) &( timestamp ));
-    if ( tmp == NULL )
-    {
-        perror( "\ttimestamp2ftime(): localtime() error" );
-        exit( EXIT_FAILURE );
-    }
-    if ( 0 == strftime( returnString, UINT32_MAX, format, tmp ) )
+    if ( dateTime || 0 == strcmp( "%H:%M:%S", format ) )
     {
-        fprintf( stderr, "\ttimestamp2ftime(): strftime() error" );
-        exit( EXIT_FAILURE );
+        TimestampCache *cache = &timestampCache;
+
+        if ( ( timestamp >= cache->hour_start && timestamp < cache->hour_end &&
+               cache->zone == __atomic_load_n( &timestampZone, __ATOMIC_ACQUIRE ) ) ||
+             timestamp_cache_fill( cache, timestamp ) )
+        {
+            uint32_t seconds = (uint32_t) ( timestamp - cache->hour_start );
+            char *at = buffer;
+
+            // "YYYY-MM-DDTHH:" or "HH:", then "MM:SS"
+            if ( dateTime )
+            {
+                memcpy( at, cache->prefix, 14 );
+                at += 14;
+            }
+            else
+            {
+                memcpy( at, cache->prefix + 11, 3 );
+                at += 3;
+            }
+            uint2digits( seconds / 60, at, 2 );
+            at[2] = ':';
+            uint2digits( seconds % 60, at + 3, 2 );
+            at += 5;
+            if ( dateTime )
+                *at++ = 'Z';
+            *at = '\0';
+
+            return buffer;
+        }
     }
 
-    return returnString;
-}
\ No newline at end of file
+    time_t time = (time_t) timestamp;
+    struct tm local;
+    if ( NULL == localtime_r( &time, &local ) || 0 == strftime( buffer, STRFTIME_STR_LEN, format, &local ) )
+        snprintf( buffer, STRFTIME_STR_LEN, "%" PRIu64, timestamp );
+
+    return buffer;
+}
+
+/// \brief Invalidates cached hours of timestamp2ftime() in all threads ( call after local time zone changed, tzset() ).
+void timestamp_zone_changed(void)
+{
+    __atomic_add_fetch( &timestampZone, 1, __ATOMIC_RELEASE );
+}
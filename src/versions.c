@@ -0,0 +1,125 @@
+#include "conf.h"
+#include "versions.h"
+#include "utils.h"
+#include <arpa/inet.h>
+#include <string.h>
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Origin of messages sent by $aem: index of $aem among the devices of $CLIENT_AEM_SOURCE.
+/// \param aem
+/// \return origin index, -1 if $aem is not a device of $CLIENT_AEM_SOURCE
+int32_t versions_origin(uint32_t aem)
+{
+    if ( 0 == strcmp( "list", CLIENT_AEM_SOURCE ) )
+        return binary_search_index( CLIENT_AEM_LIST, CLIENT_AEM_LIST_LENGTH, aem );
+
+    return aem >= CLIENT_AEM_RANGE_MIN && aem <= CLIENT_AEM_RANGE_MAX ? (int32_t) ( aem - CLIENT_AEM_RANGE_MIN ) : -1;
+}
+
+/// \brief AEM of $origin ( inverse of versions_origin() ).
+static uint32_t versions_aem(uint32_t origin)
+{
+    return 0 == strcmp( "list", CLIENT_AEM_SOURCE ) ? CLIENT_AEM_LIST[origin] : CLIENT_AEM_RANGE_MIN + origin;
+}
+
+/// \brief No. of origins ( devices of $CLIENT_AEM_SOURCE ).
+/// \return uint32
+uint32_t versions_origins(void)
+{
+    return 0 == strcmp( "list", CLIENT_AEM_SOURCE ) ? CLIENT_AEM_LIST_LENGTH : CLIENT_AEM_RANGE_LENGTH;
+}
+
+/// \brief Records that message $seq of $origin was seen. The contiguous prefix of $origin advances over any sequence
+/// numbers seen before out of order; ones beyond $VERSIONS_WINDOW above the prefix are forgotten.
+/// \param vector
+/// \param origin
+/// \param seq
+void versions_seen(VersionVector *vector, int32_t origin, uint32_t seq)
+{
+    uint32_t *version = &vector->versions[origin];
+    uint64_t *seen = &vector->seen[origin];
+
+    if ( seq <= *version )
+        return;
+
+    // Out of order: remember it above the prefix
+    if ( seq > *version + 1 )
+    {
+        if ( seq - *version - 2 < VERSIONS_WINDOW )
+            *seen |= (uint64_t) 1 << ( seq - *version - 2 );
+        return;
+    }
+
+    // Next in order: advance over the run of seen ones that follows
+    uint32_t run = ~*seen ? (uint32_t) __builtin_ctzll( ~*seen ) : VERSIONS_WINDOW;
+    *version += 1 + run;
+    *seen = run + 1 >= VERSIONS_WINDOW ? 0 : *seen >> ( run + 1 );
+}
+
+/// \brief Serializes contiguous prefixes of $vector ( non-zero ones, as AEM & sequence number pairs ) in network byte
+/// order.
+/// \param vector
+/// \param packed buffer of at least $VERSIONS_HEADER_LEN + $VERSIONS_ENTRY_LEN * $MESSAGE_DEVICES_MAX bytes
+/// \return no. of bytes written
+uint32_t versions_pack(const VersionVector *vector, uint8_t *packed)
+{
+    uint32_t origins_n = versions_origins();
+    uint32_t entries_n = 0;
+    uint32_t fields[2];
+
+    for ( uint32_t origin = 0; origin < origins_n; origin++ )
+    {
+        if ( 0 == vector->versions[origin] )
+            continue;
+
+        fields[0] = htonl( versions_aem( origin ) );
+        fields[1] = htonl( vector->versions[origin] );
+        memcpy( packed + VERSIONS_HEADER_LEN + entries_n++ * VERSIONS_ENTRY_LEN, fields, sizeof( fields ) );
+    }
+
+    fields[0] = htonl( VERSIONS_MAGIC );
+    fields[1] = htonl( entries_n );
+    memcpy( packed, fields, sizeof( fields ) );
+
+    return VERSIONS_HEADER_LEN + entries_n * VERSIONS_ENTRY_LEN;
+}
+
+/// \brief Reads header of received version vector.
+/// \param packed $VERSIONS_HEADER_LEN received bytes
+/// \return no. of bytes of the whole vector, 0 if bytes are not a version vector
+uint32_t versions_length(const uint8_t *packed)
+{
+    uint32_t fields[2];
+
+    memcpy( fields, packed, sizeof( fields ) );
+    if ( VERSIONS_MAGIC != ntohl( fields[0] ) || ntohl( fields[1] ) > MESSAGE_DEVICES_MAX )
+        return 0;
+
+    return VERSIONS_HEADER_LEN + ntohl( fields[1] ) * VERSIONS_ENTRY_LEN;
+}
+
+/// \brief Un-serializes a received version vector into $versions ( by origin; AEMs of other sources are ignored ).
+/// \param versions the result prefixes ( $MESSAGE_DEVICES_MAX, passed as pointer )
+/// \param packed received bytes ( versions_length() of them )
+/// \return FALSE if bytes are not a version vector, TRUE else
+bool versions_unpack(uint32_t *versions, const uint8_t *packed)
+{
+    uint32_t length = versions_length( packed );
+    uint32_t fields[2];
+
+    if ( 0 == length )
+        return false;
+
+    memset( versions, 0, MESSAGE_DEVICES_MAX * sizeof( uint32_t ) );
+    for ( uint32_t offset = VERSIONS_HEADER_LEN; offset < length; offset += VERSIONS_ENTRY_LEN )
+    {
+        memcpy( fields, packed + offset, sizeof( fields ) );
+
+        int32_t origin = versions_origin( ntohl( fields[0] ) );
+        if ( origin >= 0 )
+            versions[origin] = ntohl( fields[1] );
+    }
+
+    return true;
+}
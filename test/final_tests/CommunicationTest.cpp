@@ -0,0 +1,849 @@
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "communication.h"
+    #include "contacts.h"
+    #include "discovery.h"
+    #include "log.h"
+    #include "scan.h"
+    #include "server.h"
+    #include "stats.h"
+    #include "utils.h"
+
+    #include <arpa/inet.h>
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <sys/socket.h>
+    #include <sys/wait.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+extern const char *socketSubnet;
+extern const char *communicationSessionMode;
+extern const char *communicationProtocol;
+extern const char *communicationFraming;
+extern const char *communicationStreamMode;
+extern uint32_t messagesCount;
+extern bool messagesReceipts;
+
+//------------------------------------------------------------------------------------------------
+
+static const uint32_t serverAem = 8723;
+static const uint32_t clientAem = 8600;
+
+/* Outcome of one side of an exchange */
+typedef struct exchange_side_t {
+
+    uint64_t received;
+    uint64_t transmitted;
+    uint64_t purged;
+    uint32_t stored;                    // messages held once session ended
+    uint64_t examined;
+    uint64_t skipped;
+    uint64_t receipts;
+    uint64_t bytes_sent;
+    uint64_t syscalls;
+    uint64_t rejected;
+    struct timeval started_at;
+    struct timeval finished_at;
+
+} ExchangeSide;
+
+static uint64_t timevalMicros(const struct timeval &tv)
+{
+    return (uint64_t) tv.tv_sec * 1000000 + (uint64_t) tv.tv_usec;
+}
+
+/// \brief Resets messages & connection stats of this process.
+static void resetStats()
+{
+    stats_reset();
+    contacts_reset();
+}
+
+/// \brief Resets store of this process & fills it with $messages_n messages of $CLIENT_AEM.
+static void fillStore(uint16_t messages_n)
+{
+    Message message;
+
+    messages_reset();
+    resetStats();
+
+    for ( uint16_t message_i = 0; message_i < messages_n; message_i++ )
+    {
+        generateRandomMessage( &message );
+        message.sender = CLIENT_AEM;
+        message.recipient = 8888;
+        message.created_at = 1561669840 + message_i;
+        messages_push( &message );
+    }
+}
+
+/// \brief Runs communication_worker() on $socket_fd with $peerAem & reports this side's outcome.
+static ExchangeSide runSide(int socket_fd, uint32_t peerAem, bool server)
+{
+    CommunicationWorkerArgs args = {
+            .connected_device = {
+                    .AEM = peerAem,
+                    .aemIndex = binary_search_index( CLIENT_AEM_LIST, CLIENT_AEM_LIST_LENGTH, peerAem )
+            },
+            .connected_socket_fd = socket_fd,
+            .server = server
+    };
+
+    // Keep per-message log lines off the terminal
+    fflush( stdout );
+    int savedStdout = dup( STDOUT_FILENO );
+    int devNull = open( "/dev/null", O_WRONLY );
+    dup2( devNull, STDOUT_FILENO );
+
+    communication_worker( &args );
+
+    fflush( stdout );
+    dup2( savedStdout, STDOUT_FILENO );
+    close( savedStdout );
+    close( devNull );
+
+    MessagesStats messagesStats;
+    SessionStats sessionStats;
+    stats_messages( &messagesStats );
+    stats_sessions( &sessionStats );
+
+    ExchangeSide side = {
+            .received = messagesStats.received,
+            .transmitted = messagesStats.transmitted,
+            .purged = messagesStats.purged,
+            .stored = messagesCount,
+            .examined = sessionStats.examined,
+            .skipped = sessionStats.skipped,
+            .receipts = sessionStats.receipts,
+            .bytes_sent = sessionStats.bytes_sent,
+            .syscalls = sessionStats.syscalls,
+            .rejected = sessionStats.rejected
+    };
+    Contact contact;
+    EXPECT_EQ( 1U, contacts_recent( peerAem, &contact, 1 ) );
+    side.started_at = contact.start;
+    side.finished_at = contact.end;
+
+    return side;
+}
+
+/* Outcome of a device without negotiation ( baseline text protocol ) */
+typedef struct legacy_side_t {
+
+    uint32_t records;                   // records read
+    uint32_t malformed;                 // records read that are not a serialized message
+
+} LegacySide;
+
+/// \brief Runs a session on $socket_fd as devices without negotiation do: listening device sends its $messages_n
+/// messages as 277-byte text records & then receives, dialing device the other way around. Records are read until a
+/// read() falls short.
+static LegacySide legacySession(int socket_fd, bool server, uint32_t aem, uint16_t messages_n)
+{
+    LegacySide side = {};
+
+    auto transmit = [&]() {
+        char record[MESSAGE_SERIALIZED_LEN];
+        Message message;
+
+        for ( uint16_t message_i = 0; message_i < messages_n; message_i++ )
+        {
+            memset( &message, 0, sizeof( Message ) );
+            message.sender = aem;
+            message.recipient = 8888;
+            message.created_at = 1561669840 + message_i;
+            snprintf( message.body, MESSAGE_BODY_LEN, "legacy message #%u", message_i );
+            implode( "_", message, record );
+            send( socket_fd, record, MESSAGE_SERIALIZED_LEN, MSG_NOSIGNAL );
+        }
+        shutdown( socket_fd, SHUT_WR );
+    };
+    auto receive = [&]() {
+        uint8_t record[MESSAGE_SERIALIZED_LEN];
+
+        while ( MESSAGE_SERIALIZED_LEN == read( socket_fd, record, MESSAGE_SERIALIZED_LEN ) )
+        {
+            side.records++;
+            side.malformed += scan_records( record, 1, MESSAGE_SERIALIZED_LEN ) & 1 ? 0 : 1;
+        }
+        shutdown( socket_fd, SHUT_RD );
+    };
+
+    if ( server )
+    {
+        transmit();
+        receive();
+    }
+    else
+    {
+        receive();
+        transmit();
+    }
+    close( socket_fd );
+
+    return side;
+}
+
+/// \brief Runs a session between two forked devices over loopback. Each device sets up its store with $prepare first.
+/// \param server outcome of the listening device
+/// \param client outcome of the dialing device
+/// \return session wall time in usecs
+static uint64_t contact(const char *mode, const char *protocol, uint32_t serverAem, uint32_t clientAem,
+                        const std::function<void()> &prepare, ExchangeSide *server, ExchangeSide *client)
+{
+    int pipe_fd[2];
+    struct sockaddr_in address = {};
+
+    signal( SIGPIPE, SIG_IGN );
+    socketSubnet = "127.0";
+    communicationSessionMode = mode;
+    communicationProtocol = protocol;
+
+    // Listening socket of server device
+    address.sin_family = AF_INET;
+    address.sin_port = htons( SOCKET_PORT );
+    address.sin_addr.s_addr = inet_addr( aem2ip( serverAem ) );
+
+    int listen_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+    int one = 1;
+    setsockopt( listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( int ) );
+    EXPECT_EQ( 0, bind( listen_fd, (struct sockaddr *) &address, sizeof( address ) ) );
+    EXPECT_EQ( 0, listen( listen_fd, SOCKET_LISTEN_QUEUE_LEN ) );
+    EXPECT_EQ( 0, pipe( pipe_fd ) );
+
+    fflush( stdout );
+    pid_t pid = fork();
+    if ( 0 == pid )
+    {
+        // Server device ( own globals from now on )
+        close( pipe_fd[0] );
+        CLIENT_AEM = serverAem;
+        prepare();
+        log_tearUp( "communication_test_server.json" );
+
+        int socket_fd = accept( listen_fd, nullptr, nullptr );
+        ExchangeSide side = runSide( socket_fd, clientAem, true );
+
+        log_tearDown( 0.0 );
+        remove( "communication_test_server.json" );
+        remove( "communication_test_server.ndjson" );
+        messages_detach();
+        write( pipe_fd[1], &side, sizeof( ExchangeSide ) );
+        _exit( 0 );
+    }
+
+    // Client device
+    close( pipe_fd[1] );
+    close( listen_fd );
+    CLIENT_AEM = clientAem;
+    prepare();
+    log_tearUp( "communication_test_client.json" );
+
+    int socket_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+    address.sin_port = 0;
+    address.sin_addr.s_addr = inet_addr( aem2ip( clientAem ) );
+    setsockopt( socket_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( int ) );
+    bind( socket_fd, (struct sockaddr *) &address, sizeof( address ) );
+    EXPECT_EQ( true, socket_connect( socket_fd, serverAem, SOCKET_PORT ) );
+
+    *client = runSide( socket_fd, serverAem, false );
+
+    EXPECT_EQ( (ssize_t) sizeof( ExchangeSide ), read( pipe_fd[0], server, sizeof( ExchangeSide ) ) );
+    close( pipe_fd[0] );
+    waitpid( pid, nullptr, 0 );
+
+    log_tearDown( 0.0 );
+    remove( "communication_test_client.json" );
+    remove( "communication_test_client.ndjson" );
+    messages_detach();
+    socketSubnet = SOCKET_SUBNET;
+    communicationSessionMode = COMMUNICATION_SESSION_MODE;
+    communicationProtocol = COMMUNICATION_PROTOCOL;
+    communicationFraming = COMMUNICATION_FRAMING;
+
+    uint64_t startedAt = std::min( timevalMicros( server->started_at ), timevalMicros( client->started_at ) );
+    uint64_t finishedAt = std::max( timevalMicros( server->finished_at ), timevalMicros( client->finished_at ) );
+    return finishedAt - startedAt;
+}
+
+/// \brief Exchanges $messages_n messages each way between two forked devices over loopback.
+/// \param server outcome of the listening device
+/// \param client outcome of the dialing device
+/// \return session wall time in usecs
+static uint64_t exchange(const char *mode, const char *protocol, uint16_t messages_n, ExchangeSide *server, ExchangeSide *client)
+{
+    return contact( mode, protocol, serverAem, clientAem, [messages_n]() { fillStore( messages_n ); }, server, client );
+}
+
+/// \brief Store file of node $aem in multi-node scenarios ( it keeps the node's messages between contacts ).
+static std::string nodeStore(uint32_t aem)
+{
+    return "communication_test_" + std::to_string( aem ) + ".store";
+}
+
+/// \brief Empties store of node $aem & fills it with $messages_n messages produced by the node ( or relayed for
+/// $sender, when given ) for $recipient.
+static void nodeProduce(uint32_t aem, uint16_t messages_n, uint32_t sender = 0, uint32_t recipient = 8888)
+{
+    uint32_t aemOriginal = CLIENT_AEM;
+    Message message;
+
+    CLIENT_AEM = aem;
+    remove( nodeStore( aem ).c_str() );
+    messages_attach( nodeStore( aem ).c_str() );
+    for ( uint16_t message_i = 0; message_i < messages_n; message_i++ )
+    {
+        memset( &message, 0, sizeof( Message ) );
+        message.sender = 0 == sender ? aem : sender;
+        message.recipient = recipient;
+        message.created_at = 1561669840 + message_i;
+        snprintf( message.body, MESSAGE_BODY_LEN, "message #%u of node %04u", message_i, aem );
+        messages_push( &message );
+    }
+    messages_detach();
+    CLIENT_AEM = aemOriginal;
+}
+
+/// \brief Bytes a device sends ahead of its messages in "summary" protocol: negotiation, handshake with versions of
+/// $origins_n origins, then $receipts_n receipts.
+static uint64_t preambleLength(uint32_t origins_n, uint32_t receipts_n = 0)
+{
+    return NEGOTIATION_LEN + SUMMARY_LEN + VERSIONS_HEADER_LEN + origins_n * VERSIONS_ENTRY_LEN + RECEIPTS_HEADER_LEN + receipts_n * RECEIPTS_ENTRY_LEN;
+}
+
+/// \brief Bytes of the binary frames of the first $messages_n messages nodeProduce() produced at node $aem.
+static uint64_t framesLength(uint32_t aem, uint16_t messages_n)
+{
+    char body[MESSAGE_BODY_LEN];
+    uint64_t length = 0;
+
+    for ( uint16_t message_i = 0; message_i < messages_n; message_i++ )
+        length += FRAME_PREFIX_LEN + FRAME_HEADER_LEN + snprintf( body, MESSAGE_BODY_LEN, "message #%u of node %04u", message_i, aem );
+
+    return length;
+}
+
+/// \brief Runs a full-duplex session between nodes $serverAem & $clientAem ( on their stores, in forked devices ), both
+/// with binary frames.
+/// \return session wall time in usecs
+static uint64_t nodeContact(const char *protocol, uint32_t serverAem, uint32_t clientAem, ExchangeSide *server, ExchangeSide *client)
+{
+    return contact( "full-duplex", protocol, serverAem, clientAem, []() {
+        resetStats();
+        messages_attach( nodeStore( CLIENT_AEM ).c_str() );
+        communicationFraming = "binary";
+    }, server, client );
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests communication > communication_worker() function: both devices get all messages of the other one,
+/// in both session modes & both protocols.
+TEST(CommunicationTest, WorkerExchange)
+{
+    const uint16_t messages_n = 100;
+    ExchangeSide server, client;
+
+    for ( const char *protocol : {"text", "summary"} )
+    {
+        for ( const char *mode : {"half-duplex", "full-duplex"} )
+        {
+            exchange( mode, protocol, messages_n, &server, &client );
+            EXPECT_EQ( messages_n, server.received ) << mode << ", " << protocol;
+            EXPECT_EQ( messages_n, client.received ) << mode << ", " << protocol;
+        }
+    }
+}
+
+/// \brief Tests session > summary handshake: of three nodes, the last pair to meet sends only what the other one
+/// misses ( messages it got via the third node are skipped ). Messages are relayed for devices outside
+/// $CLIENT_AEM_SOURCE, so they carry no sequence numbers & only the summaries tell what the other one holds.
+TEST(CommunicationTest, SummarySkipsHeldMessages)
+{
+    const uint16_t messages_n = 100;
+    const uint32_t a = 8723, b = 8600, c = 9026;
+    ExchangeSide server, client;
+
+    for ( const char *protocol : {"text", "summary"} )
+    {
+        for ( uint32_t aem : {a, b, c} )
+            nodeProduce( aem, messages_n, aem + 1 );
+
+        nodeContact( protocol, a, b, &server, &client );
+        nodeContact( protocol, b, c, &server, &client );
+        EXPECT_EQ( 2 * messages_n, client.received ) << protocol;
+
+        // C holds all messages, A misses those of C only
+        nodeContact( protocol, c, a, &server, &client );
+        EXPECT_EQ( 0, server.received ) << protocol;
+        EXPECT_EQ( messages_n, client.received ) << protocol;
+        if ( 0 == strcmp( "summary", protocol ) )
+        {
+            EXPECT_EQ( 2U * messages_n, server.skipped );
+            EXPECT_EQ( 2U * messages_n, client.skipped );
+            EXPECT_EQ( preambleLength( 0 ) + framesLength( c, messages_n ), server.bytes_sent );
+            EXPECT_EQ( preambleLength( 0 ), client.bytes_sent );
+        }
+        else
+        {
+            EXPECT_EQ( NEGOTIATION_LEN + framesLength( a, messages_n ) + framesLength( b, messages_n ) + framesLength( c, messages_n ), server.bytes_sent );
+            EXPECT_EQ( NEGOTIATION_LEN + framesLength( a, messages_n ) + framesLength( b, messages_n ), client.bytes_sent );
+        }
+    }
+
+    for ( uint32_t aem : {a, b, c} )
+        remove( nodeStore( aem ).c_str() );
+}
+
+/// \brief Tests session > version vectors: of three nodes, the last pair to meet looks up only the range the other one
+/// misses ( messages it got via the third node are not even examined ), & meeting again examines nothing.
+TEST(CommunicationTest, VersionsSkipSeenRanges)
+{
+    const uint16_t messages_n = 100;
+    const uint32_t a = 8723, b = 8600, c = 9026;
+    ExchangeSide server, client;
+
+    for ( uint32_t aem : {a, b, c} )
+        nodeProduce( aem, messages_n );
+
+    nodeContact( "summary", a, b, &server, &client );
+    nodeContact( "summary", b, c, &server, &client );
+    EXPECT_EQ( 2 * messages_n, client.received );
+
+    // C has seen 3 origins, A only 2: C sends those of its own origin
+    nodeContact( "summary", c, a, &server, &client );
+    EXPECT_EQ( 0, server.received );
+    EXPECT_EQ( messages_n, client.received );
+    EXPECT_EQ( messages_n, server.examined );
+    EXPECT_EQ( 0U, client.examined );
+    EXPECT_EQ( 0U, server.skipped );
+    EXPECT_EQ( preambleLength( 3 ) + framesLength( c, messages_n ), server.bytes_sent );
+    EXPECT_EQ( preambleLength( 2 ), client.bytes_sent );
+
+    // Meet again: handshakes only
+    nodeContact( "summary", a, c, &server, &client );
+    EXPECT_EQ( 0U, server.examined + client.examined );
+    EXPECT_EQ( preambleLength( 3 ), server.bytes_sent );
+    EXPECT_EQ( preambleLength( 3 ), client.bytes_sent );
+
+    for ( uint32_t aem : {a, b, c} )
+        remove( nodeStore( aem ).c_str() );
+}
+
+/// \brief Tests session > framing negotiation: devices that both support binary frames use them, else they fall back to
+/// text records ( either side may lack them ), in both protocols. Text records are the baseline ones unless summaries
+/// are negotiated too; a listening device with nothing to negotiate sends no opening at all.
+TEST(CommunicationTest, FramingFallback)
+{
+    const uint16_t messages_n = 100;
+    const uint32_t a = 8723, b = 8600;
+    ExchangeSide server, client;
+
+    for ( const char *protocol : {"text", "summary"} )
+    {
+        for ( const char *framing : {"binary", "text"} )
+        {
+            for ( bool serverOnly : {true, false} )
+            {
+                nodeProduce( a, messages_n );
+                nodeProduce( b, messages_n );
+
+                // Given framing at server only ( or at client only ), binary at the other one
+                contact( "full-duplex", protocol, a, b, [framing, serverOnly, a]() {
+                    resetStats();
+                    messages_attach( nodeStore( CLIENT_AEM ).c_str() );
+                    communicationFraming = ( a == CLIENT_AEM ) == serverOnly ? framing : "binary";
+                }, &server, &client );
+
+                bool summary = 0 == strcmp( "summary", protocol );
+                uint64_t records = 0 == strcmp( "binary", framing ) ? framesLength( a, messages_n ) :
+                    (uint64_t) messages_n * ( summary ? MESSAGE_SEQUENCED_LEN : MESSAGE_SERIALIZED_LEN );
+                uint64_t preamble = summary ? preambleLength( 1 ) : ( 0 == strcmp( "text", framing ) && serverOnly ? 0 : NEGOTIATION_LEN );
+                EXPECT_EQ( messages_n, server.received ) << protocol << ", " << framing;
+                EXPECT_EQ( messages_n, client.received ) << protocol << ", " << framing;
+                EXPECT_EQ( preamble + records, server.bytes_sent ) << protocol << ", " << framing;
+            }
+        }
+    }
+
+    for ( uint32_t aem : {a, b} )
+        remove( nodeStore( aem ).c_str() );
+}
+/// \brief Tests session > buffered streams: both stream modes deliver all messages, in both protocols, & batches take
+/// far fewer syscalls than messages.
+TEST(CommunicationTest, StreamModesExchange)
+{
+    const uint16_t messages_n = 500;
+    ExchangeSide server, client;
+
+    for ( const char *protocol : {"text", "summary"} )
+    {
+        for ( const char *streamMode : {"per-message", "batched"} )
+        {
+            communicationStreamMode = streamMode;
+            exchange( "full-duplex", protocol, messages_n, &server, &client );
+            communicationStreamMode = COMMUNICATION_STREAM_MODE;
+
+            EXPECT_EQ( messages_n, server.received ) << protocol << ", " << streamMode;
+            EXPECT_EQ( messages_n, client.received ) << protocol << ", " << streamMode;
+            EXPECT_EQ( messages_n, server.transmitted ) << protocol << ", " << streamMode;
+            if ( 0 == strcmp( "batched", streamMode ) )
+                EXPECT_LT( server.syscalls, messages_n / 4U ) << protocol;
+            else
+                EXPECT_GE( server.syscalls, 2U * messages_n ) << protocol;
+        }
+    }
+}
+
+/// \brief Tests session > delivery receipts: the node that hands messages over to their recipient purges them, & the
+/// node it got them from purges them as soon as they meet again.
+TEST(CommunicationTest, ReceiptsPurgeDelivered)
+{
+    const uint16_t messages_n = 100;
+    const uint32_t a = 8723, b = 8600, c = 9026;
+    ExchangeSide server, client;
+
+    nodeProduce( a, messages_n, 0, c );
+    nodeProduce( b, 0 );
+    nodeProduce( c, 0 );
+
+    nodeContact( "summary", a, b, &server, &client );
+    EXPECT_EQ( messages_n, client.stored );
+
+    // B delivers to C
+    nodeContact( "summary", b, c, &server, &client );
+    EXPECT_EQ( messages_n, client.received );
+    EXPECT_EQ( messages_n, server.purged );
+    EXPECT_EQ( 0U, server.stored );
+
+    // B tells A
+    nodeContact( "summary", a, b, &server, &client );
+    EXPECT_EQ( messages_n, server.receipts );
+    EXPECT_EQ( messages_n, server.purged );
+    EXPECT_EQ( 0U, server.stored );
+    EXPECT_EQ( 0, server.transmitted + client.transmitted );
+    EXPECT_EQ( preambleLength( 1, messages_n ), client.bytes_sent );
+    EXPECT_EQ( preambleLength( 1 ), server.bytes_sent );
+
+    for ( uint32_t aem : {a, b, c} )
+        remove( nodeStore( aem ).c_str() );
+}
+
+/// \brief Tests communication > communication_worker() function: a dialed device counts as contacted only once the
+/// session ran to the end in both directions, so a session cut short is dialed again at the device's next beacon.
+TEST(CommunicationTest, ContactedOnlyWhenComplete)
+{
+    Beacon beacon = {.aem = serverAem, .messages = 0, .newest_created_at = 0};
+    Device targets[CLIENT_AEM_LIST_LENGTH];
+    ExchangeSide server, client;
+    int pair[2];
+
+    signal( SIGPIPE, SIG_IGN );
+    CLIENT_AEM = clientAem;
+    fillStore( 1 );
+
+    // Device hangs up before its message is sent > dialed again
+    usleep( 2000 );
+    discovery_heard( &beacon );
+    ASSERT_EQ( 1, discovery_targets( targets, CLIENT_AEM_LIST_LENGTH, 0 ) );
+    ASSERT_EQ( 0, socketpair( AF_UNIX, SOCK_STREAM, 0, pair ) );
+    close( pair[1] );
+    log_tearUp( "communication_test_client.json" );
+    runSide( pair[0], serverAem, false );
+    log_tearDown( 0.0 );
+    remove( "communication_test_client.json" );
+    remove( "communication_test_client.ndjson" );
+
+    messages_reset();
+    usleep( 2000 );
+    discovery_heard( &beacon );
+    ASSERT_EQ( 1, discovery_targets( targets, CLIENT_AEM_LIST_LENGTH, 0 ) );
+
+    // Session runs to the end > skipped while nothing changed
+    contact( "full-duplex", "summary", serverAem, clientAem, []() { messages_reset(); resetStats(); }, &server, &client );
+    messages_reset();
+    usleep( 2000 );
+    discovery_heard( &beacon );
+    EXPECT_EQ( 0, discovery_targets( targets, CLIENT_AEM_LIST_LENGTH, 0 ) );
+}
+
+/// \brief Tests session > negotiation: a device without it ( baseline text protocol ) & a "summary" device exchange
+/// messages as baseline text records, with either one listening & either framing, & neither one gets anything
+/// malformed. A device without negotiation that dials reads the opening as a short record, so it receives nothing in
+/// that session.
+TEST(CommunicationTest, LegacyPeer)
+{
+    const uint16_t messages_n = 50;
+    ExchangeSide side;
+    LegacySide legacy;
+    int pair[2];
+
+    signal( SIGPIPE, SIG_IGN );
+    communicationProtocol = "summary";
+
+    for ( const char *framing : {"binary", "text"} )
+    {
+        communicationFraming = framing;
+
+        for ( bool legacyServer : {true, false} )
+        {
+            CLIENT_AEM = clientAem;
+            fillStore( messages_n );
+            log_tearUp( "communication_test_client.json" );
+
+            ASSERT_EQ( 0, socketpair( AF_UNIX, SOCK_STREAM, 0, pair ) );
+            std::thread peer( [&]() { legacy = legacySession( pair[1], legacyServer, serverAem, messages_n ); } );
+            side = runSide( pair[0], serverAem, !legacyServer );
+            peer.join();
+
+            log_tearDown( 0.0 );
+            remove( "communication_test_client.json" );
+            remove( "communication_test_client.ndjson" );
+
+            EXPECT_EQ( messages_n, side.received ) << framing << ", " << legacyServer;
+            EXPECT_EQ( 0U, side.rejected ) << framing << ", " << legacyServer;
+            EXPECT_EQ( legacyServer ? messages_n : 0U, legacy.records ) << framing << ", " << legacyServer;
+            EXPECT_EQ( 0U, legacy.malformed ) << framing << ", " << legacyServer;
+            EXPECT_EQ( legacyServer ? (uint64_t) messages_n * MESSAGE_SERIALIZED_LEN : NEGOTIATION_LEN, side.bytes_sent ) << framing << ", " << legacyServer;
+        }
+    }
+
+    messages_reset();
+    communicationProtocol = COMMUNICATION_PROTOCOL;
+    communicationFraming = COMMUNICATION_FRAMING;
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Compares session wall time of half-duplex & full-duplex sessions for a 2000-message exchange over loopback
+/// ( 1000 messages each way, which fills both $MESSAGES_SIZE stores ).
+TEST(CommunicationTest, DISABLED_Benchmark_HalfVsFullDuplex)
+{
+    const uint16_t messages_n = MESSAGES_SIZE / 2;
+    const uint32_t repetitions = 5;
+    ExchangeSide server, client;
+
+    for ( const char *mode : {"half-duplex", "full-duplex"} )
+    {
+        uint64_t total = 0;
+        for ( uint32_t repetition_i = 0; repetition_i < repetitions; repetition_i++ )
+        {
+            total += exchange( mode, COMMUNICATION_PROTOCOL, messages_n, &server, &client );
+            ASSERT_EQ( messages_n, server.received );
+            ASSERT_EQ( messages_n, client.received );
+        }
+
+        GOUT( mode << ": session wall time = " << ( (double) total / repetitions / 1000.0 ) << "ms" );
+    }
+}
+
+/// \brief Compares socket syscalls per message & throughput of per-message & batched streams, for 2000-message
+/// exchanges over loopback ( 1000 messages each way ), in both protocols.
+TEST(CommunicationTest, DISABLED_Benchmark_StreamBatching)
+{
+    const uint16_t messages_n = MESSAGES_SIZE / 2;
+    const uint32_t repetitions = 5;
+    ExchangeSide server, client;
+
+    for ( const char *protocol : {"text", "summary"} )
+    {
+        for ( const char *streamMode : {"per-message", "batched"} )
+        {
+            uint64_t wallTime = 0, bytes = 0, syscalls = 0;
+
+            communicationStreamMode = streamMode;
+            for ( uint32_t repetition_i = 0; repetition_i < repetitions; repetition_i++ )
+            {
+                wallTime += exchange( "full-duplex", protocol, messages_n, &server, &client );
+                ASSERT_EQ( messages_n, server.received );
+                ASSERT_EQ( messages_n, client.received );
+
+                bytes += server.bytes_sent + client.bytes_sent;
+                syscalls += server.syscalls + client.syscalls;
+            }
+            communicationStreamMode = COMMUNICATION_STREAM_MODE;
+
+            GOUT( protocol << ", " << streamMode << ": syscalls = " << (double) syscalls / ( 2.0 * messages_n * repetitions )
+                  << " / message, throughput = " << (double) bytes / wallTime << " MB/s, session wall time = "
+                  << (double) wallTime / repetitions / 1000.0 << "ms" );
+        }
+    }
+}
+
+/// \brief Compares bytes on the wire & session wall time with & without summaries, for four nodes that each produce
+/// 450 messages & then meet pairwise ( every contact after the first two carries messages the peer already holds ).
+TEST(CommunicationTest, DISABLED_Benchmark_SummaryHandshake)
+{
+    const uint16_t messages_n = 450;
+    const std::vector<uint32_t> nodes = {8723, 8600, 9026, 8001};
+    const std::vector<std::pair<uint32_t, uint32_t>> contacts = {
+            {8723, 8600}, {9026, 8001}, {8723, 9026}, {8600, 8001}, {8723, 8001}, {8600, 9026}
+    };
+    ExchangeSide server, client;
+
+    for ( const char *protocol : {"text", "summary"} )
+    {
+        uint64_t bytes = 0, wallTime = 0;
+        uint32_t received = 0, skipped = 0;
+
+        for ( uint32_t aem : nodes )
+            nodeProduce( aem, messages_n );
+
+        for ( const auto &pair : contacts )
+        {
+            wallTime += nodeContact( protocol, pair.first, pair.second, &server, &client );
+            bytes += server.bytes_sent + client.bytes_sent;
+            received += server.received + client.received;
+            skipped += server.skipped + client.skipped;
+        }
+
+        GOUT( protocol << ": wire = " << bytes / 1024 << " KiB, session wall time = " << (double) wallTime / 1000.0
+              << "ms ( " << contacts.size() << " contacts, new messages = " << received << ", skipped = " << skipped << " )" );
+    }
+
+    for ( uint32_t aem : nodes )
+        remove( nodeStore( aem ).c_str() );
+}
+
+/// \brief Measures repeated contacts between two nodes that hold the same 2000 messages ( both got them from a third
+/// node ): "text" protocol, summaries alone ( messages relayed for devices outside $CLIENT_AEM_SOURCE carry no
+/// sequence numbers ) & version vectors. Reports the first contact & the average of the next ones.
+TEST(CommunicationTest, DISABLED_Benchmark_RepeatedContacts)
+{
+    const uint16_t messages_n = MESSAGES_SIZE;
+    const uint32_t repetitions = 10;
+    const uint32_t a = 8723, b = 8600, c = 9026;
+    ExchangeSide server, client;
+
+    for ( const char *variant : {"text", "summary only", "versions"} )
+    {
+        const char *protocol = 0 == strcmp( "text", variant ) ? "text" : "summary";
+        uint64_t bytes = 0, wallTime = 0, examined = 0;
+
+        nodeProduce( c, messages_n, 0 == strcmp( "versions", variant ) ? 0 : 7051 );
+        for ( uint32_t aem : {a, b} )
+        {
+            nodeProduce( aem, 0 );
+            nodeContact( protocol, c, aem, &server, &client );
+            ASSERT_EQ( messages_n, client.received ) << variant;
+        }
+
+        for ( uint32_t repetition_i = 0; repetition_i <= repetitions; repetition_i++ )
+        {
+            uint64_t contactWallTime = nodeContact( protocol, a, b, &server, &client );
+            EXPECT_EQ( 0, server.received + client.received ) << variant;
+            if ( 0 == repetition_i )
+            {
+                GOUT( variant << ": first contact: wire = " << ( server.bytes_sent + client.bytes_sent ) / 1024 << " KiB, wall time = "
+                      << (double) contactWallTime / 1000.0 << "ms, examined = " << server.examined + client.examined );
+                continue;
+            }
+
+            bytes += server.bytes_sent + client.bytes_sent;
+            wallTime += contactWallTime;
+            examined += server.examined + client.examined;
+        }
+
+        GOUT( variant << ": next contacts: wire = " << bytes / repetitions / 1024 << " KiB, wall time = "
+              << (double) wallTime / repetitions / 1000.0 << "ms, examined = " << examined / repetitions );
+    }
+
+    for ( uint32_t aem : {a, b, c} )
+        remove( nodeStore( aem ).c_str() );
+}
+
+/// \brief Measures transmitted messages & buffer occupancy with & without delivery receipts, for five nodes that each
+/// produce 40 messages per round for the others & meet in pairs ( 5 contacts per round ). Reports averages of the last
+/// 10 of 20 rounds ( steady state ).
+TEST(CommunicationTest, DISABLED_Benchmark_DeliveryReceipts)
+{
+    const uint16_t messages_n = 40;
+    const uint32_t rounds = 20, steadyRounds = 10;
+    const std::vector<uint32_t> nodes = {8723, 8600, 9026, 8001, 8011};
+    ExchangeSide server, client;
+
+    for ( bool receipts : {false, true} )
+    {
+        uint64_t transmitted = 0, occupancy = 0, purged = 0;
+        messagesReceipts = receipts;
+
+        for ( uint32_t aem : nodes )
+            nodeProduce( aem, 0 );
+
+        for ( uint32_t round_i = 0; round_i < rounds; round_i++ )
+        {
+            // Produce: message #i of a node is for its ( 1 + i % 4 )-th next node
+            for ( uint32_t node_i = 0; node_i < nodes.size(); node_i++ )
+            {
+                uint32_t aemOriginal = CLIENT_AEM;
+                Message message;
+
+                CLIENT_AEM = nodes[node_i];
+                messages_attach( nodeStore( CLIENT_AEM ).c_str() );
+                for ( uint16_t message_i = 0; message_i < messages_n; message_i++ )
+                {
+                    memset( &message, 0, sizeof( Message ) );
+                    message.sender = CLIENT_AEM;
+                    message.recipient = nodes[( node_i + 1 + message_i % 4 ) % nodes.size()];
+                    message.created_at = 1561669840 + round_i * messages_n + message_i;
+                    snprintf( message.body, MESSAGE_BODY_LEN, "message #%u of node %04u", message_i, CLIENT_AEM );
+                    messages_push( &message );
+                }
+                messages_detach();
+                CLIENT_AEM = aemOriginal;
+            }
+
+            // Meet: every node with its ( 1 + round % 2 )-th next node
+            uint64_t roundTransmitted = 0, roundOccupancy = 0, roundPurged = 0;
+            for ( uint32_t node_i = 0; node_i < nodes.size(); node_i++ )
+            {
+                nodeContact( "summary", nodes[node_i], nodes[( node_i + 1 + round_i % 2 ) % nodes.size()], &server, &client );
+                roundTransmitted += server.transmitted + client.transmitted;
+                roundPurged += server.purged + client.purged;
+            }
+            for ( uint32_t aem : nodes )
+            {
+                CLIENT_AEM = aem;
+                roundOccupancy += (uint32_t) messages_attach( nodeStore( aem ).c_str() );
+                messages_detach();
+            }
+
+            if ( round_i >= rounds - steadyRounds )
+            {
+                transmitted += roundTransmitted;
+                occupancy += roundOccupancy;
+                purged += roundPurged;
+            }
+        }
+
+        GOUT( ( receipts ? "receipts" : "no receipts" ) << ": transmitted = " << (double) transmitted / steadyRounds
+              << " messages / round, occupancy = " << (double) occupancy / steadyRounds / nodes.size() << " / " << MESSAGES_SIZE
+              << " slots / node, purged = " << (double) purged / steadyRounds << " / round" );
+    }
+
+    messagesReceipts = MESSAGES_RECEIPTS;
+    for ( uint32_t aem : nodes )
+        remove( nodeStore( aem ).c_str() );
+}
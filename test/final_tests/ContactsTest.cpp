@@ -0,0 +1,167 @@
+#include <cstddef>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "contacts.h"
+
+    #include <time.h>
+    #include <unistd.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Adds a contact with device #$aemIndex ( AEM 8000 + $aemIndex ) lasting $duration usecs, started at $at secs.
+static void addContact(int32_t aemIndex, uint64_t duration, time_t at = 1561669840)
+{
+    struct timeval start = { .tv_sec = at, .tv_usec = 250000 };
+    struct timeval end = { .tv_sec = at + (time_t) ( ( 250000 + duration ) / 1000000 ),
+                           .tv_usec = (suseconds_t) ( ( 250000 + duration ) % 1000000 ) };
+
+    contacts_add( aemIndex, 8000 + (uint32_t) aemIndex, &start, &end );
+}
+
+/// \brief Bytes of whole pages $bytes touch.
+static size_t pages(size_t bytes)
+{
+    size_t page = (size_t) sysconf( _SC_PAGESIZE );
+
+    return ( bytes + page - 1 ) / page * page;
+}
+
+class ContactsTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        contacts_reset();
+    }
+
+    void TearDown() override
+    {
+        contacts_reset();
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests contacts > contacts_add() function: count, sum, min, max & histogram of durations, past 255 contacts
+/// & for devices of the "range" source.
+TEST_F(ContactsTest, Aggregates)
+{
+    const int32_t rangeIndex = (int32_t) CLIENT_AEM_RANGE_LENGTH - 1;
+
+    addContact( 3, 500 );               // < 1 ms
+    addContact( 3, 1500 );              // [ 1, 2 ) ms
+    addContact( 3, 3000 );              // [ 2, 4 ) ms
+    addContact( 3, 10000000 );          // 10 s: [ 8192, 16384 ) ms
+
+    const ContactStats *stats = contacts_stats( 3 );
+    EXPECT_EQ( 4U, stats->count );
+    EXPECT_EQ( 10005000U, stats->sum );
+    EXPECT_EQ( 500U, stats->min );
+    EXPECT_EQ( 10000000U, stats->max );
+    EXPECT_EQ( 1U, stats->histogram[0] );
+    EXPECT_EQ( 1U, stats->histogram[1] );
+    EXPECT_EQ( 1U, stats->histogram[2] );
+    EXPECT_EQ( 1U, stats->histogram[14] );
+
+    // Hours long contacts fall in the last bucket, clock set back counts as 0
+    addContact( 4, (uint64_t) 3 * 3600 * 1000000 );
+    EXPECT_EQ( 1U, contacts_stats( 4 )->histogram[CONTACTS_HISTOGRAM_LEN - 1] );
+    struct timeval start = { .tv_sec = 1561669840, .tv_usec = 0 }, end = { .tv_sec = 1561669830, .tv_usec = 0 };
+    contacts_add( 4, 8004, &start, &end );
+    EXPECT_EQ( 0U, contacts_stats( 4 )->min );
+
+    // Past the 8-bit range, any index of "range" source
+    for ( uint32_t contact_i = 0; contact_i < 300; contact_i++ )
+        addContact( rangeIndex, 2000 );
+    EXPECT_EQ( 300U, contacts_stats( rangeIndex )->count );
+    EXPECT_EQ( 600000U, contacts_stats( rangeIndex )->sum );
+    EXPECT_EQ( 300U, contacts_stats( rangeIndex )->histogram[2] );
+    EXPECT_EQ( 0U, contacts_stats( 5 )->count );
+
+    contacts_reset();
+    EXPECT_EQ( 0U, contacts_stats( 3 )->count );
+}
+
+/// \brief Tests contacts > contacts_recent() function: the contacts of a device still in the ring, oldest first.
+TEST_F(ContactsTest, Recent)
+{
+    Contact contacts[CONTACTS_RECENT_LEN];
+
+    EXPECT_EQ( 0U, contacts_recent( 8001, contacts, CONTACTS_RECENT_LEN ) );
+
+    for ( uint32_t contact_i = 0; contact_i < 3; contact_i++ )
+        addContact( 1 + (int32_t) contact_i % 2, 1000, 1561669840 + contact_i );
+    ASSERT_EQ( 2U, contacts_recent( 8001, contacts, CONTACTS_RECENT_LEN ) );
+    EXPECT_EQ( 8001U, contacts[0].aem );
+    EXPECT_EQ( 1561669840, contacts[0].start.tv_sec );
+    EXPECT_EQ( 1561669842, contacts[1].start.tv_sec );
+    ASSERT_EQ( 1U, contacts_recent( 8001, contacts, 1 ) );
+    EXPECT_EQ( 1561669842, contacts[0].start.tv_sec );
+
+    // Ring wraps: only the most recent contacts are kept, stats keep every contact
+    for ( uint32_t contact_i = 3; contact_i < CONTACTS_RECENT_LEN + 10; contact_i++ )
+        addContact( 1 + (int32_t) contact_i % 2, 1000, 1561669840 + contact_i );
+    uint32_t recent_n = contacts_recent( 8001, contacts, CONTACTS_RECENT_LEN );
+    EXPECT_EQ( CONTACTS_RECENT_LEN / 2, recent_n );
+    EXPECT_EQ( 1561669840 + 10, contacts[0].start.tv_sec );
+    EXPECT_EQ( 1561669840 + CONTACTS_RECENT_LEN + 8, contacts[recent_n - 1].start.tv_sec );
+    EXPECT_EQ( ( CONTACTS_RECENT_LEN + 10 ) / 2, contacts_stats( 1 )->count );
+}
+
+/// \brief Reports memory of contact stats in both AEM sources, against the tables of start & end times they replace (
+/// one timeval per contact, up to 1000 contacts per device ), & the cost of adding a contact.
+TEST_F(ContactsTest, DISABLED_Benchmark_Footprint)
+{
+    const size_t tablesContacts = 1000;
+    const uint32_t contacts_n = 10000000;
+    const size_t statsBytes = MESSAGE_DEVICES_MAX * sizeof( ContactStats );
+    const size_t recentBytes = CONTACTS_RECENT_LEN * sizeof( Contact );
+
+    for ( uint32_t length : {CLIENT_AEM_LIST_LENGTH, (uint32_t) CLIENT_AEM_RANGE_LENGTH} )
+    {
+        size_t tablesBytes = 2 * length * tablesContacts * sizeof( struct timeval ) + length;
+        size_t usedBytes = length * sizeof( ContactStats ) + recentBytes;
+        size_t residentBytes = pages( length * sizeof( ContactStats ) ) + pages( recentBytes );
+
+        GOUT( ( CLIENT_AEM_LIST_LENGTH == length ? "list" : "range" ) << " ( " << length << " devices ): tables = "
+              << tablesBytes / 1024.0 << " KiB, contact stats = " << usedBytes / 1024.0 << " KiB ( "
+              << residentBytes / 1024.0 << " KiB of pages resident, of " << ( statsBytes + recentBytes ) / 1024.0
+              << " KiB static )" );
+    }
+
+    uint64_t start = nowNanos();
+    for ( uint32_t contact_i = 0; contact_i < contacts_n; contact_i++ )
+        addContact( (int32_t) ( contact_i % CLIENT_AEM_LIST_LENGTH ), contact_i % 100000, 1561669840 + contact_i / 1000 );
+    double perContact = (double) ( nowNanos() - start ) / contacts_n;
+
+    GOUT( "contacts_add(): " << perContact << " ns per contact ( " << contacts_n << " contacts )" );
+
+    uint64_t count = 0;
+    for ( uint32_t device_i = 0; device_i < CLIENT_AEM_LIST_LENGTH; device_i++ )
+        count += contacts_stats( (int32_t) device_i )->count;
+    EXPECT_EQ( contacts_n, count );
+}
@@ -0,0 +1,248 @@
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "client.h"
+    #include "communication.h"
+    #include "discovery.h"
+    #include "log.h"
+    #include "pool.h"
+    #include "server.h"
+    #include "stats.h"
+    #include "utils.h"
+
+    #include <signal.h>
+    #include <sys/epoll.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+extern const char *socketSubnet;
+
+extern PollingStats pollingStats;
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowMicros()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_nsec / 1000;
+}
+
+class DiscoveryTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        CLIENT_AEM = 9026;
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests discovery > discovery_beacon_pack() / discovery_beacon_unpack() functions.
+TEST_F(DiscoveryTest, BeaconPackUnpack)
+{
+    Beacon beacon = {.aem = 8600, .messages = 1999, .newest_created_at = 1561669840};
+    Beacon unpacked;
+    uint8_t packed[DISCOVERY_BEACON_LEN];
+
+    discovery_beacon_pack( &beacon, packed );
+    EXPECT_EQ( true, discovery_beacon_unpack( &unpacked, packed, DISCOVERY_BEACON_LEN ) );
+    EXPECT_EQ( beacon.aem, unpacked.aem );
+    EXPECT_EQ( beacon.messages, unpacked.messages );
+    EXPECT_EQ( beacon.newest_created_at, unpacked.newest_created_at );
+
+    // Wrong length / magic
+    EXPECT_EQ( false, discovery_beacon_unpack( &unpacked, packed, DISCOVERY_BEACON_LEN - 1 ) );
+    packed[0] ^= 0xFF;
+    EXPECT_EQ( false, discovery_beacon_unpack( &unpacked, packed, DISCOVERY_BEACON_LEN ) );
+}
+
+/// \brief Tests discovery > discovery_targets() function.
+TEST_F(DiscoveryTest, Targets)
+{
+    Beacon beacon = {.aem = 8723, .messages = 10, .newest_created_at = 1561669840};
+    Device targets[CLIENT_AEM_LIST_LENGTH];
+    DiscoveryStats before, after;
+
+    stats_discovery( &before );
+
+    // Heard once > dialed once
+    discovery_heard( &beacon );
+    ASSERT_EQ( 1, discovery_targets( targets, CLIENT_AEM_LIST_LENGTH, 0 ) );
+    EXPECT_EQ( 8723, targets[0].AEM );
+    EXPECT_EQ( binary_search_index( CLIENT_AEM_LIST, CLIENT_AEM_LIST_LENGTH, 8723 ), targets[0].aemIndex );
+    EXPECT_EQ( 0, discovery_targets( targets, CLIENT_AEM_LIST_LENGTH, 0 ) );
+
+    // Heard again, but last dial failed > dialed again
+    usleep( 2000 );
+    discovery_heard( &beacon );
+    EXPECT_EQ( 1, discovery_targets( targets, CLIENT_AEM_LIST_LENGTH, 0 ) );
+
+    // Heard again after contact, nothing changed > skipped
+    discovery_contacted( 8723 );
+    usleep( 2000 );
+    discovery_heard( &beacon );
+    EXPECT_EQ( 0, discovery_targets( targets, CLIENT_AEM_LIST_LENGTH, 0 ) );
+
+    // Peer's store changed > dialed
+    beacon.messages++;
+    usleep( 2000 );
+    discovery_heard( &beacon );
+    EXPECT_EQ( 1, discovery_targets( targets, CLIENT_AEM_LIST_LENGTH, 0 ) );
+
+    stats_discovery( &after );
+    EXPECT_EQ( 4U, after.beacons_heard - before.beacons_heard );
+    EXPECT_EQ( 3U, after.peers_dialed - before.peers_dialed );
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Compares time-to-first-contact & syscalls per discovered peer of "sweep" and "beacon" discovery on loopback.
+TEST_F(DiscoveryTest, DISABLED_Benchmark_SweepVsBeacon)
+{
+    const uint32_t peerAems[] = {8600, 8723, 9999};
+    const size_t peers_n = sizeof( peerAems ) / sizeof( uint32_t );
+    std::atomic<uint64_t> firstContactAt{0};
+    std::atomic<uint32_t> contacts{0};
+    std::atomic<bool> running{true};
+    std::vector<std::thread> peers;
+    int listeners[peers_n];
+
+    signal( SIGPIPE, SIG_IGN );
+    socketSubnet = "127.0";
+    messages_reset();
+    log_tearUp( "discovery_benchmark.json" );
+    pool_init( communication_worker );
+
+    // Peers: accept connections on their own loopback address
+    for ( size_t peer_i = 0; peer_i < peers_n; peer_i++ )
+    {
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons( SOCKET_PORT );
+        address.sin_addr.s_addr = inet_addr( aem2ip( peerAems[peer_i] ) );
+
+        listeners[peer_i] = socket( AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP );
+        int one = 1;
+        setsockopt( listeners[peer_i], SOL_SOCKET, SO_REUSEADDR, &one, sizeof( int ) );
+        ASSERT_EQ( 0, bind( listeners[peer_i], (struct sockaddr *) &address, sizeof( address ) ) );
+        ASSERT_EQ( 0, listen( listeners[peer_i], SOCKET_LISTEN_QUEUE_LEN ) );
+
+        peers.emplace_back( [&, peer_i]() {
+            while ( running )
+            {
+                int fd = accept( listeners[peer_i], nullptr, nullptr );
+                if ( fd < 0 ) { usleep( 100 ); continue; }
+
+                uint64_t expected = 0;
+                firstContactAt.compare_exchange_strong( expected, nowMicros() );
+                contacts++;
+                close( fd );
+            }
+        } );
+    }
+
+    int epoll_fd = epoll_create1( 0 );
+
+    // Sweep: dial every AEM of the list
+    Device targets[CLIENT_AEM_LIST_LENGTH];
+    for ( uint32_t aem_i = 0; aem_i < CLIENT_AEM_LIST_LENGTH; aem_i++ )
+        targets[aem_i] = {.AEM = CLIENT_AEM_LIST[aem_i], .aemIndex = (int32_t) aem_i};
+
+    PollingStats before = pollingStats;
+    uint64_t start = nowMicros();
+    while ( contacts < peers_n )
+        polling_round( epoll_fd, targets, CLIENT_AEM_LIST_LENGTH );
+    uint64_t sweepFirstContact = firstContactAt - start;
+    double sweepSyscalls = (double) ( pollingStats.syscalls - before.syscalls ) / (double) contacts;
+
+    // Beacon: peers broadcast at random phases, device dials only peers heard
+    firstContactAt = 0;
+    contacts = 0;
+
+    pthread_t listenerThread;
+    pthread_create( &listenerThread, nullptr, (void *(*)(void *)) discovery_listener_worker, nullptr );
+    usleep( 10000 );
+
+    std::vector<std::thread> broadcasters;
+    for ( size_t peer_i = 0; peer_i < peers_n; peer_i++ )
+    {
+        broadcasters.emplace_back( [&, peer_i]() {
+            int fd = socket( AF_INET, SOCK_DGRAM, IPPROTO_UDP );
+            int one = 1;
+            setsockopt( fd, SOL_SOCKET, SO_BROADCAST, &one, sizeof( int ) );
+
+            struct sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons( DISCOVERY_PORT );
+            address.sin_addr.s_addr = inet_addr( "127.0.255.255" );
+
+            Beacon beacon = {.aem = peerAems[peer_i], .messages = 0, .newest_created_at = 0};
+            uint8_t packed[DISCOVERY_BEACON_LEN];
+            discovery_beacon_pack( &beacon, packed );
+
+            usleep( (useconds_t) ( rand() % DISCOVERY_BEACON_INTERVAL ) * 1000 );
+            while ( running && contacts < peers_n )
+            {
+                sendto( fd, packed, DISCOVERY_BEACON_LEN, 0, (struct sockaddr *) &address, sizeof( address ) );
+                usleep( DISCOVERY_BEACON_INTERVAL * 1000 );
+            }
+            close( fd );
+        } );
+    }
+
+    before = pollingStats;
+    DiscoveryStats discoveryBefore, discoveryAfter;
+    stats_discovery( &discoveryBefore );
+    start = nowMicros();
+    while ( contacts < peers_n )
+    {
+        uint16_t targets_n = discovery_targets( targets, CLIENT_AEM_LIST_LENGTH, DISCOVERY_BEACON_INTERVAL );
+        if ( targets_n > 0 )
+            polling_round( epoll_fd, targets, targets_n );
+    }
+    uint64_t beaconFirstContact = firstContactAt - start;
+    stats_discovery( &discoveryAfter );
+    double beaconSyscalls = (double) ( pollingStats.syscalls - before.syscalls + discoveryAfter.syscalls - discoveryBefore.syscalls ) / (double) contacts;
+
+    running = false;
+    for ( auto &thread : broadcasters ) thread.join();
+    for ( auto &thread : peers ) thread.join();
+    pthread_cancel( listenerThread );
+    pthread_join( listenerThread, nullptr );
+    for ( int listener : listeners ) close( listener );
+    close( epoll_fd );
+
+    GOUT( "sweep : time-to-first-contact = " << sweepFirstContact << "us, syscalls / peer = " << sweepSyscalls );
+    GOUT( "beacon: time-to-first-contact = " << beaconFirstContact << "us, syscalls / peer = " << beaconSyscalls );
+
+    pool_destroy();
+    log_tearDown( 0.0 );
+    remove( "discovery_benchmark.json" );
+    remove( "discovery_benchmark.ndjson" );
+    socketSubnet = SOCKET_SUBNET;
+}
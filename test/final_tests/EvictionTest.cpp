@@ -0,0 +1,244 @@
+#include <cstddef>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "eviction.h"
+    #include "server.h"
+    #include "utils.h"
+
+    #include <time.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern messages_head_t messagesHead;
+
+static const Device recipient = {.AEM = 8723, .aemIndex = 6};
+static const Device other = {.AEM = 8600, .aemIndex = 5};
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Builds message #$message_i towards $recipient ( distinct for distinct $message_i ).
+static void makeMessage(Message *message, uint32_t message_i)
+{
+    memset( message, 0, sizeof( Message ) );
+    message->sender = 8000 + message_i % 500;
+    message->recipient = recipient.AEM;
+    message->created_at = 1561669840 + message_i;
+    snprintf( message->body, MESSAGE_BODY_LEN, "message body #%u", message_i );
+}
+
+/// \brief Fills the store with $MESSAGES_SIZE untransmitted messages, starting from message #$first_i.
+static void fillStore(uint32_t first_i)
+{
+    Message message;
+
+    for ( uint32_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+    {
+        makeMessage( &message, first_i + message_i );
+        messages_push( &message );
+    }
+}
+
+/// \brief Pushes a new message & returns the slot it was placed at.
+static uint16_t pushSlot(uint32_t message_i)
+{
+    Message message;
+
+    makeMessage( &message, message_i );
+    messages_push( &message );
+
+    return (uint16_t) ( ( messagesHead + MESSAGES_SIZE - 1 ) % MESSAGES_SIZE );
+}
+
+class EvictionTest : public ::testing::Test {
+
+protected:
+
+    void TearDown() override
+    {
+        messages_init( MESSAGES_PUSH_OVERRIDE_POLICY );
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests eviction > eviction_policy() function.
+TEST_F(EvictionTest, PolicyNames)
+{
+    EXPECT_EQ( EVICTION_BLIND, eviction_policy( "blind" ) );
+    EXPECT_EQ( EVICTION_SENT_ONLY, eviction_policy( "sent_only" ) );
+    EXPECT_EQ( EVICTION_OLDEST_DELIVERED, eviction_policy( "oldest_delivered" ) );
+    EXPECT_EQ( EVICTION_MOST_REPLICATED, eviction_policy( "most_replicated" ) );
+    EXPECT_EQ( -1, eviction_policy( "sent only" ) );
+}
+
+/// \brief Tests server > messages_push() function with "sent_only" policy: free slots first, then transmitted
+/// messages in transmission order, then circle buffer's head.
+TEST_F(EvictionTest, SentOnly)
+{
+    messages_init( "sent_only" );
+
+    EXPECT_EQ( 0, pushSlot( 0 ) );
+    EXPECT_EQ( 1, pushSlot( 1 ) );
+    messages_transmitted( 0, other );
+    EXPECT_EQ( 2, pushSlot( 2 ) );
+
+    messages_reset();
+    fillStore( 0 );
+    messages_transmitted( 20, other );
+    messages_transmitted( 10, other );
+    messages_transmitted( 20, recipient );
+
+    EXPECT_EQ( 20, pushSlot( MESSAGES_SIZE ) );
+    EXPECT_EQ( 10, pushSlot( MESSAGES_SIZE + 1 ) );
+    EXPECT_EQ( 11, pushSlot( MESSAGES_SIZE + 2 ) );
+}
+
+/// \brief Tests server > messages_push() function with "oldest_delivered" policy: messages delivered to their
+/// recipient first, in delivery order.
+TEST_F(EvictionTest, OldestDelivered)
+{
+    messages_init( "oldest_delivered" );
+    fillStore( 0 );
+
+    messages_transmitted( 7, other );
+    messages_transmitted( 30, recipient );
+    messages_transmitted( 5, recipient );
+
+    EXPECT_EQ( 30, pushSlot( MESSAGES_SIZE ) );
+    EXPECT_EQ( 5, pushSlot( MESSAGES_SIZE + 1 ) );
+    EXPECT_EQ( 6, pushSlot( MESSAGES_SIZE + 2 ) );
+
+    // Slot 7 was only transmitted: overwritten in circle buffer order
+    EXPECT_EQ( 7, pushSlot( MESSAGES_SIZE + 3 ) );
+}
+
+/// \brief Tests server > messages_push() function with "most_replicated" policy: messages known to most devices first,
+/// oldest first among equals.
+TEST_F(EvictionTest, MostReplicated)
+{
+    Message message;
+
+    messages_init( "most_replicated" );
+    fillStore( 0 );
+
+    // Received from a device ( replication 1 ), transmitted to more
+    messagesHead = 40;
+    makeMessage( &message, MESSAGES_SIZE );
+    bitset_set( message.transmitted_devices, 1 );
+    messages_push( &message );
+
+    messages_transmitted( 3, other );
+    messages_transmitted( 9, other );
+    messages_transmitted( 9, {.AEM = 8001, .aemIndex = 2} );
+    messages_transmitted( 9, {.AEM = 8011, .aemIndex = 3} );
+    messages_transmitted( 4, other );
+    messages_transmitted( 4, {.AEM = 8001, .aemIndex = 2} );
+
+    EXPECT_EQ( 9, pushSlot( MESSAGES_SIZE + 1 ) );
+    EXPECT_EQ( 4, pushSlot( MESSAGES_SIZE + 2 ) );
+    EXPECT_EQ( 40, pushSlot( MESSAGES_SIZE + 3 ) );
+    EXPECT_EQ( 3, pushSlot( MESSAGES_SIZE + 4 ) );
+    EXPECT_EQ( 4, pushSlot( MESSAGES_SIZE + 5 ) );
+}
+
+/// \brief Tests eviction > eviction_victim() & eviction_unlink() functions: a free slot taken by the circle buffer's
+/// head is no longer free.
+TEST_F(EvictionTest, UnlinkFree)
+{
+    static Eviction eviction;
+
+    eviction_init( &eviction, EVICTION_SENT_ONLY );
+    eviction_unlink( &eviction, 0 );
+    eviction_unlink( &eviction, 2 );
+
+    EXPECT_EQ( 1, eviction_victim( &eviction ) );
+    EXPECT_EQ( 3, eviction_victim( &eviction ) );
+
+    eviction_init( &eviction, EVICTION_BLIND );
+    EXPECT_EQ( -1, eviction_victim( &eviction ) );
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Measures push latency into a full store where nearly every message is untransmitted, for the linear
+/// "sent_only" hole search ( as before ) vs. each policy of the eviction lists.
+TEST_F(EvictionTest, DISABLED_Benchmark_FullStorePush)
+{
+    const uint32_t pushes_n = 20000;
+    Message message;
+
+    // Linear hole search ( as before ): placement search + "blind" push at the hole
+    messages_init( "blind" );
+    fillStore( 0 );
+    messages_transmitted( 100, other );
+    messages_transmitted( 1000, other );
+
+    uint64_t start = nowNanos();
+    for ( uint32_t push_i = 0; push_i < pushes_n; push_i++ )
+    {
+        messages_head_t messagesHeadOriginal = messagesHead;
+        do
+        {
+            if ( 0 == messages_header( messagesHead )->created_at ) break;
+            if ( messages_header( messagesHead )->transmitted ) break;
+        }
+        while ( ++messagesHead < MESSAGES_SIZE );
+
+        if ( MESSAGES_SIZE == messagesHead )
+        {
+            messagesHead = 0;
+            while ( messagesHead < messagesHeadOriginal )
+            {
+                if ( 0 == messages_header( messagesHead )->created_at ) break;
+                if ( messages_header( messagesHead )->transmitted ) break;
+
+                messagesHead++;
+            }
+        }
+
+        makeMessage( &message, MESSAGES_SIZE + push_i );
+        messages_push( &message );
+    }
+    GOUT( "linear hole search: push = " << (double) ( nowNanos() - start ) / pushes_n << "ns" );
+
+    for ( const char *policy : {"blind", "sent_only", "oldest_delivered", "most_replicated"} )
+    {
+        messages_init( policy );
+        fillStore( 0 );
+        messages_transmitted( 100, other );
+        messages_transmitted( 1000, other );
+
+        start = nowNanos();
+        for ( uint32_t push_i = 0; push_i < pushes_n; push_i++ )
+        {
+            makeMessage( &message, MESSAGES_SIZE + push_i );
+            messages_push( &message );
+        }
+        GOUT( policy << ": push = " << (double) ( nowNanos() - start ) / pushes_n << "ns" );
+    }
+}
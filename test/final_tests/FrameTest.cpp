@@ -0,0 +1,147 @@
+#include <cstddef>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "frame.h"
+    #include "utils.h"
+
+    #include <time.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Builds message #$message_i with a body of $body_length characters.
+static void makeMessage(Message *message, uint32_t message_i, uint16_t body_length)
+{
+    memset( message, 0, sizeof( Message ) );
+    message->sender = 8000 + message_i % 1000;
+    message->recipient = 8500 + message_i % 50;
+    message->created_at = 1561669840 + message_i;
+    message->seq = message_i;
+    for ( uint16_t char_i = 0; char_i < body_length; char_i++ )
+        message->body[char_i] = (char) ( MESSAGE_BODY_ASCII_MIN + ( message_i + char_i ) % ( MESSAGE_BODY_ASCII_MAX - MESSAGE_BODY_ASCII_MIN ) );
+    message->body[body_length] = '\0';
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests frame > frame_encode() & frame_decode() functions: frames are as long as their body & decode to the
+/// initial message, for empty, short & longest bodies.
+TEST(FrameTest, Roundtrip)
+{
+    uint8_t frame[FRAME_LEN_MAX];
+    Message message, decoded;
+
+    for ( uint16_t body_length : {0, 16, MESSAGE_BODY_LEN - 1} )
+    {
+        makeMessage( &message, 0xFFFFu + body_length, body_length );
+        message.created_at |= (uint64_t) 1 << 40;
+
+        uint16_t length = frame_encode( &message, frame );
+        EXPECT_EQ( FRAME_PREFIX_LEN + FRAME_HEADER_LEN + body_length, length );
+        EXPECT_EQ( length, frame_length( frame ) );
+
+        memset( &decoded, 0xAA, sizeof( Message ) );
+        frame_decode( &decoded, frame );
+        EXPECT_EQ( message.sender, decoded.sender );
+        EXPECT_EQ( message.recipient, decoded.recipient );
+        EXPECT_EQ( message.created_at, decoded.created_at );
+        EXPECT_EQ( message.seq, decoded.seq );
+        EXPECT_STREQ( message.body, decoded.body );
+        EXPECT_EQ( 0, decoded.transmitted );
+        EXPECT_EQ( 0, decoded.transmitted_to_recipient );
+    }
+}
+
+/// \brief Tests frame > frame_length() function: prefixes shorter than the header or longer than the longest body are
+/// rejected.
+TEST(FrameTest, BadPrefix)
+{
+    uint8_t frame[FRAME_PREFIX_LEN];
+
+    for ( uint16_t length : {0, FRAME_HEADER_LEN - 1, FRAME_HEADER_LEN + MESSAGE_BODY_LEN, 0xFFFF} )
+    {
+        frame[0] = (uint8_t) length;
+        frame[1] = (uint8_t) ( length >> 8 );
+        EXPECT_EQ( 0, frame_length( frame ) ) << length;
+    }
+}
+
+/// \brief Compares bytes & encode / decode cost per message of text records ( implode() / explode() ) vs. binary
+/// frames, for short, medium & longest bodies.
+TEST(FrameTest, DISABLED_Benchmark_Codec)
+{
+    const uint32_t messages_n = 100000;
+    char record[MESSAGE_SEQUENCED_LEN + 1];
+    uint8_t frame[FRAME_LEN_MAX];
+    Message message, decoded;
+    uint64_t checksum = 0;
+
+    for ( uint16_t body_length : {16, 64, MESSAGE_BODY_LEN - 1} )
+    {
+        makeMessage( &message, 0, body_length );
+
+        // Text records ( as before )
+        uint64_t start = nowNanos();
+        for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+        {
+            message.created_at = 1561669840 + message_i;
+            implode( "_", message, record );
+            checksum += (uint8_t) record[message_i % MESSAGE_SERIALIZED_LEN];
+        }
+        double textEncode = (double) ( nowNanos() - start ) / messages_n;
+
+        start = nowNanos();
+        for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+        {
+            explode( &decoded, "_", record );
+            checksum += decoded.created_at;
+        }
+        double textDecode = (double) ( nowNanos() - start ) / messages_n;
+
+        // Binary frames
+        uint16_t length = 0;
+        start = nowNanos();
+        for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+        {
+            message.created_at = 1561669840 + message_i;
+            length = frame_encode( &message, frame );
+            checksum += frame[message_i % length];
+        }
+        double binaryEncode = (double) ( nowNanos() - start ) / messages_n;
+
+        start = nowNanos();
+        for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+        {
+            frame_decode( &decoded, frame );
+            checksum += decoded.created_at;
+        }
+        double binaryDecode = (double) ( nowNanos() - start ) / messages_n;
+
+        GOUT( "body = " << body_length << ": text = " << MESSAGE_SEQUENCED_LEN << " bytes, " << textEncode << "ns encode, "
+              << textDecode << "ns decode / message; binary = " << length << " bytes, " << binaryEncode << "ns encode, "
+              << binaryDecode << "ns decode / message" );
+    }
+
+    EXPECT_NE( 0U, checksum );
+}
@@ -0,0 +1,218 @@
+#include <cstddef>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "index.h"
+    #include "server.h"
+    #include "stats.h"
+    #include "utils.h"
+
+    #include <time.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+extern messages_head_t inboxHead;
+extern uint16_t inboxCount;
+extern InboxMessage *INBOX;
+
+static Device device = {.AEM = 8600, .aemIndex = 5};
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Builds message #$message_i for this device, from one of 10 senders ( distinct for distinct $message_i ).
+static void makeMessage(Message *message, uint32_t message_i)
+{
+    memset( message, 0, sizeof( Message ) );
+    message->sender = 8000 + message_i % 10;
+    message->recipient = CLIENT_AEM;
+    message->created_at = 1561669840 + message_i;
+    snprintf( message->body, MESSAGE_BODY_LEN, "message body #%u", message_i );
+}
+
+/// \brief Builds inbox message #$message_i ( distinct for distinct $message_i ).
+static void makeInboxMessage(InboxMessage *message, uint32_t message_i)
+{
+    memset( message, 0, sizeof( InboxMessage ) );
+    message->sender = 8000 + message_i % 1000;
+    message->created_at = 1561669840 + message_i / 1000;
+    snprintf( message->body, MESSAGE_BODY_LEN, "message body #%u", message_i );
+}
+
+class InboxTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        CLIENT_AEM = 9026;
+        inbox_reset();
+        stats_reset();
+    }
+
+    void TearDown() override
+    {
+        inbox_reset();
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests server > inbox_push() function: duplicates are rejected, ring wraps & evicted messages may arrive
+/// again.
+TEST_F(InboxTest, PushWrapsAndDedups)
+{
+    const uint32_t messages_n = INBOX_SIZE + 100;
+    Message message;
+
+    for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+    {
+        makeMessage( &message, message_i );
+        EXPECT_EQ( true, inbox_push( &message, &device ) );
+    }
+    EXPECT_EQ( 100, inboxHead );
+    EXPECT_EQ( INBOX_SIZE, inboxCount );
+    EXPECT_EQ( messages_n, stats_counter( STATS_RECEIVED_FOR_ME ) );
+
+    // Oldest were overwritten
+    EXPECT_EQ( 1561669840U + 100, INBOX[inboxHead].created_at );
+
+    makeMessage( &message, messages_n - 1 );
+    EXPECT_EQ( false, inbox_push( &message, &device ) );
+    makeMessage( &message, 0 );
+    EXPECT_EQ( true, inbox_push( &message, &device ) );
+    EXPECT_EQ( INBOX_SIZE, inboxCount );
+}
+
+/// \brief Tests server > inbox_since() & inbox_from() functions, before & after the ring wraps.
+TEST_F(InboxTest, SinceAndFrom)
+{
+    static InboxMessage messages[INBOX_SIZE];
+    Message message;
+
+    // Arrive out of created_at order
+    for ( uint32_t message_i : {5U, 1U, 9U, 3U, 7U, 11U} )
+    {
+        makeMessage( &message, message_i );
+        inbox_push( &message, &device );
+    }
+
+    ASSERT_EQ( 3, inbox_since( 1561669840 + 6, messages, INBOX_SIZE ) );
+    EXPECT_EQ( 1561669840U + 7, messages[0].created_at );
+    EXPECT_EQ( 1561669840U + 9, messages[1].created_at );
+    EXPECT_EQ( 1561669840U + 11, messages[2].created_at );
+    EXPECT_EQ( 2, inbox_since( 1561669840 + 6, messages, 2 ) );
+    EXPECT_EQ( 0, inbox_since( 1561669840 + 12, messages, INBOX_SIZE ) );
+
+    // Sender 8001: #1, #11 ( newest first )
+    ASSERT_EQ( 2, inbox_from( 8001, messages, INBOX_SIZE ) );
+    EXPECT_EQ( 1561669840U + 11, messages[0].created_at );
+    EXPECT_EQ( 1561669840U + 1, messages[1].created_at );
+    EXPECT_EQ( 0, inbox_from( 8002, messages, INBOX_SIZE ) );
+
+    // Wrap: only the last $INBOX_SIZE messages remain indexed
+    inbox_reset();
+    for ( uint32_t message_i = 0; message_i < 3 * INBOX_SIZE; message_i++ )
+    {
+        makeMessage( &message, message_i );
+        inbox_push( &message, &device );
+    }
+
+    EXPECT_EQ( INBOX_SIZE, inbox_since( 0, messages, INBOX_SIZE ) );
+    EXPECT_EQ( 1561669840U + 2 * INBOX_SIZE, messages[0].created_at );
+    EXPECT_EQ( INBOX_SIZE / 10, inbox_from( 8003, messages, INBOX_SIZE ) );
+    EXPECT_EQ( 1561669840U + 3 * INBOX_SIZE - 7, messages[0].created_at );
+    EXPECT_EQ( 1561669840U + 2 * INBOX_SIZE + 3, messages[INBOX_SIZE / 10 - 1].created_at );
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Compares per-message dedup cost of a linear isMessageEqualInbox() scan ( as before ) vs. the hash index, for
+/// inboxes of 1k, 10k & 100k messages. Half of the checked messages are duplicates.
+TEST_F(InboxTest, DISABLED_Benchmark_DedupCost)
+{
+    const uint32_t checked_n = 2000;
+
+    for ( uint32_t inbox_n : {1000U, 10000U, 100000U} )
+    {
+        auto *inbox = (InboxMessage *) calloc( inbox_n, sizeof( InboxMessage ) );
+        uint32_t capacity = 1;
+        while ( capacity < 2 * inbox_n )
+            capacity <<= 1;
+        auto *entries = (MessageIndexEntry *) malloc( capacity * sizeof( MessageIndexEntry ) );
+        MessageIndex index;
+        MessageKey key;
+        InboxMessage message;
+        uint32_t duplicates;
+
+        for ( uint32_t message_i = 0; message_i < inbox_n; message_i++ )
+            makeInboxMessage( &inbox[message_i], message_i );
+
+        // Linear scan ( as before )
+        duplicates = 0;
+        uint64_t start = nowNanos();
+        for ( uint32_t message_i = 0; message_i < checked_n; message_i++ )
+        {
+            makeInboxMessage( &message, message_i % 2 ? inbox_n - 1 - message_i / 2 % inbox_n : inbox_n + message_i );
+            for ( uint32_t inbox_i = 0; inbox_i < inbox_n; inbox_i++ )
+            {
+                if ( isMessageEqualInbox( message, inbox[inbox_i] ) )
+                {
+                    duplicates++;
+                    break;
+                }
+            }
+        }
+        double linearCost = (double) ( nowNanos() - start ) / checked_n;
+        EXPECT_EQ( checked_n / 2, duplicates );
+
+        // Hash index
+        index_init( &index, entries, capacity );
+        for ( uint32_t message_i = 0; message_i < inbox_n; message_i++ )
+        {
+            index_key_inbox( &key, &inbox[message_i] );
+            index_insert( &index, &key, message_i );
+        }
+
+        duplicates = 0;
+        start = nowNanos();
+        for ( uint32_t message_i = 0; message_i < checked_n; message_i++ )
+        {
+            makeInboxMessage( &message, message_i % 2 ? inbox_n - 1 - message_i / 2 % inbox_n : inbox_n + message_i );
+            index_key_inbox( &key, &message );
+            if ( index_find( &index, &key ) >= 0 )
+                duplicates++;
+        }
+        double indexCost = (double) ( nowNanos() - start ) / checked_n;
+        EXPECT_EQ( checked_n / 2, duplicates );
+
+        GOUT( "inbox = " << inbox_n << ": linear scan = " << linearCost << "ns / message, hash index = " << indexCost << "ns / message" );
+
+        free( entries );
+        free( inbox );
+    }
+}
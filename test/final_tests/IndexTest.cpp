@@ -0,0 +1,283 @@
+#include <cstddef>
+#include <map>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "communication.h"
+    #include "index.h"
+    #include "server.h"
+    #include "stats.h"
+    #include "utils.h"
+
+    #include <time.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+extern MessageIndex messagesIndex;
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Builds message #$message_i ( distinct for distinct $message_i ).
+static void makeMessage(Message *message, uint32_t message_i)
+{
+    memset( message, 0, sizeof( Message ) );
+    message->sender = 8000 + message_i % 1000;
+    message->recipient = 8500 + message_i % 50;
+    message->created_at = 1561669840 + message_i / 1000;
+    snprintf( message->body, MESSAGE_BODY_LEN, "message body #%u", message_i );
+}
+
+class IndexTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        CLIENT_AEM = 9026;
+        messages_reset();
+    }
+
+    void TearDown() override
+    {
+        messages_reset();
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests index > index_insert() / index_find() / index_remove() functions on a crowded index.
+TEST_F(IndexTest, InsertFindRemove)
+{
+    MessageIndexEntry entries[16];
+    MessageIndex index;
+    MessageKey keys[12];
+    Message message;
+
+    index_init( &index, entries, 16 );
+    for ( uint32_t key_i = 0; key_i < 12; key_i++ )
+    {
+        makeMessage( &message, key_i );
+        index_key( &keys[key_i], &message );
+        EXPECT_EQ( true, index_insert( &index, &keys[key_i], key_i ) );
+    }
+
+    // Insert-if-absent
+    EXPECT_EQ( false, index_insert( &index, &keys[3], 100 ) );
+    EXPECT_EQ( 3, index_find( &index, &keys[3] ) );
+    EXPECT_EQ( 12U, index.length );
+
+    // Removal only if key maps to given slot
+    EXPECT_EQ( false, index_remove( &index, &keys[4], 5 ) );
+    for ( uint32_t key_i = 0; key_i < 12; key_i += 2 )
+        EXPECT_EQ( true, index_remove( &index, &keys[key_i], key_i ) );
+
+    for ( uint32_t key_i = 0; key_i < 12; key_i++ )
+        EXPECT_EQ( key_i % 2 ? (int32_t) key_i : -1, index_find( &index, &keys[key_i] ) );
+    EXPECT_EQ( 6U, index.length );
+}
+
+/// \brief Tests index > index_remove() function: random inserts & removes agree with std::map.
+TEST_F(IndexTest, RemoveKeepsProbeSequences)
+{
+    MessageIndexEntry entries[64];
+    MessageIndex index;
+    std::map<uint32_t, bool> reference;
+    MessageKey key;
+    Message message;
+
+    srand( 2278 );
+    index_init( &index, entries, 64 );
+    for ( uint32_t op_i = 0; op_i < 20000; op_i++ )
+    {
+        uint32_t message_i = (uint32_t) rand() % 80;
+        makeMessage( &message, message_i );
+        index_key( &key, &message );
+
+        if ( reference.count( message_i ) )
+        {
+            EXPECT_EQ( (int32_t) message_i, index_find( &index, &key ) );
+            EXPECT_EQ( true, index_remove( &index, &key, message_i ) );
+            reference.erase( message_i );
+        }
+        else if ( reference.size() < 48 )
+        {
+            EXPECT_EQ( -1, index_find( &index, &key ) );
+            EXPECT_EQ( true, index_insert( &index, &key, message_i ) );
+            reference[message_i] = true;
+        }
+    }
+
+    EXPECT_EQ( reference.size(), index.length );
+}
+
+/// \brief Tests server > messages_push() & messages_push_unique() functions: index follows evictions.
+TEST_F(IndexTest, StoreStaysInSync)
+{
+    const uint32_t messages_n = MESSAGES_SIZE + 100;
+    Message message, stored;
+    MessageKey key;
+
+    for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+    {
+        makeMessage( &message, message_i );
+        EXPECT_EQ( true, messages_push_unique( &message ) );
+    }
+    EXPECT_EQ( (uint32_t) MESSAGES_SIZE, messagesIndex.length );
+
+    for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+    {
+        makeMessage( &message, message_i );
+        index_key( &key, &message );
+        int32_t slot = index_find( &messagesIndex, &key );
+
+        if ( message_i < messages_n - MESSAGES_SIZE )
+        {
+            // Evicted
+            EXPECT_EQ( -1, slot );
+        }
+        else
+        {
+            ASSERT_GE( slot, 0 );
+            messages_get( (uint16_t) slot, &stored );
+            EXPECT_EQ( 1, isMessageEqual( message, stored ) );
+        }
+    }
+
+    // Stored > rejected, evicted > stored again
+    makeMessage( &message, messages_n - 1 );
+    EXPECT_EQ( false, messages_push_unique( &message ) );
+    makeMessage( &message, 0 );
+    EXPECT_EQ( true, messages_push_unique( &message ) );
+    EXPECT_EQ( (uint32_t) MESSAGES_SIZE, messagesIndex.length );
+}
+
+/// \brief Tests communication > communication_store_message() function: concurrent sessions store a message once.
+TEST_F(IndexTest, ConcurrentStoreOnce)
+{
+    const uint32_t messages_n = 1000;
+    std::vector<std::thread> sessions;
+
+    stats_reset();
+    for ( uint32_t session_i = 0; session_i < 4; session_i++ )
+    {
+        sessions.emplace_back( [&, session_i]() {
+            Device device = { .AEM = CLIENT_AEM_LIST[session_i], .aemIndex = (int32_t) session_i };
+            Message message;
+
+            for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+            {
+                makeMessage( &message, message_i );
+                communication_store_message( &message, device );
+            }
+        } );
+    }
+    for ( auto &session : sessions )
+        session.join();
+
+    EXPECT_EQ( messages_n, stats_counter( STATS_RECEIVED ) );
+    EXPECT_EQ( messages_n, messagesIndex.length );
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Compares per-message ingest cost ( duplicate check + store ) of a linear scan vs. the hash index, for stores
+/// of 2k, 20k & 200k messages. Half of the ingested messages are duplicates.
+TEST_F(IndexTest, DISABLED_Benchmark_IngestCost)
+{
+    const uint32_t ingested_n = 2000;
+
+    for ( uint32_t store_n : {2000U, 20000U, 200000U} )
+    {
+        auto *store = (Message *) calloc( store_n, sizeof( Message ) );
+        uint32_t capacity = 1;
+        while ( capacity < 2 * store_n )
+            capacity <<= 1;
+        auto *entries = (MessageIndexEntry *) malloc( capacity * sizeof( MessageIndexEntry ) );
+        MessageIndex index;
+        MessageKey key;
+        Message message;
+
+        // Linear scan ( as before )
+        for ( uint32_t message_i = 0; message_i < store_n; message_i++ )
+            makeMessage( &store[message_i], message_i );
+
+        uint32_t head = 0;
+        uint64_t start = nowNanos();
+        for ( uint32_t message_i = 0; message_i < ingested_n; message_i++ )
+        {
+            makeMessage( &message, message_i % 2 ? store_n - 1 - message_i : store_n + message_i );
+
+            bool duplicate = false;
+            for ( uint32_t store_i = 0; store_i < store_n && !duplicate; store_i++ )
+                duplicate = 1 == isMessageEqual( message, store[store_i] );
+
+            if ( !duplicate )
+            {
+                memcpy( &store[head], &message, sizeof( Message ) );
+                head = ( head + 1 ) % store_n;
+            }
+        }
+        double linearCost = (double) ( nowNanos() - start ) / ingested_n;
+
+        // Hash index
+        index_init( &index, entries, capacity );
+        for ( uint32_t message_i = 0; message_i < store_n; message_i++ )
+        {
+            makeMessage( &store[message_i], message_i );
+            index_key( &key, &store[message_i] );
+            index_insert( &index, &key, message_i );
+        }
+
+        head = 0;
+        start = nowNanos();
+        for ( uint32_t message_i = 0; message_i < ingested_n; message_i++ )
+        {
+            makeMessage( &message, message_i % 2 ? store_n - 1 - message_i : store_n + message_i );
+
+            index_key( &key, &message );
+            if ( index_find( &index, &key ) < 0 )
+            {
+                MessageKey evictedKey;
+                index_key( &evictedKey, &store[head] );
+                index_remove( &index, &evictedKey, head );
+                index_insert( &index, &key, head );
+
+                memcpy( &store[head], &message, sizeof( Message ) );
+                head = ( head + 1 ) % store_n;
+            }
+        }
+        double indexCost = (double) ( nowNanos() - start ) / ingested_n;
+
+        GOUT( "store = " << store_n << ": linear scan = " << linearCost << "ns / message, hash index = " << indexCost << "ns / message" );
+
+        free( entries );
+        free( store );
+    }
+}
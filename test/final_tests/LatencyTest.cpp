@@ -0,0 +1,264 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "latency.h"
+    #include "server.h"
+    #include "stats.h"
+
+    #include <time.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Builds message #$message_i for this device ( distinct for distinct $message_i ).
+static void makeMessage(Message *message, uint32_t message_i)
+{
+    memset( message, 0, sizeof( Message ) );
+    message->sender = 8000 + message_i % 10;
+    message->recipient = 8500;
+    message->created_at = 1561669840 + message_i;
+    snprintf( message->body, MESSAGE_BODY_LEN, "message body #%u", message_i );
+}
+
+/// \brief Returns what latency_dump() writes.
+static std::string dump()
+{
+    char *buffer = NULL;
+    size_t length = 0;
+    FILE *fp = open_memstream( &buffer, &length );
+
+    latency_dump( fp );
+    fclose( fp );
+    std::string dumped( buffer, length );
+    free( buffer );
+
+    return dumped;
+}
+
+class LatencyTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        latency_reset();
+    }
+
+    void TearDown() override
+    {
+        latency_reset();
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests latency > latency_percentile() function: exact below 2^$LATENCY_PRECISION_BITS nsecs, within
+/// 1 / 2^$LATENCY_PRECISION_BITS of the value above, & never past the max recorded.
+TEST_F(LatencyTest, Precision)
+{
+    EXPECT_EQ( 0U, latency_count( LATENCY_SEND ) );
+    EXPECT_EQ( 0U, latency_percentile( LATENCY_SEND, 50.0 ) );
+
+    for ( uint64_t value = 0; value < LATENCY_SUB_BUCKETS; value++ )
+    {
+        latency_reset();
+        latency_record( LATENCY_SEND, value );
+        EXPECT_EQ( value, latency_percentile( LATENCY_SEND, 0 ) );
+        EXPECT_EQ( value, latency_percentile( LATENCY_SEND, 100.0 ) );
+    }
+
+    // From usecs to minutes: bucket of each value holds it & is narrow enough
+    for ( uint64_t value = LATENCY_SUB_BUCKETS; value < (uint64_t) 120 * 1000000000; value = value * 7 / 3 + 1 )
+    {
+        latency_reset();
+        latency_record( LATENCY_SEND, value );
+        latency_record( LATENCY_SEND, 2 * value );
+        uint64_t low = latency_percentile( LATENCY_SEND, 0 ), high = latency_percentile( LATENCY_SEND, 50.0 );
+
+        EXPECT_LE( low, value );
+        EXPECT_GE( high, value );
+        EXPECT_LE( high - low, value >> LATENCY_PRECISION_BITS ) << value;
+        EXPECT_EQ( 2 * value, latency_percentile( LATENCY_SEND, 100.0 ) );
+    }
+
+    // Past the range: last bucket, max still exact
+    latency_reset();
+    latency_record( LATENCY_SEND, (uint64_t) 1 << ( LATENCY_RANGE_BITS + 2 ) );
+    EXPECT_EQ( 1U, latency_count( LATENCY_SEND ) );
+    EXPECT_EQ( (uint64_t) 1 << ( LATENCY_RANGE_BITS + 2 ), latency_percentile( LATENCY_SEND, 100.0 ) );
+}
+
+/// \brief Tests latency > latency_percentile() function on a known distribution: 1..10000 usecs, each once.
+TEST_F(LatencyTest, Percentiles)
+{
+    for ( uint64_t micros = 1; micros <= 10000; micros++ )
+        latency_record( LATENCY_RECEIVE, micros * 1000 );
+
+    EXPECT_EQ( 10000U, latency_count( LATENCY_RECEIVE ) );
+    for ( double percentile : {50.0, 90.0, 99.0, 99.9} )
+    {
+        double expected = percentile * 100 * 1000;
+        double actual = (double) latency_percentile( LATENCY_RECEIVE, percentile );
+
+        EXPECT_GE( actual, expected ) << percentile;
+        EXPECT_LE( actual, expected * ( 1 + 1.0 / LATENCY_SUB_BUCKETS ) ) << percentile;
+    }
+    EXPECT_EQ( 10000000U, latency_percentile( LATENCY_RECEIVE, 100.0 ) );
+    EXPECT_LE( latency_percentile( LATENCY_RECEIVE, 0 ), 1000U );
+
+    // Other phases untouched
+    EXPECT_EQ( 0U, latency_count( LATENCY_CONNECT ) );
+}
+
+/// \brief Tests latency > latency_record() function from many threads at once: no latency is lost.
+TEST_F(LatencyTest, ConcurrentRecording)
+{
+    const uint32_t threads_n = 8, records_n = 100000;
+    std::vector<std::thread> threads;
+
+    for ( uint32_t thread_i = 0; thread_i < threads_n; thread_i++ )
+        threads.emplace_back( [thread_i, records_n]()
+        {
+            for ( uint32_t record_i = 0; record_i < records_n; record_i++ )
+                latency_record( LATENCY_DEDUP, 100 + thread_i * 1000 + record_i % 100 );
+        } );
+    for ( std::thread &thread : threads )
+        thread.join();
+
+    EXPECT_EQ( (uint64_t) threads_n * records_n, latency_count( LATENCY_DEDUP ) );
+    EXPECT_EQ( 100 + ( threads_n - 1 ) * 1000 + 99, latency_percentile( LATENCY_DEDUP, 100.0 ) );
+    EXPECT_EQ( 100U, latency_percentile( LATENCY_DEDUP, 0 ) );
+}
+
+/// \brief Tests latency > latency_dump() function: a JSON object with the stats of every phase.
+TEST_F(LatencyTest, Dump)
+{
+    latency_record( LATENCY_CONNECT, 1500000 );
+    latency_record( LATENCY_CONNECT, 2500000 );
+
+    std::string dumped = dump();
+    EXPECT_EQ( '{', dumped.front() );
+    EXPECT_EQ( '}', dumped.back() );
+    for ( const char *phase : {"connect", "first_byte", "serialize", "send", "receive", "dedup", "push"} )
+        EXPECT_NE( std::string::npos, dumped.find( std::string( "\"" ) + phase + "\": { \"count\": " ) ) << phase;
+    EXPECT_NE( std::string::npos, dumped.find( "\"connect\": { \"count\": \"2\", \"mean\": \"2000.0us\"" ) ) << dumped;
+    EXPECT_NE( std::string::npos, dumped.find( "\"max\": \"2500.0us\" }" ) ) << dumped;
+    EXPECT_NE( std::string::npos, dumped.find( "\"push\": { \"count\": \"0\"" ) ) << dumped;
+}
+
+/// \brief Tests latency > latency_print_requested() function: prints only once for each latency_request_print().
+TEST_F(LatencyTest, PrintRequested)
+{
+    char *buffer = NULL;
+    size_t length = 0;
+    FILE *fp = open_memstream( &buffer, &length );
+
+    latency_print_requested( fp );
+    EXPECT_EQ( 0U, length );
+
+    latency_request_print();
+    latency_print_requested( fp );
+    size_t printed = length;
+    EXPECT_NE( std::string::npos, std::string( buffer, length ).find( "| Latency ( usecs )" ) );
+
+    latency_print_requested( fp );
+    EXPECT_EQ( printed, length );
+
+    fclose( fp );
+    free( buffer );
+}
+
+/// \brief Tests server > messages_push_unique() function: dedup lookup of every message & push of new ones are timed.
+TEST_F(LatencyTest, PushPhases)
+{
+    Message message;
+
+    CLIENT_AEM = 9026;
+    messages_init( MESSAGES_PUSH_OVERRIDE_POLICY );
+    stats_reset();
+
+    makeMessage( &message, 1 );
+    EXPECT_TRUE( messages_push_unique( &message ) );
+    EXPECT_FALSE( messages_push_unique( &message ) );
+    makeMessage( &message, 2 );
+    EXPECT_TRUE( messages_push_unique( &message ) );
+
+    EXPECT_EQ( 3U, latency_count( LATENCY_DEDUP ) );
+    EXPECT_EQ( 2U, latency_count( LATENCY_PUSH ) );
+
+    messages_reset();
+}
+
+/// \brief Reports cost of recording a latency, single-threaded & from 4 threads on the same phase, & percentiles of
+/// the dedup lookup & push phases of messages_push_unique().
+TEST_F(LatencyTest, DISABLED_Benchmark_Record)
+{
+    const uint32_t records_n = 10000000, threads_n = 4;
+    Message message;
+
+    uint64_t start = nowNanos();
+    for ( uint32_t record_i = 0; record_i < records_n; record_i++ )
+        latency_record( LATENCY_SEND, record_i % 100000 );
+    GOUT( "latency_record(): " << (double) ( nowNanos() - start ) / records_n << " ns per record ( 1 thread )" );
+
+    std::vector<std::thread> threads;
+    start = nowNanos();
+    for ( uint32_t thread_i = 0; thread_i < threads_n; thread_i++ )
+        threads.emplace_back( [records_n, threads_n]()
+        {
+            for ( uint32_t record_i = 0; record_i < records_n / threads_n; record_i++ )
+                latency_record( LATENCY_RECEIVE, record_i % 100000 );
+        } );
+    for ( std::thread &thread : threads )
+        thread.join();
+    GOUT( "latency_record(): " << (double) ( nowNanos() - start ) / records_n << " ns per record ( " << threads_n << " threads )" );
+
+    start = nowNanos();
+    for ( uint32_t record_i = 0; record_i < records_n; record_i++ )
+        latency_now();
+    GOUT( "latency_now(): " << (double) ( nowNanos() - start ) / records_n << " ns per call" );
+
+    CLIENT_AEM = 9026;
+    messages_init( MESSAGES_PUSH_OVERRIDE_POLICY );
+    for ( uint32_t message_i = 0; message_i < 100000; message_i++ )
+    {
+        makeMessage( &message, message_i % 50000 );
+        messages_push_unique( &message );
+    }
+    for ( LatencyPhase phase : {LATENCY_DEDUP, LATENCY_PUSH} )
+        GOUT( ( LATENCY_DEDUP == phase ? "dedup" : "push" ) << ": count = " << latency_count( phase ) << ", p50 = "
+              << latency_percentile( phase, 50.0 ) << " ns, p99 = " << latency_percentile( phase, 99.0 ) << " ns, p99.9 = "
+              << latency_percentile( phase, 99.9 ) << " ns, max = " << latency_percentile( phase, 100.0 ) << " ns" );
+    messages_reset();
+}
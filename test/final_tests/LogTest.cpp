@@ -0,0 +1,533 @@
+#include <cstddef>
+#include <algorithm>
+#include <fstream>
+#include <regex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "binlog.h"
+    #include "log.h"
+    #include "ndjson.h"
+    #include "server.h"
+    #include "utils.h"
+
+    #include <signal.h>
+    #include <sys/wait.h>
+    #include <time.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern const char *logFormat;
+extern const char *logMode;
+extern LogStats logStats;
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Builds message #$message_i of thread #$thread_i & event #$event_i ( its body names all three ).
+static void makeMessage(Message *message, uint32_t thread_i, uint32_t event_i, uint32_t message_i)
+{
+    memset( message, 0, sizeof( Message ) );
+    message->sender = 8000 + thread_i;
+    message->recipient = 8500 + event_i % 50;
+    message->created_at = 1561669840 + event_i;
+    snprintf( message->body, MESSAGE_BODY_LEN, "t%u e%u m%u", thread_i, event_i, message_i );
+}
+
+/// \brief Logs event #$event_i of thread #$thread_i, with $messages_n messages.
+static void logEvent(uint32_t thread_i, uint32_t event_i, uint32_t messages_n)
+{
+    Message message;
+
+    log_lock( true );
+        log_event_start( "connection", 8000 + thread_i, 9026 );
+        for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+        {
+            makeMessage( &message, thread_i, event_i, message_i );
+            log_event_message( 0 == message_i % 2 ? "received" : "transmitted", &message );
+        }
+        log_event_stop();
+    log_unlock();
+}
+
+/// \brief Logs an event of a message transmitted twice, to more devices the second time.
+static void logTransmissions()
+{
+    Message message;
+
+    makeMessage( &message, 9, 9, 0 );
+    message.transmitted = 1;
+    log_lock( true );
+        log_event_start( "connection", 8009, 9026 );
+        log_event_message( "received", &message );
+        bitset_set( message.transmitted_devices, 0 );
+        log_event_message( "transmitted", &message );
+        bitset_set( message.transmitted_devices, 1 );
+        message.transmitted_to_recipient = 1;
+        log_event_message( "transmitted", &message );
+        log_event_stop();
+    log_unlock();
+}
+
+/// \brief Contents of file $fileName.
+static std::string readFile(const char *fileName)
+{
+    std::ifstream file( fileName );
+    std::stringstream content;
+    content << file.rdbuf();
+
+    return content.str();
+}
+
+/// \brief Reads no. of read & write syscalls of this process so far.
+static uint64_t ioSyscalls()
+{
+    std::ifstream io( "/proc/self/io" );
+    std::string key;
+    uint64_t value, syscalls = 0;
+
+    while ( io >> key >> value )
+        if ( "syscr:" == key || "syscw:" == key )
+            syscalls += value;
+
+    return syscalls;
+}
+
+/// \brief Events' array of session.json file $fileName, with times & durations blanked.
+static std::string loggedEvents(const char *fileName)
+{
+    std::string json = readFile( fileName );
+    size_t start = json.find( "\"events\": [" );
+    size_t end = json.rfind( "], \"duration\": ", json.find( " s\", \"end\": " ) );
+    if ( std::string::npos == start || std::string::npos == end )
+        return "";
+
+    std::string events = json.substr( start, end - start );
+    events = std::regex_replace( events, std::regex( "\"(saved_at|occured_at|duration)\": \"[^\"]*\"" ), "\"$1\": \"\"" );
+
+    return events;
+}
+
+class LogTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        messages_reset();
+    }
+
+    void TearDown() override
+    {
+        logFormat = LOG_FORMAT;
+        logMode = LOG_MODE;
+        remove( "log_test.json" );
+        remove( "log_test.ndjson" );
+        remove( "log_test.bin" );
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests log > log_event_*() functions: asynchronous log writes the same events as synchronous log, & session.json
+/// rebuilt from session.ndjson or exported from session.bin holds the same events as session.json written in place.
+TEST_F(LogTest, AsyncMatchesSync)
+{
+    std::string events[6];
+    const char *formats[6] = {"json", "json", "ndjson", "ndjson", "binary", "binary"};
+    const char *modes[6] = {"sync", "async", "sync", "async", "sync", "async"};
+
+    for ( uint32_t mode_i = 0; mode_i < 6; mode_i++ )
+    {
+        logFormat = formats[mode_i];
+        logMode = modes[mode_i];
+        log_tearUp( "log_test.json" );
+
+        logEvent( 0, 0, 1 );
+        logEvent( 1, 1, 0 );
+        logEvent( 2, 2, 7 );
+        logTransmissions();
+
+        log_lock( true );
+            log_event_start( "datetime", SETUP_DATETIME_AEM, 9026 );
+            log_event_message_datetime( 1561669840, 1561669850 );
+            log_event_stop();
+        log_unlock();
+
+        log_tearDown( 0.0 );
+        if ( 0 == strcmp( "binary", formats[mode_i] ) )
+            EXPECT_EQ( 5, binlog_export( "log_test.bin", "log_test.json" ) ) << modes[mode_i];
+        events[mode_i] = loggedEvents( "log_test.json" );
+    }
+
+    char devices[64];
+    snprintf( devices, sizeof( devices ), "\"transmitted_devices\": \"%04u,%04u\", \"transmitted_to_recipient\": \"TRUE\"",
+              CLIENT_AEM_LIST[0], CLIENT_AEM_LIST[1] );
+    EXPECT_NE( "", events[0] );
+    EXPECT_NE( std::string::npos, events[0].find( devices ) );
+    for ( uint32_t mode_i = 1; mode_i < 6; mode_i++ )
+        EXPECT_EQ( events[0], events[mode_i] ) << formats[mode_i] << ", " << modes[mode_i];
+    EXPECT_EQ( 5U, logStats.events );
+    EXPECT_EQ( 5U * 2 + 1 + 7 + 3 + 1, logStats.queued );
+    EXPECT_EQ( 0U, logStats.dropped );
+    EXPECT_EQ( 1U + 7 + 1, logStats.bodies );           // each body once ( "t1 e1" event has none )
+}
+
+/// \brief Tests binlog > binlog_export() function: session.json exported from session.bin holds the same document as
+/// the one rebuilt from session.ndjson ( but for times, pool stats that depend on time & log stats ), a log cut short
+/// yields the events stopped so far, & other files are refused.
+TEST_F(LogTest, BinaryExport)
+{
+    std::regex variable( "\"(start|end|saved_at|occured_at|duration|utilisation|queue_wait_avg|queue_wait_max|format|bodies)\": \"[^\"]*\"" );
+    std::string json;
+
+    for ( const char *format : {"ndjson", "binary"} )
+    {
+        logFormat = format;
+        logMode = "sync";
+        log_tearUp( "log_test.json" );
+        for ( uint32_t event_i = 0; event_i < 20; event_i++ )
+            logEvent( 0, event_i / 2, 4 );
+        logTransmissions();
+        log_tearDown( 0.0 );
+
+        if ( 0 == strcmp( "ndjson", format ) )
+        {
+            json = std::regex_replace( readFile( "log_test.json" ), variable, "\"$1\": \"\"" );
+            continue;
+        }
+
+        EXPECT_EQ( 21, binlog_export( "log_test.bin", "log_test.json" ) );
+        EXPECT_EQ( json, std::regex_replace( readFile( "log_test.json" ), variable, "\"$1\": \"\"" ) );
+    }
+    EXPECT_EQ( 10U * 4 + 1, logStats.bodies );             // events logged in pairs carry the same messages
+
+    // Cut short inside the 11th event ( & inside a record )
+    std::string binlog = readFile( "log_test.bin" );
+    size_t stop_n = 0, cut;
+    for ( cut = 0; cut < binlog.size() && stop_n < 10; cut += BINLOG_RECORD_LEN )
+        stop_n += BINLOG_STOP == (uint8_t) binlog[cut] ? 1 : 0;
+    cut += 3 * BINLOG_RECORD_LEN + BINLOG_RECORD_LEN / 2;
+
+    FILE *fp = fopen( "log_test.bin", "wb" );
+    fwrite( binlog.data(), 1, cut, fp );
+    fclose( fp );
+    EXPECT_EQ( 10, binlog_export( "log_test.bin", "log_test.json" ) );
+    json = readFile( "log_test.json" );
+    EXPECT_EQ( "]}", json.substr( json.size() - 2 ) );
+    EXPECT_EQ( std::string::npos, json.find( "\"body\": \"t0 e5" ) );
+
+    // Not a binary session log
+    EXPECT_EQ( -1, binlog_export( "log_test.ndjson", "log_test.json" ) );
+    EXPECT_EQ( -1, binlog_export( "log_test.missing", "log_test.json" ) );
+}
+
+/// \brief Tests log > log_event_*() functions: events logged by many threads at once are written whole, with their
+/// messages in order ( but for dropped records ), & every record is either written or counted as dropped.
+TEST_F(LogTest, ConcurrentEvents)
+{
+    const uint32_t threads_n = 8, events_n = 1000, messages_n = 6;
+    std::vector<std::thread> threads;
+
+    logMode = "async";
+    log_tearUp( "log_test.json" );
+
+    for ( uint32_t thread_i = 0; thread_i < threads_n; thread_i++ )
+        threads.emplace_back( [thread_i]() {
+            for ( uint32_t event_i = 0; event_i < events_n; event_i++ )
+                logEvent( thread_i, event_i, messages_n );
+        } );
+    for ( auto &thread : threads )
+        thread.join();
+
+    log_tearDown( 0.0 );
+
+    EXPECT_EQ( (uint64_t) threads_n * events_n * ( messages_n + 2 ), logStats.queued + logStats.dropped );
+    EXPECT_EQ( logStats.queued, logStats.written );
+    EXPECT_GT( logStats.dropped, 0U );          // producers outpace the writer ( $LOG_RING_LEN records of slack )
+
+    // Each event holds messages of a single thread & event, in order
+    std::string events = loggedEvents( "log_test.json" );
+    std::regex bodyPattern( "\"body\": \"t([0-9]+) e([0-9]+) m([0-9]+)\"" );
+    uint32_t loggedEvents_n = 0;
+    size_t start = events.find( "{\"occured_at\"" );
+    while ( std::string::npos != start )
+    {
+        size_t end = events.find( "{\"occured_at\"", start + 1 );
+        std::string event = events.substr( start, std::string::npos == end ? std::string::npos : end - start );
+        int32_t thread_i = -1, event_i = -1, message_i = -1;
+
+        for ( auto match = std::sregex_iterator( event.begin(), event.end(), bodyPattern ); match != std::sregex_iterator(); ++match )
+        {
+            if ( -1 == thread_i )
+            {
+                thread_i = std::stoi( ( *match )[1] );
+                event_i = std::stoi( ( *match )[2] );
+            }
+            EXPECT_EQ( thread_i, std::stoi( ( *match )[1] ) );
+            EXPECT_EQ( event_i, std::stoi( ( *match )[2] ) );
+            EXPECT_LT( message_i, std::stoi( ( *match )[3] ) );
+            message_i = std::stoi( ( *match )[3] );
+        }
+
+        loggedEvents_n++;
+        start = end;
+    }
+    EXPECT_EQ( logStats.events, loggedEvents_n );
+    EXPECT_GT( loggedEvents_n, 0U );
+}
+
+/// \brief Tests ndjson > ndjson_rebuild() function: records are put in the arrays of session.json, a log cut short
+/// yields the events so far & its last line is skipped unless complete.
+TEST_F(LogTest, Rebuild)
+{
+    const char *records[] = {
+            "{\"record\": \"session\", \"start\": \"S\", \"client_aem\": \"9026\"}\n",
+            "{\"record\": \"event\", \"type\": \"a\", \"messages\": [{\"body\": \"x\"}]}\n",
+            "{\"record\": \"event\", \"type\": \"b\", \"messages\": []}\n",
+            "{\"record\": \"end\", \"duration\": \"1 s\", \"stats\": { \"produced\": \"1\"}}\n",
+            "{\"record\": \"device\", \"aem\": \"8600\", \"connections\": []}\n",
+            "{\"record\": \"inbox_message\", \"sender\": \"8600\"}\n",
+            "{\"record\": \"inbox_message\", \"sender\": \"8601\"}\n",
+    };
+
+    // Whole log ( no buffered messages )
+    FILE *fp = fopen( "log_test.ndjson", "w" );
+    for ( const char *record : records )
+        fputs( record, fp );
+    fclose( fp );
+
+    EXPECT_EQ( 2, ndjson_rebuild( "log_test.ndjson", "log_test.json" ) );
+    EXPECT_EQ( "{\"start\": \"S\", \"client_aem\": \"9026\", \"events\": [{\"type\": \"a\", \"messages\": [{\"body\": \"x\"}]},"
+               "{\"type\": \"b\", \"messages\": []}], \"duration\": \"1 s\", \"stats\": { \"produced\": \"1\", \"devices\": ["
+               "{\"aem\": \"8600\", \"connections\": []}], \"buffer_messages\": [], \"inbox_messages\": [{\"sender\": \"8600\"},"
+               "{\"sender\": \"8601\"}]}}", readFile( "log_test.json" ) );
+
+    // Log cut short, in the middle of a line
+    fp = fopen( "log_test.ndjson", "w" );
+    fputs( records[0], fp );
+    fputs( records[1], fp );
+    fputs( "{\"record\": \"event\", \"type\": \"c\", \"mess", fp );
+    fclose( fp );
+
+    EXPECT_EQ( 1, ndjson_rebuild( "log_test.ndjson", "log_test.json" ) );
+    EXPECT_EQ( "{\"start\": \"S\", \"client_aem\": \"9026\", \"events\": [{\"type\": \"a\", \"messages\": [{\"body\": \"x\"}]}]}",
+               readFile( "log_test.json" ) );
+
+    // No session record
+    fp = fopen( "log_test.ndjson", "w" );
+    fputs( records[1], fp );
+    fclose( fp );
+    EXPECT_EQ( -1, ndjson_rebuild( "log_test.ndjson", "log_test.json" ) );
+}
+
+/// \brief Tests log > session.ndjson file: events logged before the device is killed ( no log_tearDown() ) are on disk
+/// & session.json can be rebuilt from them.
+TEST_F(LogTest, SurvivesKill)
+{
+    fflush( stdout );
+    pid_t pid = fork();
+    if ( 0 == pid )
+    {
+        logFormat = "ndjson";
+        logMode = "async";
+        log_tearUp( "log_test.json" );
+        for ( uint32_t event_i = 0; event_i < 50; event_i++ )
+            logEvent( 0, event_i, 3 );
+
+        // Writer flushes once the ring is empty
+        struct timespec wait = { 0, 200 * 1000000L };
+        nanosleep( &wait, NULL );
+        raise( SIGKILL );
+    }
+
+    int status;
+    ASSERT_EQ( pid, waitpid( pid, &status, 0 ) );
+    ASSERT_TRUE( WIFSIGNALED( status ) );
+    EXPECT_EQ( SIGKILL, WTERMSIG( status ) );
+
+    EXPECT_EQ( 50, ndjson_rebuild( "log_test.ndjson", "log_test.json" ) );
+    std::string json = readFile( "log_test.json" );
+    EXPECT_NE( std::string::npos, json.find( "\"body\": \"t0 e49 m2\"" ) );
+    EXPECT_EQ( "]}", json.substr( json.size() - 2 ) );
+}
+
+/// \brief Measures cost & read / write syscalls per event of synchronous log, for session.json written in place vs.
+/// session.ndjson appended.
+TEST_F(LogTest, DISABLED_Benchmark_EventOverhead)
+{
+    const uint32_t events_n = 20000, messages_n = 2;
+
+    for ( const char *format : {"json", "ndjson"} )
+    {
+        logFormat = format;
+        logMode = "sync";
+        log_tearUp( "log_test.json" );
+
+        uint64_t syscalls = ioSyscalls();
+        uint64_t start = nowNanos();
+        for ( uint32_t event_i = 0; event_i < events_n; event_i++ )
+            logEvent( 0, event_i, messages_n );
+        double cost = (double) ( nowNanos() - start ) / events_n;
+        syscalls = ioSyscalls() - syscalls;
+
+        log_tearDown( 0.0 );
+        GOUT( format << ": " << cost << "ns / event ( " << messages_n << " messages ), "
+              << (double) syscalls / events_n << " syscalls / event" );
+    }
+}
+
+/// \brief Measures latency of log calls ( p50, p99 & max ) & throughput of sessions that log their messages at the end
+/// ( as session_flush_log() does ), with synchronous log, asynchronous log & no log.
+TEST_F(LogTest, DISABLED_Benchmark_LogCall)
+{
+    const uint32_t threads_n = 4, sessions_n = 2000, messages_n = 32;
+
+    for ( const char *mode : {"sync", "async", "off"} )
+    {
+        std::vector<std::thread> threads;
+        std::vector<std::vector<uint64_t>> latencies( threads_n );
+        bool off = 0 == strcmp( "off", mode );
+
+        logMode = off ? "async" : mode;
+        log_tearUp( "log_test.json" );
+
+        uint64_t start = nowNanos();
+        for ( uint32_t thread_i = 0; thread_i < threads_n; thread_i++ )
+            threads.emplace_back( [thread_i, off, &latencies]() {
+                Message messages[messages_n];
+                char serialized[MESSAGE_SERIALIZED_LEN];
+                std::vector<uint64_t> &latency = latencies[thread_i];
+
+                latency.reserve( sessions_n * ( messages_n + 2 ) );
+                for ( uint32_t session_i = 0; session_i < sessions_n; session_i++ )
+                {
+                    // Exchange
+                    for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+                    {
+                        makeMessage( &messages[message_i], thread_i, session_i, message_i );
+                        implode( "_", messages[message_i], serialized );
+                        explode( &messages[message_i], "_", serialized );
+                    }
+                    if ( off )
+                        continue;
+
+                    // Log
+                    uint64_t call = nowNanos();
+                    log_lock( true );
+                    log_event_start( "connection", 8000 + thread_i, 9026 );
+                    latency.push_back( nowNanos() - call );
+                    for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+                    {
+                        call = nowNanos();
+                        log_event_message( "received", &messages[message_i] );
+                        latency.push_back( nowNanos() - call );
+                    }
+                    call = nowNanos();
+                    log_event_stop();
+                    log_unlock();
+                    latency.push_back( nowNanos() - call );
+                }
+            } );
+        for ( auto &thread : threads )
+            thread.join();
+        double duration = (double) ( nowNanos() - start );
+
+        log_tearDown( 0.0 );
+
+        std::vector<uint64_t> all;
+        for ( auto &latency : latencies )
+            all.insert( all.end(), latency.begin(), latency.end() );
+        std::sort( all.begin(), all.end() );
+
+        std::stringstream calls;
+        if ( !all.empty() )
+            calls << ", calls: p50 = " << all[all.size() / 2] << "ns, p99 = " << all[all.size() * 99 / 100]
+                  << "ns, max = " << all.back() << "ns, dropped = " << logStats.dropped << " / "
+                  << logStats.queued + logStats.dropped;
+        GOUT( mode << ": " << 1e9 * threads_n * sessions_n / duration << " sessions / s" << calls.str() );
+    }
+}
+
+/// \brief Measures bytes written & CPU time spent logging a session ( 2000 events of 16 messages, drawn from 500 that
+/// travel again & again, to more devices each time ), for session.ndjson ( + session.json rebuilt at log_tearDown() )
+/// vs. session.bin, with synchronous & asynchronous log ( events paced, as sessions are, so that none is dropped ).
+TEST_F(LogTest, DISABLED_Benchmark_BinaryLog)
+{
+    const uint32_t events_n = 2000, messages_n = 16, pool_n = 500;
+    const struct timespec pace = { 0, 100 * 1000L };
+    std::vector<Message> messages( pool_n );
+
+    for ( uint32_t message_i = 0; message_i < pool_n; message_i++ )
+    {
+        makeMessage( &messages[message_i], message_i % 8, message_i, message_i );
+        memset( messages[message_i].body + strlen( messages[message_i].body ), 'x',
+                MESSAGE_BODY_LEN - 1 - strlen( messages[message_i].body ) );
+    }
+
+    for ( const char *mode : {"sync", "async"} )
+    {
+        for ( const char *format : {"ndjson", "binary"} )
+        {
+            logFormat = format;
+            logMode = mode;
+            log_tearUp( "log_test.json" );
+
+            struct timespec cpuStart, cpuStop;
+            clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &cpuStart );
+            for ( uint32_t event_i = 0; event_i < events_n; event_i++ )
+            {
+                log_lock( true );
+                    log_event_start( "connection", 8000 + event_i % 8, 9026 );
+                    for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+                    {
+                        Message *message = &messages[( event_i * 7 + message_i * 31 ) % pool_n];
+                        message->transmitted = 1;
+                        bitset_set( message->transmitted_devices, ( event_i + message_i ) % CLIENT_AEM_LIST_LENGTH );
+                        log_event_message( 0 == message_i % 2 ? "received" : "transmitted", message );
+                    }
+                    log_event_stop();
+                log_unlock();
+
+                if ( 0 == strcmp( "async", mode ) )
+                    nanosleep( &pace, NULL );
+            }
+            log_tearDown( 0.0 );
+            clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &cpuStop );
+            double cpu = (double) ( cpuStop.tv_sec - cpuStart.tv_sec ) * 1e3 + (double) ( cpuStop.tv_nsec - cpuStart.tv_nsec ) / 1e6;
+
+            size_t logBytes = readFile( 0 == strcmp( "binary", format ) ? "log_test.bin" : "log_test.ndjson" ).size();
+            size_t jsonBytes = 0 == strcmp( "binary", format ) ? 0 : readFile( "log_test.json" ).size();
+            GOUT( mode << ", " << format << ": " << logBytes / 1024 << " KiB logged + " << jsonBytes / 1024
+                  << " KiB session.json, CPU = " << cpu << "ms ( " << logStats.bodies << " bodies, dropped = "
+                  << logStats.dropped << " )" );
+
+            for ( auto &message : messages )
+                memset( message.transmitted_devices, 0, sizeof( message.transmitted_devices ) );
+        }
+    }
+}
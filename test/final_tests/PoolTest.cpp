@@ -0,0 +1,188 @@
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "pool.h"
+
+    #include <time.h>
+    #include <unistd.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern PoolStats poolStats;
+
+static std::atomic<uint32_t> jobsRun;
+static std::atomic<uint32_t> jobsSeen[ 1000 ];
+static std::atomic<bool> jobsBlocked;
+static std::atomic<uint64_t> jobsLatency;
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowMicros()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_nsec / 1000;
+}
+
+/// \brief Job that records its $connected_socket_fd ( blocks while $jobsBlocked ).
+static void recordJob(void *args)
+{
+    auto *jobArgs = (CommunicationWorkerArgs *) args;
+
+    while ( jobsBlocked )
+        usleep( 1000 );
+
+    jobsSeen[ jobArgs->connected_socket_fd ]++;
+    jobsRun++;
+}
+
+/// \brief Job that accumulates submit-to-start latency ( submit time travels in $connected_device ).
+static void latencyJob(void *args)
+{
+    auto *jobArgs = (CommunicationWorkerArgs *) args;
+    uint64_t submittedAt = ( (uint64_t) jobArgs->connected_device.AEM << 32 ) | (uint32_t) jobArgs->connected_device.aemIndex;
+
+    jobsLatency += nowMicros() - submittedAt;
+    jobsRun++;
+}
+
+class PoolTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        jobsRun = 0;
+        jobsBlocked = false;
+        jobsLatency = 0;
+        for ( auto & seen : jobsSeen )
+            seen = 0;
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests pool > pool_submit() function: every job runs exactly once with its own copy of its arguments.
+TEST_F(PoolTest, SubmitOwnsArgs)
+{
+    CommunicationWorkerArgs args = {};
+
+    pool_init( recordJob );
+    for ( int32_t job_i = 0; job_i < 1000; job_i++ )
+    {
+        // Same stack variable for every job
+        args.connected_socket_fd = job_i;
+        pool_submit( &args );
+    }
+    pool_destroy();
+
+    EXPECT_EQ( 1000U, jobsRun.load() );
+    EXPECT_EQ( 1000U, poolStats.jobs );
+    for ( auto & seen : jobsSeen )
+        EXPECT_EQ( 1U, seen.load() );
+}
+
+/// \brief Tests pool > pool_submit() function: submitter blocks while queue is full.
+TEST_F(PoolTest, Backpressure)
+{
+    CommunicationWorkerArgs args = {};
+    std::atomic<bool> submitted{false};
+
+    if ( 0 == COMMUNICATION_WORKERS_MAX )
+        return;
+
+    jobsBlocked = true;
+    pool_init( recordJob );
+
+    // Busy workers + full queue
+    for ( int32_t job_i = 0; job_i < COMMUNICATION_WORKERS_MAX + COMMUNICATION_QUEUE_LEN; job_i++ )
+    {
+        args.connected_socket_fd = job_i;
+        pool_submit( &args );
+        usleep( 1000 );
+    }
+    EXPECT_EQ( 0U, poolStats.backpressured );
+
+    // One more > blocks until a worker frees a queue slot
+    std::thread submitter( [&]() {
+        CommunicationWorkerArgs lastArgs = { .connected_socket_fd = COMMUNICATION_WORKERS_MAX + COMMUNICATION_QUEUE_LEN };
+        pool_submit( &lastArgs );
+        submitted = true;
+    } );
+
+    usleep( 50000 );
+    EXPECT_FALSE( submitted.load() );
+    EXPECT_EQ( 1U, poolStats.backpressured );
+
+    jobsBlocked = false;
+    submitter.join();
+    pool_destroy();
+
+    EXPECT_TRUE( submitted.load() );
+    EXPECT_EQ( (uint32_t) ( COMMUNICATION_WORKERS_MAX + COMMUNICATION_QUEUE_LEN + 1 ), jobsRun.load() );
+    EXPECT_GT( pool_utilisation(), 0.0 );
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Compares submit-to-start latency of pre-spawned pool workers vs. a new ( detached ) thread per job.
+TEST_F(PoolTest, DISABLED_Benchmark_PoolVsThreadPerJob)
+{
+    const uint32_t jobs_n = 10000;
+    CommunicationWorkerArgs args = {};
+
+    // Pool
+    pool_init( latencyJob );
+    for ( uint32_t job_i = 0; job_i < jobs_n; job_i++ )
+    {
+        uint64_t submittedAt = nowMicros();
+        args.connected_device.AEM = (uint32_t) ( submittedAt >> 32 );
+        args.connected_device.aemIndex = (int32_t) (uint32_t) submittedAt;
+        pool_submit( &args );
+    }
+    pool_destroy();
+    double poolLatency = (double) jobsLatency / (double) jobs_n;
+    double poolQueueWait = poolStats.queueWaitAvg;
+
+    // Thread per job
+    jobsRun = 0;
+    jobsLatency = 0;
+    for ( uint32_t job_i = 0; job_i < jobs_n; job_i++ )
+    {
+        auto *jobArgs = (CommunicationWorkerArgs *) malloc( sizeof( CommunicationWorkerArgs ) );
+        uint64_t submittedAt = nowMicros();
+        jobArgs->connected_device.AEM = (uint32_t) ( submittedAt >> 32 );
+        jobArgs->connected_device.aemIndex = (int32_t) (uint32_t) submittedAt;
+
+        pthread_t thread;
+        pthread_create( &thread, nullptr, [](void *jobArgs) -> void * { latencyJob( jobArgs ); free( jobArgs ); return nullptr; }, jobArgs );
+        pthread_detach( thread );
+    }
+    while ( jobsRun < jobs_n )
+        usleep( 1000 );
+    double threadLatency = (double) jobsLatency / (double) jobs_n;
+
+    GOUT( "pool ( " << COMMUNICATION_WORKERS_MAX << " workers ): submit-to-start = " << poolLatency << "us ( queue wait avg. = " << poolQueueWait << "ms )" );
+    GOUT( "thread per job       : submit-to-start = " << threadLatency << "us" );
+}
@@ -0,0 +1,253 @@
+#include <cstddef>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "log.h"
+    #include "reactor.h"
+    #include "server.h"
+    #include "utils.h"
+
+    #include <arpa/inet.h>
+    #include <signal.h>
+    #include <sys/time.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+extern const char *socketSubnet;
+extern const char *communicationProtocol;
+extern bool messagesReceipts;
+extern bool CLIENT_AEM_ACTIVE_LIST[ CLIENT_AEM_LIST_LENGTH ];
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Connects to $CLIENT_AEM from the loopback address of $aem.
+static int peerConnect(uint32_t aem, int receiveBuffer)
+{
+    int fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+    int one = 1;
+    setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( int ) );
+    if ( receiveBuffer > 0 )
+        setsockopt( fd, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof( int ) );
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = inet_addr( aem2ip( aem ) );
+    bind( fd, (struct sockaddr *) &address, sizeof( address ) );
+
+    address.sin_port = htons( SOCKET_PORT );
+    address.sin_addr.s_addr = inet_addr( aem2ip( CLIENT_AEM ) );
+    if ( connect( fd, (struct sockaddr *) &address, sizeof( address ) ) < 0 )
+    {
+        close( fd );
+        return -1;
+    }
+
+    return fd;
+}
+
+/// \brief Reads until EOF, returns no. of bytes read.
+static size_t peerReadAll(int fd)
+{
+    char buffer[4096];
+    size_t total = 0;
+    ssize_t n;
+
+    while ( ( n = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+        total += n;
+
+    return total;
+}
+
+/// \brief Counts stored messages sent by $aems[$from...].
+static uint32_t storedFrom(const std::vector<uint32_t> &aems, uint32_t from)
+{
+    uint32_t stored = 0;
+    for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+        for ( uint32_t aem_i = from; aem_i < aems.size(); aem_i++ )
+            if ( messages_header( message_i )->sender == aems[aem_i] )
+                stored++;
+
+    return stored;
+}
+
+class ReactorTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        signal( SIGPIPE, SIG_IGN );
+        socketSubnet = "127.0";
+        communicationProtocol = "text";     // peers below speak raw records
+        messagesReceipts = false;           // messages of peers are counted in the store, even once delivered
+        CLIENT_AEM = 9026;
+
+        messages_reset();
+        for ( bool & i : CLIENT_AEM_ACTIVE_LIST )
+            i = false;
+
+        log_tearUp( "reactor_test.json" );
+
+        // Listening socket of device under test
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons( SOCKET_PORT );
+        address.sin_addr.s_addr = inet_addr( aem2ip( CLIENT_AEM ) );
+
+        listen_fd = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+        int one = 1;
+        setsockopt( listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( int ) );
+        ASSERT_EQ( 0, bind( listen_fd, (struct sockaddr *) &address, sizeof( address ) ) );
+        ASSERT_EQ( 0, listen( listen_fd, 128 ) );
+
+        reactor = std::thread( [this]() { reactor_run( listen_fd ); } );
+    }
+
+    void TearDown() override
+    {
+        reactor_stop();
+        reactor.join();
+        close( listen_fd );
+
+        log_tearDown( 0.0 );
+        remove( "reactor_test.json" );
+        remove( "reactor_test.ndjson" );
+
+        messages_reset();
+        socketSubnet = SOCKET_SUBNET;
+        communicationProtocol = COMMUNICATION_PROTOCOL;
+        messagesReceipts = MESSAGES_RECEIPTS;
+    }
+
+    int listen_fd = -1;
+    std::thread reactor;
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests reactor > reactor_run() with dozens of simultaneous peers: stalled peers ( never reading ) & peers with
+/// unknown AEMs must not delay the sessions of healthy peers.
+TEST_F(ReactorTest, StressSimultaneousPeers)
+{
+    const uint32_t messagesPerPeer = 10;
+    const uint32_t stalled_n = 5;
+    const uint32_t unknown_n = 30;
+    Message message;
+
+    // Fill store of device under test
+    for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+    {
+        generateRandomMessage( &message );
+        message.created_at += message_i;
+        messages_push( &message );
+    }
+
+    std::vector<uint32_t> aems;
+    for ( uint32_t aem_i = 0; aem_i < CLIENT_AEM_LIST_LENGTH; aem_i++ )
+        if ( CLIENT_AEM_LIST[aem_i] != CLIENT_AEM && CLIENT_AEM_LIST[aem_i] > 1000 )
+            aems.push_back( CLIENT_AEM_LIST[aem_i] );
+
+    // Stalled peers: connect with a tiny receive buffer & never read
+    std::vector<int> stalled;
+    for ( uint32_t peer_i = 0; peer_i < stalled_n; peer_i++ )
+    {
+        int fd = peerConnect( aems[peer_i], 1024 );
+        ASSERT_GE( fd, 0 );
+        stalled.push_back( fd );
+    }
+
+    // Healthy peers: receive everything, then transmit own messages ( as in communication_worker() client-side )
+    std::atomic<uint32_t> healthyDone{0};
+    std::vector<size_t> healthyReceived( aems.size(), 0 );
+    std::vector<std::thread> peers;
+    for ( uint32_t peer_i = stalled_n; peer_i < aems.size(); peer_i++ )
+    {
+        peers.emplace_back( [&, peer_i]() {
+            int fd = peerConnect( aems[peer_i], 0 );
+            if ( fd < 0 ) return;
+
+            healthyReceived[peer_i] = peerReadAll( fd );
+
+            for ( uint32_t message_i = 0; message_i < messagesPerPeer; message_i++ )
+            {
+                Message own;
+                char serialized[MESSAGE_SERIALIZED_LEN + 1];
+                generateRandomMessage( &own );
+                own.sender = aems[peer_i];
+                own.recipient = 8888 == aems[peer_i] ? 8999 : 8888;
+                own.created_at = 1561669840 + message_i;
+
+                implode( "_", own, serialized );
+                send( fd, serialized, MESSAGE_SERIALIZED_LEN, MSG_NOSIGNAL );
+            }
+            shutdown( fd, SHUT_WR );
+
+            peerReadAll( fd );
+            close( fd );
+            healthyDone++;
+        } );
+    }
+
+    // Unknown peers: AEMs outside the list are rejected right away
+    std::atomic<uint32_t> unknownClosed{0};
+    for ( uint32_t peer_i = 0; peer_i < unknown_n; peer_i++ )
+    {
+        peers.emplace_back( [&, peer_i]() {
+            int fd = peerConnect( 7010 + peer_i, 0 );
+            if ( fd < 0 ) return;
+
+            if ( 0 == peerReadAll( fd ) )
+                unknownClosed++;
+            close( fd );
+        } );
+    }
+
+    for ( auto &peer : peers )
+        peer.join();
+
+    // Peers close right after their last frame: give the reactor a moment to drain them
+    for ( uint32_t wait_i = 0; wait_i < 500 && storedFrom( aems, stalled_n ) < ( aems.size() - stalled_n ) * messagesPerPeer; wait_i++ )
+        usleep( 10000 );
+
+    // Healthy sessions finished while stalled ones are still open
+    EXPECT_EQ( aems.size() - stalled_n, healthyDone.load() );
+    EXPECT_EQ( unknown_n, unknownClosed.load() );
+    for ( uint32_t peer_i = stalled_n; peer_i < aems.size(); peer_i++ )
+    {
+        EXPECT_EQ( 0U, healthyReceived[peer_i] % MESSAGE_SERIALIZED_LEN );
+    }
+
+    // Messages of every healthy peer were stored
+    for ( uint32_t peer_i = stalled_n; peer_i < aems.size(); peer_i++ )
+    {
+        uint32_t stored = 0;
+        for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+            if ( messages_header( message_i )->sender == aems[peer_i] )
+                stored++;
+
+        EXPECT_EQ( messagesPerPeer, stored );
+    }
+
+    for ( int fd : stalled )
+        close( fd );
+
+    GOUT( "healthy = " << healthyDone.load() << ", stalled = " << stalled_n << ", unknown = " << unknown_n );
+}
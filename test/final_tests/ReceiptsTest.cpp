@@ -0,0 +1,201 @@
+#include <cstddef>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "communication.h"
+    #include "index.h"
+    #include "receipts.h"
+    #include "server.h"
+    #include "summary.h"
+}
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+extern messages_head_t messagesHead;
+extern uint32_t messagesCount;
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Builds message #$message_i ( distinct for distinct $message_i ).
+static void makeMessage(Message *message, uint32_t message_i)
+{
+    memset( message, 0, sizeof( Message ) );
+    message->sender = 8000 + message_i % 500;
+    message->recipient = 8723;
+    message->created_at = 1561669840 + message_i;
+    snprintf( message->body, MESSAGE_BODY_LEN, "message body #%u", message_i );
+}
+
+class ReceiptsTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        CLIENT_AEM = 9026;
+        messages_init( "blind" );
+    }
+
+    void TearDown() override
+    {
+        messages_init( MESSAGES_PUSH_OVERRIDE_POLICY );
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests receipts > receipts_add() function: duplicates are rejected, ring wraps & forgotten receipts may be
+/// added again.
+TEST_F(ReceiptsTest, AddWrapsAndDedups)
+{
+    static Receipts receipts;
+    static MessageIndexEntry entries[RECEIPTS_INDEX_SIZE];
+    MessageIndex index;
+    Message message;
+    MessageKey key;
+
+    memset( &receipts, 0, sizeof( Receipts ) );
+    index_init( &index, entries, RECEIPTS_INDEX_SIZE );
+
+    for ( uint32_t message_i = 0; message_i < RECEIPTS_SIZE + 10; message_i++ )
+    {
+        makeMessage( &message, message_i );
+        index_key( &key, &message );
+        EXPECT_EQ( true, receipts_add( &receipts, &index, &key ) );
+    }
+    EXPECT_EQ( 10U, receipts.head );
+
+    makeMessage( &message, RECEIPTS_SIZE + 9 );
+    index_key( &key, &message );
+    EXPECT_EQ( false, receipts_add( &receipts, &index, &key ) );
+    makeMessage( &message, 0 );
+    index_key( &key, &message );
+    EXPECT_EQ( true, receipts_add( &receipts, &index, &key ) );
+
+    // Rebuilt index has the same receipts
+    receipts_rebuild( &receipts, &index );
+    EXPECT_EQ( false, receipts_add( &receipts, &index, &key ) );
+    EXPECT_EQ( RECEIPTS_SIZE, index.length );
+}
+
+/// \brief Tests receipts > receipts_pack() & receipts_unpack() functions: only receipts of messages in the filter are
+/// sent.
+TEST_F(ReceiptsTest, PackUnpack)
+{
+    static Receipts receipts;
+    static MessageIndexEntry entries[RECEIPTS_INDEX_SIZE];
+    static uint8_t packed[RECEIPTS_LEN_MAX];
+    static Summary filter;
+    MessageIndex index;
+    MessageKey keys[10], unpacked;
+    Message message;
+
+    memset( &receipts, 0, sizeof( Receipts ) );
+    index_init( &index, entries, RECEIPTS_INDEX_SIZE );
+    summary_init( &filter, 2278 );
+
+    for ( uint32_t message_i = 0; message_i < 10; message_i++ )
+    {
+        makeMessage( &message, message_i );
+        index_key( &keys[message_i], &message );
+        receipts_add( &receipts, &index, &keys[message_i] );
+        if ( message_i % 2 )
+            summary_add( &filter, &keys[message_i] );
+    }
+
+    uint32_t length = receipts_pack( &receipts, &filter, packed );
+    ASSERT_EQ( (uint32_t) RECEIPTS_HEADER_LEN + 5 * RECEIPTS_ENTRY_LEN, length );
+    EXPECT_EQ( length, receipts_length( packed ) );
+
+    for ( uint32_t receipt_i = 0; receipt_i < 5; receipt_i++ )
+    {
+        receipts_unpack( &unpacked, packed, receipt_i );
+        EXPECT_EQ( 0, memcmp( &keys[2 * receipt_i + 1], &unpacked, sizeof( MessageKey ) ) );
+    }
+
+    packed[0] ^= 1;
+    EXPECT_EQ( 0U, receipts_length( packed ) );
+}
+
+/// \brief Tests server > messages_receipt() function: a held message is purged & its slot is the next one filled
+/// ( head is kept ), & the message is not stored again.
+TEST_F(ReceiptsTest, ReceiptPurges)
+{
+    Message message;
+    MessageKey key;
+    bool purged;
+
+    for ( uint32_t message_i = 0; message_i < 10; message_i++ )
+    {
+        makeMessage( &message, message_i );
+        messages_push( &message );
+    }
+
+    makeMessage( &message, 3 );
+    index_key( &key, &message );
+    EXPECT_EQ( true, messages_receipt( &key, &purged ) );
+    EXPECT_EQ( true, purged );
+    EXPECT_EQ( false, messages_receipt( &key, &purged ) );
+    EXPECT_EQ( false, purged );
+    EXPECT_EQ( 9U, messagesCount );
+    EXPECT_EQ( 0U, messages_header( 3 )->created_at );
+    EXPECT_EQ( 4, messages_next_pending( 3, 5 ) );
+
+    EXPECT_EQ( false, messages_push_unique( &message ) );
+
+    makeMessage( &message, 10 );
+    EXPECT_EQ( true, messages_push_unique( &message ) );
+    EXPECT_EQ( 1561669840U + 10, messages_header( 3 )->created_at );
+    EXPECT_EQ( 10, messagesHead );
+
+    // Delivered by this device
+    EXPECT_EQ( true, messages_delivered( 4 ) );
+    EXPECT_EQ( 0U, messages_header( 4 )->created_at );
+    EXPECT_EQ( 9U, messagesCount );
+}
+
+/// \brief Tests communication > communication_mark_transmitted() function: a message sent after its slot was purged
+/// ( & reused ) marks nothing, neither the message now in the slot nor an empty slot.
+TEST_F(ReceiptsTest, MarkTransmittedChecksSlot)
+{
+    Device device = {.AEM = 8600, .aemIndex = 5};
+    Message message, copy;
+    MessageKey sentKey, key;
+    bool purged;
+
+    for ( uint32_t message_i = 0; message_i < 10; message_i++ )
+    {
+        makeMessage( &message, message_i );
+        messages_push( &message );
+    }
+
+    // Message of slot 3 is serialized, then purged by a receipt & its slot is filled with a message for the device
+    makeMessage( &message, 3 );
+    index_key( &sentKey, &message );
+    EXPECT_EQ( true, messages_receipt( &sentKey, &purged ) );
+    makeMessage( &message, 10 );
+    message.recipient = device.AEM;
+    EXPECT_EQ( true, messages_push_unique( &message ) );
+    ASSERT_EQ( 1561669840U + 10, messages_header( 3 )->created_at );
+
+    EXPECT_EQ( false, communication_mark_transmitted( 3, &sentKey, device, &copy ) );
+    EXPECT_EQ( 1561669840U + 10, messages_header( 3 )->created_at );
+    EXPECT_EQ( 0, messages_header( 3 )->transmitted );
+    EXPECT_EQ( 10U, messagesCount );
+
+    // Message of the slot itself: delivered to its recipient & purged
+    index_key( &key, &message );
+    EXPECT_EQ( true, communication_mark_transmitted( 3, &key, device, &copy ) );
+    EXPECT_EQ( 1561669840U + 10, copy.created_at );
+    EXPECT_EQ( 0U, messages_header( 3 )->created_at );
+    EXPECT_EQ( 9U, messagesCount );
+
+    // Empty slot
+    EXPECT_EQ( false, communication_mark_transmitted( 3, &key, device, &copy ) );
+    EXPECT_EQ( 9U, messagesCount );
+}
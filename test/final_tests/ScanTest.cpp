@@ -0,0 +1,175 @@
+#include <cstddef>
+#include <random>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "scan.h"
+    #include "utils.h"
+
+    #include <time.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern const char *scanKernel;
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Writes sequenced text record of a random message with a body of $body_length characters at $record.
+static void makeRecord(uint8_t *record, std::mt19937 &random, uint16_t body_length)
+{
+    Message message;
+
+    memset( &message, 0, sizeof( Message ) );
+    message.sender = 8000 + random() % 1000;
+    message.recipient = 8000 + random() % 1000;
+    message.created_at = 1561669840 + random() % 1000;
+    for ( uint16_t char_i = 0; char_i < body_length; char_i++ )
+    {
+        do { message.body[char_i] = (char) ( 32 + random() % 95 ); }
+        while ( '_' == message.body[char_i] || '\\' == message.body[char_i] || '"' == message.body[char_i] );
+    }
+
+    implode( "_", message, (char *) record );
+    uint2digits( random(), (char *) record + MESSAGE_SERIALIZED_LEN, 10 );
+}
+
+/// \brief Kernels this CPU runs.
+static std::vector<const char *> kernels()
+{
+    std::vector<const char *> names;
+
+    for ( const char *name : {"scalar", "sse2", "avx2", "neon"} )
+    {
+        scanKernel = name;
+        if ( 0 == strcmp( name, scan_kernel_name() ) )
+            names.push_back( name );
+    }
+    scanKernel = SCAN_KERNEL;
+
+    return names;
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests scan > scan_records() function: valid records of every body length pass, records with a bad field, a
+/// glue or a character out of class in their body, no NUL or a bad sequence number fail, with every kernel.
+TEST(ScanTest, Records)
+{
+    std::mt19937 random( 42 );
+    std::vector<uint8_t> records( 64 * MESSAGE_SEQUENCED_LEN );
+
+    for ( const char *kernel : kernels() )
+    {
+        scanKernel = kernel;
+
+        for ( uint16_t record_i = 0; record_i < 64; record_i++ )
+            makeRecord( &records[record_i * MESSAGE_SEQUENCED_LEN], random, (uint16_t) ( record_i * 5 > 255 ? 255 : record_i * 5 ) );
+        EXPECT_EQ( ~(uint64_t) 0, scan_records( records.data(), 64, MESSAGE_SEQUENCED_LEN ) ) << kernel;
+        EXPECT_EQ( 0x7FU, scan_records( records.data(), 7, MESSAGE_SEQUENCED_LEN ) ) << kernel;
+
+        // Corrupt one record each: body ( early & late ), fields, NUL, sequence number
+        struct { uint16_t record_i, offset; uint8_t byte; } corruptions[] = {
+                {1, 2, 'x'}, {10, 9, '0'}, {20, 30, '_'}, {30, 40, '"'}, {40, 60, '\\'},
+                {62, 250, 0x80}, {60, 250, '\n'}, {63, 276, 'a'}, {45, 280, ' '}, {5, 20, '1'}
+        };
+        uint64_t expected = ~(uint64_t) 0;
+        for ( const auto &corruption : corruptions )
+        {
+            records[corruption.record_i * MESSAGE_SEQUENCED_LEN + corruption.offset] = corruption.byte;
+            expected &= ~( (uint64_t) 1 << corruption.record_i );
+        }
+        EXPECT_EQ( expected, scan_records( records.data(), 64, MESSAGE_SEQUENCED_LEN ) ) << kernel;
+
+        // Record of wider fields ( as implode() writes them for AEMs over 9999 )
+        char record[MESSAGE_SERIALIZED_LEN];
+        snprintf( record, MESSAGE_SERIALIZED_LEN, "12345_8600_1561669840_a body" );
+        EXPECT_EQ( 1U, scan_records( (const uint8_t *) record, 1, MESSAGE_SERIALIZED_LEN ) ) << kernel;
+        snprintf( record, MESSAGE_SERIALIZED_LEN, "12345_8600_a body" );
+        EXPECT_EQ( 0U, scan_records( (const uint8_t *) record, 1, MESSAGE_SERIALIZED_LEN ) ) << kernel;
+    }
+
+    scanKernel = SCAN_KERNEL;
+}
+
+/// \brief Tests scan > scan_body() function: every kernel agrees with the scalar one on random bytes, for every length.
+TEST(ScanTest, BodyKernelsAgree)
+{
+    std::mt19937 random( 7 );
+    uint8_t body[MESSAGE_BODY_LEN];
+
+    for ( uint32_t round_i = 0; round_i < 2000; round_i++ )
+    {
+        uint16_t n = (uint16_t) ( random() % MESSAGE_BODY_LEN );
+        for ( uint16_t byte_i = 0; byte_i < n; byte_i++ )
+            body[byte_i] = (uint8_t) ( 32 + random() % 95 );
+
+        // Most bodies are valid, some carry one byte of any value
+        if ( n > 0 && 0 == round_i % 2 )
+            body[random() % n] = (uint8_t) random();
+
+        scanKernel = "scalar";
+        bool expected = scan_body( body, n );
+        for ( const char *kernel : kernels() )
+        {
+            scanKernel = kernel;
+            EXPECT_EQ( expected, scan_body( body, n ) ) << kernel << ", length = " << n;
+        }
+    }
+
+    scanKernel = SCAN_KERNEL;
+}
+
+/// \brief Measures validation throughput of every kernel this CPU runs, over batches of 64 sequenced text records.
+TEST(ScanTest, DISABLED_Benchmark_Kernels)
+{
+    const uint32_t batches_n = 20000;
+    std::mt19937 random( 42 );
+    std::vector<uint8_t> records( 64 * MESSAGE_SEQUENCED_LEN );
+    std::vector<uint8_t> body( MESSAGE_BODY_LEN - 1, 'a' );
+    uint64_t checksum = 0;
+
+    for ( uint16_t record_i = 0; record_i < 64; record_i++ )
+        makeRecord( &records[record_i * MESSAGE_SEQUENCED_LEN], random, MESSAGE_BODY_LEN - 1 );
+
+    for ( const char *kernel : kernels() )
+    {
+        scanKernel = kernel;
+
+        uint64_t start = nowNanos();
+        for ( uint32_t batch_i = 0; batch_i < batches_n; batch_i++ )
+            checksum += scan_records( records.data(), 64, MESSAGE_SEQUENCED_LEN );
+        double recordsRate = (double) batches_n * records.size() / (double) ( nowNanos() - start );
+
+        start = nowNanos();
+        for ( uint32_t batch_i = 0; batch_i < 64 * batches_n; batch_i++ )
+            checksum += scan_body( body.data(), (uint16_t) body.size() );
+        double bodiesRate = (double) 64 * batches_n * body.size() / (double) ( nowNanos() - start );
+
+        GOUT( kernel << ": records = " << recordsRate << " GB/s, bodies = " << bodiesRate << " GB/s" );
+    }
+
+    scanKernel = SCAN_KERNEL;
+    EXPECT_NE( 0U, checksum );
+}
@@ -4,6 +4,7 @@ extern "C" {
     #include "conf.h"
     #include "types.h"
     #include "server.h"
+    #include "stats.h"
     #include "utils.h"
     #include "client.h"
 
@@ -24,30 +25,20 @@ extern "C" {
 uint32_t executionTimeRequested;       // secs
 static struct timespec executionTimeActualStart, executionTimeActualFinish;
 
-pthread_t communicationThreads[COMMUNICATION_WORKERS_MAX];
-uint8_t communicationThreadsAvailable = COMMUNICATION_WORKERS_MAX;
-
 static pthread_t pollingThread, producerThread, datetimeListenerThread;
-pthread_mutex_t messagesBufferLock, activeDevicesLock, availableThreadsLock, messagesStatsLock, logLock, logEventLock;
+pthread_mutex_t messagesBufferLock, activeDevicesLock, logLock, logEventLock;
 
 //DevicesQueue activeDevicesQueue;
-MessagesStats messagesStats;
 
 uint32_t CLIENT_AEM;
 uint32_t setupDatetimeAem;
 
-// Communication time for each device
-struct timeval CLIENT_AEM_CONN_START_LIST[CLIENT_AEM_LIST_LENGTH][MAX_CONNECTIONS_WITH_SAME_CLIENT] = {0, 0};
-struct timeval CLIENT_AEM_CONN_END_LIST[CLIENT_AEM_LIST_LENGTH][MAX_CONNECTIONS_WITH_SAME_CLIENT] = {0, 0};
-uint8_t CLIENT_AEM_CONN_N_LIST[CLIENT_AEM_LIST_LENGTH] = {0};
-
 //------------------------------------------------------------------------------------------------
 
 
 /* messagesHead is in range: [0, $MESSAGES_SIZE - 1] */
 extern messages_head_t messagesHead;
 extern messages_head_t inboxHead;
-extern Message MESSAGES_BUFFER[ MESSAGES_SIZE ];
 extern InboxMessage *INBOX;
 
 // Active flag for each AEM
@@ -64,12 +55,7 @@ protected:
         for (bool & i : CLIENT_AEM_ACTIVE_LIST)
             i = false;
 
-        messagesStats.received = 0;
-        messagesStats.received_for_me = 0;
-        messagesStats.transmitted = 0;
-        messagesStats.transmitted_to_recipient = 0;
-        messagesStats.produced = 0;
-        messagesStats.producedDelayAvg = 0.0F;
+        stats_reset();
 
         // Set max execution time ( in seconds )
         executionTimeRequested = MAX_EXECUTION_TIME;
@@ -82,18 +68,10 @@ protected:
 
         // Initialize types
         messagesHead = 0;
-        inboxHead = 0;
 
         // Initialize INBOX buffer
-        INBOX = (InboxMessage *) malloc(INBOX_SIZE * sizeof( InboxMessage ) );
-//    for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ ) INBOX[message_i].created_at = 0;
-
-        // Initialize logger
-        messagesStats.produced = 0;
-        messagesStats.received = 0;
-        messagesStats.received_for_me = 0;
-        messagesStats.transmitted = 0;
-        messagesStats.transmitted_to_recipient = 0;
+        inbox_reset();
+
     }
 
 public:
@@ -105,11 +83,11 @@ public:
             i = false;
 
         // Restore $messagesHead back to 0
-        //  - "erase" all MESSAGES_BUFFER
-        memset(&MESSAGES_BUFFER, 0, MESSAGES_SIZE * sizeof(Message) );
         //  - set $messagesHead
         messagesHead = 0;
-        inboxHead = 0;
+        inbox_reset();
+        //  - "erase" all messages & empty duplicate-detection index
+        messages_reset();
     }
 
 };
@@ -226,87 +204,94 @@ TEST_F(ServerTest, MessagesPushSimple)
     EXPECT_EQ(messagesHead, 2);
 }
 
-/// \brief Tests utils > messages_push() function.
+/// \brief Tests utils > messages_push() function, for "blind" & "sent_only" policies.
 TEST_F(ServerTest, MessagesPushFull)
 {
-    char log[100];
+    for ( const char *policy : {"blind", "sent_only"} )
+    {
+        messages_init( policy );
 
-    uint32_t firstTransmittedMessageIndex = 0;
-    uint8_t firstTransmittedMessageIndexSet = 0;
+        char log[100];
 
-    uint32_t secondTransmittedMessageIndex = 0;
-    uint8_t secondTransmittedMessageIndexSet = 0;
+        uint32_t firstTransmittedMessageIndex = 0;
+        uint8_t firstTransmittedMessageIndexSet = 0;
 
-    uint32_t thirdTransmittedMessageIndex = 0;
-    uint8_t thirdTransmittedMessageIndexSet = 0;
+        uint32_t secondTransmittedMessageIndex = 0;
+        uint8_t secondTransmittedMessageIndexSet = 0;
 
-    // Add $MESSAGE_SIZE MESSAGES_BUFFER
-    Message message;
-    for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
-    {
-        generateRandomMessage( &message );
+        uint32_t thirdTransmittedMessageIndex = 0;
+        uint8_t thirdTransmittedMessageIndexSet = 0;
 
-        // Initialize RNG
+        // Add $MESSAGE_SIZE MESSAGES_BUFFER
+        Message message;
+        for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+        {
+            generateRandomMessage( &message );
+
+            // Initialize RNG
 //        srand( (unsigned int) time(nullptr) );
-        uint32_t rr = randombytes_random();
+            uint32_t rr = randombytes_random();
 
 //        sprintf( log, "rr = %u\n", rr );
 //        GOUT( log );
 
-        if ( randombytes_random() % 10000 < 489 )
-        {
-            message.transmitted = 1;
-        }
-
-        messages_push( &message );
-
-        if ( 1 == message.transmitted )
-        {
-            if ( 0 == firstTransmittedMessageIndexSet )
+            if ( randombytes_random() % 10000 < 489 )
             {
-                firstTransmittedMessageIndexSet = 1;
-                firstTransmittedMessageIndex = message_i;
-
-                sprintf( log, "firstTransmittedMessageIndex = %d\n", firstTransmittedMessageIndex );
-                GOUT( log );
+                message.transmitted = 1;
             }
-            else if ( 0 == secondTransmittedMessageIndexSet )
-            {
-                secondTransmittedMessageIndexSet = 1;
-                secondTransmittedMessageIndex = message_i;
 
-                sprintf( log, "secondTransmittedMessageIndex = %d\n", secondTransmittedMessageIndex );
-                GOUT( log );
-            }
-            else if ( 0 == thirdTransmittedMessageIndexSet )
-            {
-                thirdTransmittedMessageIndexSet = 1;
-                thirdTransmittedMessageIndex = message_i;
+            messages_push( &message );
 
-                sprintf( log, "thirdTransmittedMessageIndex = %d\n", thirdTransmittedMessageIndex );
-                GOUT( log );
+            if ( 1 == message.transmitted )
+            {
+                if ( 0 == firstTransmittedMessageIndexSet )
+                {
+                    firstTransmittedMessageIndexSet = 1;
+                    firstTransmittedMessageIndex = message_i;
+
+                    sprintf( log, "firstTransmittedMessageIndex = %d\n", firstTransmittedMessageIndex );
+                    GOUT( log );
+                }
+                else if ( 0 == secondTransmittedMessageIndexSet )
+                {
+                    secondTransmittedMessageIndexSet = 1;
+                    secondTransmittedMessageIndex = message_i;
+
+                    sprintf( log, "secondTransmittedMessageIndex = %d\n", secondTransmittedMessageIndex );
+                    GOUT( log );
+                }
+                else if ( 0 == thirdTransmittedMessageIndexSet )
+                {
+                    thirdTransmittedMessageIndexSet = 1;
+                    thirdTransmittedMessageIndex = message_i;
+
+                    sprintf( log, "thirdTransmittedMessageIndex = %d\n", thirdTransmittedMessageIndex );
+                    GOUT( log );
+                }
             }
         }
-    }
-    EXPECT_EQ( messagesHead, 0 );
+        EXPECT_EQ( messagesHead, 0 );
 
-    // Check next push
-    generateRandomMessage( &message );
-    messages_push( &message );
-    uint32_t real_value = 0 != strcmp( "sent_only", MESSAGES_PUSH_OVERRIDE_POLICY ) ? 1 : firstTransmittedMessageIndex + 1;
-    EXPECT_EQ( messagesHead, real_value );
+        // Check next push
+        generateRandomMessage( &message );
+        messages_push( &message );
+        uint32_t real_value = 0 != strcmp( "sent_only", policy ) ? 1 : firstTransmittedMessageIndex + 1;
+        EXPECT_EQ( messagesHead, real_value ) << policy;
 
-    // Check next push
-    generateRandomMessage( &message );
-    messages_push( &message );
-    real_value = 0 != strcmp( "sent_only", MESSAGES_PUSH_OVERRIDE_POLICY ) ? 2 : secondTransmittedMessageIndex + 1;
-    EXPECT_EQ( messagesHead, real_value );
+        // Check next push
+        generateRandomMessage( &message );
+        messages_push( &message );
+        real_value = 0 != strcmp( "sent_only", policy ) ? 2 : secondTransmittedMessageIndex + 1;
+        EXPECT_EQ( messagesHead, real_value ) << policy;
 
-    // Check next push
-    generateRandomMessage( &message );
-    messages_push( &message );
-    real_value = 0 != strcmp( "sent_only", MESSAGES_PUSH_OVERRIDE_POLICY ) ? 3 : thirdTransmittedMessageIndex + 1;
-    EXPECT_EQ( messagesHead, real_value );
+        // Check next push
+        generateRandomMessage( &message );
+        messages_push( &message );
+        real_value = 0 != strcmp( "sent_only", policy ) ? 3 : thirdTransmittedMessageIndex + 1;
+        EXPECT_EQ( messagesHead, real_value ) << policy;
+    }
+
+    messages_init( MESSAGES_PUSH_OVERRIDE_POLICY );
 }
 
 
@@ -338,3 +323,250 @@ TEST_F(ServerTest, MessagesPushFull)
 
 
 
+
+/// \brief Tests server > messages_next_pending() function.
+TEST_F(ServerTest, MessagesNextPending)
+{
+    Device device = {.AEM = 8600, .aemIndex = binary_search_index( CLIENT_AEM_LIST, CLIENT_AEM_LIST_LENGTH, 8600 )};
+    Device other = {.AEM = 8723, .aemIndex = binary_search_index( CLIENT_AEM_LIST, CLIENT_AEM_LIST_LENGTH, 8723 )};
+    Message message;
+
+    EXPECT_EQ( -1, messages_next_pending( 0, device.aemIndex ) );
+
+    // Slots 0 - 69: to other, slot 1 received from device
+    for ( uint16_t message_i = 0; message_i < 70; message_i++ )
+    {
+        generateRandomMessage( &message );
+        message.recipient = other.AEM;
+        message.created_at += message_i;
+        if ( 1 == message_i )
+            bitset_set( message.transmitted_devices, device.aemIndex );
+        messages_push( &message );
+    }
+
+    EXPECT_EQ( 0, messages_next_pending( 0, device.aemIndex ) );
+    EXPECT_EQ( 2, messages_next_pending( 1, device.aemIndex ) );
+    EXPECT_EQ( 69, messages_next_pending( 69, device.aemIndex ) );
+    EXPECT_EQ( -1, messages_next_pending( 70, device.aemIndex ) );
+
+    // Sent to device > not pending for device only, sent to recipient > not pending for any device
+    messages_transmitted( 2, device );
+    messages_transmitted( 3, other );
+    EXPECT_EQ( 4, messages_next_pending( 2, device.aemIndex ) );
+    EXPECT_EQ( 2, messages_next_pending( 2, other.aemIndex ) );
+    EXPECT_EQ( 4, messages_next_pending( 3, other.aemIndex ) );
+
+    // Slot overwritten by a new message > pending again
+    messagesHead = 2;
+    generateRandomMessage( &message );
+    message.recipient = other.AEM;
+    messages_push( &message );
+    EXPECT_EQ( 2, messages_next_pending( 1, device.aemIndex ) );
+}
+
+/// \brief Tests server > messages_get() & messages_header() functions: a stored message is read back whole.
+TEST_F(ServerTest, MessagesGet)
+{
+    Device device = {.AEM = CLIENT_AEM_RANGE_MAX, .aemIndex = CLIENT_AEM_RANGE_LENGTH - 1};
+    Message message, stored;
+
+    generateRandomMessage( &message );
+    message.recipient = 8723;
+    bitset_set( message.transmitted_devices, 3 );
+    messages_push( &message );
+    messages_transmitted( 0, device );
+
+    messages_get( 0, &stored );
+    EXPECT_EQ( 1, isMessageEqual( message, stored ) );
+    EXPECT_EQ( 0, strcmp( message.body, stored.body ) );
+    EXPECT_EQ( 1, stored.transmitted );
+    EXPECT_EQ( 0, stored.transmitted_to_recipient );
+    EXPECT_TRUE( bitset_test( stored.transmitted_devices, 3 ) );
+    EXPECT_TRUE( bitset_test( stored.transmitted_devices, device.aemIndex ) );
+    EXPECT_FALSE( bitset_test( stored.transmitted_devices, 4 ) );
+
+    EXPECT_EQ( message.created_at, messages_header( 0 )->created_at );
+    EXPECT_EQ( 8723U, messages_header( 0 )->recipient );
+    EXPECT_EQ( 0U, messages_header( 1 )->created_at );
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/* $messages slot as stored before the header / body / devices split ( array of structs, a byte per device ) */
+template <uint32_t devices_n>
+struct LegacyMessage {
+
+    uint32_t sender;
+    uint32_t recipient;
+    uint64_t created_at;
+    char body[MESSAGE_BODY_LEN];
+
+    uint8_t transmitted;
+    uint8_t transmitted_devices[devices_n];
+    uint8_t transmitted_to_recipient;
+
+};
+
+static double cpuNanos(const struct timespec &start, const struct timespec &finish)
+{
+    return ( finish.tv_sec - start.tv_sec ) * 1e9 + ( finish.tv_nsec - start.tv_nsec );
+}
+
+/// \brief Reports footprint of the $messages store & throughput of its two scans ( pending messages of a device,
+/// "sent_only" hole search ), for the array of structs ( as before ) vs. the header / body / devices split, with
+/// $devices_n devices.
+template <uint32_t devices_n>
+static void benchmarkStoreLayout(const char *source)
+{
+    const uint32_t scans_n = 2000;
+    const uint32_t words_n = ( devices_n + 63 ) / 64;
+    const int32_t aemIndex = devices_n - 1;
+    struct timespec start, finish;
+    uint32_t found;
+
+    auto *legacy = (LegacyMessage<devices_n> *) calloc( MESSAGES_SIZE, sizeof( LegacyMessage<devices_n> ) );
+    auto *headers = (MessageHeader *) calloc( MESSAGES_SIZE, sizeof( MessageHeader ) );
+    auto *bodies = (char *) calloc( MESSAGES_SIZE, MESSAGE_BODY_LEN );
+    auto *devices = (uint64_t *) calloc( MESSAGES_SIZE, words_n * sizeof( uint64_t ) );
+
+    // Full store, 1 in 8 messages still pending for the device
+    for ( uint32_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+    {
+        legacy[message_i].created_at = headers[message_i].created_at = 1561669840 + message_i;
+        legacy[message_i].sender = headers[message_i].sender = 8000 + message_i % 1000;
+        legacy[message_i].recipient = headers[message_i].recipient = 8723;
+        snprintf( legacy[message_i].body, MESSAGE_BODY_LEN, "message body #%u", message_i );
+        memcpy( bodies + message_i * MESSAGE_BODY_LEN, legacy[message_i].body, MESSAGE_BODY_LEN );
+        if ( message_i % 8 )
+        {
+            legacy[message_i].transmitted_devices[aemIndex] = 1;
+            bitset_set( devices + message_i * words_n, aemIndex );
+        }
+    }
+
+    // Array of structs
+    found = 0;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &start );
+    for ( uint32_t scan_i = 0; scan_i < scans_n; scan_i++ )
+        for ( uint32_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+            if ( legacy[message_i].created_at > 0 && 0 == legacy[message_i].transmitted_devices[aemIndex]
+                 && 0 == legacy[message_i].transmitted_to_recipient )
+                found++;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &finish );
+    double legacyPendingScan = cpuNanos( start, finish ) / scans_n;
+    EXPECT_EQ( scans_n * MESSAGES_SIZE / 8, found );
+
+    found = 0;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &start );
+    for ( uint32_t scan_i = 0; scan_i < scans_n; scan_i++ )
+        for ( uint32_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+            if ( 0 == legacy[message_i].created_at || legacy[message_i].transmitted )
+                found++;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &finish );
+    double legacyHoleScan = cpuNanos( start, finish ) / scans_n;
+    EXPECT_EQ( 0U, found );
+
+    // Headers / bodies / devices bitsets
+    found = 0;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &start );
+    for ( uint32_t scan_i = 0; scan_i < scans_n; scan_i++ )
+        for ( uint32_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+            if ( headers[message_i].created_at > 0 && !bitset_test( devices + message_i * words_n, aemIndex )
+                 && 0 == headers[message_i].transmitted_to_recipient )
+                found++;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &finish );
+    double splitPendingScan = cpuNanos( start, finish ) / scans_n;
+    EXPECT_EQ( scans_n * MESSAGES_SIZE / 8, found );
+
+    found = 0;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &start );
+    for ( uint32_t scan_i = 0; scan_i < scans_n; scan_i++ )
+        for ( uint32_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+            if ( 0 == headers[message_i].created_at || headers[message_i].transmitted )
+                found++;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &finish );
+    double splitHoleScan = cpuNanos( start, finish ) / scans_n;
+    EXPECT_EQ( 0U, found );
+
+    size_t legacyFootprint = MESSAGES_SIZE * sizeof( LegacyMessage<devices_n> );
+    size_t splitFootprint = MESSAGES_SIZE * ( sizeof( MessageHeader ) + MESSAGE_BODY_LEN + words_n * sizeof( uint64_t ) );
+
+    GOUT( source << " ( " << devices_n << " devices ): footprint = " << legacyFootprint / 1024 << "KiB > " << splitFootprint / 1024 << "KiB" );
+    GOUT( source << " ( " << devices_n << " devices ): pending scan = " << legacyPendingScan / 1000 << "us > " << splitPendingScan / 1000
+                 << "us, hole scan = " << legacyHoleScan / 1000 << "us > " << splitHoleScan / 1000 << "us ( " << MESSAGES_SIZE << " slots )" );
+
+    free( devices );
+    free( bodies );
+    free( headers );
+    free( legacy );
+}
+
+/// \brief Compares the $messages store layouts for "list" & "range" AEM sources ( as built, every slot holds
+/// $MESSAGE_DEVICES_MAX device bits ).
+TEST_F(ServerTest, DISABLED_Benchmark_StoreLayout)
+{
+    benchmarkStoreLayout<CLIENT_AEM_LIST_LENGTH>( "list" );
+    benchmarkStoreLayout<CLIENT_AEM_RANGE_LENGTH>( "range" );
+
+    GOUT( "as built: footprint = " << MESSAGES_SIZE * ( sizeof( MessageHeader ) + MESSAGE_BODY_LEN + MESSAGE_DEVICES_WORDS * sizeof( uint64_t ) ) / 1024
+                 << "KiB + pending bitsets = " << MESSAGE_DEVICES_MAX * MESSAGES_PENDING_WORDS * sizeof( uint64_t ) / 1024 << "KiB" );
+}
+
+/// \brief Measures per-contact CPU time of finding the messages pending for a device as the store fills, by scanning all
+/// slots ( as before ) vs. with the per-device pending bitsets. Only 2 messages are new for the device on each contact.
+TEST_F(ServerTest, DISABLED_Benchmark_PendingPerContact)
+{
+    const uint32_t contacts_n = 10000;
+    Device device = {.AEM = 8600, .aemIndex = binary_search_index( CLIENT_AEM_LIST, CLIENT_AEM_LIST_LENGTH, 8600 )};
+    auto *legacy = (LegacyMessage<CLIENT_AEM_LIST_LENGTH> *) calloc( MESSAGES_SIZE, sizeof( LegacyMessage<CLIENT_AEM_LIST_LENGTH> ) );
+    Message message;
+    struct timespec start, finish;
+
+    for ( uint32_t fill : {MESSAGES_SIZE / 10, MESSAGES_SIZE / 4, MESSAGES_SIZE / 2, MESSAGES_SIZE} )
+    {
+        messages_reset();
+        memset( legacy, 0, MESSAGES_SIZE * sizeof( LegacyMessage<CLIENT_AEM_LIST_LENGTH> ) );
+        for ( uint32_t message_i = 0; message_i < fill; message_i++ )
+        {
+            generateRandomMessage( &message );
+            message.recipient = 8723;
+            message.created_at += message_i;
+            if ( message_i < fill - 2 )
+                bitset_set( message.transmitted_devices, device.aemIndex );
+            messages_push( &message );
+
+            legacy[message_i].created_at = message.created_at;
+            legacy[message_i].transmitted_devices[ device.aemIndex ] = message_i < fill - 2;
+        }
+
+        // Scan all slots
+        uint32_t found = 0;
+        clock_gettime( CLOCK_THREAD_CPUTIME_ID, &start );
+        for ( uint32_t contact_i = 0; contact_i < contacts_n; contact_i++ )
+            for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+                if ( legacy[message_i].created_at > 0
+                     && 0 == legacy[message_i].transmitted_devices[ device.aemIndex ]
+                     && 0 == legacy[message_i].transmitted_to_recipient )
+                    found++;
+        clock_gettime( CLOCK_THREAD_CPUTIME_ID, &finish );
+        double scanCost = ( ( finish.tv_sec - start.tv_sec ) * 1e9 + ( finish.tv_nsec - start.tv_nsec ) ) / contacts_n;
+        EXPECT_EQ( 2 * contacts_n, found );
+
+        // Pending bitsets
+        found = 0;
+        clock_gettime( CLOCK_THREAD_CPUTIME_ID, &start );
+        for ( uint32_t contact_i = 0; contact_i < contacts_n; contact_i++ )
+            for ( int32_t message_i = messages_next_pending( 0, device.aemIndex ); message_i >= 0;
+                  message_i = messages_next_pending( (uint16_t) ( message_i + 1 ), device.aemIndex ) )
+                found++;
+        clock_gettime( CLOCK_THREAD_CPUTIME_ID, &finish );
+        double bitsetCost = ( ( finish.tv_sec - start.tv_sec ) * 1e9 + ( finish.tv_nsec - start.tv_nsec ) ) / contacts_n;
+        EXPECT_EQ( 2 * contacts_n, found );
+
+        GOUT( "store = " << fill << " messages: slot scan = " << scanCost << "ns / contact, pending bitset = " << bitsetCost << "ns / contact" );
+    }
+
+    free( legacy );
+}
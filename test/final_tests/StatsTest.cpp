@@ -0,0 +1,181 @@
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "server.h"
+    #include "stats.h"
+    #include "utils.h"
+
+    #include <pthread.h>
+    #include <time.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Runs $update on $threads_n threads, $updates_n times each.
+/// \return throughput ( updates per usec )
+template <typename Update>
+static double runThreads(uint32_t threads_n, uint32_t updates_n, Update update)
+{
+    std::vector<std::thread> threads;
+
+    uint64_t start = nowNanos();
+    for ( uint32_t thread_i = 0; thread_i < threads_n; thread_i++ )
+    {
+        threads.emplace_back( [&]() {
+            for ( uint32_t update_i = 0; update_i < updates_n; update_i++ )
+                update();
+        } );
+    }
+    for ( auto &thread : threads )
+        thread.join();
+
+    return (double) threads_n * updates_n * 1000.0 / (double) ( nowNanos() - start );
+}
+
+class StatsTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        stats_reset();
+    }
+
+    void TearDown() override
+    {
+        stats_reset();
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests stats > stats_add() function: counters run past the 16-bit range & snapshots read them.
+TEST_F(StatsTest, Counters64Bit)
+{
+    MessagesStats messagesStats;
+    SessionStats sessionStats;
+
+    for ( uint32_t update_i = 0; update_i < 70000; update_i++ )
+        stats_add( STATS_PRODUCED, 1 );
+    stats_add( STATS_PRODUCED_DELAY, 70000 * 60 );
+    stats_add( STATS_BYTES_SENT, (uint64_t) 1 << 40 );
+    stats_add( STATS_BYTES_SENT, (uint64_t) 1 << 40 );
+
+    EXPECT_EQ( 70000U, stats_counter( STATS_PRODUCED ) );
+    EXPECT_EQ( (uint64_t) 1 << 41, stats_counter( STATS_BYTES_SENT ) );
+    EXPECT_EQ( 0U, stats_counter( STATS_RECEIVED ) );
+
+    stats_messages( &messagesStats );
+    EXPECT_EQ( 70000U, messagesStats.produced );
+    EXPECT_FLOAT_EQ( 1.0F, messagesStats.producedDelayAvg );
+    stats_sessions( &sessionStats );
+    EXPECT_EQ( (uint64_t) 1 << 41, sessionStats.bytes_sent );
+
+    // Reset
+    stats_reset();
+    EXPECT_EQ( 0U, stats_counter( STATS_PRODUCED ) );
+    stats_messages( &messagesStats );
+    EXPECT_FLOAT_EQ( 0.0F, messagesStats.producedDelayAvg );
+}
+
+/// \brief Tests stats > stats_add() & stats_gauge_add() functions: no update of concurrent threads is lost.
+TEST_F(StatsTest, ConcurrentUpdates)
+{
+    const uint32_t threads_n = 8, updates_n = 200000;
+
+    runThreads( threads_n, updates_n, []() {
+        stats_add( STATS_RECEIVED, 1 );
+        stats_add( STATS_BYTES_RECEIVED, 3 );
+        stats_gauge_add( STATS_ACTIVE_SESSIONS, 1 );
+    } );
+    runThreads( threads_n, updates_n / 2, []() { stats_gauge_add( STATS_ACTIVE_SESSIONS, -1 ); } );
+
+    EXPECT_EQ( (uint64_t) threads_n * updates_n, stats_counter( STATS_RECEIVED ) );
+    EXPECT_EQ( (uint64_t) 3 * threads_n * updates_n, stats_counter( STATS_BYTES_RECEIVED ) );
+    EXPECT_EQ( (int64_t) threads_n * updates_n / 2, stats_gauge( STATS_ACTIVE_SESSIONS ) );
+}
+
+/// \brief Tests buffer occupancy gauge: it follows $messages circle buffer ( pushes, evictions, reset ) & survives
+/// stats_reset().
+TEST_F(StatsTest, BufferedGauge)
+{
+    Message message;
+    MessagesStats messagesStats;
+
+    CLIENT_AEM = 9026;
+    messages_reset();
+    EXPECT_EQ( 0, stats_gauge( STATS_BUFFERED ) );
+
+    for ( uint32_t message_i = 0; message_i < MESSAGES_SIZE + 10; message_i++ )
+    {
+        generateRandomMessage( &message );
+        message.created_at = 1561669840 + message_i;
+        messages_push( &message );
+        if ( 10 == message_i )
+            EXPECT_EQ( 11, stats_gauge( STATS_BUFFERED ) );
+    }
+    EXPECT_EQ( MESSAGES_SIZE, stats_gauge( STATS_BUFFERED ) );
+
+    stats_reset();
+    stats_messages( &messagesStats );
+    EXPECT_EQ( MESSAGES_SIZE, messagesStats.buffered );
+
+    messages_reset();
+    EXPECT_EQ( 0, stats_gauge( STATS_BUFFERED ) );
+}
+
+/// \brief Measures counter updates of 8 threads: sharded counters, against a counter under a mutex ( as
+/// $messagesStatsLock kept them ) & a single shared atomic counter.
+TEST_F(StatsTest, DISABLED_Benchmark_Contention)
+{
+    const uint32_t threads_n = 8, updates_n = 2000000;
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    uint64_t locked = 0, shared = 0;
+
+    double lockedRate = runThreads( threads_n, updates_n, [&]() {
+        pthread_mutex_lock( &lock );
+            locked++;
+        pthread_mutex_unlock( &lock );
+    } );
+    double sharedRate = runThreads( threads_n, updates_n, [&]() {
+        __atomic_fetch_add( &shared, 1, __ATOMIC_RELAXED );
+    } );
+    double shardedRate = runThreads( threads_n, updates_n, []() { stats_add( STATS_TRANSMITTED, 1 ); } );
+
+    GOUT( threads_n << " threads x " << updates_n << " updates ( " << std::thread::hardware_concurrency() << " cpus )" );
+    GOUT( "mutex: " << lockedRate << " updates/usec" );
+    GOUT( "shared atomic: " << sharedRate << " updates/usec" );
+    GOUT( "sharded: " << shardedRate << " updates/usec ( x" << shardedRate / lockedRate << " mutex )" );
+
+    EXPECT_EQ( (uint64_t) threads_n * updates_n, locked );
+    EXPECT_EQ( (uint64_t) threads_n * updates_n, shared );
+    EXPECT_EQ( (uint64_t) threads_n * updates_n, stats_counter( STATS_TRANSMITTED ) );
+}
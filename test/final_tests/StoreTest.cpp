@@ -0,0 +1,310 @@
+#include <cstddef>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "server.h"
+    #include "utils.h"
+    #include "versions.h"
+
+    #include <fcntl.h>
+    #include <signal.h>
+    #include <sys/wait.h>
+    #include <time.h>
+    #include <unistd.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+extern messages_head_t messagesHead;
+extern messages_head_t inboxHead;
+extern uint32_t messagesCount;
+
+static const char *storePath = "store_test.store";
+static const char *seqPath = "store_test.seq";
+static const Device device = {.AEM = 8600, .aemIndex = 5};
+
+//------------------------------------------------------------------------------------------------
+
+static double nowMillis()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (double) now.tv_sec * 1e3 + (double) now.tv_nsec / 1e6;
+}
+
+/// \brief Builds message #$message_i ( its body names $message_i, so that a slot can be checked on its own ).
+static void makeMessage(Message *message, uint32_t message_i)
+{
+    memset( message, 0, sizeof( Message ) );
+    message->sender = 8000 + message_i % 500;
+    message->recipient = 8723;
+    message->created_at = 1561669840 + message_i;
+    snprintf( message->body, MESSAGE_BODY_LEN, "message body #%u", message_i );
+}
+
+/// \brief Counts valid slots of the store & checks each one holds a whole message.
+static uint32_t checkSlots()
+{
+    Message stored, expected;
+    uint32_t valid = 0;
+
+    for ( uint16_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+    {
+        if ( 0 == messages_header( message_i )->created_at )
+            continue;
+
+        messages_get( message_i, &stored );
+        makeMessage( &expected, (uint32_t) ( stored.created_at - 1561669840 ) );
+        EXPECT_EQ( 1, isMessageEqual( expected, stored ) ) << "slot " << message_i;
+        EXPECT_EQ( 0, strcmp( expected.body, stored.body ) ) << "slot " << message_i;
+        valid++;
+    }
+
+    return valid;
+}
+
+/// \brief Forks a device that attaches the store file & pushes messages until it is killed with SIGKILL after
+/// $pushes_n pushes.
+/// \return no. of pushes reported before the kill
+static uint32_t pushUntilKilled(uint32_t pushes_n)
+{
+    int pipe_fd[2];
+    uint32_t pushed = 0;
+
+    EXPECT_EQ( 0, pipe( pipe_fd ) );
+
+    fflush( stdout );
+    pid_t pid = fork();
+    if ( 0 == pid )
+    {
+        Message message;
+
+        close( pipe_fd[0] );
+        messages_attach( storePath );
+        for ( uint32_t message_i = 0; ; message_i++ )
+        {
+            makeMessage( &message, message_i );
+            messages_push( &message );
+            if ( 0 == message_i % 50 )
+                write( pipe_fd[1], &message_i, sizeof( uint32_t ) );
+        }
+    }
+
+    close( pipe_fd[1] );
+    while ( pushed < pushes_n && sizeof( uint32_t ) == read( pipe_fd[0], &pushed, sizeof( uint32_t ) ) );
+    kill( pid, SIGKILL );
+    waitpid( pid, nullptr, 0 );
+    close( pipe_fd[0] );
+
+    return pushed;
+}
+
+class StoreTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        CLIENT_AEM = 9026;
+        remove( storePath );
+        remove( seqPath );
+        messages_reset();
+    }
+
+    void TearDown() override
+    {
+        messages_detach();
+        messages_seq_detach();
+        remove( storePath );
+        remove( seqPath );
+        messages_reset();
+        inbox_reset();
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests server > messages_attach() & messages_detach() functions: messages, their metadata & the heads
+/// survive a restart.
+TEST_F(StoreTest, Reattach)
+{
+    Message message;
+
+    EXPECT_EQ( 0, messages_attach( storePath ) );
+    for ( uint32_t message_i = 0; message_i < 100; message_i++ )
+    {
+        makeMessage( &message, message_i );
+        messages_push( &message );
+    }
+    messages_transmitted( 5, device );
+
+    makeMessage( &message, 1000 );
+    message.recipient = CLIENT_AEM;
+    Device sender = device;
+    inbox_push( &message, &sender );
+
+    messages_detach();
+    EXPECT_EQ( 0U, messagesCount );
+    EXPECT_EQ( 0, inboxHead );
+
+    EXPECT_EQ( 100, messages_attach( storePath ) );
+    EXPECT_EQ( 100, messagesHead );
+    EXPECT_EQ( 1, inboxHead );
+    EXPECT_EQ( 100U, checkSlots() );
+
+    // Metadata, index & pending bitsets
+    messages_get( 5, &message );
+    EXPECT_EQ( 1, message.transmitted );
+    EXPECT_TRUE( bitset_test( message.transmitted_devices, device.aemIndex ) );
+    EXPECT_EQ( 6, messages_next_pending( 5, device.aemIndex ) );
+
+    makeMessage( &message, 7 );
+    EXPECT_EQ( false, messages_push_unique( &message ) );
+    makeMessage( &message, 100 );
+    EXPECT_EQ( true, messages_push_unique( &message ) );
+    EXPECT_EQ( 101, messagesHead );
+}
+
+/// \brief Tests server > messages_attach() function: a store of another device or version starts empty.
+TEST_F(StoreTest, ForeignStoreIsReset)
+{
+    Message message;
+
+    messages_attach( storePath );
+    makeMessage( &message, 0 );
+    messages_push( &message );
+    messages_detach();
+
+    CLIENT_AEM = 8723;
+    EXPECT_EQ( 0, messages_attach( storePath ) );
+    messages_push( &message );
+    messages_detach();
+
+    // Bump version on disk
+    int fd = open( storePath, O_RDWR );
+    uint32_t version = MESSAGES_STORE_VERSION + 1;
+    EXPECT_EQ( (ssize_t) sizeof( uint32_t ), pwrite( fd, &version, sizeof( uint32_t ), offsetof( MessagesStoreHeader, version ) ) );
+    close( fd );
+
+    EXPECT_EQ( 0, messages_attach( storePath ) );
+    EXPECT_EQ( 0, messagesHead );
+}
+
+/// \brief Tests server > messages_seq_attach() function: own messages are numbered on after a restart with the store
+/// reset ( or kept in memory ), so that peers holding a higher version of this device never skip them.
+TEST_F(StoreTest, OwnSequenceSurvivesReset)
+{
+    Message message;
+
+    EXPECT_EQ( 0, messages_seq_attach( seqPath ) );
+    for ( uint32_t message_i = 0; message_i < 3; message_i++ )
+    {
+        makeMessage( &message, message_i );
+        message.sender = CLIENT_AEM;
+        messages_push( &message );
+        EXPECT_EQ( message_i + 1, message.seq );
+    }
+
+    // Restart: store starts empty
+    messages_seq_detach();
+    messages_reset();
+    EXPECT_EQ( 3, messages_seq_attach( seqPath ) );
+
+    makeMessage( &message, 3 );
+    message.sender = CLIENT_AEM;
+    messages_push( &message );
+    EXPECT_EQ( 4U, message.seq );
+    EXPECT_EQ( 4U, messages_versions()->versions[versions_origin( CLIENT_AEM )] );
+
+    // Seq file of another device counts as empty, no seq file: numbered after the store's vector
+    messages_seq_detach();
+    messages_reset();
+    CLIENT_AEM = 8723;
+    EXPECT_EQ( 0, messages_seq_attach( seqPath ) );
+    messages_seq_detach();
+    CLIENT_AEM = 9026;
+    makeMessage( &message, 4 );
+    message.sender = CLIENT_AEM;
+    messages_push( &message );
+    EXPECT_EQ( 1U, message.seq );
+}
+
+/// \brief Tests server > messages_attach() function: after a SIGKILL mid-push every slot holds a whole message & at
+/// most the slot being written is lost.
+TEST_F(StoreTest, KillRetains)
+{
+    pushUntilKilled( 3 * MESSAGES_SIZE );
+
+    int32_t retained = messages_attach( storePath );
+    EXPECT_GE( retained, MESSAGES_SIZE - 1 );
+    EXPECT_EQ( (uint32_t) retained, checkSlots() );
+}
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Measures startup time of a fresh vs. a full reattached store, & messages retained across SIGKILLs at random
+/// points of a push loop.
+TEST_F(StoreTest, DISABLED_Benchmark_WarmRestart)
+{
+    const uint32_t repetitions = 20;
+    Message message;
+    double start, fresh = 0, warm = 0;
+
+    for ( uint32_t repetition_i = 0; repetition_i < repetitions; repetition_i++ )
+    {
+        messages_detach();
+        remove( storePath );
+        start = nowMillis();
+        messages_attach( storePath );
+        fresh += nowMillis() - start;
+
+        for ( uint32_t message_i = 0; message_i < MESSAGES_SIZE; message_i++ )
+        {
+            makeMessage( &message, message_i );
+            messages_push( &message );
+        }
+        messages_detach();
+
+        start = nowMillis();
+        EXPECT_EQ( MESSAGES_SIZE, messages_attach( storePath ) );
+        warm += nowMillis() - start;
+    }
+    messages_detach();
+
+    GOUT( "startup: fresh store = " << fresh / repetitions << "ms, reattach " << MESSAGES_SIZE << " messages = " << warm / repetitions << "ms" );
+
+    // Kill at random points
+    uint32_t retainedMin = MESSAGES_SIZE, retainedTotal = 0;
+    srand( 2278 );
+    for ( uint32_t repetition_i = 0; repetition_i < repetitions; repetition_i++ )
+    {
+        remove( storePath );
+        uint32_t pushed = pushUntilKilled( (uint32_t) ( rand() % ( 2 * MESSAGES_SIZE ) ) );
+
+        int32_t retained = messages_attach( storePath );
+        EXPECT_EQ( (uint32_t) retained, checkSlots() );
+        EXPECT_GE( (uint32_t) retained + 1, std::min( pushed, (uint32_t) MESSAGES_SIZE ) );
+        retainedMin = std::min( retainedMin, (uint32_t) retained );
+        retainedTotal += retained;
+        messages_detach();
+    }
+
+    GOUT( "kill -9: retained avg. = " << (double) retainedTotal / repetitions << " messages, min. = " << retainedMin << " ( before: 0 )" );
+}
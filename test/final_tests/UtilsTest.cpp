@@ -1,103 +1,432 @@
-//#include <stdarg.h>
-//#include <stddef.h>
-//#include <setjmp.h>
-//#include "gtest/gtest.h"
-//extern "C" {
-//    #include "log.h"
-//    #include "utils.h"
-//}
-//
-//
-////------------------------------------------------------------------------------------------------
-//
-//
-//#define MAX_EXECUTION_TIME 10 //7200     // 2 hours
-//
-//static pthread_t pollingThread, producerThread;
-//pthread_mutex_t availableThreadsLock, messagesBufferLock, activeDevicesLock, messagesStatsLock;
-//
-//pthread_t communicationThreads[COMMUNICATION_WORKERS_MAX];
-//uint8_t communicationThreadsAvailable = COMMUNICATION_WORKERS_MAX;
-//
-//MessagesStats messagesStats;
-//
-////------------------------------------------------------------------------------------------------
-//
-//
-//class UtilsTest : public ::testing::Test {
-//
-//protected:
-//
-//    void SetUp() override
-//    {
-//        // Init a random message
-//        message.transmitted = 0;
-//        message.sender = 9026;
-//        message.recipient = 8908;
-//        snprintf( message.body, 256, "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Nunc pharetra commodo ligula, id tempor ligula feugiat eu. Quisque condimentum tortor et nunc cursus, suscipit mollis tellus volutpat. Proin semper venenatis eros, eget faucibus nibh facilisis metus" );
-//        message.created_at = 1561669840;    // 06/27/2019 @ 9:10pm (UTC)
-//
-//        // Implode Message
-//        messageSerialized = (char *) malloc( 277 );
-//        snprintf( messageSerialized, 277, "%d_%d_%ld_%s", message.sender, message.recipient, message.created_at, message.body );
-//    }
-//
-//    Message message{};
-//    MessageSerialized messageSerialized{};
-//
-//};
-//
-//
-////------------------------------------------------------------------------------------------------
-//
-//
-///// \brief Tests utils > explode() function.
-//TEST_F(UtilsTest, Explode)
-//{
-//    Message myMessage;
-//
-//    // Perform explode()
-//    myMessage = explode( "_", messageSerialized );
-//
-//    // Check Result
-//    EXPECT_EQ( message.sender, myMessage.sender );
-//    EXPECT_EQ( message.recipient, myMessage.recipient );
-//    EXPECT_EQ( message.created_at, myMessage.created_at );
-//    EXPECT_STREQ( message.body, myMessage.body );
-//}
-//
-///// \brief Tests utils > inspect() function.
-//TEST_F(UtilsTest, Implode)
-//{
-//    MessageSerialized myMessageSerialized;
-//    myMessageSerialized = (char *)malloc( 277 );
-//
-//    // Perform implode()
-//    implode( "_", message, myMessageSerialized );
-//
-//    // Check result
-//    EXPECT_STREQ( myMessageSerialized, messageSerialized );
-//}
-//
-///// \brief Tests utils > isMessageEqual() function.
-//TEST_F(UtilsTest, IsMessageEqual)
-//{
-//    Message myMessage, myMessageDifferent;
-//
-//    // Check equality
-//    memcpy( &myMessage, &message, sizeof( Message ) );
-//    EXPECT_EQ( 1, isMessageEqual( myMessage, message ) );
-//
-//    // Check non-equality
-//    myMessageDifferent = generateRandomMessage();
-//    EXPECT_EQ( 0, isMessageEqual( message, myMessageDifferent ) );
-//}
-//
-///// \brief Tests utils > ip2aem() function.
-//TEST_F(UtilsTest, Ip2Aem)
-//{
-//    uint32_t aem = 9026;
-//    char *ip = "10.0.90.26";
-//
-//    EXPECT_EQ( 9026, ip2aem( ip ) );
-//}
+#include <cstddef>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "utils.h"
+
+    #include <malloc.h>
+    #include <time.h>
+}
+
+#define GOUT(STREAM) \
+    do \
+    { \
+        std::stringstream ss; \
+        ss << STREAM << std::endl; \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_GREEN, "[ INFO ] "); \
+        testing::internal::ColoredPrintf(testing::internal::COLOR_YELLOW, ss.str().c_str()); \
+    } while (false); \
+
+//------------------------------------------------------------------------------------------------
+
+static uint64_t nowNanos()
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/// \brief Serializes $message as implode() did before ( snprintf() ).
+static void legacyImplode(const char *glue, const Message &message, char *messageSerialized)
+{
+    snprintf( messageSerialized, MESSAGE_SERIALIZED_LEN, "%04d%s%04d%s%010llu%s%s",
+              message.sender, glue, message.recipient, glue, (unsigned long long) message.created_at, glue, message.body );
+}
+
+/// \brief Un-serializes $messageSerialized as explode() did before ( strsep() & strtol() on a copy ).
+static void legacyExplode(Message *message, const char *glue, const char *messageSerialized)
+{
+    char *messageCopy = strdup( messageSerialized );
+    char *field = messageCopy;
+
+    memset( message, 0, sizeof( Message ) );
+    message->sender = (uint32_t) strtol( strsep( &field, glue ), nullptr, STRSEP_BASE_10 );
+    message->recipient = (uint32_t) strtol( strsep( &field, glue ), nullptr, STRSEP_BASE_10 );
+    message->created_at = (uint64_t) strtoll( strsep( &field, glue ), nullptr, STRSEP_BASE_10 );
+    strncpy( message->body, strsep( &field, glue ), MESSAGE_BODY_LEN - 1 );
+
+    free( messageCopy );
+}
+
+/// \brief Builds message #$message_i with a body of $body_length characters.
+static void makeMessage(Message *message, uint32_t message_i, uint16_t body_length)
+{
+    memset( message, 0, sizeof( Message ) );
+    message->sender = 8000 + message_i % 1000;
+    message->recipient = 8500 + message_i % 50;
+    message->created_at = 1561669840 + message_i;
+    for ( uint16_t char_i = 0; char_i < body_length; char_i++ )
+        message->body[char_i] = (char) ( MESSAGE_BODY_ASCII_MIN + ( message_i + char_i ) % ( MESSAGE_BODY_ASCII_MAX - MESSAGE_BODY_ASCII_MIN ) );
+}
+
+/// \brief Formats $timestamp as timestamp2ftime() did before ( localtime() & strftime() into a fresh buffer ).
+static char *legacyTimestamp2ftime(uint64_t timestamp, const char *format)
+{
+    char *string = (char *) malloc( STRFTIME_STR_LEN );
+    time_t time = (time_t) timestamp;
+
+    strftime( string, STRFTIME_STR_LEN, format, localtime( &time ) );
+    return string;
+}
+
+/// \brief Sets local time zone to $zone ( NULL for the one of the system ) & drops hours timestamp2ftime() cached.
+static void setZone(const char *zone)
+{
+    if ( nullptr == zone )
+        unsetenv( "TZ" );
+    else
+        setenv( "TZ", zone, 1 );
+    tzset();
+    timestamp_zone_changed();
+}
+
+class UtilsTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        // Init a message
+        memset( &message, 0, sizeof( Message ) );
+        message.sender = 9026;
+        message.recipient = 8908;
+        snprintf( message.body, 256, "Lorem ipsum dolor sit amet, consectetur adipiscing elit. Nunc pharetra commodo ligula, id tempor ligula feugiat eu. Quisque condimentum tortor et nunc cursus, suscipit mollis tellus volutpat. Proin semper venenatis eros, eget faucibus nibh facilisis metus" );
+        message.created_at = 1561669840;    // 06/27/2019 @ 9:10pm (UTC)
+
+        // Implode Message
+        snprintf( messageSerialized, 277, "%u_%u_%llu_%s", message.sender, message.recipient, (unsigned long long) message.created_at, message.body );
+    }
+
+    Message message{};
+    char messageSerialized[MESSAGE_SERIALIZED_LEN]{};
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests utils > explode() function.
+TEST_F(UtilsTest, Explode)
+{
+    Message myMessage;
+
+    // Perform explode()
+    explode( &myMessage, "_", messageSerialized );
+
+    // Check Result
+    EXPECT_EQ( message.sender, myMessage.sender );
+    EXPECT_EQ( message.recipient, myMessage.recipient );
+    EXPECT_EQ( message.created_at, myMessage.created_at );
+    EXPECT_STREQ( message.body, myMessage.body );
+}
+
+/// \brief Tests utils > implode() function.
+TEST_F(UtilsTest, Implode)
+{
+    char myMessageSerialized[MESSAGE_SERIALIZED_LEN];
+
+    // Perform implode()
+    implode( "_", message, myMessageSerialized );
+
+    // Check result
+    EXPECT_STREQ( myMessageSerialized, messageSerialized );
+}
+
+/// \brief Tests utils > implode() function: the record is zero-padded after the body whatever the buffer held, so
+/// that no stale bytes are sent or stored & equal messages give equal records.
+TEST_F(UtilsTest, ImplodePadding)
+{
+    char record[MESSAGE_SERIALIZED_LEN];
+    Message myMessage;
+
+    for ( const char *glue : {"_", "__"} )
+    {
+        makeMessage( &myMessage, 3, 10 );
+        memset( record, '#', MESSAGE_SERIALIZED_LEN );
+        implode( glue, myMessage, record );
+
+        size_t length = strlen( record );
+        ASSERT_LT( length, (size_t) MESSAGE_SERIALIZED_LEN ) << glue;
+        for ( size_t byte_i = length; byte_i < MESSAGE_SERIALIZED_LEN; byte_i++ )
+            EXPECT_EQ( '\0', record[byte_i] ) << glue << ", " << byte_i;
+    }
+}
+
+/// \brief Tests utils > isMessageEqual() function.
+TEST_F(UtilsTest, IsMessageEqual)
+{
+    Message myMessage, myMessageDifferent;
+
+    // Check equality
+    memcpy( &myMessage, &message, sizeof( Message ) );
+    EXPECT_EQ( 1, isMessageEqual( myMessage, message ) );
+
+    // Check non-equality
+    generateRandomMessage( &myMessageDifferent );
+    EXPECT_EQ( 0, isMessageEqual( message, myMessageDifferent ) );
+}
+
+/// \brief Tests utils > ip2aem() function.
+TEST_F(UtilsTest, Ip2Aem)
+{
+    EXPECT_EQ( 9026U, ip2aem( "10.0.90.26" ) );
+    EXPECT_EQ( 1U, ip2aem( "10.0.0.1" ) );
+    EXPECT_EQ( 8600U, ip2aem( "127.0.86.00" ) );
+    EXPECT_EQ( 7051U, ip2aem( "10.0.70.51\n" ) );       // as getClientAem() formats it
+}
+
+/// \brief Tests utils > implode() & explode() functions: output matches the snprintf() / strtol() codec for random
+/// messages, empty & longest bodies, fields of other widths & glue of many characters.
+TEST_F(UtilsTest, CodecCompatibility)
+{
+    char serialized[MESSAGE_SERIALIZED_LEN], legacySerialized[MESSAGE_SERIALIZED_LEN];
+    Message myMessage, legacyMessage;
+
+    for ( uint32_t message_i = 0; message_i < 1000; message_i++ )
+    {
+        makeMessage( &myMessage, message_i, (uint16_t) ( message_i % MESSAGE_BODY_LEN ) );
+        if ( 0 == message_i % 7 )
+            myMessage.sender = message_i % 10;
+        if ( 0 == message_i % 11 )
+            myMessage.created_at = message_i;
+        if ( 0 == message_i % 13 )
+            myMessage.recipient = 10000 + message_i;
+        if ( 0 == message_i % 17 )
+            myMessage.created_at = 10000000000ULL + message_i;
+
+        for ( const char *glue : {"_", "__"} )
+        {
+            implode( glue, myMessage, serialized );
+            legacyImplode( glue, myMessage, legacySerialized );
+            ASSERT_STREQ( legacySerialized, serialized ) << message_i;
+        }
+
+        explode( &message, "_", serialized );
+        legacyExplode( &legacyMessage, "_", serialized );
+        EXPECT_EQ( legacyMessage.sender, message.sender ) << message_i;
+        EXPECT_EQ( legacyMessage.recipient, message.recipient ) << message_i;
+        EXPECT_EQ( legacyMessage.created_at, message.created_at ) << message_i;
+        EXPECT_STREQ( legacyMessage.body, message.body ) << message_i;
+    }
+
+    // Hand-written records of other widths
+    for ( const char *record : {"1_2_3_body", "0001_0002_0000000003_", "12345_8600_1561669840_body"} )
+    {
+        explode( &message, "_", record );
+        legacyExplode( &legacyMessage, "_", record );
+        EXPECT_EQ( legacyMessage.sender, message.sender ) << record;
+        EXPECT_EQ( legacyMessage.recipient, message.recipient ) << record;
+        EXPECT_EQ( legacyMessage.created_at, message.created_at ) << record;
+        EXPECT_STREQ( legacyMessage.body, message.body ) << record;
+    }
+
+    // Truncated record ( strsep() returned NULL before )
+    explode( &message, "_", "9026_8908" );
+    EXPECT_EQ( 9026U, message.sender );
+    EXPECT_EQ( 8908U, message.recipient );
+    EXPECT_EQ( 0U, message.created_at );
+    EXPECT_STREQ( "", message.body );
+}
+
+/// \brief Tests utils > explode() function: a received record is parsed in place, without a terminating NUL & without
+/// being modified ( sequence number follows it ).
+TEST_F(UtilsTest, ExplodeInPlace)
+{
+    char record[MESSAGE_SEQUENCED_LEN];
+    char recordCopy[MESSAGE_SEQUENCED_LEN];
+    Message myMessage;
+
+    makeMessage( &message, 7, MESSAGE_BODY_LEN - 1 );
+    implode( "_", message, record );
+    uint2digits( 4294967295U, record + MESSAGE_SERIALIZED_LEN, 10 );
+    memcpy( recordCopy, record, MESSAGE_SEQUENCED_LEN );
+
+    explode( &myMessage, "_", record );
+    EXPECT_EQ( 1, isMessageEqual( message, myMessage ) );
+    EXPECT_EQ( 4294967295U, digits2uint( record + MESSAGE_SERIALIZED_LEN, 10 ) );
+    EXPECT_EQ( 0, memcmp( record, recordCopy, MESSAGE_SEQUENCED_LEN ) );
+}
+
+/// \brief Tests utils > implode(), explode() & ip2aem() functions: heap stays the same however many messages pass.
+TEST_F(UtilsTest, CodecAllocationFree)
+{
+    char serialized[MESSAGE_SERIALIZED_LEN];
+    Message myMessage;
+
+    size_t heapBefore = mallinfo2().uordblks;
+    for ( uint32_t message_i = 0; message_i < 10000; message_i++ )
+    {
+        makeMessage( &myMessage, message_i, 64 );
+        implode( "_", myMessage, serialized );
+        explode( &myMessage, "_", serialized );
+        EXPECT_EQ( 9026U, ip2aem( "10.0.90.26" ) );
+    }
+
+    EXPECT_EQ( heapBefore, mallinfo2().uordblks );
+}
+
+/// \brief Tests utils > timestamp2ftime() function: cached formats match strftime() second by second across hours, days
+/// & a DST change, in zones of whole & half-hour offsets, & after the zone changed; other formats go to strftime().
+TEST_F(UtilsTest, Timestamp2ftime)
+{
+    char buffer[STRFTIME_STR_LEN];
+
+    // 2019-03-31 ( Athens: 03:00 -> 04:00 ), 2019-06-27 ( this suite's message ), 2019-10-27 ( Athens: 04:00 -> 03:00 )
+    const uint64_t days[] = {1553990400, 1561593600, 1572134400};
+    for ( const char *zone : {"Europe/Athens", "Asia/Kolkata", "UTC"} )
+    {
+        setZone( zone );
+        for ( uint64_t day : days )
+        {
+            for ( uint64_t timestamp = day - 3600; timestamp < day + 86400 + 3600; timestamp += 7 )
+            {
+                for ( const char *format : {"%FT%TZ", "%H:%M:%S"} )
+                {
+                    char *expected = legacyTimestamp2ftime( timestamp, format );
+                    ASSERT_STREQ( expected, timestamp2ftime( timestamp, format, buffer ) ) << zone << ", " << timestamp;
+                    free( expected );
+                }
+            }
+        }
+    }
+
+    // Going back in time, & a format of its own
+    setZone( "Europe/Athens" );
+    EXPECT_STREQ( "2019-06-28T00:10:40Z", timestamp2ftime( message.created_at, "%FT%TZ", buffer ) );
+    EXPECT_STREQ( "2019-06-27T23:59:59Z", timestamp2ftime( 1561669199, "%FT%TZ", buffer ) );
+    EXPECT_STREQ( "Fri, 28 Jun 2019 @ 00:10:40", timestamp2ftime( message.created_at, "%a, %d %b %Y @ %T", buffer ) );
+    EXPECT_EQ( buffer, timestamp2ftime( message.created_at, "%H:%M:%S", buffer ) );
+    EXPECT_STREQ( "00:10:40", buffer );
+
+    // Cached hour is dropped with the zone
+    setZone( "UTC" );
+    EXPECT_STREQ( "21:10:40", timestamp2ftime( message.created_at, "%H:%M:%S", buffer ) );
+
+    setZone( nullptr );
+}
+
+/// \brief Tests utils > timestamp2ftime() function: heap stays the same over a simulated 2-hour session ( a few
+/// timestamps formatted every second ).
+TEST_F(UtilsTest, Timestamp2ftimeAllocationFree)
+{
+    char buffer[STRFTIME_STR_LEN];
+    uint64_t checksum = 0;
+
+    setZone( "Europe/Athens" );
+    timestamp2ftime( message.created_at, "%a, %d %b %Y @ %T", buffer );
+
+    size_t heapBefore = mallinfo2().uordblks;
+    for ( uint64_t second = 0; second < 2 * 3600; second++ )
+    {
+        checksum += (uint8_t) timestamp2ftime( message.created_at + second, "%FT%TZ", buffer )[18];
+        checksum += (uint8_t) timestamp2ftime( message.created_at + second, "%H:%M:%S", buffer )[7];
+        checksum += (uint8_t) timestamp2ftime( message.created_at - second, "%FT%TZ", buffer )[18];
+        checksum += (uint8_t) timestamp2ftime( message.created_at + second, "%a, %d %b %Y @ %T", buffer )[0];
+    }
+
+    EXPECT_EQ( heapBefore, mallinfo2().uordblks );
+    EXPECT_NE( 0U, checksum );
+
+    setZone( nullptr );
+}
+
+/// \brief Compares cost per message of the snprintf() / strtol() codec vs. the fixed-width codec, for short & longest
+/// bodies, & cost of ip2aem().
+TEST_F(UtilsTest, DISABLED_Benchmark_TextCodec)
+{
+    const uint32_t messages_n = 200000;
+    char serialized[MESSAGE_SERIALIZED_LEN];
+    Message myMessage;
+    uint64_t checksum = 0;
+
+    for ( uint16_t body_length : {16, MESSAGE_BODY_LEN - 1} )
+    {
+        double costs[4];
+
+        makeMessage( &message, 0, body_length );
+        for ( uint32_t variant_i = 0; variant_i < 2; variant_i++ )
+        {
+            uint64_t start = nowNanos();
+            for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+            {
+                message.created_at = 1561669840 + message_i;
+                if ( 0 == variant_i )
+                    legacyImplode( "_", message, serialized );
+                else
+                    implode( "_", message, serialized );
+                checksum += (uint8_t) serialized[message_i % 21];
+            }
+            costs[2 * variant_i] = (double) ( nowNanos() - start ) / messages_n;
+
+            start = nowNanos();
+            for ( uint32_t message_i = 0; message_i < messages_n; message_i++ )
+            {
+                if ( 0 == variant_i )
+                    legacyExplode( &myMessage, "_", serialized );
+                else
+                    explode( &myMessage, "_", serialized );
+                checksum += myMessage.created_at;
+            }
+            costs[2 * variant_i + 1] = (double) ( nowNanos() - start ) / messages_n;
+        }
+
+        GOUT( "body = " << body_length << ": snprintf / strtol = " << costs[0] << "ns implode, " << costs[1]
+              << "ns explode; fixed-width = " << costs[2] << "ns implode, " << costs[3] << "ns explode" );
+    }
+
+    uint64_t start = nowNanos();
+    for ( uint32_t ip_i = 0; ip_i < messages_n; ip_i++ )
+        checksum += ip2aem( "10.0.90.26" );
+    GOUT( "ip2aem = " << (double) ( nowNanos() - start ) / messages_n << "ns" );
+
+    EXPECT_NE( 0U, checksum );
+}
+
+/// \brief Compares formats per second of localtime() & strftime() into a fresh buffer vs. timestamp2ftime(), & heap
+/// either one leaves behind over a simulated 2-hour session ( 100 timestamps formatted every second ).
+TEST_F(UtilsTest, DISABLED_Benchmark_Timestamp2ftime)
+{
+    const uint32_t perSecond = 100, seconds_n = 2 * 3600;
+    char buffer[STRFTIME_STR_LEN];
+    uint64_t checksum = 0;
+
+    setZone( "Europe/Athens" );
+    for ( const char *format : {"%FT%TZ", "%H:%M:%S"} )
+    {
+        std::vector<char *> strings;
+        strings.reserve( perSecond * seconds_n );
+
+        // Before: fresh buffer per call ( never freed by callers )
+        size_t heapBefore = mallinfo2().uordblks;
+        uint64_t start = nowNanos();
+        for ( uint32_t second = 0; second < seconds_n; second++ )
+            for ( uint32_t format_i = 0; format_i < perSecond; format_i++ )
+                strings.push_back( legacyTimestamp2ftime( message.created_at + second, format ) );
+        double legacyRate = 1e9 * perSecond * seconds_n / (double) ( nowNanos() - start );
+        size_t legacyHeap = mallinfo2().uordblks - heapBefore - strings.capacity() * sizeof( char * );
+        for ( char *string : strings )
+        {
+            checksum += (uint8_t) string[7];
+            free( string );
+        }
+
+        heapBefore = mallinfo2().uordblks;
+        start = nowNanos();
+        for ( uint32_t second = 0; second < seconds_n; second++ )
+            for ( uint32_t format_i = 0; format_i < perSecond; format_i++ )
+                checksum += (uint8_t) timestamp2ftime( message.created_at + second, format, buffer )[7];
+        double cachedRate = 1e9 * perSecond * seconds_n / (double) ( nowNanos() - start );
+        size_t cachedHeap = mallinfo2().uordblks - heapBefore;
+
+        GOUT( format << ": localtime / strftime = " << legacyRate / 1e6 << "M formats/s ( heap after 2h: "
+              << legacyHeap / 1024 << " KiB ), cached = " << cachedRate / 1e6 << "M formats/s ( heap after 2h: "
+              << cachedHeap / 1024 << " KiB )" );
+    }
+
+    setZone( nullptr );
+    EXPECT_NE( 0U, checksum );
+}
@@ -0,0 +1,197 @@
+#include <cstddef>
+#include <vector>
+#include "gtest/gtest.h"
+extern "C" {
+    #include "conf.h"
+    #include "types.h"
+    #include "server.h"
+    #include "versions.h"
+}
+
+//------------------------------------------------------------------------------------------------
+
+extern uint32_t CLIENT_AEM;
+
+static const Device device = {.AEM = 8001, .aemIndex = 2};
+
+//------------------------------------------------------------------------------------------------
+
+/// \brief Builds a message of $sender numbered $seq ( distinct for distinct pairs ).
+static void makeMessage(Message *message, uint32_t sender, uint32_t seq)
+{
+    memset( message, 0, sizeof( Message ) );
+    message->sender = sender;
+    message->recipient = 8888;
+    message->created_at = 1561669840 + seq;
+    message->seq = seq;
+    snprintf( message->body, MESSAGE_BODY_LEN, "message #%u of %04u", seq, sender );
+}
+
+/// \brief Walks $messages with a fresh cursor.
+/// \return ( sender, seq ) of the missing messages, in the order they are returned
+static std::vector<std::pair<uint32_t, uint32_t>> missing(const uint32_t *versions)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> result;
+    MessagesCursor cursor = {};
+    Message message;
+    int32_t slot;
+
+    while ( -1 != ( slot = messages_next_missing( &cursor, versions, device.aemIndex ) ) )
+    {
+        messages_get( (uint16_t) slot, &message );
+        result.emplace_back( message.sender, message.seq );
+    }
+
+    return result;
+}
+
+class VersionsTest : public ::testing::Test {
+
+protected:
+
+    void SetUp() override
+    {
+        CLIENT_AEM = 9026;
+        messages_init( "blind" );
+    }
+
+    void TearDown() override
+    {
+        messages_init( MESSAGES_PUSH_OVERRIDE_POLICY );
+    }
+
+};
+
+
+//------------------------------------------------------------------------------------------------
+
+
+/// \brief Tests versions > versions_seen() function: the prefix advances over sequence numbers seen out of order, as
+/// long as they are in the window.
+TEST_F(VersionsTest, SeenAdvancesPrefix)
+{
+    VersionVector vector = {};
+    int32_t origin = versions_origin( 8600 );
+
+    ASSERT_EQ( 5, origin );
+    EXPECT_EQ( -1, versions_origin( 8601 ) );
+
+    versions_seen( &vector, origin, 1 );
+    versions_seen( &vector, origin, 1 );
+    EXPECT_EQ( 1U, vector.versions[origin] );
+
+    // 3 & 4 wait for 2
+    versions_seen( &vector, origin, 4 );
+    versions_seen( &vector, origin, 3 );
+    EXPECT_EQ( 1U, vector.versions[origin] );
+    versions_seen( &vector, origin, 2 );
+    EXPECT_EQ( 4U, vector.versions[origin] );
+    EXPECT_EQ( 0U, vector.seen[origin] );
+
+    // Beyond the window: forgotten
+    versions_seen( &vector, origin, 4 + 1 + VERSIONS_WINDOW + 1 );
+    versions_seen( &vector, origin, 4 + 1 + VERSIONS_WINDOW );
+    versions_seen( &vector, origin, 5 );
+    EXPECT_EQ( 5U, vector.versions[origin] );
+    for ( uint32_t seq = 6; seq < 5 + VERSIONS_WINDOW; seq++ )
+        versions_seen( &vector, origin, seq );
+    EXPECT_EQ( 4U + VERSIONS_WINDOW + 1, vector.versions[origin] );
+}
+
+/// \brief Tests versions > versions_pack() & versions_unpack() functions.
+TEST_F(VersionsTest, PackUnpack)
+{
+    static uint8_t packed[VERSIONS_HEADER_LEN + VERSIONS_ENTRY_LEN * MESSAGE_DEVICES_MAX];
+    uint32_t versions[MESSAGE_DEVICES_MAX];
+    VersionVector vector = {};
+
+    vector.versions[versions_origin( 8600 )] = 7;
+    vector.versions[versions_origin( 9999 )] = 123456;
+
+    uint32_t length = versions_pack( &vector, packed );
+    EXPECT_EQ( (uint32_t) VERSIONS_HEADER_LEN + 2 * VERSIONS_ENTRY_LEN, length );
+    EXPECT_EQ( length, versions_length( packed ) );
+
+    ASSERT_EQ( true, versions_unpack( versions, packed ) );
+    EXPECT_EQ( 0, memcmp( versions, vector.versions, sizeof( versions ) ) );
+
+    packed[0] ^= 1;
+    EXPECT_EQ( 0U, versions_length( packed ) );
+    EXPECT_EQ( false, versions_unpack( versions, packed ) );
+}
+
+/// \brief Tests server > messages_next_missing() function: per origin, messages above the device's version in
+/// sequence order, then unsequenced messages; messages the device already got are left out.
+TEST_F(VersionsTest, NextMissingRanges)
+{
+    uint32_t versions[MESSAGE_DEVICES_MAX] = {};
+    Message message;
+
+    for ( uint32_t seq : {1U, 2U, 3U, 4U, 5U} )
+    {
+        makeMessage( &message, 8600, seq );
+        messages_push( &message );
+    }
+    for ( uint32_t seq : {3U, 1U, 2U} )
+    {
+        makeMessage( &message, 8723, seq );
+        messages_push( &message );
+    }
+
+    // Own messages are numbered on push, unknown devices' are unsequenced
+    for ( uint32_t message_i = 0; message_i < 2; message_i++ )
+    {
+        makeMessage( &message, CLIENT_AEM, 0 );
+        message.created_at += message_i;
+        messages_push( &message );
+        EXPECT_EQ( message_i + 1, message.seq );
+    }
+    makeMessage( &message, 8601, 9 );
+    messages_push( &message );
+
+    versions[versions_origin( 8600 )] = 2;
+    std::vector<std::pair<uint32_t, uint32_t>> expected = {
+            {8600, 3}, {8600, 4}, {8600, 5}, {8723, 1}, {8723, 2}, {8723, 3}, {9026, 1}, {9026, 2}, {8601, 9}
+    };
+    EXPECT_EQ( expected, missing( versions ) );
+
+    // Transmitted to device ( slot 6: seq 1 of 8723 ): no longer missing
+    messages_transmitted( 6, device );
+    expected.erase( expected.begin() + 3 );
+    EXPECT_EQ( expected, missing( versions ) );
+
+    EXPECT_EQ( 5U, messages_versions()->versions[versions_origin( 8600 )] );
+    EXPECT_EQ( 3U, messages_versions()->versions[versions_origin( 8723 )] );
+    EXPECT_EQ( 2U, messages_versions()->versions[versions_origin( CLIENT_AEM )] );
+}
+
+/// \brief Tests server > messages_next_missing() function: a cursor whose last slot was evicted resumes above its
+/// sequence number, & messages placed meanwhile are found.
+TEST_F(VersionsTest, NextMissingResumes)
+{
+    uint32_t versions[MESSAGE_DEVICES_MAX] = {};
+    MessagesCursor cursor = {};
+    Message message;
+
+    for ( uint32_t seq = 1; seq <= MESSAGES_SIZE; seq++ )
+    {
+        makeMessage( &message, 8600, seq );
+        messages_push( &message );
+    }
+
+    int32_t slot = messages_next_missing( &cursor, versions, device.aemIndex );
+    ASSERT_EQ( 0, slot );
+
+    // Evicts slot 0
+    makeMessage( &message, 8600, MESSAGES_SIZE + 1 );
+    messages_push( &message );
+
+    slot = messages_next_missing( &cursor, versions, device.aemIndex );
+    messages_get( (uint16_t) slot, &message );
+    EXPECT_EQ( 2U, message.seq );
+
+    uint32_t returned = 2;
+    while ( -1 != ( slot = messages_next_missing( &cursor, versions, device.aemIndex ) ) )
+        returned++;
+    EXPECT_EQ( (uint32_t) MESSAGES_SIZE + 1, returned );
+}
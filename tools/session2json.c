@@ -0,0 +1,48 @@
+#include "binlog.h"
+#include "ndjson.h"
+#include <stdlib.h>
+#include <string.h>
+
+/// \brief Rebuilds session.json document from session log ( session.ndjson ), e.g. of a session that was killed, or
+/// exports it from binary session log ( session.bin, times in local time zone: set TZ to the one of the device ).
+/// \example ./session2json session1.ndjson [session1.json]
+/// \example TZ=Europe/Athens ./session2json session1.bin [session1.json]
+/// \param argc
+/// \param argv
+/// \return
+int main( int argc, char **argv )
+{
+    char jsonFileName[FILENAME_MAX];
+
+    if ( argc < 2 )
+    {
+        fprintf( stderr, "Usage: %s SESSION_LOG [SESSION_JSON]\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+
+    // session1.ndjson / session1.bin --> session1.json, unless given
+    size_t nameLength = strlen( argv[1] );
+    bool binary = nameLength >= 4 && 0 == strcmp( ".bin", argv[1] + nameLength - 4 );
+    if ( argc < 3 )
+    {
+        if ( binary )
+            nameLength -= 4;
+        else if ( nameLength >= 7 && 0 == strcmp( ".ndjson", argv[1] + nameLength - 7 ) )
+            nameLength -= 7;
+        snprintf( jsonFileName, FILENAME_MAX, "%.*s.json", (int) nameLength, argv[1] );
+    }
+    else
+    {
+        snprintf( jsonFileName, FILENAME_MAX, "%s", argv[2] );
+    }
+
+    int32_t events_n = binary ? binlog_export( argv[1], jsonFileName ) : ndjson_rebuild( argv[1], jsonFileName );
+    if ( events_n < 0 )
+    {
+        perror( binary ? "session2json: binlog_export() failed" : "session2json: ndjson_rebuild() failed" );
+        return EXIT_FAILURE;
+    }
+
+    fprintf( stdout, "%s: %d events\n", jsonFileName, events_n );
+    return EXIT_SUCCESS;
+}